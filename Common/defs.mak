@@ -17,15 +17,28 @@ CFLAGS := -O2 -pipe -Wall -DPOSIX_TTY -DLITTLE_ENDIAN -DMEM_BREAK \
 	  -Wno-strict-aliasing \
 	  -std=c99 
 
-UNUSED_CFLAGS := -DAUTORUN -DRAW_TERM
+UNUSED_CFLAGS := -DAUTORUN -DRAW_TERM -DOPCODE_HISTOGRAM
 
 LDFLAGS := 
 
 SRCS := \
 	$(ORIGSRC)/z80.c \
+	$(ORIGSRC)/cycles.c \
 	$(ORIGSRC)/disassem.c \
 	$(ORIGSRC)/main.c \
+	$(ORIGSRC)/hexcodec.c \
+	$(ORIGSRC)/tracering.c \
+	$(ORIGSRC)/profile.c \
+	$(ORIGSRC)/symtab.c \
+	$(ORIGSRC)/callgraph.c \
+	$(ORIGSRC)/breaks.c \
+	$(ORIGSRC)/gdbstub.c \
+	$(ORIGSRC)/stats.c \
+	$(ORIGSRC)/ophist.c \
+	$(ORIGSRC)/coverage.c \
+	$(ORIGSRC)/heatmap.c \
 	$(COMMONSRC)/host.c \
+	$(COMMONSRC)/timesource.c \
 	$(COMMONSRC)/memregion.c \
 	$(COMMONSRC)/ioports.c \
 	$(COMMONSRC)/mc6850_console.c \
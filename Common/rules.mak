@@ -22,12 +22,40 @@ $(BIN)/$(TARG): dirs $(OBJS)
 
 ######################################################################
 
-$(BUILD)/z80.o:			$(ORIGSRC)/defs.h $(ORIGSRC)/z80.c
-$(BUILD)/disassem.o:		$(ORIGSRC)/defs.h $(ORIGSRC)/disassem.c
-$(BUILD)/main.o:		$(ORIGSRC)/defs.h $(ORIGSRC)/main.c
+$(BUILD)/z80.o:			$(ORIGSRC)/defs.h $(ORIGSRC)/z80.c $(ORIGSRC)/tracering.h \
+				$(ORIGSRC)/profile.h $(ORIGSRC)/callgraph.h $(ORIGSRC)/stats.h \
+				$(ORIGSRC)/ophist.h $(ORIGSRC)/coverage.h
+$(BUILD)/cycles.o:		$(ORIGSRC)/defs.h $(ORIGSRC)/cycles.c
+$(BUILD)/disassem.o:		$(ORIGSRC)/defs.h $(ORIGSRC)/disassem.c $(ORIGSRC)/disassem.h
+$(BUILD)/main.o:		$(ORIGSRC)/defs.h $(ORIGSRC)/main.c $(ORIGSRC)/hexcodec.h \
+				$(ORIGSRC)/disassem.h \
+				$(ORIGSRC)/tracering.h $(ORIGSRC)/profile.h $(ORIGSRC)/symtab.h \
+				$(ORIGSRC)/callgraph.h $(ORIGSRC)/breaks.h $(ORIGSRC)/gdbstub.h \
+				$(ORIGSRC)/stats.h $(ORIGSRC)/ophist.h $(ORIGSRC)/coverage.h \
+				$(ORIGSRC)/heatmap.h
+$(BUILD)/tracering.o:		$(ORIGSRC)/defs.h $(ORIGSRC)/tracering.c $(ORIGSRC)/tracering.h
+$(BUILD)/profile.o:		$(ORIGSRC)/defs.h $(ORIGSRC)/profile.c $(ORIGSRC)/profile.h \
+				$(ORIGSRC)/symtab.h
+$(BUILD)/symtab.o:		$(ORIGSRC)/defs.h $(ORIGSRC)/symtab.c $(ORIGSRC)/symtab.h
+$(BUILD)/callgraph.o:		$(ORIGSRC)/defs.h $(ORIGSRC)/callgraph.c $(ORIGSRC)/callgraph.h \
+				$(ORIGSRC)/symtab.h
+$(BUILD)/breaks.o:		$(ORIGSRC)/defs.h $(ORIGSRC)/breaks.c $(ORIGSRC)/breaks.h \
+				$(ORIGSRC)/symtab.h
+$(BUILD)/gdbstub.o:		$(ORIGSRC)/defs.h $(ORIGSRC)/gdbstub.c $(ORIGSRC)/gdbstub.h \
+				$(ORIGSRC)/breaks.h
+$(BUILD)/stats.o:		$(ORIGSRC)/defs.h $(ORIGSRC)/stats.c $(ORIGSRC)/stats.h
+$(BUILD)/ophist.o:		$(ORIGSRC)/defs.h $(ORIGSRC)/ophist.c $(ORIGSRC)/ophist.h \
+				$(ORIGSRC)/disassem.h
+$(BUILD)/coverage.o:		$(ORIGSRC)/defs.h $(ORIGSRC)/coverage.c $(ORIGSRC)/coverage.h \
+				$(ORIGSRC)/symtab.h $(ORIGSRC)/heatmap.h $(ORIGSRC)/stats.h
+$(BUILD)/heatmap.o:		$(ORIGSRC)/defs.h $(ORIGSRC)/heatmap.c $(ORIGSRC)/heatmap.h \
+				$(ORIGSRC)/coverage.h $(ORIGSRC)/symtab.h $(ORIGSRC)/stats.h
+$(BUILD)/hexcodec.o:		$(ORIGSRC)/defs.h $(ORIGSRC)/hexcodec.c $(ORIGSRC)/hexcodec.h
 $(BUILD)/iomem.o:		$(ORIGSRC)/defs.h $(SRC)/iomem.c
-$(BUILD)/host.o:		$(ORIGSRC)/defs.h $(COMMONSRC)/host.c
-$(BUILD)/memregion.o:		$(ORIGSRC)/defs.h $(COMMONSRC)/memregion.c
+$(BUILD)/host.o:		$(ORIGSRC)/defs.h $(COMMONSRC)/host.c $(COMMONSRC)/timesource.h
+$(BUILD)/timesource.o:		$(ORIGSRC)/defs.h $(COMMONSRC)/timesource.c
+$(BUILD)/memregion.o:		$(ORIGSRC)/defs.h $(COMMONSRC)/memregion.c $(ORIGSRC)/stats.h \
+				$(ORIGSRC)/heatmap.h
 $(BUILD)/m6850_console.o:	$(ORIGSRC)/defs.h $(COMMONSRC)/6850_console.c
 
 ######################################################################
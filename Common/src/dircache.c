@@ -0,0 +1,343 @@
+/* DirCache
+ *
+ *  Cached directory listings
+ *
+ *  A handful of directories are kept, least recently used goes first.
+ *  Each one holds the raw entries, and one block of text per formatter
+ *  that's asked for it, so a repeated catalog is just a copy.
+ *
+ *  With inotify, a watch is put on each cached directory and the
+ *  events are drained (without blocking) at the top of each lookup.
+ *  Otherwise the directory's mtime is checked; a listing built in the
+ *  same second as that mtime isn't trusted, since something else may
+ *  have happened in that second too.
+ *
+ *  2026-10-19
+ */
+
+#define _DEFAULT_SOURCE		/* for inotify_init1 flags */
+
+#include <stdio.h>
+#include <stdlib.h>	/* for calloc, realloc, free */
+#include <string.h>	/* for strcmp, strdup */
+#include <time.h>	/* for time */
+#include <dirent.h>
+#include <unistd.h>	/* for read */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "dircache.h"
+
+#if defined __linux__ && !defined NO_INOTIFY
+#define DIRCACHE_INOTIFY
+#include <sys/inotify.h>
+#endif
+
+
+#define kDC_MaxDirs	(16)	/* directories remembered */
+#define kDC_MaxFormats	(4)	/* listing styles per directory */
+
+typedef struct DirCacheDir {
+	char * path;		/* NULL if this slot is free */
+	int valid;		/* 0 if it needs to be read again */
+	unsigned long lastUse;
+
+	int wd;			/* inotify watch, or -1 */
+	time_t mtime;		/* directory's mtime when it was read */
+	time_t readAt;
+
+	DirCacheEntry * ents;
+	int nEnts;
+
+	struct {
+		DirCacheFormatFcn fmt;
+		DirCacheText text;
+	} out[ kDC_MaxFormats ];
+	int nOut;
+} DirCacheDir;
+
+static DirCacheDir dirs[ kDC_MaxDirs ];
+static unsigned long useCount = 0;
+
+#ifdef DIRCACHE_INOTIFY
+static int inFd = -2;		/* -2 not tried yet, -1 not available */
+#endif
+
+
+/* ********************************************************************** */
+/* text building */
+
+void DirCache_Put( DirCacheText * t, const char * data, size_t len )
+{
+	char * n;
+	size_t sz;
+
+	if( t->len + len + 1 > t->size ) {
+		sz = t->size ? t->size : 1024;
+		while( sz < t->len + len + 1 ) sz *= 2;
+
+		n = realloc( t->data, sz );
+		if( !n ) return;
+		t->data = n;
+		t->size = sz;
+	}
+	memcpy( t->data + t->len, data, len );
+	t->len += len;
+	t->data[ t->len ] = '\0';
+}
+
+void DirCache_PutString( DirCacheText * t, const char * str )
+{
+	if( str ) DirCache_Put( t, str, strlen( str ));
+}
+
+
+/* ********************************************************************** */
+/* one directory */
+
+/* throw away the entries and text, but keep the slot */
+static void DirCache_Flush( DirCacheDir * d )
+{
+	int i;
+
+	for( i=0 ; i<d->nEnts ; i++ ) {
+		free( d->ents[i].name );
+	}
+	free( d->ents );
+	d->ents = NULL;
+	d->nEnts = 0;
+
+	for( i=0 ; i<d->nOut ; i++ ) {
+		free( d->out[i].text.data );
+	}
+	memset( d->out, 0, sizeof( d->out ));
+	d->nOut = 0;
+	d->valid = 0;
+}
+
+static void DirCache_Free( DirCacheDir * d )
+{
+	DirCache_Flush( d );
+#ifdef DIRCACHE_INOTIFY
+	if( d->wd >= 0 && inFd >= 0 ) inotify_rm_watch( inFd, d->wd );
+#endif
+	free( d->path );
+	d->path = NULL;
+	d->wd = -1;
+}
+
+
+/* read the directory in.  returns 0 if it couldn't be opened */
+static int DirCache_Read( DirCacheDir * d )
+{
+	DIR * dp;
+	struct dirent * de;
+	struct stat st;
+	char * full;
+	size_t plen = strlen( d->path );
+	int max = 0;
+	DirCacheEntry * n;
+
+	DirCache_Flush( d );
+
+	/* note the time before reading, so a change during it is caught */
+	d->mtime = ( stat( d->path, &st ) == 0 ) ? st.st_mtime : 0;
+	d->readAt = time( NULL );
+
+	dp = opendir( d->path );
+	if( !dp ) return 0;
+
+	while(( de = readdir( dp )) != NULL ) {
+		/* skip if there's no content, or "." */
+		if( de->d_name[0] == '\0' ) continue;
+		if( !strcmp( de->d_name, "." )) continue;
+
+		if( d->nEnts == max ) {
+			max = max ? max * 2 : 32;
+			n = realloc( d->ents, max * sizeof( DirCacheEntry ));
+			if( !n ) break;
+			d->ents = n;
+		}
+
+		full = malloc( plen + strlen( de->d_name ) + 2 );
+		if( !full ) break;
+		sprintf( full, "%s/%s", d->path, de->d_name );
+
+		if( stat( full, &st ) != 0 ) {
+			d->ents[ d->nEnts ].size = kDC_SizeErr;
+		} else if( S_ISDIR( st.st_mode )) {
+			d->ents[ d->nEnts ].size = kDC_SizeDir;
+		} else {
+			d->ents[ d->nEnts ].size = (long)st.st_size;
+		}
+		free( full );
+
+		d->ents[ d->nEnts ].name = strdup( de->d_name );
+		if( !d->ents[ d->nEnts ].name ) break;
+		d->nEnts++;
+	}
+	closedir( dp );
+
+	d->valid = 1;
+	return 1;
+}
+
+
+/* is what we have for this directory still good? */
+static int DirCache_Current( DirCacheDir * d )
+{
+	struct stat st;
+
+	if( !d->valid ) return 0;
+
+#ifdef DIRCACHE_INOTIFY
+	/* events have already been drained; valid is up to date */
+	if( d->wd >= 0 ) return 1;
+#endif
+
+	if( stat( d->path, &st ) != 0 ) return 0;
+	if( st.st_mtime != d->mtime ) return 0;
+	if( d->mtime >= d->readAt ) return 0;	/* too close to call */
+	return 1;
+}
+
+
+/* ********************************************************************** */
+/* inotify */
+
+#ifdef DIRCACHE_INOTIFY
+
+static void DirCache_Watch( DirCacheDir * d )
+{
+	if( inFd == -2 ) {
+		inFd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+	}
+	if( inFd < 0 || d->wd >= 0 ) return;
+
+	d->wd = inotify_add_watch( inFd, d->path,
+			IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE
+			| IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO
+			| IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR );
+}
+
+/* mark anything that's changed as needing a re-read */
+static void DirCache_Drain( void )
+{
+	char buf[ 4096 ]
+		__attribute__(( aligned( __alignof__( struct inotify_event ))));
+	const struct inotify_event * ev;
+	ssize_t len;
+	char * p;
+	int i;
+
+	if( inFd < 0 ) return;
+
+	while(( len = read( inFd, buf, sizeof( buf ))) > 0 ) {
+		for( p = buf ; p < buf + len ;
+		     p += sizeof( struct inotify_event ) + ev->len ) {
+			ev = (const struct inotify_event *)p;
+
+			for( i=0 ; i<kDC_MaxDirs ; i++ ) {
+				if( dirs[i].path && dirs[i].wd == ev->wd ) {
+					dirs[i].valid = 0;
+					/* the watch is gone with the directory */
+					if( ev->mask & IN_IGNORED ) dirs[i].wd = -1;
+				}
+			}
+		}
+	}
+}
+
+#else
+
+static void DirCache_Watch( DirCacheDir * d ) { }
+static void DirCache_Drain( void ) { }
+
+#endif
+
+
+/* ********************************************************************** */
+
+/* find the slot for 'path', taking over the oldest one if needed */
+static DirCacheDir * DirCache_Find( const char * path )
+{
+	DirCacheDir * d = NULL;
+	int i;
+
+	for( i=0 ; i<kDC_MaxDirs ; i++ ) {
+		if( dirs[i].path && !strcmp( dirs[i].path, path )) {
+			return &dirs[i];
+		}
+	}
+
+	for( i=0 ; i<kDC_MaxDirs ; i++ ) {
+		if( !dirs[i].path ) {
+			d = &dirs[i];
+			break;
+		}
+		if( !d || dirs[i].lastUse < d->lastUse ) d = &dirs[i];
+	}
+
+	if( d->path ) DirCache_Free( d );
+	memset( d, 0, sizeof( DirCacheDir ));
+	d->wd = -1;
+	d->path = strdup( path );
+	return d->path ? d : NULL;
+}
+
+
+const char * DirCache_Listing( const char * path, DirCacheFormatFcn fmt,
+				size_t * len )
+{
+	DirCacheDir * d;
+	int i;
+
+	if( !path || !fmt ) return NULL;
+
+	DirCache_Drain();
+
+	d = DirCache_Find( path );
+	if( !d ) return NULL;
+	d->lastUse = ++useCount;
+
+	if( !DirCache_Current( d )) {
+		/* watch first, so nothing between reading and watching is lost */
+		DirCache_Watch( d );
+		if( !DirCache_Read( d )) {
+			DirCache_Free( d );
+			return NULL;
+		}
+	}
+
+	/* already formatted this way? */
+	for( i=0 ; i<d->nOut ; i++ ) {
+		if( d->out[i].fmt == fmt ) break;
+	}
+
+	if( i == d->nOut ) {
+		if( d->nOut == kDC_MaxFormats ) {
+			/* out of slots; just reuse the last one */
+			i = kDC_MaxFormats - 1;
+			free( d->out[i].text.data );
+		} else {
+			d->nOut++;
+		}
+		memset( &d->out[i].text, 0, sizeof( DirCacheText ));
+		d->out[i].fmt = fmt;
+		fmt( &d->out[i].text, d->ents, d->nEnts );
+	}
+
+	if( len ) *len = d->out[i].text.len;
+	return d->out[i].text.data ? d->out[i].text.data : "";
+}
+
+
+void DirCache_Invalidate( const char * path )
+{
+	int i;
+
+	for( i=0 ; i<kDC_MaxDirs ; i++ ) {
+		if( dirs[i].path && ( !path || !strcmp( dirs[i].path, path ))) {
+			dirs[i].valid = 0;
+		}
+	}
+}
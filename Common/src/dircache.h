@@ -0,0 +1,58 @@
+/* DirCache
+ *
+ *  Cached directory listings for the catalog commands.
+ *
+ *  Each directory is read (readdir + a stat per entry) the first time
+ *  it's asked for, and the formatted text for each listing style is
+ *  kept until the directory changes.  Changes are picked up with
+ *  inotify where there is one, and by the directory's mtime otherwise;
+ *  without inotify a file changing size in place isn't noticed, so
+ *  code that writes files should call DirCache_Invalidate().
+ *
+ *  2026-10-19
+ */
+
+#include <stddef.h>		/* for size_t */
+
+#ifndef __DIRCACHE_H__
+#define __DIRCACHE_H__
+
+/* ********************************************************************** */
+
+/* sizes for DirCacheEntry */
+#define kDC_SizeDir	(-1)	/* it's a directory */
+#define kDC_SizeErr	(-999)	/* couldn't stat it */
+
+/* one thing in a directory.  "." is never in the list. */
+typedef struct DirCacheEntry {
+    char * name;
+    long size;			/* bytes, or kDC_SizeDir / kDC_SizeErr */
+} DirCacheEntry;
+
+/* text being built up by a formatter */
+typedef struct DirCacheText {
+    char * data;
+    size_t len;
+    size_t size;
+} DirCacheText;
+
+/* turns the entries (in readdir order) into the text for a listing */
+typedef void (*DirCacheFormatFcn)( DirCacheText * out,
+				   const DirCacheEntry * ents, int nEnts );
+
+
+/* get the listing of 'path' as formatted by 'fmt'.
+    The text is only good until the next DirCache call.
+    returns NULL if the directory couldn't be read */
+const char * DirCache_Listing( const char * path, DirCacheFormatFcn fmt,
+				size_t * len );
+
+/* forget what we know about 'path', or everything if it's NULL */
+void DirCache_Invalidate( const char * path );
+
+
+/* for formatters: add text onto the end */
+void DirCache_Put( DirCacheText * t, const char * data, size_t len );
+void DirCache_PutString( DirCacheText * t, const char * str );
+
+#endif
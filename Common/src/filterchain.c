@@ -0,0 +1,164 @@
+/* Filter chain
+ *
+ *  An ordered list of stages that a byte stream is run through.
+ *
+ *  The stages are kept in an array sorted by priority.  Removal only
+ *  marks a slot empty while the chain is running; the array is packed
+ *  up once the run is done so that a stage can take itself (or any
+ *  other) out of the chain from inside its own callback.
+ *
+ *  2026-10-19
+ */
+
+#include <stdio.h>
+#include <stdlib.h>	/* for calloc, free */
+#include <string.h>	/* for memmove */
+#include "filterchain.h"
+
+
+typedef struct FilterStage {
+	int id;
+	int priority;
+	const char * name;
+	FilterStageFcn fcn;	/* NULL if removed */
+	void * ctx;
+} FilterStage;
+
+struct FilterChain {
+	FilterStage * stages;
+	int nstages;
+	int maxstages;
+
+	int nextId;
+	int running;		/* inside FilterChain_Run() */
+	int removed;		/* there are empty slots to pack */
+};
+
+
+/* ********************************************************************** */
+
+FilterChain * FilterChain_Create( void )
+{
+	return calloc( 1, sizeof( FilterChain ));
+}
+
+
+void FilterChain_Destroy( FilterChain * fc )
+{
+	if( !fc ) return;
+
+	free( fc->stages );
+	free( fc );
+}
+
+
+/* squeeze out any removed stages */
+static void FilterChain_Pack( FilterChain * fc )
+{
+	int i, j;
+
+	for( i=0, j=0 ; i<fc->nstages ; i++ ) {
+		if( fc->stages[i].fcn ) {
+			fc->stages[j++] = fc->stages[i];
+		}
+	}
+	fc->nstages = j;
+	fc->removed = 0;
+}
+
+
+int FilterChain_Insert( FilterChain * fc, int priority, const char * name,
+			FilterStageFcn fcn, void * ctx )
+{
+	FilterStage * s;
+	int pos;
+
+	if( !fc || !fcn ) return -1;
+
+	if( fc->nstages >= fc->maxstages ) {
+		int newmax = fc->maxstages ? fc->maxstages * 2 : 8;
+		s = realloc( fc->stages, newmax * sizeof( FilterStage ));
+		if( !s ) return -1;
+		fc->stages = s;
+		fc->maxstages = newmax;
+	}
+
+	/* after everything at this priority or lower */
+	for( pos = 0 ; pos < fc->nstages ; pos++ ) {
+		if( fc->stages[pos].priority > priority ) break;
+	}
+
+	memmove( &fc->stages[pos+1], &fc->stages[pos],
+		 (fc->nstages - pos) * sizeof( FilterStage ));
+	fc->nstages++;
+
+	s = &fc->stages[pos];
+	s->id = fc->nextId++;
+	s->priority = priority;
+	s->name = name ? name : "?";
+	s->fcn = fcn;
+	s->ctx = ctx;
+
+	return s->id;
+}
+
+
+void FilterChain_Remove( FilterChain * fc, int id )
+{
+	int i;
+
+	if( !fc || id < 0 ) return;
+
+	for( i=0 ; i<fc->nstages ; i++ ) {
+		if( fc->stages[i].id == id && fc->stages[i].fcn ) {
+			fc->stages[i].fcn = NULL;
+			fc->removed = 1;
+		}
+	}
+
+	if( !fc->running ) FilterChain_Pack( fc );
+}
+
+
+/* ********************************************************************** */
+
+FilterSpan FilterChain_Run( FilterChain * fc, FilterSpan in )
+{
+	int i;
+	FilterStage s;
+
+	if( !fc ) return in;
+
+	fc->running++;
+
+	/* a stage inserted during the run can move things around in the
+	   array, so take a copy of each one before calling it.  Stages
+	   inserted ahead of the one running are picked up next time. */
+	for( i=0 ; i<fc->nstages && in.len > 0 ; i++ ) {
+		s = fc->stages[i];
+		if( !s.fcn ) continue;
+
+		in = s.fcn( in, s.ctx );
+
+		/* skip past anything that was inserted before us */
+		while( i < fc->nstages && fc->stages[i].id != s.id ) i++;
+	}
+
+	fc->running--;
+	if( !fc->running && fc->removed ) FilterChain_Pack( fc );
+
+	return in;
+}
+
+
+void FilterChain_Dump( FilterChain * fc )
+{
+	int i;
+
+	if( !fc ) return;
+
+	for( i=0 ; i<fc->nstages ; i++ ) {
+		if( !fc->stages[i].fcn ) continue;
+		printf( "  %4d  %s\n", fc->stages[i].priority, fc->stages[i].name );
+	}
+}
@@ -0,0 +1,59 @@
+/* Filter chain
+ *
+ *  An ordered list of stages that a byte stream is run through.
+ *
+ *  Each stage is handed a span of bytes and hands back the span to
+ *  pass on to the next stage.  A stage that doesn't change anything
+ *  just returns what it was given, so nothing is copied.  Otherwise it
+ *  can return part of the input, an empty span to swallow it all, or
+ *  a span in a buffer of its own (valid until it's called again).
+ *
+ *  Stages can be inserted and removed at any time, including from
+ *  inside a stage while the chain is running.
+ *
+ *  2026-10-19
+ */
+
+#include <stddef.h>		/* for size_t */
+#include "defs.h"		/* byte */
+
+#ifndef __FILTERCHAIN_H__
+#define __FILTERCHAIN_H__
+
+/* ********************************************************************** */
+
+typedef struct FilterSpan {
+	const byte * data;
+	size_t len;
+} FilterSpan;
+
+/* a stage.  'ctx' is whatever was passed in when it was inserted */
+typedef FilterSpan (*FilterStageFcn)( FilterSpan in, void * ctx );
+
+typedef struct FilterChain FilterChain;
+
+
+/* make a new, empty chain */
+FilterChain * FilterChain_Create( void );
+
+/* and get rid of one */
+void FilterChain_Destroy( FilterChain * fc );
+
+
+/* add a stage.  Stages run lowest 'priority' first; equal priorities
+    run in the order they were added.
+    returns an id for the stage (>= 0) or -1 on error */
+int FilterChain_Insert( FilterChain * fc, int priority, const char * name,
+			FilterStageFcn fcn, void * ctx );
+
+/* remove a stage by id */
+void FilterChain_Remove( FilterChain * fc, int id );
+
+
+/* run a span through all of the stages; returns what came out the end */
+FilterSpan FilterChain_Run( FilterChain * fc, FilterSpan in );
+
+/* list the stages to stdout */
+void FilterChain_Dump( FilterChain * fc );
+
+#endif
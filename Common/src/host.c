@@ -5,8 +5,12 @@
  *  2017-02-15 Scott Lawrence
  */
 
+/* for clock_gettime() et al under -std=c99 */
+#define _DEFAULT_SOURCE
+
 #include <stdio.h>
 #include <unistd.h>             /* for usleep */
+#include <time.h>               /* for clock_gettime */
 #include <sys/time.h>           /* for timeval */
 #include "mc6850_console.h"     /* port bit definitions */
 
@@ -17,27 +21,64 @@
 #endif
 
 #ifdef SOCKS
+#include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
-#include <poll.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "timesource.h"		/* to pace the socket polling */
 
 #define kPortNo (6850)
 
+/* how many remotes can be attached at once.  The first one attached
+   is the "driver" and its keys go to the emulation.  The rest are
+   observers; they see the console output, their input is dropped.
+   When the driver detaches, the longest-attached observer takes over. */
+#define kMaxClients	(8)
+
+/* per-client output buffer.  Console output is batched up in here and
+   written out once per socket poll, rather than a write() per byte. */
+#define kClientBufSz	(4096)
+
+/* and how much the kernel may hold for it.  Left alone, that grows to
+   megabytes, and a remote that stopped reading would come back to
+   minutes-old output; past this, it's stalled and we drop instead. */
+#define kClientSndBuf	(16384)
+
+/* how often (in emulated cycles) we go and look at the sockets. 
+   Everything in between is just a compare against the cycle counter */
+#ifndef kSockPollCycles
+#define kSockPollCycles	(kEmuCyclesPerMS / 4)
+#endif
+
+
+typedef struct SockClient {
+	int fd;				/* -1 if this slot is free */
+	unsigned long serial;		/* attach order, oldest is lowest */
+	int nout;			/* bytes waiting in outbuf */
+	int stalled;			/* socket full, waiting on EPOLLOUT */
+	char outbuf[ kClientBufSz ];
+} SockClient;
 
 typedef struct Sock {
 	int ok;
-	int sockfd;
-	int newsockfd;
+	int sockfd;			/* listening socket */
+	int epfd;			/* epoll instance */
 	int portno;
-	int clilen;
-	char buffer[ 256 ];
 	struct sockaddr_in serv_addr;
-	struct sockaddr_in cli_addr;
-	struct timeval timeout;
+
+	SockClient clients[ kMaxClients ];
+	int driver;			/* index of the driver, -1 if none */
+	unsigned long nextSerial;
+
+	unsigned long long nextPoll;	/* emulated cycle of next poll */
+
+	char buffer[ 256 ];		/* input from the driver */
 	int nbytesvalid;
 	int bufsendpos;
 } Sock ;
@@ -51,19 +92,41 @@ void Socks_error(char *msg)
 }
 
 
+static int Socks_SetNonBlocking( int fd )
+{
+	int flags = fcntl( fd, F_GETFL, 0 );
+	if( flags < 0 ) return -1;
+	return fcntl( fd, F_SETFL, flags | O_NONBLOCK );
+}
+
+
 void Socks_Init()
 {
+	int i;
+	int one = 1;
+	struct epoll_event ev;
+
 	sock.ok = 0;
 
 	sock.nbytesvalid = 0;
 	sock.bufsendpos = 0;
 
+	sock.driver = -1;
+	sock.nextSerial = 0;
+	sock.nextPoll = 0;
+	for( i=0 ; i<kMaxClients ; i++ ) {
+		sock.clients[i].fd = -1;
+		sock.clients[i].nout = 0;
+		sock.clients[i].stalled = 0;
+	}
+
 	// create the socket
-	sock.sockfd = sock.newsockfd = sock.clilen = 0;
 	sock.portno = kPortNo;
 	sock.sockfd = socket(AF_INET, SOCK_STREAM, 0);
 	if (sock.sockfd < 0) Socks_error("ERROR opening socket");
 
+	// so we can come right back up on the same port after a restart
+	setsockopt( sock.sockfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ));
 
 	// setup stuff
 	bzero((char *) &sock.serv_addr, sizeof(sock.serv_addr));
@@ -93,85 +156,303 @@ void Socks_Init()
 		Socks_error("ERROR on binding");
 	}
 
+	if( listen( sock.sockfd, 5 ) < 0 ) Socks_error( "ERROR on listen" );
+
+	// we never block on the socket; new connections are picked up
+	// from Socks_Poll() while the emulation runs.
+	if( Socks_SetNonBlocking( sock.sockfd ) < 0 ) {
+		Socks_error( "ERROR setting non-blocking" );
+	}
+
+	sock.epfd = epoll_create1( 0 );
+	if( sock.epfd < 0 ) Socks_error( "ERROR creating epoll" );
+
+	bzero( &ev, sizeof( ev ));
+	ev.events = EPOLLIN;
+	ev.data.fd = sock.sockfd;
+	if( epoll_ctl( sock.epfd, EPOLL_CTL_ADD, sock.sockfd, &ev ) < 0 ) {
+		Socks_error( "ERROR adding listener to epoll" );
+	}
+
 	printf( "Server started on port %d\n", sock.portno );
-	printf( "Waiting for connection...\n" );
+	printf( "Remotes may connect at any time.\n" );
+}
 
-	listen(sock.sockfd,5);
-	sock.clilen = sizeof(sock.cli_addr);
 
-	// this will block on waiting...
-	sock.newsockfd = accept( sock.sockfd,
-						(struct sockaddr *) &sock.cli_addr,
-						&sock.clilen );
+/* which events we want from epoll for a client */
+static void Socks_ClientWatch( SockClient * c )
+{
+	struct epoll_event ev;
 
-	if (sock.newsockfd < 0) {
-		Socks_error("ERROR on accept");
+	bzero( &ev, sizeof( ev ));
+	ev.events = EPOLLIN | EPOLLRDHUP | (c->stalled ? EPOLLOUT : 0);
+	ev.data.fd = c->fd;
+	epoll_ctl( sock.epfd, EPOLL_CTL_MOD, c->fd, &ev );
+}
+
+
+/* write out what we can of a client's buffer.  If the socket won't
+   take it all, the client is marked stalled and we leave it alone
+   until epoll says there's room again, rather than calling send()
+   on it over and over.  Returns -1 if the client has gone bad. */
+static int Socks_ClientWrite( SockClient * c )
+{
+	int n;
+
+	if( c->fd < 0 || c->stalled || c->nout == 0 ) return 0;
+
+	n = send( c->fd, c->outbuf, c->nout, MSG_NOSIGNAL );
+	if( n < 0 ) {
+		if( errno != EAGAIN && errno != EWOULDBLOCK ) return -1;
+		n = 0;
 	}
-	
-	// we want to timeout as quick as we can on this
-	// so we will not block the main code.
-    sock.timeout.tv_sec = 0;
-    sock.timeout.tv_usec = 1;
-
-    if( setsockopt(	sock.newsockfd, 
-					SOL_SOCKET,
-					SO_RCVTIMEO,
-					(char *)&sock.timeout,
-					sizeof(sock.timeout) ) < 0)
-        Socks_error( "setsockopt failed\n" );
-
-    if( setsockopt(	sock.newsockfd,
-					SOL_SOCKET,
-					SO_SNDTIMEO,
-					(char *)&sock.timeout,
-					sizeof(sock.timeout) ) < 0)
-        Socks_error( "setsockopt failed\n" );
-
-	// We're ready!!!
-	printf( "Remote Connected.\n" );
-
-/*
+
+	memmove( c->outbuf, c->outbuf + n, c->nout - n );
+	c->nout -= n;
+
+	if( c->nout > 0 ) {
+		c->stalled = 1;
+		Socks_ClientWatch( c );
+	}
+	return 0;
+}
+
+
+/* queue up some bytes for one client.  If its buffer is full, we try
+   to flush it first; if that still doesn't make room, the client has
+   stalled and the excess is dropped -- a slow remote should never hold
+   up the emulation. */
+static void Socks_ClientQueue( SockClient * c, const char * data, int len )
+{
+	if( c->fd < 0 ) return;
+
+	if( c->nout + len > kClientBufSz ) {
+		Socks_ClientWrite( c );
+	}
+
+	if( c->nout + len > kClientBufSz ) {
+		len = kClientBufSz - c->nout;
+	}
+
+	memcpy( c->outbuf + c->nout, data, len );
+	c->nout += len;
+}
+
+
+static void Socks_ClientClose( int idx )
+{
+	SockClient * c = &sock.clients[ idx ];
+	int i;
+	int oldest = -1;
+
+	if( c->fd < 0 ) return;
+
+	epoll_ctl( sock.epfd, EPOLL_CTL_DEL, c->fd, NULL );
+	close( c->fd );
+	c->fd = -1;
+	c->nout = 0;
+	c->stalled = 0;
+
+	printf( "Remote %d detached.\n", idx );
+
+	if( sock.driver != idx ) return;
+
+	// the driver left, so anything it typed that we haven't
+	// used yet goes with it, and the oldest observer takes over.
+	sock.driver = -1;
+	sock.nbytesvalid = 0;
+	sock.bufsendpos = 0;
+
+	for( i=0 ; i<kMaxClients ; i++ ) {
+		if( sock.clients[i].fd < 0 ) continue;
+		if( oldest < 0 || sock.clients[i].serial < sock.clients[oldest].serial ) {
+			oldest = i;
+		}
+	}
+
+	if( oldest >= 0 ) {
+		sock.driver = oldest;
+		printf( "Remote %d is now the driver.\n", oldest );
+		Socks_ClientQueue( &sock.clients[oldest], "[DRIVER]\n", 9 );
+	}
+}
+
+
+static void Socks_Accept( void )
+{
+	int fd;
+	int idx;
+	int one = 1;
+	int sndbuf = kClientSndBuf;
+	struct epoll_event ev;
+	struct sockaddr_in cli_addr;
+	socklen_t clilen;
+
 	while( 1 ) {
-		bzero(sock.buffer,256);
-		n = read( sock.newsockfd, sock.buffer, 255);
-		if( n > 0 ) {
+		clilen = sizeof( cli_addr );
+		fd = accept( sock.sockfd, (struct sockaddr *) &cli_addr, &clilen );
+		if( fd < 0 ) return; // EAGAIN - no more pending
 
-			printf("Here is the message: %s\n",sock.buffer);
-			n = write(sock.newsockfd,"I got your message",18);
+		for( idx=0 ; idx<kMaxClients ; idx++ ) {
+			if( sock.clients[idx].fd < 0 ) break;
+		}
 
-			if (n < 0) {
-				Socks_error("ERROR writing to socket");
-			}
+		if( idx >= kMaxClients ) {
+			send( fd, "[FULL]\n", 7, MSG_NOSIGNAL );
+			close( fd );
+			continue;
+		}
+
+		Socks_SetNonBlocking( fd );
+
+		// console traffic is tiny packets; don't let Nagle sit on them.
+		// We do our own batching in the output buffers.
+		setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof( one ));
+		setsockopt( fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof( sndbuf ));
+
+		bzero( &ev, sizeof( ev ));
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.fd = fd;
+		if( epoll_ctl( sock.epfd, EPOLL_CTL_ADD, fd, &ev ) < 0 ) {
+			close( fd );
+			continue;
+		}
+
+		sock.clients[idx].fd = fd;
+		sock.clients[idx].nout = 0;
+		sock.clients[idx].stalled = 0;
+		sock.clients[idx].serial = sock.nextSerial++;
+
+		if( sock.driver < 0 ) {
+			sock.driver = idx;
+			printf( "Remote %d connected (driver).\n", idx );
+			Socks_ClientQueue( &sock.clients[idx], "[DRIVER]\n", 9 );
+		} else {
+			printf( "Remote %d connected (observer).\n", idx );
+			Socks_ClientQueue( &sock.clients[idx], "[OBSERVER]\n", 11 );
 		}
 	}
-*/
 }
 
 
-void Socks_Send( byte data )
+static int Socks_FindClient( int fd )
+{
+	int i;
+	for( i=0 ; i<kMaxClients ; i++ ) {
+		if( sock.clients[i].fd == fd ) return i;
+	}
+	return -1;
+}
+
+
+static void Socks_Read( int idx )
 {
+	char junk[ 256 ];
 	int n;
-	byte buf[2];
+	int fd = sock.clients[idx].fd;
+
+	if( idx != sock.driver ) {
+		// observers are read-only; drain and drop what they send
+		do {
+			n = read( fd, junk, sizeof( junk ));
+		} while( n > 0 );
+	} else if( sock.nbytesvalid > 0 ) {
+		// haven't consumed the last batch yet, leave it in the socket
+		return;
+	} else {
+		n = read( fd, sock.buffer, sizeof( sock.buffer ));
+		sock.bufsendpos = 0;
+		sock.nbytesvalid = (n > 0) ? n : 0;
+	}
+
+	if( n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK )) {
+		Socks_ClientClose( idx );
+	}
+}
+
+
+static void Socks_Flush( void )
+{
+	int i;
+
+	for( i=0 ; i<kMaxClients ; i++ ) {
+		if( Socks_ClientWrite( &sock.clients[i] ) < 0 ) {
+			Socks_ClientClose( i );
+		}
+	}
+}
+
+
+/* service the sockets: new connections, hangups, input, and flush
+   the batched output.  This is cheap to call every opcode; it only
+   does any real work every kSockPollCycles emulated cycles. */
+void Socks_Poll( void )
+{
+	struct epoll_event events[ kMaxClients + 1 ];
+	int nev, i, idx;
 
 	if( !sock.ok ) return;
+	if( TimeSource_Cycles() < sock.nextPoll ) return;
+	sock.nextPoll = TimeSource_Cycles() + kSockPollCycles;
 
-	buf[0] = data;
-	buf[1] = '\0';
+	nev = epoll_wait( sock.epfd, events, kMaxClients + 1, 0 );
 
-	n = write( sock.newsockfd, buf, 1);
+	for( i=0 ; i<nev ; i++ ) {
+		if( events[i].data.fd == sock.sockfd ) {
+			Socks_Accept();
+			continue;
+		}
+
+		idx = Socks_FindClient( events[i].data.fd );
+		if( idx < 0 ) continue;
+
+		if( events[i].events & EPOLLIN ) {
+			Socks_Read( idx );
+		}
 
-	if (n < 0) {
-		printf( "ERROR writing to socket\n" );
+		if( sock.clients[idx].fd >= 0 && events[i].events & EPOLLOUT ) {
+			// there's room again; the flush below picks it up
+			sock.clients[idx].stalled = 0;
+			Socks_ClientWatch( &sock.clients[idx] );
+		}
+
+		if( sock.clients[idx].fd >= 0 
+		    && events[i].events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP )) {
+			// there may still be data before the hangup
+			if( idx != sock.driver || sock.nbytesvalid == 0 ) {
+				Socks_ClientClose( idx );
+			}
+		}
 	}
+
+	Socks_Flush();
 }
 
 
-void Socks_SendString( char * str )
+/* output goes to every attached remote */
+void Socks_SendBuf( const char * data, int len )
 {
-	int n=0;
+	int i;
+
 	if( !sock.ok ) return;
 
-	n = write( sock.newsockfd, str, strlen( str ));
+	for( i=0 ; i<kMaxClients ; i++ ) {
+		Socks_ClientQueue( &sock.clients[i], data, len );
+	}
+}
+
+
+void Socks_Send( byte data )
+{
+	char ch = (char) data;
+	Socks_SendBuf( &ch, 1 );
+}
+
+
+void Socks_SendString( char * str )
+{
+	if( !str ) return;
+	Socks_SendBuf( str, strlen( str ));
 }
 
 
@@ -179,23 +460,9 @@ int Socks_Available()
 {
 	if( !sock.ok ) return 0;
 
-	// if there's already content, send it.
-	if( sock.nbytesvalid > 0 ) { 
-		return 1;
-	}
+	Socks_Poll();
 
-	// let's try to read another buffer
-	bzero(sock.buffer,256);
-	sock.nbytesvalid = read( sock.newsockfd, sock.buffer, 255);
-	if( sock.nbytesvalid < 0 ) { 
-		sock.nbytesvalid = 0;
-	}
-	sock.bufsendpos = 0;
-
-	if( sock.nbytesvalid > 0 ) { 
-		return 1;
-	}
-	return 0;
+	return( sock.nbytesvalid > 0 );
 }
 
 byte Socks_Filter( byte ch )
@@ -257,6 +524,19 @@ void Host_PutChar( byte data )
 #endif
 }
 
+/* send a run of bytes to the actual console */
+void Host_Write( const byte * data, size_t len )
+{
+    if( !len ) return;
+
+    fwrite( data, 1, len, stdout );
+    fflush( stdout );
+
+#ifdef SOCKS
+	Socks_SendBuf( (const char *) data, (int) len );
+#endif
+}
+
 /* is a key available on the keyboard? */
 int Host_KeyHit( void )
 {
@@ -276,32 +556,40 @@ byte Host_GetChar( byte defaultVal )
 	}
 #endif
 
-    /* get in a byte from the console */
+    /* get in a byte from the console.  read() rather than getchar(),
+       which would pull the rest of a burst into stdio's buffer where
+       Host_KeyHit()'s select() can't see it */
     if( Host_KeyHit() ) {
-		return getchar();
+		byte ch;
+		if( read( STDIN_FILENO, &ch, 1 ) == 1 ) return ch;
     }
     return defaultVal;
 }
 
-/* utility function to get the number of milliseconds since we started */
+/* utility function to get the number of milliseconds since we started
+    NOTE: this is a system call.  Device code should use the cached
+    TimeSource_*() clocks instead of calling this per opcode. */
 long long Host_Millis( void )
 {
-    struct timeval te;
+    struct timespec ts;
     long long milliseconds;
 
-    static long long startTime = 0;
+    static long long startTime = -1;
+
+    /* get current time - the coarse clock is plenty for millis */
+#ifdef CLOCK_MONOTONIC_COARSE
+    clock_gettime( CLOCK_MONOTONIC_COARSE, &ts );
+#else
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+#endif
 
-    /* get current time */
-    gettimeofday(&te, NULL);
+    /* calculate milliseconds */
+    milliseconds = ts.tv_sec*1000LL + ts.tv_nsec/1000000;
 
     /* adjust the start time */
-    if( startTime == 0 ) {
-        /* calculate milliseconds */
-        startTime = te.tv_sec*1000LL + te.tv_usec/1000;
+    if( startTime < 0 ) {
+        startTime = milliseconds;
     }
 
-    /* calculate milliseconds */
-    milliseconds = te.tv_sec*1000LL + te.tv_usec/1000;
-
-    return milliseconds;
+    return milliseconds - startTime;
 }
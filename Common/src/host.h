@@ -15,11 +15,15 @@ void Host_Init( z80info * z80 );
 /* send a byte of data to the actual console */
 void Host_PutChar( byte data );
 
+/* and a run of them, in one go */
+void Host_Write( const byte * data, size_t len );
+
 /* is a key available on the keyboard? */
 int Host_KeyHit( void );
 
 /* Get a key if it's available */
 byte Host_GetChar( byte defaultVal );
 
-/* utility function to get the number of milliseconds since we started */
+/* utility function to get the number of milliseconds since we started
+    (see timesource.h for the cheap cached version) */
 long long Host_Millis( void );
@@ -7,6 +7,7 @@
 #include <stdlib.h> 	/* for exit() */
 #include "defs.h"
 #include "ioports.h"
+#include "stats.h"
 
 
 /* ********************************************************************** */
@@ -66,7 +67,10 @@ byte HandlePortRead02( void ) { return digital_io2; }
 byte HandlePortRead03( void ) { return digital_io3; }
 
 
-/* internal emulation control */
+/* internal emulation control
+ *	0xF0		quit
+ *	0x80+n		read counter n next (see stats.h)
+ */
 void HandleEmulationControl( const byte data )
 {
     if( data == 0xF0 )
@@ -74,6 +78,8 @@ void HandleEmulationControl( const byte data )
             z_resetterm();
             exit( 0 );
     }
+
+    stats_guestwrite( data );
 }
 
 
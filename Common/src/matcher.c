@@ -0,0 +1,335 @@
+/* Matcher
+ *
+ *  Streaming multi-pattern matcher (Aho-Corasick)
+ *
+ *  The patterns are compiled into a full DFA: every (state, input)
+ *  pair has its next state precomputed, so there's no failure-link
+ *  chasing while the stream runs.  To keep the table small, input
+ *  bytes are first mapped to a "class" - one class per distinct byte
+ *  that appears in any pattern, and class 0 for everything else.
+ *
+ *  Adding or removing a pattern rebuilds the tables, and the text of
+ *  the partial match in progress is run through the new ones, so a
+ *  pattern that's halfway seen when another changes still matches.
+ *
+ *  2026-10-19
+ */
+
+#include <stdio.h>
+#include <stdlib.h>	/* for calloc, free */
+#include <string.h>	/* for memcpy */
+#include "matcher.h"
+
+
+typedef struct MatcherPattern {
+	byte * text;		/* NULL if this slot was removed */
+	size_t len;
+	matchFcn fcn;
+	void * ctx;
+	int next;		/* next pattern ending in the same state */
+} MatcherPattern;
+
+struct Matcher {
+	/* the patterns as registered */
+	MatcherPattern * patterns;
+	int npatterns;
+	int maxpatterns;
+
+	/* the compiled automaton.  rebuilt if 'dirty' */
+	int dirty;
+	unsigned short classOf[ 256 ];	/* up to 256 classes, plus class 0 */
+	int nclasses;
+	int nstates;
+	int * delta;		/* [ state * nclasses + class ] -> state */
+	int * parent;		/* the state before this one in the trie, */
+	byte * via;		/* and the byte that got us here from it */
+	int * own;		/* first pattern ending exactly at state, or -1 */
+	int * dict;		/* nearest fail-state with its own patterns, or -1 */
+	int * report;		/* state to start reporting from, or -1 */
+
+	int state;		/* where we are in the stream */
+};
+
+
+/* ********************************************************************** */
+
+Matcher * Matcher_Create( void )
+{
+	Matcher * m = calloc( 1, sizeof( Matcher ));
+	if( !m ) return NULL;
+
+	m->dirty = 1;
+	return m;
+}
+
+
+static void Matcher_FreeTables( Matcher * m )
+{
+	free( m->delta );
+	free( m->own );
+	free( m->dict );
+	free( m->report );
+	free( m->parent );
+	free( m->via );
+	m->delta = m->own = m->dict = m->report = m->parent = NULL;
+	m->via = NULL;
+	m->nstates = 0;
+}
+
+
+void Matcher_Destroy( Matcher * m )
+{
+	int i;
+
+	if( !m ) return;
+
+	for( i=0 ; i<m->npatterns ; i++ ) {
+		free( m->patterns[i].text );
+	}
+	free( m->patterns );
+	Matcher_FreeTables( m );
+	free( m );
+}
+
+
+/* ********************************************************************** */
+
+int Matcher_AddBytes( Matcher * m, const byte * pattern, size_t len,
+			matchFcn fcn, void * ctx )
+{
+	MatcherPattern * p;
+
+	if( !m || !pattern || len == 0 ) return -1;
+
+	if( m->npatterns >= m->maxpatterns ) {
+		int newmax = m->maxpatterns ? m->maxpatterns * 2 : 16;
+		p = realloc( m->patterns, newmax * sizeof( MatcherPattern ));
+		if( !p ) return -1;
+		m->patterns = p;
+		m->maxpatterns = newmax;
+	}
+
+	p = &m->patterns[ m->npatterns ];
+	p->text = malloc( len );
+	if( !p->text ) return -1;
+	memcpy( p->text, pattern, len );
+	p->len = len;
+	p->fcn = fcn;
+	p->ctx = ctx;
+	p->next = -1;
+
+	m->dirty = 1;
+	return m->npatterns++;
+}
+
+
+int Matcher_Add( Matcher * m, const char * pattern, matchFcn fcn, void * ctx )
+{
+	if( !pattern ) return -1;
+	return Matcher_AddBytes( m, (const byte *)pattern, strlen( pattern ),
+				fcn, ctx );
+}
+
+
+void Matcher_Remove( Matcher * m, int id )
+{
+	if( !m || id < 0 || id >= m->npatterns ) return;
+
+	free( m->patterns[id].text );
+	m->patterns[id].text = NULL;
+	m->patterns[id].len = 0;
+	m->dirty = 1;
+}
+
+
+void Matcher_Reset( Matcher * m )
+{
+	if( m ) m->state = 0;
+}
+
+
+/* ********************************************************************** */
+
+/* the text of the partial match we're in the middle of, from the
+    trie.  returns its length, with it in a new '*text' to be freed,
+    or 0 if there isn't one (or we're out of memory) */
+static size_t Matcher_Partial( Matcher * m, byte ** text )
+{
+	size_t len = 0, i;
+	int s;
+
+	*text = NULL;
+	if( m->nstates == 0 ) return 0;
+
+	for( s = m->state ; s > 0 ; s = m->parent[s] ) len++;
+	if( len == 0 || !(*text = malloc( len ))) return 0;
+
+	/* it's walked backwards, from the end of the match */
+	i = len;
+	for( s = m->state ; s > 0 ; s = m->parent[s] ) {
+		(*text)[ --i ] = m->via[s];
+	}
+	return len;
+}
+
+
+/* (re)compile the automaton from the pattern list.
+    returns 0 if we're out of memory (and the matcher is left empty) */
+static int Matcher_Build( Matcher * m )
+{
+	int i, c, s, u, f;
+	size_t j, total = 0;
+	int * fail = NULL;
+	int * queue = NULL;
+	int qhead, qtail;
+	byte * partial;
+	size_t npartial;
+
+	npartial = Matcher_Partial( m, &partial );
+	Matcher_FreeTables( m );
+	m->state = 0;
+	m->dirty = 0;
+
+	/* byte classes.  Class 0 is "not in any pattern" */
+	memset( m->classOf, 0, sizeof( m->classOf ));
+	m->nclasses = 1;
+	for( i=0 ; i<m->npatterns ; i++ ) {
+		for( j=0 ; j<m->patterns[i].len ; j++ ) {
+			byte b = m->patterns[i].text[j];
+			if( m->classOf[b] == 0 ) {
+				m->classOf[b] = m->nclasses++;
+			}
+		}
+		total += m->patterns[i].len;
+	}
+
+	/* worst case, every pattern byte is its own state, plus the root */
+	m->delta = malloc( (total + 1) * m->nclasses * sizeof( int ));
+	m->own = malloc( (total + 1) * sizeof( int ));
+	m->dict = malloc( (total + 1) * sizeof( int ));
+	m->report = malloc( (total + 1) * sizeof( int ));
+	m->parent = malloc( (total + 1) * sizeof( int ));
+	m->via = malloc( (total + 1) * sizeof( byte ));
+	fail = malloc( (total + 1) * sizeof( int ));
+	queue = malloc( (total + 1) * sizeof( int ));
+
+	if( !m->delta || !m->own || !m->dict || !m->report
+	    || !m->parent || !m->via || !fail || !queue ) {
+		Matcher_FreeTables( m );
+		free( fail );
+		free( queue );
+		free( partial );
+		return 0;
+	}
+
+	/* the trie */
+	m->nstates = 1;
+	for( c=0 ; c<m->nclasses ; c++ ) m->delta[c] = -1;
+	m->own[0] = -1;
+	m->parent[0] = -1;
+
+	for( i=0 ; i<m->npatterns ; i++ ) {
+		MatcherPattern * p = &m->patterns[i];
+		if( !p->text ) continue;
+
+		s = 0;
+		for( j=0 ; j<p->len ; j++ ) {
+			c = m->classOf[ p->text[j] ];
+			u = m->delta[ s * m->nclasses + c ];
+			if( u < 0 ) {
+				u = m->nstates++;
+				for( f=0 ; f<m->nclasses ; f++ ) {
+					m->delta[ u * m->nclasses + f ] = -1;
+				}
+				m->own[u] = -1;
+				m->parent[u] = s;
+				m->via[u] = p->text[j];
+				m->delta[ s * m->nclasses + c ] = u;
+			}
+			s = u;
+		}
+
+		/* keep registration order within a state */
+		p->next = -1;
+		if( m->own[s] < 0 ) {
+			m->own[s] = i;
+		} else {
+			f = m->own[s];
+			while( m->patterns[f].next >= 0 ) f = m->patterns[f].next;
+			m->patterns[f].next = i;
+		}
+	}
+
+	/* breadth first, fill in the failure transitions so that every
+	   (state, class) has somewhere to go */
+	qhead = qtail = 0;
+	fail[0] = 0;
+	m->dict[0] = -1;
+	for( c=0 ; c<m->nclasses ; c++ ) {
+		u = m->delta[c];
+		if( u < 0 ) {
+			m->delta[c] = 0;
+		} else {
+			fail[u] = 0;
+			m->dict[u] = -1;
+			queue[ qtail++ ] = u;
+		}
+	}
+
+	while( qhead < qtail ) {
+		s = queue[ qhead++ ];
+		for( c=0 ; c<m->nclasses ; c++ ) {
+			u = m->delta[ s * m->nclasses + c ];
+			f = m->delta[ fail[s] * m->nclasses + c ];
+			if( u < 0 ) {
+				m->delta[ s * m->nclasses + c ] = f;
+			} else {
+				fail[u] = f;
+				m->dict[u] = (m->own[f] >= 0) ? f : m->dict[f];
+				queue[ qtail++ ] = u;
+			}
+		}
+	}
+
+	for( s=0 ; s<m->nstates ; s++ ) {
+		m->report[s] = (m->own[s] >= 0) ? s : m->dict[s];
+	}
+
+	/* pick the stream back up where it was.  Nothing is reported;
+	   it all was the first time through */
+	for( j=0 ; j<npartial ; j++ ) {
+		m->state = m->delta[ m->state * m->nclasses
+				     + m->classOf[ partial[j] ]];
+	}
+
+	free( fail );
+	free( queue );
+	free( partial );
+	return 1;
+}
+
+
+/* ********************************************************************** */
+
+void Matcher_Feed( Matcher * m, byte data )
+{
+	int s, p;
+
+	if( !m ) return;
+
+	if( m->dirty ) {
+		if( !Matcher_Build( m )) return;
+	}
+	if( m->nstates == 0 ) return;
+
+	m->state = m->delta[ m->state * m->nclasses + m->classOf[data] ];
+
+	/* anything end here? */
+	for( s = m->report[ m->state ] ; s >= 0 ; s = m->dict[s] ) {
+		for( p = m->own[s] ; p >= 0 ; p = m->patterns[p].next ) {
+			if( m->patterns[p].fcn ) {
+				m->patterns[p].fcn( p, m->patterns[p].ctx );
+			}
+		}
+	}
+}
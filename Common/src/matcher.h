@@ -0,0 +1,55 @@
+/* Matcher
+ *
+ *  Streaming multi-pattern matcher (Aho-Corasick) for watching the
+ *  console byte stream for prompts, error messages and the like.
+ *
+ *  Patterns and their callbacks can be added at any time.  The
+ *  automaton is rebuilt lazily on the next byte fed in, and after
+ *  that every byte costs one table lookup no matter how many
+ *  patterns are registered.
+ *
+ *  2026-10-19
+ */
+
+#include <stddef.h>		/* for size_t */
+#include "defs.h"		/* byte */
+
+#ifndef __MATCHER_H__
+#define __MATCHER_H__
+
+/* ********************************************************************** */
+
+/* called when a pattern has just been seen in the stream.
+    'id' is what Matcher_Add() returned for it. */
+typedef void (*matchFcn)( int id, void * ctx );
+
+typedef struct Matcher Matcher;
+
+
+/* make a new, empty matcher */
+Matcher * Matcher_Create( void );
+
+/* and get rid of one */
+void Matcher_Destroy( Matcher * m );
+
+
+/* register a pattern.  The text is copied.
+    returns an id for the pattern (>= 0), or -1 on error */
+int Matcher_Add( Matcher * m, const char * pattern, matchFcn fcn, void * ctx );
+
+/* same, for patterns that may contain NULs */
+int Matcher_AddBytes( Matcher * m, const byte * pattern, size_t len,
+			matchFcn fcn, void * ctx );
+
+/* unregister a pattern by id */
+void Matcher_Remove( Matcher * m, int id );
+
+
+/* forget any partial match in progress */
+void Matcher_Reset( Matcher * m );
+
+/* feed the next byte of the stream through.  All patterns that end
+    on this byte get their callbacks called, longest first. */
+void Matcher_Feed( Matcher * m, byte data );
+
+#endif
@@ -17,13 +17,29 @@
 #include <sys/time.h>		/* for timeval */
 #include "mc6850_console.h"	/* port bit definitions */
 #include "host.h"		/* host console interface */
+#include "timesource.h"		/* cheap emulated clock */
+#include "stats.h"		/* console byte counts */
 
 
 /* ********************************************************************** */
 
+/* the guest's output, waiting to go to the host as one run */
+#define kToConsoleRunSz		(512)
+#ifndef kToConsoleFlushCycles
+#define kToConsoleFlushCycles	(kEmuCyclesPerMS / 4)
+#endif
+
+static byte toConsole[ kToConsoleRunSz ];
+static size_t toConsoleLen = 0;
+static unsigned long long toConsoleSince = 0;	/* cycle of the oldest byte */
+
+
 /* initialize the ACIA */
 void mc6850_console_init( z80info * z80 )
 {
+    TimeSource_Init( z80 );
+    atexit( mc6850_console_flush );
+
 #ifdef FILTER_CONSOLE
     Filter_Init( z80 );
 #else
@@ -34,27 +50,70 @@ void mc6850_console_init( z80info * z80 )
 
 /* send out a byte of data */
 void mc6850_out_to_console_data( byte data )
+{
+    z80stats.conout++;
+
+    if( toConsoleLen == 0 ) {
+	toConsoleSince = TimeSource_Cycles();
+    }
+    toConsole[ toConsoleLen++ ] = data;
+
+    if( toConsoleLen == kToConsoleRunSz ) {
+	mc6850_console_flush();
+    }
+}
+
+/* send the waiting output to the host console */
+void mc6850_console_flush( void )
 {
 #ifdef FILTER_CONSOLE
-    /* send it into the filter */
-    Filter_ToConsole( data );
+    const byte * out;
+    size_t len;
+#endif
 
-    /* and poll the filter for bytes to display to the host console */
-    while( Filter_ToConsoleAvailable() )
-    {
-	Host_PutChar( Filter_ToConsoleGet() );
+#ifdef FILTER_CONSOLE
+    /* run it through the filter, and send on whatever comes out -
+       which may just be a reply to something typed at the console */
+    if( toConsoleLen ) {
+	Filter_ToConsoleBuf( toConsole, toConsoleLen );
     }
+    out = Filter_ToConsoleTake( &len );
+    Host_Write( out, len );
 #else
-    /* send out a byte to the console */
-    Host_PutChar( data );
+    Host_Write( toConsole, toConsoleLen );
 #endif
+
+    toConsoleLen = 0;
 }
 
+/* send it once it's had a moment to gather up */
+static void mc6850_console_flush_aged( void )
+{
+    if( toConsoleLen
+	&& TimeSource_Cycles() - toConsoleSince >= kToConsoleFlushCycles ) {
+	mc6850_console_flush();
+    }
+}
+
+/* the last control word the guest wrote, and whether it has written
+    one since the last master reset.  Baud/framing bits are ignored;
+    we only care about the RTS line for flow control. */
+static byte control = kPWC_Div1 | kPWC_Div2;
+static int controlSet = 0;
+
 /* set control in the 6850 (baud, etc */
 void mc6850_out_to_console_control( byte data )
 {
-    /* do nothing -- ignored */
-    /* this would be for setting baud, etc. */
+    control = data;
+
+    /* master reset puts us back to the un-programmed (throttled) state */
+    controlSet = ( (data & (kPWC_Div1 | kPWC_Div2)) != (kPWC_Div1 | kPWC_Div2) );
+}
+
+/* is the guest holding off the sender?  (-RTS high, see mc6850.h) */
+static int mc6850_rts_holdoff( void )
+{
+    return( (control & (kPWC_Tx1 | kPWC_Tx2)) == kPWC_Tx2 );
 }
 
 
@@ -71,6 +130,10 @@ byte mc6850_in_from_console_data( void )
     exit( -1 );
 #endif
 
+    /* the guest wants a key; make sure it's seen what it said */
+    mc6850_console_flush();
+
+    z80stats.conin++;
     return Host_GetChar( 0xff );
 }
 
@@ -87,6 +150,8 @@ byte mc6850_in_from_console_status( void )
     exit( -1 );
 #endif
 
+    mc6850_console_flush_aged();
+
     if( Host_KeyHit() ) {
 	    val |= kPRS_RxDataReady; /* key is available to read */
     }
@@ -154,19 +219,44 @@ static byte FromConsoleBuffer_Dequeue( void )
 }
 
 /* ********************************************************************** */
-/* Our Available also checks time to throttle the input to the emulation */
+/* Our Available also does the flow control for input to the emulation.
+
+    Once the guest has programmed the ACIA, we do what the real part
+    would: present one byte at a time (it sits in RDR until the guest
+    reads it) and stop while the guest has -RTS raised.  That lets
+    pasted text go in as fast as the guest can take it.
 
-/* the next timestamp to read a byte */
-long long nextm = 0;
+    If the guest never sets up the ACIA (or we're built with
+    NO_RTS_FLOW), fall back to pacing the input on the clock below.
+*/
+
+/* the next emulated cycle count at which we can read a byte.
+    The throttle runs on emulated time since it's there to pace the
+    guest, and reading it is just a compare (no system call per opcode) */
+unsigned long long nextc = 0;
 int burst = 0;
 
+/* are we pacing off the guest's RTS line rather than the clock? */
+static int FromConsoleBuffer_FlowControlled( void )
+{
+#ifdef NO_RTS_FLOW
+    return 0;
+#else
+    return controlSet;
+#endif
+}
+
 /* the kbhit() that references our buffer. */
 int FromConsoleBuffer_Available( void )
 {
 
     if( bs == be ) return 0;
 
-    if( Host_Millis() > nextm ) {
+    if( FromConsoleBuffer_FlowControlled() ) {
+	return !mc6850_rts_holdoff();
+    }
+
+    if( TimeSource_Cycles() > nextc ) {
 	return 1;
     }
 
@@ -178,6 +268,7 @@ int FromConsoleBuffer_Available( void )
 /* this gets polled from the main loop to update our buffer */
 void FromConsoleBuffered_PollConsole( void )
 {
+    mc6850_console_flush_aged();
 
 #ifdef FILTER_CONSOLE
     /* just queue up all available characters... */
@@ -191,6 +282,11 @@ void FromConsoleBuffered_PollConsole( void )
         FromConsoleBuffer_QueueChar( Filter_ToRemoteGet() );
     }
 
+    /* an ESC} command may have had something to say */
+    if( Filter_ToConsoleAvailable() ) {
+	mc6850_console_flush();
+    }
+
 #else
     /* just queue up all available characters... */
     while ( Host_KeyHit() ) {
@@ -206,8 +302,18 @@ byte mc6850_in_from_buffered_console_data( void )
 {
     if( FromConsoleBuffer_Available() ) 
     {
+	/* the guest is taking a key; make sure it's seen what it said */
+	mc6850_console_flush();
+
+	z80stats.conin++;
+
+	if( FromConsoleBuffer_FlowControlled() ) {
+	    /* the guest paces itself with RTS */
+	    return FromConsoleBuffer_Dequeue();
+	}
+
 	if( burst > kBurstCount ) {
-	    nextm = Host_Millis() + kThrottleMS;
+	    nextc = TimeSource_Cycles() + (kThrottleMS * kEmuCyclesPerMS);
 	    burst = 0;
 	}
 	burst++;
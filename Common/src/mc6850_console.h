@@ -31,6 +31,13 @@ void mc6850_console_init( z80info * z80 );
 /* send out a byte of data */
 void mc6850_out_to_console_data( byte data );
 
+/* the guest's output is gathered up and sent to the host a run at a
+    time; this sends whatever's waiting.  It's done from the poll below
+    once the oldest byte has waited a quarter of an (emulated)
+    millisecond, when the run fills up, when the guest reads a key,
+    and at exit. */
+void mc6850_console_flush( void );
+
 /* set control in the 6850 (baud, etc */
 void mc6850_out_to_console_control( byte data );
 
@@ -46,7 +53,7 @@ byte mc6850_in_from_console_status( void );
 /* ********************************************************************** */
 /* internal buffered versions */
 
-/* minimum time in milliseconds between keypresses */
+/* minimum time in (emulated) milliseconds between keypresses */
 #define kThrottleMS	(10)
 /* number of keypresses to send out every duration timeout */
 #define kBurstCount	(5)
@@ -57,6 +64,10 @@ byte mc6850_in_from_console_status( void );
     pseudo-ring buffer of kRingBufSz bytes.  It will send out 
     kBurstCount available bytes from the buffer every kThrottleMS 
     milliseconds. 
+
+    Once the guest writes a control word to the ACIA, the throttle is
+    dropped and input is flow controlled by the guest's RTS setting
+    instead (build with -DNO_RTS_FLOW to always use the throttle).
 */
 
 /* poll routine to be called from the system_poll() */
@@ -81,9 +92,14 @@ void Filter_Init( z80info * z80 );
 
 /* Handlers for content going TO the CONSOLE */
 void Filter_ToConsole( byte data );
+void Filter_ToConsoleBuf( const byte * data, size_t len );
 int  Filter_ToConsoleAvailable();
 byte Filter_ToConsoleGet();
 
+/* take everything waiting for the console at once; the pointer is
+    good until the next byte goes into the filter */
+const byte * Filter_ToConsoleTake( size_t * len );
+
 /* Add stuff into the Console send buffer (typer buffer) */
 void FromConsoleBuffer_QueueChar( char ch );
 void FromConsoleBuffer_QueueString( char * str );
@@ -9,6 +9,8 @@
 #include <string.h>	/* for memcpy */
 #include "defs.h"
 #include "memregion.h"
+#include "stats.h"
+#include "heatmap.h"
 
 
 /* regions_display
@@ -83,6 +85,8 @@ void regions_init( MemRegion * m, byte * z80mem )
 
     while( m->addressStart < REGION_MAX )
     {
+	stats_region( region, m->addressStart, m->length );
+
 	printf( "Mem region %d: 0x%04lx - 0x%04lx (%s) ",
 		region,
 		m->addressStart, m->addressStart + m->length - 1,
@@ -120,6 +124,37 @@ void regions_init( MemRegion * m, byte * z80mem )
  *      perform a memory read on the specified address
  */
 byte regions_read( MemRegion * m, word addr )
+{
+    int region = 0;
+
+    if( !m ) return 0xff;
+
+    while( m->addressStart < REGION_MAX )
+    {
+	if(    (addr >= m->addressStart)
+	    && (addr < (m->addressStart + m->length ))
+	    && (REGION_ACTIVE == m->active ) 
+	)
+	{
+	    if( region < STATS_REGIONS ) z80stats.region[ region ].reads++;
+	    if( z80heat ) heatmap_region( region, addr - m->addressStart, 0 );
+	    return m->mem[ addr - m->addressStart ];
+	}
+
+	region++;
+	m++;
+    }
+
+    return 0xff;
+}
+
+
+/* regions_peek
+ *
+ *      look at the byte at the specified address, for the debugger and
+ *      friends - it's not counted in the stats or the heatmap
+ */
+byte regions_peek( MemRegion * m, word addr )
 {
     if( !m ) return 0xff;
 
@@ -146,6 +181,8 @@ byte regions_read( MemRegion * m, word addr )
  */
 byte regions_write( MemRegion * m, word addr, byte val )
 {
+    int region = 0;
+
     if( !m ) return 0xff;
 
     while( m->addressStart < REGION_MAX )
@@ -156,10 +193,13 @@ byte regions_write( MemRegion * m, word addr, byte val )
 	    && (REGION_ACTIVE == m->active) 
 	)
 	{
+	    if( region < STATS_REGIONS ) z80stats.region[ region ].writes++;
+	    if( z80heat ) heatmap_region( region, addr - m->addressStart, 1 );
 	    m->mem[ addr - m->addressStart ] = val;
 	    return val;
 	}
 
+	region++;
 	m++;
     }
     return val;
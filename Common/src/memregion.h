@@ -54,6 +54,12 @@ void regions_init( MemRegion * m, byte * z80mem );
  */
 byte regions_read( MemRegion * m, word addr );
 
+/* regions_peek
+ *
+ *	the same, without counting it in the stats or the heatmap
+ */
+byte regions_peek( MemRegion * m, word addr );
+
 /* regions_write
  *
  *	perform a memory write on the specified address
@@ -7,6 +7,8 @@
 #include "ioports.h"            /* io port handling */
 #include "memregion.h"          /* memory region handling */
 #include "mc6850_console.h"     /* mc6850 emulation as console */
+#include "timesource.h"         /* cheap emulated/host clocks */
+#include "stats.h"              /* emulator counters */
 
 #ifndef __RC2014_H__
 #define __RC2014_H__
@@ -0,0 +1,85 @@
+/* Time source
+ *
+ *  A cheap clock for device code that runs from system_poll().
+ *
+ *  2026-10-19
+ */
+
+#include <stdio.h>
+#include <time.h>		/* for time() */
+#include "timesource.h"
+#include "host.h"		/* Host_Millis() */
+
+
+/* ********************************************************************** */
+
+static z80info * tsZ80 = NULL;
+
+/* cycle count at the last host sample */
+static unsigned long long lastSample = 0;
+
+/* cached host time */
+static long long hostMillis = 0;
+
+/* wall clock at init, and the host time it was taken at */
+static time_t epochBase = 0;
+static long long epochBaseMillis = 0;
+
+
+/* TimeSource_Init
+ *	take the first host sample and remember the z80 to read cycles from
+ */
+void TimeSource_Init( z80info * z80 )
+{
+    tsZ80 = z80;
+
+    hostMillis = Host_Millis();
+    epochBase = time( NULL );
+    epochBaseMillis = hostMillis;
+
+    lastSample = (z80 != NULL) ? z80->cycles : 0;
+}
+
+
+/* TimeSource_Poll
+ *	re-sample the host clock if enough emulated cycles have gone by
+ */
+int TimeSource_Poll( void )
+{
+    if( !tsZ80 ) return 0;
+
+    if( (tsZ80->cycles - lastSample) < kTimeSourceSampleCycles ) {
+	return 0;
+    }
+
+    lastSample = tsZ80->cycles;
+    hostMillis = Host_Millis();
+    return 1;
+}
+
+
+/* ********************************************************************** */
+
+unsigned long long TimeSource_Cycles( void )
+{
+    if( !tsZ80 ) return 0;
+    return tsZ80->cycles;
+}
+
+long long TimeSource_EmuMillis( void )
+{
+    return (long long)( TimeSource_Cycles() / kEmuCyclesPerMS );
+}
+
+long long TimeSource_HostMillis( void )
+{
+    return hostMillis;
+}
+
+time_t TimeSource_Seconds( void )
+{
+    /* before init, just ask the OS */
+    if( !tsZ80 ) return time( NULL );
+
+    return epochBase + (time_t)((hostMillis - epochBaseMillis) / 1000);
+}
@@ -0,0 +1,55 @@
+/* Time source
+ *
+ *  A cheap clock for device code that runs from system_poll().
+ *
+ *  Emulated time comes from the z80's T-state counter, so reading it
+ *  costs nothing.  Host time is sampled from the OS at most once every
+ *  kTimeSourceSampleCycles emulated cycles and cached in between, so
+ *  nothing on the per-opcode path makes a system call.
+ *
+ *  2026-10-19
+ */
+
+#include <time.h>		/* for time_t */
+#include "defs.h"		/* z80info */
+
+#ifndef __TIMESOURCE_H__
+#define __TIMESOURCE_H__
+
+/* ********************************************************************** */
+
+/* clock rate of the emulated machine (RC2014 standard is 7.3728 MHz) */
+#ifndef kEmuClockHz
+#define kEmuClockHz		(7372800L)
+#endif
+
+/* emulated cycles per emulated millisecond */
+#define kEmuCyclesPerMS		(kEmuClockHz / 1000L)
+
+/* re-sample host time at most this often (in emulated cycles) */
+#ifndef kTimeSourceSampleCycles
+#define kTimeSourceSampleCycles	(kEmuCyclesPerMS)
+#endif
+
+
+/* ********************************************************************** */
+
+/* initialize with the z80 whose cycle counter drives emulated time */
+void TimeSource_Init( z80info * z80 );
+
+/* call from system_poll().
+    returns 1 if host time was re-sampled on this call, 0 otherwise */
+int TimeSource_Poll( void );
+
+
+/* emulated time - T-states executed, and milliseconds derived from that */
+unsigned long long TimeSource_Cycles( void );
+long long TimeSource_EmuMillis( void );
+
+/* cached host monotonic time, milliseconds since TimeSource_Init() */
+long long TimeSource_HostMillis( void );
+
+/* cached host wall-clock time, as time( NULL ) would return */
+time_t TimeSource_Seconds( void );
+
+#endif
@@ -0,0 +1,277 @@
+#!/usr/bin/env python3
+#
+# socktest.py  --  a scripted check of the console's socket server
+#
+#   For an emulator built with -DMC6850_SOCKET (host.c).  Starts it on
+#   a pty, types "g" at its EMU: prompt, waits for BASIC to ask for the
+#   memory top, and then attaches remotes on localhost:
+#
+#	- the first is the driver, its keys reach BASIC
+#	- the next is an observer, it sees the output, its keys are dropped
+#	- one that never reads mustn't hold up the rest, and gets its
+#	  output again once it does read
+#	- when the driver leaves, the oldest observer takes over
+#	- ^C from the driver is announced as [BREAK]
+#	- past kMaxClients (8), a remote is turned away with [FULL]
+#
+#	python3 ../Common/utils/socktest.py [emulator [args...]]
+#
+#   Run it from the emulator's directory (it loads ROMs/ from there);
+#   the emulator defaults to bin/rc2014.  Exits 0 if it all checks out.
+#
+#   2026-10-19
+
+import os
+import pty
+import re
+import select
+import signal
+import socket
+import sys
+import time
+
+
+MAXCLIENTS = 8
+LINES = 1500		# enough output to fill a remote that isn't reading
+LINE = "X" * 60
+
+failures = 0
+
+
+def check(what, ok, detail=""):
+    global failures
+    print("%-40s %s%s" % (what, "ok" if ok else "FAILED",
+                          "" if ok or not detail else "  (" + detail + ")"))
+    if not ok:
+        failures += 1
+
+
+class Emulator:
+    """the emulator on a pty; its console output is kept, so it never
+       blocks writing to us"""
+
+    def __init__(self, argv):
+        self.pid, self.fd = pty.fork()
+        if self.pid == 0:
+            try:
+                os.execvp(argv[0], argv)
+            finally:
+                os._exit(127)
+        self.text = ""
+
+    def pump(self, socks, secs):
+        """read the pty for up to 'secs', and any of 'socks' that have
+           something; returns once one of 'socks' did"""
+        end = time.time() + secs
+        while True:
+            left = end - time.time()
+            if left <= 0:
+                return False
+            fds = [self.fd] + [s.sock for s in socks]
+            r, _, _ = select.select(fds, [], [], left)
+            got = False
+            for f in r:
+                if f == self.fd:
+                    try:
+                        data = os.read(self.fd, 65536)
+                    except OSError:
+                        data = b""
+                    if not data:
+                        raise EOFError("the emulator went away")
+                    self.text += data.decode("latin-1").replace("\r", "")
+                else:
+                    for s in socks:
+                        if s.sock == f:
+                            s.recv()
+                            got = True
+            if got:
+                return True
+
+    def expect(self, pattern, secs=10):
+        rx = re.compile(pattern)
+        end = time.time() + secs
+        while True:
+            m = rx.search(self.text)
+            if m:
+                self.text = self.text[m.end():]
+                return m
+            if time.time() >= end:
+                raise IOError("timed out waiting for %r on the console"
+                              % pattern)
+            self.pump([], min(0.1, end - time.time()))
+
+    def close(self):
+        os.kill(self.pid, signal.SIGKILL)
+        os.waitpid(self.pid, 0)
+        os.close(self.fd)
+
+
+class Remote:
+    """one attached remote"""
+
+    def __init__(self, emu, port, rcvbuf=0):
+        self.emu = emu
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        if rcvbuf:
+            self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, rcvbuf)
+        self.sock.connect(("127.0.0.1", port))
+        self.text = ""
+        self.closed = False
+
+    def recv(self):
+        data = self.sock.recv(65536)
+        if not data:
+            self.closed = True
+        self.text += data.decode("latin-1").replace("\r", "")
+
+    def send(self, s):
+        self.sock.sendall(s.encode("latin-1"))
+
+    def expect(self, pattern, secs=10):
+        """wait for 'pattern' from the server; returns the text before
+           it, and drops everything up to the end of it"""
+        rx = re.compile(pattern)
+        end = time.time() + secs
+        while True:
+            m = rx.search(self.text)
+            if m:
+                before = self.text[:m.start()]
+                self.text = self.text[m.end():]
+                return before
+            if self.closed:
+                raise EOFError("the server hung up")
+            left = end - time.time()
+            if left <= 0:
+                raise IOError("timed out waiting for %r" % pattern)
+            self.emu.pump([self], left)
+
+    def close(self):
+        self.sock.close()
+
+
+def lines(text):
+    """how many of the loop's lines came through whole"""
+    return len(re.findall(LINE + r" \d+ *\n", text))
+
+
+def role(r):
+    """the [DRIVER] / [OBSERVER] / [FULL] greeting"""
+    m = re.search(r"\[(DRIVER|OBSERVER|FULL)\]\n", r.text)
+    while not m:
+        if r.closed:
+            return "hung up"
+        if not r.emu.pump([r], 5):
+            return "nothing"
+        m = re.search(r"\[(DRIVER|OBSERVER|FULL)\]\n", r.text)
+    r.text = r.text[m.end():]
+    return m.group(1)
+
+
+def main(argv):
+    emulator = argv[1:] or ["bin/rc2014"]
+    emu = Emulator(emulator)
+    remotes = []
+
+    try:
+        port = int(emu.expect(r"Server started on port (\d+)").group(1))
+        emu.expect(r"EMU:")
+        os.write(emu.fd, b"g\r")
+        emu.expect(r"Memory top\?")
+
+        # driver and observer
+        a = Remote(emu, port)
+        remotes.append(a)
+        r = role(a)
+        check("first remote", r == "DRIVER", r)
+        b = Remote(emu, port)
+        remotes.append(b)
+        r = role(b)
+        check("second remote", r == "OBSERVER", r)
+
+        a.send("\r")
+        a.expect(r"Ok\n")
+        b.expect(r"Ok\n")
+        check("driver's keys reach BASIC", True)
+
+        b.send("PRINT 99\r")
+        time.sleep(0.3)
+        a.send("PRINT 2+3\r")
+        out = a.expect(r" 5 *\nOk\n")
+        check("observer's keys are dropped", "99" not in out, repr(out))
+        out = b.expect(r" 5 *\nOk\n")
+        check("  and it sees the output", "PRINT 2+3" in out, repr(out))
+
+        # one that doesn't read
+        c = Remote(emu, port, rcvbuf=1024)
+        remotes.append(c)
+        r = role(c)
+        check("third remote", r == "OBSERVER", r)
+
+        # BASIC starts with too little string space for it
+        a.send("CLEAR 200\r")
+        a.expect(r"Ok\n")
+        b.expect(r"Ok\n")
+        a.send('A$="%s"\r' % LINE)
+        a.expect(r"Ok\n")
+        b.expect(r"Ok\n")
+        start = time.time()
+        a.send("FOR I=1 TO %d:PRINT A$;I:NEXT\r" % LINES)
+        out = a.expect(r" %d *\nOk\n" % LINES, 120)
+        secs = time.time() - start
+        check("a stalled remote doesn't hold it up",
+              lines(out) == LINES - 1, "%d lines in %.1fs"
+              % (lines(out), secs))
+        b.expect(r" %d *\nOk\n" % LINES, 5)
+
+        # now let it catch up; it lost some, but it's still attached
+        while emu.pump([c], 0.5):
+            pass
+        got = lines(c.text)
+        check("  it kept the start of it", 0 < got < LINES,
+              "%d of %d lines" % (got, LINES))
+        c.text = ""
+        a.send("PRINT 6*7\r")
+        a.expect(r" 42 *\nOk\n")
+        out = c.expect(r" 42 *\nOk\n", 5)
+        check("  and gets output again once it reads",
+              not c.closed, repr(out[-40:]))
+
+        # the driver goes; the oldest observer takes over
+        a.close()
+        remotes.remove(a)
+        r = role(b)
+        check("driver leaves, oldest observer drives", r == "DRIVER", r)
+        b.send("PRINT 3*3\r")
+        b.expect(r" 9 *\nOk\n")
+        check("  and its keys reach BASIC", True)
+
+        # a ^C is seen by everyone
+        b.send("\x03")
+        b.expect(r"\[BREAK\]\n")
+        c.expect(r"\[BREAK\]\n")
+        check("^C from the driver is a [BREAK]", True)
+
+        # and no more than kMaxClients at once
+        while len(remotes) < MAXCLIENTS:
+            r = Remote(emu, port)
+            remotes.append(r)
+            role(r)
+        d = Remote(emu, port)
+        r = role(d)
+        check("remote %d turned away" % (MAXCLIENTS + 1), r == "FULL", r)
+        d.close()
+
+    except (OSError, EOFError) as e:
+        check("talking to the server", False, str(e))
+
+    finally:
+        for r in remotes:
+            r.close()
+        emu.close()
+
+    print("%d failed" % failures if failures else "all ok")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,545 @@
+/* BASIC program support
+ *
+ *  Host-side tokenizer and program image handling for the NASCOM /
+ *  Grant Searle BASIC 4.7 in basic32.rom and basic56.rom.
+ *
+ *  Program lines live in guest RAM starting at (BASTXT) as:
+ *
+ *	[link lo][link hi][line lo][line hi][tokens...][00]
+ *
+ *  where "link" is the address of the next line, and a link of 0000
+ *  ends the program.  (PROGND) points just past that 0000.
+ *
+ *  2026-10-19
+ */
+
+#include <stdio.h>
+#include <stdlib.h>		/* for malloc, free */
+#include <string.h>		/* for memcpy, strlen */
+#include "basic.h"
+
+
+////////////////////////////////////////
+// workspace layout (WRKSPC offsets, same in both ROMs)
+
+#define kWsBASTXT	(0x5E)	/* Pointer to start of program */
+#define kWsSTRSPC	(0x5A)	/* Bottom of string space (and stack) */
+#define kWsLINEAT	(0x5C)	/* Current line number, FFFF if direct */
+#define kWsPROGND	(0xD6)	/* End of program */
+#define kWsVAREND	(0xD8)	/* End of variables */
+#define kWsARREND	(0xDA)	/* End of arrays */
+
+/* leave at least this much between the program and the stack */
+#define kStackMargin	(128)
+
+/* where each ROM puts its workspace.  The first thing in it is
+   the warm start JP. */
+static word workspaces[] = {
+    0x8045,	/* basic32.rom */
+    0x2045,	/* basic56.rom */
+    0
+};
+
+
+/* the keyword table, in token order starting at kTokEND */
+static const char * words[] = {
+    "END", "FOR", "NEXT", "DATA", "INPUT", "DIM", "READ", "LET",
+    "GOTO", "RUN", "IF", "RESTORE", "GOSUB", "RETURN", "REM", "STOP",
+    "OUT", "ON", "NULL", "WAIT", "DEF", "POKE", "DOKE", "SCREEN",
+    "LINES", "CLS", "WIDTH", "MONITOR", "SET", "RESET", "PRINT", "CONT",
+    "LIST", "CLEAR", "CLOAD", "CSAVE", "NEW", "TAB(", "TO", "FN",
+    "SPC(", "THEN", "NOT", "STEP", "+", "-", "*", "/",
+    "^", "AND", "OR", ">", "=", "<", "SGN", "INT",
+    "ABS", "USR", "FRE", "INP", "POS", "SQR", "RND", "LOG",
+    "EXP", "COS", "SIN", "TAN", "ATN", "PEEK", "DEEK", "POINT",
+    "LEN", "STR$", "VAL", "ASC", "CHR$", "HEX$", "BIN$", "LEFT$",
+    "RIGHT$", "MID$",
+    NULL
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// tokenizer
+
+/* BASIC upper-cases anything from 'a' up when matching a keyword */
+static byte Basic_Upper( byte b )
+{
+    if( b >= 'a' ) b &= 0x5F;
+    return b;
+}
+
+/* see if one of the keywords starts at 's'.
+    returns the token and sets *used to the number of source bytes
+    it covers, or returns 0 if there's no match */
+static byte Basic_FindWord( const byte * s, size_t * used )
+{
+    int w;
+    size_t i, j;
+
+    for( w=0 ; words[w] ; w++ ) {
+	const char * k = words[w];
+	byte tok = (byte)(kTokEND + w);
+
+	if( s[0] != (byte)k[0] ) continue;
+
+	for( i=1, j=0 ; k[i] ; i++ ) {
+	    j++;
+	    /* "GO TO" is allowed */
+	    if( tok == kTokGOTO ) {
+		while( s[j] == ' ' ) j++;
+	    }
+	    if( Basic_Upper( s[j] ) != (byte)k[i] ) break;
+	}
+
+	if( k[i] == '\0' ) {
+	    *used = j + 1;
+	    return tok;
+	}
+    }
+    return 0;
+}
+
+
+int Basic_Crunch( const char * src, byte * dst, size_t dstsz )
+{
+    byte buf[ kBasicMaxText ];
+    byte * s = buf;
+    size_t o = 0;
+    size_t used;
+    int literal = 0;		/* in a DATA statement */
+    byte c, term, tok;
+
+    /* work on a copy; like the ROM, we upper-case things in place */
+    if( strlen( src ) >= sizeof( buf )) return -1;
+    strcpy( (char *)buf, src );
+
+#define PUT( b )  do { if( o >= dstsz - 1 ) return -1; dst[o++] = (b); } while( 0 )
+
+    while( (c = *s) != '\0' ) {
+
+	if( c == '"' ) {
+	    /* copy a string literal, up to and including the close quote */
+	    term = '"';
+	    PUT( c );
+	    s++;
+
+	} else {
+	    if( c == ' ' || literal ) {
+		tok = c;
+		used = 1;
+	    } else if( c == '?' ) {
+		tok = kTokPRINT;
+		used = 1;
+	    } else if( c >= '0' && c <= ';' ) {
+		/* digits, ':' and ';' go straight through */
+		tok = c;
+		used = 1;
+	    } else {
+		if( c >= 'a' && c <= 'z' ) {
+		    c &= 0x5F;
+		    *s = c;
+		}
+		tok = Basic_FindWord( s, &used );
+		if( !tok ) {
+		    tok = c;
+		    used = 1;
+		}
+	    }
+
+	    PUT( tok );
+	    s += used;
+
+	    if( tok == ':' ) {
+		literal = 0;
+	    } else if( tok == kTokDATA ) {
+		literal = 1;
+	    }
+
+	    if( tok != kTokREM ) continue;
+
+	    /* the rest of the line is the remark */
+	    term = '\0';
+	}
+
+	/* copy until the terminator, then handle it as a normal byte */
+	while( *s != '\0' && *s != term ) {
+	    PUT( *s );
+	    s++;
+	}
+	if( *s == '"' ) {
+	    PUT( *s );
+	    s++;
+	}
+    }
+
+#undef PUT
+
+    dst[o] = '\0';
+    return (int)o;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// host side program images
+
+BasicProgram * Basic_ProgramCreate( void )
+{
+    return calloc( 1, sizeof( BasicProgram ));
+}
+
+void Basic_ProgramFree( BasicProgram * p )
+{
+    int i;
+
+    if( !p ) return;
+
+    for( i=0 ; i<p->nlines ; i++ ) {
+	free( p->lines[i].tokens );
+    }
+    free( p->lines );
+    free( p );
+}
+
+
+int Basic_ProgramSetLine( BasicProgram * p, word number,
+			  const byte * tokens, size_t len )
+{
+    int i;
+    BasicLine * l;
+    byte * t = NULL;
+
+    if( !p ) return -1;
+
+    /* find where it goes.  Listings are almost always in order,
+       so check the end first. */
+    if( p->nlines && p->lines[ p->nlines-1 ].number < number ) {
+	i = p->nlines;
+    } else {
+	for( i=0 ; i<p->nlines ; i++ ) {
+	    if( p->lines[i].number >= number ) break;
+	}
+    }
+
+    if( len > 0 ) {
+	t = malloc( len );
+	if( !t ) return -1;
+	memcpy( t, tokens, len );
+    }
+
+    /* replacing (or deleting) an existing line */
+    if( i < p->nlines && p->lines[i].number == number ) {
+	free( p->lines[i].tokens );
+	if( len > 0 ) {
+	    p->lines[i].tokens = t;
+	    p->lines[i].len = len;
+	} else {
+	    memmove( &p->lines[i], &p->lines[i+1],
+		     (p->nlines - i - 1) * sizeof( BasicLine ));
+	    p->nlines--;
+	}
+	return 0;
+    }
+
+    /* deleting a line that isn't there */
+    if( len == 0 ) return 0;
+
+    if( p->nlines >= p->maxlines ) {
+	int newmax = p->maxlines ? p->maxlines * 2 : 64;
+	l = realloc( p->lines, newmax * sizeof( BasicLine ));
+	if( !l ) {
+	    free( t );
+	    return -1;
+	}
+	p->lines = l;
+	p->maxlines = newmax;
+    }
+
+    memmove( &p->lines[i+1], &p->lines[i],
+	     (p->nlines - i) * sizeof( BasicLine ));
+    p->nlines++;
+
+    l = &p->lines[i];
+    l->number = number;
+    l->tokens = t;
+    l->len = len;
+    return 0;
+}
+
+
+int Basic_ProgramParse( BasicProgram * p, FILE * fp, char * err, size_t errsz )
+{
+    char text[ kBasicMaxText ];
+    byte tokens[ kBasicMaxLine + 1 ];
+    char * s;
+    char * d;
+    long number;
+    int lineno = 0;
+    int len;
+
+    while( fgets( text, sizeof( text ), fp )) {
+	lineno++;
+
+	/* drop the line ending */
+	text[ strcspn( text, "\r\n" ) ] = '\0';
+
+	/* GETLIN ignores control codes other than ^G as they're typed,
+	   so tabs and the like never get as far as CRUNCH */
+	for( s = d = text ; *s ; s++ ) {
+	    if( (byte)*s >= ' ' || *s == 0x07 ) *d++ = *s;
+	}
+	*d = '\0';
+
+	/* leading spaces don't matter, and blank lines are ignored */
+	s = text;
+	while( *s == ' ' ) s++;
+	if( *s == '\0' ) continue;
+
+	if( *s < '0' || *s > '9' ) {
+	    snprintf( err, errsz, "line %d has no line number", lineno );
+	    return -1;
+	}
+
+	/* same as ATOH; spaces between digits are skipped */
+	number = 0;
+	while( (*s >= '0' && *s <= '9') || *s == ' ' ) {
+	    if( *s != ' ' ) {
+		number = (number * 10) + (*s - '0');
+		if( number > kBasicMaxLineNo ) {
+		    snprintf( err, errsz, "line %d: bad line number", lineno );
+		    return -1;
+		}
+	    }
+	    s++;
+	}
+
+	len = Basic_Crunch( s, tokens, sizeof( tokens ));
+	if( len < 0 ) {
+	    snprintf( err, errsz, "line %d is too long", lineno );
+	    return -1;
+	}
+
+	if( Basic_ProgramSetLine( p, (word)number, tokens, len )) {
+	    snprintf( err, errsz, "out of memory" );
+	    return -1;
+	}
+    }
+
+    return 0;
+}
+
+
+size_t Basic_ProgramSize( BasicProgram * p )
+{
+    int i;
+    size_t sz = 2;	/* the 0000 end link */
+
+    for( i=0 ; i<p->nlines ; i++ ) {
+	sz += 4 + p->lines[i].len + 1;
+    }
+    return sz;
+}
+
+
+/* list one line's tokens, the same as LIST does, except that string
+    literals and remarks are copied as-is since CRUNCH left them alone */
+static void Basic_ListTokens( FILE * fp, const byte * t, size_t len )
+{
+    size_t i;
+    int quoted = 0;
+    int remark = 0;
+    byte b;
+
+    for( i=0 ; i<len ; i++ ) {
+	b = t[i];
+
+	if( b == '"' ) {
+	    quoted = !quoted;
+	}
+
+	if( b < kTokEND || quoted || remark
+	    || (b - kTokEND) >= (int)(sizeof( words ) / sizeof( words[0] )) - 1 ) {
+	    fputc( b, fp );
+	    continue;
+	}
+
+	fputs( words[ b - kTokEND ], fp );
+	if( b == kTokREM ) remark = 1;
+    }
+}
+
+
+int Basic_ProgramList( BasicProgram * p, FILE * fp )
+{
+    int i;
+
+    for( i=0 ; i<p->nlines ; i++ ) {
+	fprintf( fp, "%u ", p->lines[i].number );
+	Basic_ListTokens( fp, p->lines[i].tokens, p->lines[i].len );
+	fputc( '\n', fp );
+    }
+
+    if( ferror( fp )) return -1;
+    return p->nlines;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// guest side
+
+static z80info * bz80 = NULL;
+
+/* the workspace we found BASIC in */
+static word wrkspc = 0;
+
+
+void Basic_Init( z80info * z80 )
+{
+    bz80 = z80;
+}
+
+static byte Basic_Peek( word addr )
+{
+    return (byte) mem_read( bz80, addr );
+}
+
+static word Basic_Deek( word addr )
+{
+    return Basic_Peek( addr ) | (Basic_Peek( addr + 1 ) << 8);
+}
+
+static void Basic_Poke( word addr, byte val )
+{
+    mem_write( bz80, addr, val );
+}
+
+static void Basic_Doke( word addr, word val )
+{
+    Basic_Poke( addr, val & 0xFF );
+    Basic_Poke( addr + 1, (val >> 8) & 0xFF );
+}
+
+
+int Basic_Detect( void )
+{
+    int i;
+    word w, bastxt, strspc, prognd;
+
+    if( !bz80 ) return 0;
+
+    for( i=0 ; workspaces[i] ; i++ ) {
+	w = workspaces[i];
+
+	/* the warm start jump is copied in on cold start */
+	if( Basic_Peek( w ) != 0xC3 ) continue;
+
+	/* and the pointers should make sense */
+	bastxt = Basic_Deek( w + kWsBASTXT );
+	strspc = Basic_Deek( w + kWsSTRSPC );
+	prognd = Basic_Deek( w + kWsPROGND );
+
+	if( bastxt <= w || bastxt >= strspc ) continue;
+	if( prognd < bastxt + 2 || prognd > strspc ) continue;
+
+	wrkspc = w;
+	return 1;
+    }
+
+    wrkspc = 0;
+    return 0;
+}
+
+
+int Basic_DirectMode( void )
+{
+    if( !wrkspc && !Basic_Detect() ) return 0;
+    return( Basic_Deek( wrkspc + kWsLINEAT ) == 0xFFFF );
+}
+
+
+int Basic_ReadProgram( BasicProgram * p, char * err, size_t errsz )
+{
+    word addr, next, end, number;
+    byte tokens[ kBasicMaxLine + 1 ];
+    size_t len;
+
+    if( !wrkspc && !Basic_Detect() ) {
+	snprintf( err, errsz, "BASIC isn't running" );
+	return -1;
+    }
+
+    addr = Basic_Deek( wrkspc + kWsBASTXT );
+    end = Basic_Deek( wrkspc + kWsPROGND );
+
+    while( (next = Basic_Deek( addr )) != 0 ) {
+	/* don't go chasing a corrupt list off into the weeds */
+	if( next <= addr || next > end ) {
+	    snprintf( err, errsz, "the program in memory is corrupt" );
+	    return -1;
+	}
+	number = Basic_Deek( addr + 2 );
+
+	len = 0;
+	while( Basic_Peek( addr + 4 + len ) != 0 ) {
+	    /* rather than keep half of it */
+	    if( len >= kBasicMaxLine ) {
+		snprintf( err, errsz, "line %d is too long", number );
+		return -1;
+	    }
+	    tokens[len] = Basic_Peek( addr + 4 + len );
+	    len++;
+	}
+
+	if( Basic_ProgramSetLine( p, number, tokens, len )) {
+	    snprintf( err, errsz, "out of memory" );
+	    return -1;
+	}
+	addr = next;
+    }
+
+    return 0;
+}
+
+
+long Basic_WriteProgram( BasicProgram * p )
+{
+    word bastxt, strspc, addr, next;
+    size_t sz;
+    size_t j;
+    int i;
+
+    if( !wrkspc && !Basic_Detect() ) return -1;
+
+    bastxt = Basic_Deek( wrkspc + kWsBASTXT );
+    strspc = Basic_Deek( wrkspc + kWsSTRSPC );
+
+    /* make sure it fits, with room left over for the stack */
+    sz = Basic_ProgramSize( p );
+    if( (long)bastxt + (long)sz + kStackMargin > (long)strspc ) {
+	return -1;
+    }
+
+    addr = bastxt;
+    for( i=0 ; i<p->nlines ; i++ ) {
+	BasicLine * l = &p->lines[i];
+
+	next = addr + 4 + l->len + 1;
+	Basic_Doke( addr, next );
+	Basic_Doke( addr + 2, l->number );
+	for( j=0 ; j<l->len ; j++ ) {
+	    Basic_Poke( addr + 4 + j, l->tokens[j] );
+	}
+	Basic_Poke( addr + 4 + l->len, 0x00 );
+	addr = next;
+    }
+
+    /* end of program */
+    Basic_Doke( addr, 0x0000 );
+    addr += 2;
+
+    /* and the program end; variables and arrays are now empty */
+    Basic_Doke( wrkspc + kWsPROGND, addr );
+    Basic_Doke( wrkspc + kWsVAREND, addr );
+    Basic_Doke( wrkspc + kWsARREND, addr );
+
+    return (long)sz;
+}
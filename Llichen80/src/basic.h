@@ -0,0 +1,104 @@
+/* BASIC program support
+ *
+ *  Host-side tokenizer and program image handling for the NASCOM /
+ *  Grant Searle BASIC 4.7 in basic32.rom and basic56.rom, so that
+ *  programs can be put straight into guest RAM rather than typed in.
+ *
+ *  2026-10-19
+ */
+
+#include <stdio.h>
+#include "defs.h"		/* z80info, byte, word */
+
+#ifndef __BASIC_H__
+#define __BASIC_H__
+
+////////////////////////////////////////
+// tokens we need to know about (see WORDS in bas32K.asm)
+
+#define kTokEND		(0x80)
+#define kTokDATA	(0x83)
+#define kTokGOTO	(0x88)
+#define kTokREM		(0x8E)
+#define kTokPRINT	(0x9E)
+
+// longest tokenized line we'll deal with (not counting the terminator)
+#define kBasicMaxLine	(255)
+
+// longest line of program text we'll read in
+#define kBasicMaxText	(1024)
+
+// largest line number BASIC will accept
+#define kBasicMaxLineNo	(65529)
+
+
+////////////////////////////////////////
+// a program image on the host side, sorted by line number
+
+typedef struct BasicLine {
+    word number;
+    size_t len;			/* tokens, not counting the 00 terminator */
+    byte * tokens;
+} BasicLine;
+
+typedef struct BasicProgram {
+    BasicLine * lines;
+    int nlines;
+    int maxlines;
+} BasicProgram;
+
+BasicProgram * Basic_ProgramCreate( void );
+void Basic_ProgramFree( BasicProgram * p );
+
+/* add or replace a line.  len == 0 deletes it (like typing just the number)
+    returns 0 on success */
+int Basic_ProgramSetLine( BasicProgram * p, word number,
+			  const byte * tokens, size_t len );
+
+/* parse and tokenize a text listing.
+    returns 0 on success, or -1 (with 'err' filled in) if anything in
+    it can't be stored as a program line - eg. lines with no number */
+int Basic_ProgramParse( BasicProgram * p, FILE * fp, char * err, size_t errsz );
+
+/* how much guest RAM the program will take, end marker included */
+size_t Basic_ProgramSize( BasicProgram * p );
+
+/* write out a text listing of the program, as LIST would show it.
+    returns the number of lines written, or -1 on a write error */
+int Basic_ProgramList( BasicProgram * p, FILE * fp );
+
+
+////////////////////////////////////////
+// the tokenizer.  Works the same as CRUNCH in the ROM.
+
+/* tokenize 'src' (the text after the line number) into 'dst'.
+    returns the number of bytes, not counting the 00 terminator,
+    or -1 if it doesn't fit */
+int Basic_Crunch( const char * src, byte * dst, size_t dstsz );
+
+
+////////////////////////////////////////
+// the guest side
+
+/* hang on to the z80 so we can get at its memory */
+void Basic_Init( z80info * z80 );
+
+/* is BASIC up and running in the guest?
+    returns 1 if so, and it's safe to read/write the program area */
+int Basic_Detect( void );
+
+/* is BASIC sitting in direct mode (not running a program)? */
+int Basic_DirectMode( void );
+
+/* read the guest's current program into 'p'.  This only reads guest
+    RAM, so it's fine to do at any time.  returns 0 on success, or -1
+    (with 'err' filled in) if it can't all be read - eg. a line longer
+    than kBasicMaxLine */
+int Basic_ReadProgram( BasicProgram * p, char * err, size_t errsz );
+
+/* replace the guest's program with 'p', and fix up BASIC's program
+    end, variable and array pointers to match.
+    returns the number of bytes written, or -1 if it won't fit */
+long Basic_WriteProgram( BasicProgram * p );
+
+#endif
@@ -3,13 +3,24 @@
  *  2017-02-17 Scott Lawrence
  *
  *   Filter console input to provide a backchannel for data transfer
+ *
+ *   Each direction has a chain of stages (see filterchain.h) that the
+ *   bytes are run through before they land in the output buffer:
+ *
+ *	TO CONSOLE:  pattern triggers, capture (save), ESC{ commands
+ *	TO REMOTE:   ESC} commands
+ *
+ *   Other features can add their own stages with Filter_AddStage().
  */
 
 #include <stdio.h>
-#include <string.h>		/* for strlen() */
+#include <stdlib.h>		/* for realloc() */
+#include <string.h>		/* for strlen(), memchr() */
 #include "mc6850_console.h"
 #include "config.h"
 #include "filter.h"
+#include "matcher.h"
+#include "basic.h"
 
 
 ////////////////////////////////////////
@@ -17,27 +28,60 @@
 /* max space in the buffers */
 #define kFCPosMax (1024 * 1024) /* 1 megabyte buffers */
 
-/* TO Console buffers */
-static int tcPos = -1;
-char ToConsoleBuffer[kFCPosMax]; /* additional stuff we're sending to the console */
+/* an output buffer.  Bytes are taken from 'head' and added at 'tail',
+   and it goes back to the start whenever it empties out. */
+typedef struct FilterBuf {
+    size_t head;
+    size_t tail;
+    byte data[ kFCPosMax ];
+} FilterBuf;
+
+static FilterBuf ToConsoleBuffer;  /* additional stuff we're sending to the console */
+static FilterBuf ToRemoteBuffer;   /* additional stuff we're sending to the remote */
+
+/* a span a stage builds for itself, when it can't just pass on its input */
+typedef struct FilterOut {
+    byte * data;
+    size_t len;
+    size_t sz;
+} FilterOut;
+
+/* while a stage is running, anything it says to the console goes in
+   here instead, so it comes out in step with the bytes around it */
+static FilterOut * consoleReply = NULL;
+
+/* a command capture: ESC, start char, command text, ^G */
+typedef struct FilterCmd {
+    int stage;			/* kPS_IDLE, kPS_ESC, or 'cmdStage' */
+    byte startCh;		/* kStartMsgRC or kStartMsgCR */
+    int cmdStage;		/* kPS_TCCMD or kPS_TRCMD */
+    void (*process)( byte *, size_t );
+    int direction;		/* the chain it's in */
+
+    byte command[ kFCPosMax ];
+    size_t pos;
+
+    FilterOut out;		/* pass-through that had to be rewritten */
+} FilterCmd;
 
-static int ProcessStageTC = kPS_IDLE;
-static byte FilterTCCommand[ kFCPosMax ];
-static size_t FC_TCPos = 0;
+static FilterCmd cmdTC = { kPS_IDLE, kStartMsgRC, kPS_TCCMD, Filter_ProcessTC,
+			    kFilterToConsole };
+static FilterCmd cmdTR = { kPS_IDLE, kStartMsgCR, kPS_TRCMD, Filter_ProcessTR,
+			    kFilterToRemote };
 
-/* TO Remote buffers */
-static int trPos = -1;
-char ToRemoteBuffer[kFCPosMax]; /* additional stuff we're sending to the console */
+/* the stage chains for each direction */
+static FilterChain * chains[ 2 ] = { NULL, NULL };
 
-static int ProcessStageTR = kPS_IDLE;
-static byte FilterTRCommand[ kFCPosMax ];
-static size_t FC_TRPos = 0;
+static void Filter_Setup( void );
 
 
 // Filter_Init
 //  perform all initialization stuff
 void Filter_Init( z80info * z80 )
 {
+    Filter_Setup();
+    Basic_Init( z80 );
+
 #ifdef FILTER_CONSOLE
     printf( "--------------------------------------------\n" );
     printf( "Type '0' for memory size to trigger autoload.\n" );
@@ -47,23 +91,78 @@ void Filter_Init( z80info * z80 )
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// to console buffer stuff 
+// output buffer stuff
+
+static void FilterBuf_Put( FilterBuf * fb, const byte * data, size_t len )
+{
+    if( len > kFCPosMax - fb->tail ) {
+	len = kFCPosMax - fb->tail;  /* full.  drop the rest */
+    }
+    memcpy( fb->data + fb->tail, data, len );
+    fb->tail += len;
+}
+
+static void FilterOut_Put( FilterOut * fo, const byte * data, size_t len )
+{
+    byte * n;
+    size_t sz;
+
+    if( fo->len + len > fo->sz ) {
+	sz = fo->sz ? fo->sz : 256;
+	while( sz < fo->len + len ) sz *= 2;
+
+	n = realloc( fo->data, sz );
+	if( !n ) return;  /* no room.  drop it */
+	fo->data = n;
+	fo->sz = sz;
+    }
+    memcpy( fo->data + fo->len, data, len );
+    fo->len += len;
+}
+
+static int FilterBuf_Available( FilterBuf * fb )
+{
+    return( fb->head != fb->tail );
+}
+
+static byte FilterBuf_Get( FilterBuf * fb )
+{
+    byte r;
+
+    if( fb->head == fb->tail ) return 0xff;
+
+    r = fb->data[ fb->head++ ];
+
+    /* collapsed? start over at the beginning */
+    if( fb->head == fb->tail ) {
+	fb->head = fb->tail = 0;
+    }
+    return r;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// to console buffer stuff
 
 
 // Filter_ToConsolePutByte
 //  add something into the ToConsole buffer
 void Filter_ToConsolePutByte( byte data )
 {
-    tcPos++;
-    ToConsoleBuffer[tcPos] = data;
-    ToConsoleBuffer[tcPos+1] = '\0';
+    if( consoleReply ) {
+	FilterOut_Put( consoleReply, &data, 1 );
+    } else {
+	FilterBuf_Put( &ToConsoleBuffer, &data, 1 );
+    }
 }
 
 void Filter_ToConsolePutString( char * str )
 {
-    while( str && *str ) {
-	Filter_ToConsolePutByte( *str );
-	str++;
+    if( !str ) return;
+    if( consoleReply ) {
+	FilterOut_Put( consoleReply, (byte *)str, strlen( str ));
+    } else {
+	FilterBuf_Put( &ToConsoleBuffer, (byte *)str, strlen( str ));
     }
 }
 
@@ -71,272 +170,315 @@ void Filter_ToConsolePutString( char * str )
 //  Is there something in the ToConsole buffer?
 int Filter_ToConsoleAvailable()
 {
-    if( tcPos == -1 ) return 0;
-    return 1;
+    return FilterBuf_Available( &ToConsoleBuffer );
 }
 
 // Filter_ToConsoleGet
 //  get something from the ToConsole buffer
 byte Filter_ToConsoleGet()
 {
+    return FilterBuf_Get( &ToConsoleBuffer );
+}
+
+// Filter_ToConsoleTake
+//  take everything in the ToConsole buffer at once.  It's good until
+//  the next Put, which starts back at the beginning.
+const byte * Filter_ToConsoleTake( size_t * len )
+{
+    FilterBuf * fb = &ToConsoleBuffer;
+    const byte * r = fb->data + fb->head;
+
+    *len = fb->tail - fb->head;
+    fb->head = fb->tail = 0;
+    return r;
+}
+
+
+//////////////////////////////////////////////////////////////////////
+// pattern triggers on the console output
+
+static Matcher * consoleMatcher = NULL;
+
+// Filter_RegisterPattern
+//  call 'fcn' whenever 'pattern' goes by on its way to the console.
+//  returns the id for the pattern or -1
+int Filter_RegisterPattern( const char * pattern, matchFcn fcn, void * ctx )
+{
+    if( !consoleMatcher ) {
+	consoleMatcher = Matcher_Create();
+    }
+    return Matcher_Add( consoleMatcher, pattern, fcn, ctx );
+}
+
+// Filter_UnregisterPattern
+//  stop watching for a pattern
+void Filter_UnregisterPattern( int id )
+{
+    Matcher_Remove( consoleMatcher, id );
+}
+
+// the stage that feeds the matcher.  It only watches, unless a
+// trigger has something to say; that goes out right after the byte
+// that set it off, and on down the chain with the rest.
+static FilterOut patternOut;
+static FilterOut patternReply;
+
+static FilterSpan Filter_PatternStage( FilterSpan in, void * ctx )
+{
+    FilterOut * prev = consoleReply;
+    int rewriting = 0;
     size_t i;
-    byte r;
 
-    if( tcPos == -1 ) return 0xff;
+    patternReply.len = 0;
+    consoleReply = &patternReply;
 
-    r = ToConsoleBuffer[0];
+    for( i=0 ; i<in.len ; i++ ) {
+	Matcher_Feed( consoleMatcher, in.data[i] );
 
-    /* shift everything down */
-    for( i=0 ; i<kFCPosMax-1 ; i++ ) {
-	ToConsoleBuffer[i] = ToConsoleBuffer[i+1];
+	if( rewriting ) {
+	    FilterOut_Put( &patternOut, in.data + i, 1 );
+	}
+	if( patternReply.len ) {
+	    if( !rewriting ) {
+		/* from here on, it's our own span */
+		patternOut.len = 0;
+		FilterOut_Put( &patternOut, in.data, i + 1 );
+		rewriting = 1;
+	    }
+	    FilterOut_Put( &patternOut, patternReply.data, patternReply.len );
+	    patternReply.len = 0;
+	}
     }
-    tcPos--;
 
-    return r;
+    consoleReply = prev;
+
+    if( rewriting ) {
+	in.data = patternOut.data;
+	in.len = patternOut.len;
+    }
+    return in;
 }
 
 
 //////////////////////////////////////////////////////////////////////
 // autostart support
 
-#define kASBLen	(16)
-char autostartBuf[ kASBLen ];
-int asBpos = 0;
+static void Filter_Autostart( int id, void * ctx )
+{
+    Filter_ToConsolePutString( "\n>> Autostart phrase detected <<\n" );
+    Filter_ProcessTC( (byte *)kAutoBootCommand, strlen( kAutoBootCommand ) );
+}
+
+static void Filter_AutostartInit( void )
+{
+    /* the phrase, when it's the end of the line */
+    Filter_RegisterPattern( kAutoBootPhrase "\r", Filter_Autostart, NULL );
+    Filter_RegisterPattern( kAutoBootPhrase "\n", Filter_Autostart, NULL );
+}
 
+//////////////////////////////////////////////////////////////////////
+// ESC command capture, for both directions
 
-void Filter_AutostartCheck( byte data )
+static void Filter_ReInitCmd( FilterCmd * fc )
 {
-    autostartBuf[ asBpos ] = '\0';
+    fc->stage = kPS_IDLE;
+    fc->pos = 0;
+}
 
-    /* check for end of line */
-    if( data == '\n' || data == '\r' ) {
-	if( !strcmp( autostartBuf, kAutoBootPhrase )) {
-		Filter_ToConsolePutString( "\n>> Autostart phrase detected <<\n" );
-    		Filter_ProcessTC( kAutoBootCommand, strlen( kAutoBootCommand ) );
-	}
+static FilterSpan Filter_CommandStage( FilterSpan in, void * ctx )
+{
+    FilterCmd * fc = (FilterCmd *)ctx;
+    FilterOut * prev;
+    FilterSpan out;
+    size_t i;
+    byte data;
+    byte held[ 2 ];
 
-	asBpos = 0;
-	autostartBuf[ 0 ] = '\0';
-    } else {
-	/* Nope. append if we're okay to do so */
-	if( asBpos < (kASBLen-2) ) {
-	    autostartBuf[ asBpos ] = data;
-	    asBpos++;
-	    autostartBuf[ asBpos ] = data;
+    /* nothing for us in here, pass it straight on */
+    if( fc->stage == kPS_IDLE && !memchr( in.data, kEscKey, in.len )) {
+	return in;
+    }
+
+    fc->out.len = 0;
+
+    for( i=0 ; i<in.len ; i++ ) {
+	data = in.data[i];
+
+	switch( fc->stage ) {
+
+	    case( kPS_IDLE ):
+		if( data == kEscKey ) {
+		    fc->stage = kPS_ESC;
+		} else {
+		    FilterOut_Put( &fc->out, &data, 1 );
+		}
+		break;
+
+	    case( kPS_ESC ):
+		if( data == '\r' || data == '\n' ) {
+		    /* bail out */
+		    Filter_ReInitCmd( fc );
+
+		} else if( data == fc->startCh ) {
+		    /* yep! it's for us! */
+		    fc->stage = fc->cmdStage;
+
+		} else {
+		    /* nope.  inject both bytes so far. */
+		    held[ 0 ] = kEscKey;
+		    held[ 1 ] = data;
+		    FilterOut_Put( &fc->out, held, 2 );
+		    /* and restore our state... */
+		    fc->stage = kPS_IDLE;
+		}
+		break;
+
+	    default:
+		/* process... */
+		if( data == '\r' || data == '\n' ) {
+		    /* bail out */
+		    Filter_ReInitCmd( fc );
+
+		} else if( data == kEndMsg ) {
+		    /* We're done. process it!  A reply to the console
+		       goes after what we've passed through so far */
+		    fc->command[ fc->pos ] = '\0';
+		    prev = consoleReply;
+		    if( fc->direction == kFilterToConsole ) {
+			consoleReply = &fc->out;
+		    }
+		    fc->process( fc->command, fc->pos );
+		    consoleReply = prev;
+		    Filter_ReInitCmd( fc );
+
+		} else {
+		    if( fc->pos < kFCPosMax-1 ) {
+			fc->command[ fc->pos++ ] = data;
+		    }
+		}
+		break;
 	}
     }
 
+    out.data = fc->out.data;
+    out.len = fc->out.len;
+    return out;
 }
 
+
 //////////////////////////////////////////////////////////////////////
+// the chains
 
-////////////////////////////////////////
+static void Filter_Setup( void )
+{
+    if( chains[ kFilterToConsole ] ) return;
 
-/* for REMOTE -> CONSOLE (TC) */
+    chains[ kFilterToConsole ] = FilterChain_Create();
+    chains[ kFilterToRemote ] = FilterChain_Create();
 
-void Filter_ReInitTC( void )
-{
-    int tcPos=0;
+    if( !consoleMatcher ) {
+	consoleMatcher = Matcher_Create();
+    }
+    Filter_AutostartInit();
+
+    FilterChain_Insert( chains[ kFilterToConsole ], kFilterPrioPatterns,
+			"patterns", Filter_PatternStage, NULL );
+    FilterChain_Insert( chains[ kFilterToConsole ], kFilterPrioCommands,
+			"ESC{ commands", Filter_CommandStage, &cmdTC );
+    FilterChain_Insert( chains[ kFilterToRemote ], kFilterPrioCommands,
+			"ESC} commands", Filter_CommandStage, &cmdTR );
+}
 
-    ProcessStageTC = kPS_IDLE;
+// Filter_AddStage
+//  add a stage to one of the chains
+int Filter_AddStage( int direction, int priority, const char * name,
+			FilterStageFcn fcn, void * ctx )
+{
+    if( direction != kFilterToConsole && direction != kFilterToRemote ) {
+	return -1;
+    }
+    Filter_Setup();
+    return FilterChain_Insert( chains[ direction ], priority, name, fcn, ctx );
+}
 
-    for( tcPos=0 ; tcPos<(kFCPosMax-1) ; tcPos++ )
-	FilterTCCommand[tcPos] = '\0';
-    FC_TCPos = 0;
+// Filter_RemoveStage
+//  take a stage back out
+void Filter_RemoveStage( int direction, int id )
+{
+    if( direction != kFilterToConsole && direction != kFilterToRemote ) {
+	return;
+    }
+    FilterChain_Remove( chains[ direction ], id );
 }
 
 
+////////////////////////////////////////
+
+/* for REMOTE -> CONSOLE (TC) */
+
 /* filter input going TO the CONSOLE */
-void Filter_ToConsole( byte data )
+void Filter_ToConsoleBuf( const byte * data, size_t len )
 {
-    Filter_AutostartCheck( data );
+    FilterSpan s = { data, len };
 
-    if( consumeFcn ) {
-    	int r = consumeFcn( data );
-	if( r == -1 ) return;
-    }
-    
-    switch( ProcessStageTC ) {
-
-	case( kPS_IDLE ):
-	    if( data == kEscKey ) {
-		ProcessStageTC = kPS_ESC;
-	    } else {
-	    	Filter_ToConsolePutByte( data );
-	    }
-	    break;
-
-	case( kPS_ESC ):
-	    if( data == '\r' || data == '\n' ) {
-		/* bail out */
-                ProcessStageTC = kPS_IDLE;
-		Filter_ReInitTC();
-
-	    } else if( data == kStartMsgRC ) {
-		/* yep! it's for us! */
-                ProcessStageTC = kPS_TCCMD;	/* Remote->Console command! */
-            } else {
-		/* nope.  inject both bytes so far. */
-		Filter_ToConsolePutByte( kEscKey );
-		Filter_ToConsolePutByte( data );
-		/* and restore our state... */
-		ProcessStageTC = kPS_IDLE;
-	    }
-	    break;
-
-	case( kPS_TCCMD ):
-	    /* process... */
-	    if( data == '\r' || data == '\n' ) {
-		/* bail out */
-                ProcessStageTC = kPS_IDLE;
-		Filter_ReInitTC();
-
-	    } else if( data == kEndMsg ) {
-		/* We're done. process it! */
-                ProcessStageTC = kPS_IDLE;
-		Filter_ProcessTC( FilterTCCommand, FC_TCPos );
-		Filter_ReInitTC();
-
-	    } else {
-		if( FC_TCPos < kFCPosMax ) {
-		    FilterTCCommand[ FC_TCPos ] = data;
-		    FC_TCPos++;
-		}
-	    }
-	    break;
+    Filter_Setup();
 
-	default:
-	    ProcessStageTC = kPS_IDLE;
-	    Filter_ToConsolePutByte( data );
-	    break;
-    }
+    s = FilterChain_Run( chains[ kFilterToConsole ], s );
+    FilterBuf_Put( &ToConsoleBuffer, s.data, s.len );
+}
+
+void Filter_ToConsole( byte data )
+{
+    Filter_ToConsoleBuf( &data, 1 );
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
-// to remote buffer stuff 
+// to remote buffer stuff
 
 
 // Filter_ToRemotePutByte
 //  add something into the ToRemote buffer
 void Filter_ToRemotePutByte( byte data )
 {
-    if( trPos < 0 ) {
-	trPos = 0;
-    } else {
-	trPos++;
-    }
-    ToRemoteBuffer[trPos] = data;
-    ToRemoteBuffer[trPos+1] = '\0';
+    FilterBuf_Put( &ToRemoteBuffer, &data, 1 );
 }
 
 void Filter_ToRemotePutString( char * str )
 {
-    while( str && *str ) {
-	Filter_ToRemotePutByte( *str );
-	str++;
-    }
+    if( !str ) return;
+    FilterBuf_Put( &ToRemoteBuffer, (byte *)str, strlen( str ));
 }
 
 // Filter_ToRemoteAvailable
 //  Is there something in the ToRemote buffer?
 int Filter_ToRemoteAvailable()
 {
-    if( trPos < 0 ) return 0;
-    return 1;
+    return FilterBuf_Available( &ToRemoteBuffer );
 }
 
 // Filter_ToRemoteGet
 //  get something from the ToRemote buffer
 byte Filter_ToRemoteGet()
 {
-    size_t i;
-    byte r;
-
-    if( trPos < 0 ) return 0xff;
-
-    r = ToRemoteBuffer[0];
-
-    /* shift everything down */
-    for( i=0 ; i<kFCPosMax-1 ; i++ ) {
-	ToRemoteBuffer[i] = ToRemoteBuffer[i+1];
-    }
-    trPos--;
-
-    return r;
+    return FilterBuf_Get( &ToRemoteBuffer );
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 // TO REMOTE
 
-
-void Filter_ReInitTR( void )
+/* filter input going TO the REMOTE */
+void Filter_ToRemoteBuf( const byte * data, size_t len )
 {
-    int trPos=0;
+    FilterSpan s = { data, len };
 
-    ProcessStageTR = kPS_IDLE;
+    Filter_Setup();
 
-    for( trPos=0 ; trPos<(kFCPosMax-1) ; trPos++ )
-	FilterTCCommand[trPos] = '\0';
-    FC_TRPos = 0;
+    s = FilterChain_Run( chains[ kFilterToRemote ], s );
+    FilterBuf_Put( &ToRemoteBuffer, s.data, s.len );
 }
 
-/* filter input going TO the REMOTE */
 void Filter_ToRemote( byte data )
 {
-    switch( ProcessStageTR ) {
-
-	case( kPS_IDLE ):
-	    if( data == kEscKey ) {
-		ProcessStageTR = kPS_ESC;
-	    } else {
-	    	Filter_ToRemotePutByte( data );
-	    }
-	    break;
-
-	case( kPS_ESC ):
-	    if( data == '\r' || data == '\n' ) {
-		/* bail out */
-                ProcessStageTR = kPS_IDLE;
-		Filter_ReInitTR();
-
-	    } if( data == kStartMsgCR ) {
-		/* yep! it's for us! */
-                ProcessStageTR = kPS_TRCMD;	/* Console->Remote command! */
-
-            } else {
-		/* nope.  inject both bytes so far. */
-		Filter_ToRemotePutByte( kEscKey );
-		Filter_ToRemotePutByte( data );
-		/* and restore our state... */
-		ProcessStageTR = kPS_IDLE;
-	    }
-	    break;
-
-	case( kPS_TRCMD ):
-	    /* process... */
-	    if( data == '\r' || data == '\n' ) {
-		/* Bail out! */
-                ProcessStageTR = kPS_IDLE;
-		Filter_ReInitTR();
-
-	    } else if( data == kEndMsg ) {
-		/* We're done. process it! */
-                ProcessStageTR = kPS_IDLE;
-		Filter_ProcessTR( FilterTRCommand, FC_TRPos );
-		Filter_ReInitTR();
-
-	    } else {
-		if( FC_TRPos < kFCPosMax ) {
-		    FilterTRCommand[ FC_TRPos ] = data;
-		    FC_TRPos++;
-		}
-	    }
-	    break;
-
-	default:
-	    ProcessStageTR = kPS_IDLE;
-	    Filter_ToRemotePutByte( data );
-	    break;
-    }
+    Filter_ToRemoteBuf( &data, 1 );
 }
@@ -8,6 +8,9 @@
 #ifndef __FILTER_H__
 #define __FILTER_H__
 
+#include "matcher.h"
+#include "filterchain.h"
+
 ////////////////////////////////////////
 
 /* pass-through */
@@ -41,14 +44,33 @@ void Filter_ToRemotePutString( char * str );
 
 ////////////////////////////////////////
 
-// If this function pointer is set, then bytes
-// will be passed through it as well.
-// return the byte passed in for it to get further consumed
-// or return -1 to not further pass on anything
+// Pattern triggers.  The callback is called as soon as the last byte
+// of 'pattern' is sent to the console (see matcher.h).  Any number of
+// these can be registered; the cost per byte doesn't change.
+int Filter_RegisterPattern( const char * pattern, matchFcn fcn, void * ctx );
+void Filter_UnregisterPattern( int id );
+
+////////////////////////////////////////
+
+// Stage chains.  Bytes going in either direction are run through a
+// chain of stages (see filterchain.h) before being buffered for output.
+// A stage can watch the bytes go by, rewrite them, or swallow them.
+
+#define kFilterToConsole	(0)
+#define kFilterToRemote		(1)
+
+// suggested priorities; lower runs first
+#define kFilterPrioPatterns	(100)	// pattern triggers (watch only)
+#define kFilterPrioCapture	(200)	// capture to file, etc
+#define kFilterPrioCommands	(300)	// ESC{ / ESC} command capture
 
-typedef int (*consumeByteFcn)( byte );
+int Filter_AddStage( int direction, int priority, const char * name,
+			FilterStageFcn fcn, void * ctx );
+void Filter_RemoveStage( int direction, int id );
 
-consumeByteFcn consumeFcn;
+// run a span of bytes through, rather than one at a time
+void Filter_ToConsoleBuf( const byte * data, size_t len );
+void Filter_ToRemoteBuf( const byte * data, size_t len );
 
 
 #endif
@@ -11,8 +11,11 @@
 #include <string.h>	/* strlen, strcmp */
 #include <time.h>	/* time */
 #include "mc6850_console.h"
+#include "timesource.h"
 #include "config.h"
 #include "filter.h"
+#include "basic.h"
+#include "dircache.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 // Define stuff
@@ -20,7 +23,8 @@
 
 // Path buffer sizes
 #define kBDOSBufSz (1024)
-#define kPRBufSz (255)
+#define kErrBufSz (128)
+#define kPRBufSz (kBDOSBufSz + kErrBufSz + 64)	/* a path plus a message */
 
 // current working directory path
 static char cwbuf[kBDOSBufSz];
@@ -76,6 +80,18 @@ char * checkAndAdvance( char * buf, char * key )
     return buf;
 }
 
+/* Handle_path
+ *
+ *  build the full path to 'filename' in the current directory into fpbuf
+ *	returns 0 if ok, -1 if it wouldn't fit
+ */
+static int Handle_path( byte * filename )
+{
+    int n = snprintf( fpbuf, kBDOSBufSz, "%s%s", cwd, (char *)filename );
+
+    return ( n < 0 || n >= kBDOSBufSz ) ? -1 : 0;
+}
+
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -106,81 +122,45 @@ void Handle_cd( byte * path )
 }
 
 
-int quietText( byte b )
-{
-    static byte lastb = 0;
-
-    if( ( lastb == 0x0a || lastb == 0x0d ) && b == '.')
-    {
-    	consumeFcn = NULL;
-    }
-
-    lastb = b;
-	
-    return -1;
-}
-
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <unistd.h>
-
-int DirOrFileSize( const char *path )
+/* Handle_catalog_Format
+ *	the lines of a catalog, for DirCache
+ */
+static void Handle_catalog_Format( DirCacheText * out,
+				   const DirCacheEntry * ents, int nEnts )
 {
-    struct stat statbuf;
-
-    /* attempt to stat */
-    if (stat(path, &statbuf) != 0) {
-    	return -999;
-    }
-
-    /* -1 for directory */
-    if( S_ISDIR(statbuf.st_mode) ) {
-	return -1;
+    char buf[80];
+    int i;
+
+    for( i=0 ; i<nEnts ; i++ ) {
+	snprintf( buf, 80, "  %20s   ", ents[i].name );
+	DirCache_PutString( out, buf );
+	if( ents[i].size == kDC_SizeDir ) {
+	    DirCache_PutString( out, "DIR\n" );
+	} else if( ents[i].size == kDC_SizeErr ) {
+	    DirCache_PutString( out, "?err\n" );
+	} else {
+	    snprintf( buf, 80, "%ld\n", ents[i].size );
+	    DirCache_PutString( out, buf );
+	}
     }
-
-    return statbuf.st_size;
 }
 
 /* Handle_catalog
  *	give a listing of the current directory
  *	end it with "."
+ *	the listing comes out of the cache unless the directory changed
  */
 void Handle_catalog( byte * junk )
 {
-    DIR *d;
-    struct dirent *dir;
-    char buf[80];
-    int fsize = 0;
+    const char * listing;
 
-    d = opendir( cwd );
-    if (d)
+    listing = DirCache_Listing( cwd, Handle_catalog_Format, NULL );
+    if( listing )
     {
 	Filter_ToConsolePutString( "Listing of " );
 	Filter_ToConsolePutString( cwd );
 	Filter_ToConsolePutString( "\n" );
-        while ((dir = readdir(d)) != NULL)
-        {
-	    /* skip if there's no content, or "." */
-	    if(    !( dir->d_name[0] == '.' && dir->d_name[1] == '\0' )
-		&& !( dir->d_name[0] == '\0' )
-	      )
-	    {
-		snprintf( buf, 80, "%s/%s", cwd, dir->d_name );
-		fsize = DirOrFileSize( buf );
-
-		snprintf( buf, 80, "  %20s   ", dir->d_name );
-		Filter_ToConsolePutString( buf );
-		if( fsize == -1 ) {
-		    Filter_ToConsolePutString( "DIR\n" );
-		} else if( fsize == -999 ) {
-		    Filter_ToConsolePutString( "?err\n" );
-		} else {
-		    snprintf( buf, 80, "%d\n", fsize );
-		    Filter_ToConsolePutString( buf );
-		}
-	    }
-        }
-        closedir(d);
+	Filter_ToConsolePutString( (char *)listing );
     }
 }
 
@@ -195,8 +175,10 @@ void Handle_more( byte * filename )
     char prbuf[ kPRBufSz ];
 
     /* build the path */
-    strncpy( fpbuf, cwbuf, kBDOSBufSz );
-    strncat( fpbuf, filename, kBDOSBufSz );
+    if( Handle_path( filename )) {
+	Filter_ToConsolePutString( "Path too long!\n" );
+	return;
+    }
 
     fp = fopen( fpbuf, "r" );
     if( fp ) {
@@ -212,7 +194,7 @@ void Handle_more( byte * filename )
 	Filter_ToConsolePutString( prbuf );
 
     } else {
-	snprintf( prbuf, kPRBufSz, "%s: Cannot open!/n", fpbuf );
+	snprintf( prbuf, kPRBufSz, "%s: Cannot open!\n", fpbuf );
 	Filter_ToConsolePutString( prbuf );
     }
 }
@@ -228,8 +210,10 @@ void Handle_type( byte * filename )
     char prbuf[ kPRBufSz ];
 
     /* build the path */
-    strncpy( fpbuf, cwbuf, kBDOSBufSz );
-    strncat( fpbuf, filename, kBDOSBufSz );
+    if( Handle_path( filename )) {
+	Filter_ToConsolePutString( "Path too long!\n" );
+	return;
+    }
 
     fp = fopen( fpbuf, "r" );
     if( fp ) {
@@ -250,7 +234,7 @@ void Handle_type( byte * filename )
     	fclose( fp );
 	Filter_ToConsolePutString( "Done!\n" );
     } else {
-	snprintf( prbuf, kPRBufSz, "%s: Cannot open!/n", fpbuf );
+	snprintf( prbuf, kPRBufSz, "%s: Cannot open!\n", fpbuf );
 	Filter_ToConsolePutString( prbuf );
     }
 }
@@ -258,14 +242,162 @@ void Handle_type( byte * filename )
 
 ////////////////////////////////////////////////////////////////////////////////
 
+/* Loading programs
+ *
+ *  Rather than typing the program in, we tokenize it here and drop it
+ *  straight into the guest's program area (see basic.c).  That can only
+ *  be done while BASIC is sitting at its command prompt, so if a program
+ *  is running (or BASIC isn't up yet, as with autostart) we wait for
+ *  the next "Ok" before doing it.
+ *
+ *  If BASIC isn't found, or the file has anything in it that can't be
+ *  stored as a program line, we fall back to typing it in.
+ */
+
+#define kLoadMerge	(0x01)	/* keep lines already in the guest */
+#define kLoadRun	(0x02)	/* "run" it afterwards */
+#define kLoadWait	(0x04)	/* always wait for "Ok" first */
+
+static BasicProgram * pendingProg = NULL;
+static int pendingFlags = 0;
+static int pendingOkId = -1;
+static char pendingName[ kBDOSBufSz ];
+
+
+/* type the file in, the old way */
+static void Handle_typeProgram( byte * filename, int flags )
+{
+    if( !(flags & kLoadMerge) ) {
+	Filter_ToRemotePutString( "new\r\n" );
+	Filter_ToRemotePutString( "clear\r\n" );
+    }
+    Handle_type( filename );
+    if( flags & kLoadRun ) {
+	Filter_ToRemotePutString( "run\r\n" );
+    }
+}
+
+
+/* put the pending program into the guest */
+static void Handle_injectNow( void )
+{
+    BasicProgram * p = pendingProg;
+    char err[ kErrBufSz ];
+    char prbuf[ kPRBufSz ];
+    long sz = -1;
+    int i;
+
+    pendingProg = NULL;
+    if( !p ) return;
+
+    if( Basic_Detect() ) {
+	if( pendingFlags & kLoadMerge ) {
+	    /* lay the new lines over what's there */
+	    BasicProgram * m = Basic_ProgramCreate();
+	    if( m && !Basic_ReadProgram( m, err, kErrBufSz ) ) {
+		for( i=0 ; i<p->nlines ; i++ ) {
+		    Basic_ProgramSetLine( m, p->lines[i].number,
+					  p->lines[i].tokens, p->lines[i].len );
+		}
+		sz = Basic_WriteProgram( m );
+	    } else if( m ) {
+		snprintf( prbuf, kPRBufSz, "%s: %s, typing it in.\n",
+			  pendingName, err );
+		Filter_ToConsolePutString( prbuf );
+	    }
+	    Basic_ProgramFree( m );
+	} else {
+	    sz = Basic_WriteProgram( p );
+	}
+    }
+
+    if( sz < 0 ) {
+	/* BASIC wasn't there, or the program didn't fit */
+	Basic_ProgramFree( p );
+	Handle_typeProgram( (byte *)pendingName, pendingFlags );
+	return;
+    }
+
+    snprintf( prbuf, kPRBufSz, "%s: Loaded %d lines, %ld bytes\n",
+		pendingName, p->nlines, sz );
+    Filter_ToConsolePutString( prbuf );
+    Basic_ProgramFree( p );
+
+    /* let BASIC reset the rest of its run state */
+    if( pendingFlags & kLoadRun ) {
+	Filter_ToRemotePutString( "run\r\n" );
+    } else {
+	Filter_ToRemotePutString( "clear\r\n" );
+    }
+}
+
+static void Handle_injectOnOk( int id, void * ctx )
+{
+    Filter_UnregisterPattern( pendingOkId );
+    pendingOkId = -1;
+    Handle_injectNow();
+}
+
+
+/* Handle_inject
+ *	tokenize 'filename' and get it into the guest (now or at the next Ok)
+ *	returns 0 if it couldn't be tokenized; the caller should type it in
+ */
+static int Handle_inject( byte * filename, int flags )
+{
+    FILE * fp;
+    BasicProgram * p;
+    char err[ kErrBufSz ];
+    char prbuf[ kPRBufSz ];
+
+    /* build the path */
+    if( Handle_path( filename )) {
+	/* let the typing path report it */
+	return 0;
+    }
+
+    fp = fopen( fpbuf, "r" );
+    if( !fp ) {
+	/* let the typing path report it */
+	return 0;
+    }
+
+    p = Basic_ProgramCreate();
+    if( !p || Basic_ProgramParse( p, fp, err, kErrBufSz )) {
+	fclose( fp );
+	Basic_ProgramFree( p );
+	if( p ) {
+	    snprintf( prbuf, kPRBufSz, "%s: %s, typing it in.\n", fpbuf, err );
+	    Filter_ToConsolePutString( prbuf );
+	}
+	return 0;
+    }
+    fclose( fp );
+
+    /* only one load at a time; a newer one wins */
+    Basic_ProgramFree( pendingProg );
+    pendingProg = p;
+    pendingFlags = flags;
+    strncpy( pendingName, (char *)filename, kBDOSBufSz - 1 );
+    pendingName[ kBDOSBufSz - 1 ] = '\0';
+
+    if( !(flags & kLoadWait) && Basic_Detect() && Basic_DirectMode() ) {
+	Handle_injectNow();
+    } else if( pendingOkId < 0 ) {
+	pendingOkId = Filter_RegisterPattern( "Ok\r\n", Handle_injectOnOk, NULL );
+    }
+
+    return 1;
+}
+
+
 /* Handle_load
  *	New, clear and run a new program
  */
 void Handle_load( byte * filename )
 {
-    Filter_ToRemotePutString( "new\r\n" );
-    Filter_ToRemotePutString( "clear\r\n" );
-    Handle_type( filename );
+    if( Handle_inject( filename, 0 )) return;
+    Handle_typeProgram( filename, 0 );
 }
 
 /* Handle_loadrun
@@ -273,10 +405,8 @@ void Handle_load( byte * filename )
  */
 void Handle_loadrun( byte * filename )
 {
-    Filter_ToRemotePutString( "new\r\n" );
-    Filter_ToRemotePutString( "clear\r\n" );
-    Handle_type( filename );
-    Filter_ToRemotePutString( "run\r\n" );
+    if( Handle_inject( filename, kLoadRun )) return;
+    Handle_typeProgram( filename, kLoadRun );
 }
 
 /* Handle_chain
@@ -285,8 +415,8 @@ void Handle_loadrun( byte * filename )
  */
 void Handle_chain( byte * filename )
 {
-    Handle_type( filename );
-    Filter_ToRemotePutString( "run\r\n" );
+    if( Handle_inject( filename, kLoadMerge | kLoadRun )) return;
+    Handle_typeProgram( filename, kLoadMerge | kLoadRun );
 }
 
 
@@ -304,6 +434,8 @@ void Handle_chain( byte * filename )
   7. read in and handle a line at a time
 	- if Number, set "got numbers", save line to file
 	- if Ok, and gotNumbers, terminate
+  8. skip the screen entirely, and read the program out of RAM.
+	- the scraper is kept for when BASIC can't be found
  */
 
 
@@ -317,15 +449,11 @@ static FILE * savefp = NULL;
 
 /* consumeSaveByte
  *	consume a byte for the save function
+ *	returns 1 when the save is complete
  */
-int consumeSaveByte( byte b )
+static int consumeSaveByte( byte b )
 {
-    if( !savefp )
-    {
-	consumeFcn = NULL;
-	return b;
-    }
-
+    if( !savefp ) return 1;
 
     /* is end of line? */
     if( b == 0x0a || b == 0x0d ) {
@@ -333,7 +461,7 @@ int consumeSaveByte( byte b )
 
 	if( cfLineBuf[0] == '\0' ) {
 	    /* empty string. do nothing */
-	    return( -1 );
+	    return 0;
 	}
 
 	if( cfLineBuf[ 0 ] >= '0' && cfLineBuf[ 0 ] <= '9' ) {
@@ -346,7 +474,9 @@ int consumeSaveByte( byte b )
 	    gotNumbers = 0;
 	    fclose( savefp );
 	    savefp = NULL;
+	    DirCache_Invalidate( cwd );
 	    Filter_ToConsolePutString( "\n\nDone saving.\n" );
+	    return 1;
 	}
 
 	/* clear the buffer */
@@ -362,21 +492,44 @@ int consumeSaveByte( byte b )
 	}
     }
 
-    return( -1 ); /* don't echo anything! */
+    return 0;
 }
 
-/* Handle_save
- *	Start the mechanism to save out to a file
+/* saveStage
+ *	capture the listing off of the console stream.
+ *	none of it gets echoed to the console.
+ */
+static int saveId = -1;
+
+FilterSpan saveStage( FilterSpan in, void * ctx )
+{
+    size_t i;
+
+    for( i=0 ; i<in.len ; i++ ) {
+	if( consumeSaveByte( in.data[i] )) {
+	    /* all done.  pass along whatever's after the listing */
+	    Filter_RemoveStage( kFilterToConsole, saveId );
+	    saveId = -1;
+	    in.data += i + 1;
+	    in.len -= i + 1;
+	    return in;
+	}
+    }
+
+    in.len = 0;
+    return in;
+}
+
+/* Handle_saveListing
+ *	Save by screen scraping, for when we can't find BASIC in RAM
  *	- Open the file
  *	- trigger the 'list' command
  *	- set up our capture function above
  */
-void Handle_save( byte * filename )
+static void Handle_saveListing( void )
 {
-    strncpy( fpbuf, cwd, kBDOSBufSz );
-    strncat( fpbuf, filename, kBDOSBufSz );
-
     /* attempt to open the file for write */
+    if( savefp ) fclose( savefp );
     savefp = fopen( fpbuf, "w" );
     if( !savefp ) {
 	return;
@@ -390,11 +543,67 @@ void Handle_save( byte * filename )
     cfLinePos = 0;
     gotNumbers = 0;
 
-    consumeFcn = consumeSaveByte;
+    if( saveId < 0 ) {
+	saveId = Filter_AddStage( kFilterToConsole, kFilterPrioCapture,
+				"save capture", saveStage, NULL );
+    }
 
     /* leave the file open... */
 }
 
+/* Handle_save
+ *	Save out the program in the guest to a file
+ *
+ *  The program is read straight out of guest RAM and detokenized here,
+ *  so the guest never sees a thing; nothing is typed and nothing in
+ *  the guest is changed.
+ */
+void Handle_save( byte * filename )
+{
+    BasicProgram * p;
+    FILE * fp;
+    char err[ kErrBufSz ];
+    char prbuf[ kPRBufSz ];
+    int n = -1;
+
+    if( Handle_path( filename )) {
+	Filter_ToConsolePutString( "Path too long!\n" );
+	return;
+    }
+
+    p = Basic_ProgramCreate();
+    if( !p || !Basic_Detect() ) {
+	Basic_ProgramFree( p );
+	Handle_saveListing();
+	return;
+    }
+
+    if( Basic_ReadProgram( p, err, kErrBufSz )) {
+	/* LIST will show it all, even if we can't */
+	snprintf( prbuf, kPRBufSz, "%s: %s, saving the listing.\n",
+		  fpbuf, err );
+	Filter_ToConsolePutString( prbuf );
+	Basic_ProgramFree( p );
+	Handle_saveListing();
+	return;
+    }
+
+    fp = fopen( fpbuf, "w" );
+    if( fp ) {
+	n = Basic_ProgramList( p, fp );
+	if( fclose( fp )) n = -1;
+	DirCache_Invalidate( cwd );
+    }
+    Basic_ProgramFree( p );
+
+    if( n < 0 ) {
+	snprintf( prbuf, kPRBufSz, "%s: Couldn't save.\n", fpbuf );
+    } else {
+	snprintf( prbuf, kPRBufSz, "%s: Saved %d lines\n", filename, n );
+    }
+    Filter_ToConsolePutString( prbuf );
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Date and time
 
@@ -404,7 +613,7 @@ void Handle_save( byte * filename )
 void Handle_seconds( byte * arg )
 {
     char buf[16];
-    snprintf( buf, 16, "   %lu\r\n", (unsigned long) time( NULL ));
+    snprintf( buf, 16, "   %lu\r\n", (unsigned long) TimeSource_Seconds() );
     Filter_ToRemotePutString( buf );
     //printf( "secs>> %s <<\n", buf );
 }
@@ -415,7 +624,7 @@ void Handle_seconds( byte * arg )
  */
 void Handle_date( byte * arg )
 {
-    time_t current_time = time( NULL );
+    time_t current_time = TimeSource_Seconds();
     char buf[32];
 
     struct tm * loctime;
@@ -434,8 +643,10 @@ void Handle_date( byte * arg )
  */
 void Handle_boot( byte * filename )
 {
-    /* handle the case where the user types 0 for autoboot */
-    Handle_loadrun( kBootFile );
+    /* handle the case where the user types 0 for autoboot.
+       BASIC hasn't cold started yet, so wait for its first Ok */
+    if( Handle_inject( (byte *)kBootFile, kLoadRun | kLoadWait )) return;
+    Handle_typeProgram( (byte *)kBootFile, kLoadRun );
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -551,6 +762,7 @@ void Filter_ProcessTR( byte * buf, size_t len )
     	if( (args = checkAndAdvance( buf, hf->name )) != NULL )
 	{
 	    /* found it! Call the handler! */
+	    Handle_init();
 	    hf->fcn( args );
 	    used = 1;
 	}
@@ -14,6 +14,7 @@
 #include "defs.h"	/* z80 emu system header */
 #include "rc2014.h"	/* common rc2014 emulator headers */
 #include "config.h"	/* z80 emu system header */
+#include "xstorage.h"	/* serial mass storage */
 
 /* ********************************************************************** */
 /*  our memory layout */
@@ -86,6 +87,9 @@ void system_poll( z80info * z80 )
 	/* NMI -> call 0x0066 */
 	/* INTR -> call 0x0038 (IM1) */
 
+	/* keep the cached host clock fresh */
+	TimeSource_Poll();
+
 	FromConsoleBuffered_PollConsole();
 
 	if( FromConsoleBuffer_Available() ) 
@@ -120,7 +124,7 @@ void myHandlePageableRomToggler( const byte data )
 }
 
 
-byte HandleEmulationSignature( void ) { return 'B'; }
+byte HandleEmulationSignature( void ) { return stats_guestread( 'B' ); }
 
 /* ********************************************************************** */
 
@@ -164,6 +168,14 @@ void io_init( z80info * z80 )
 	readPorts[ kMC6850PortRxData ] = mc6850_in_from_buffered_console_data;
 	readPorts[ kMC6850PortStatus ] = mc6850_in_from_buffered_console_status;
 
+	/* Mass storage (SD drive) */
+	MassStorage_Init();
+	writePorts[ kMassPortTxData ] = MassStorage_TX;
+	writePorts[ kMassPortControl ] = MassStorage_Control;
+
+	readPorts[ kMassPortRxData ] = MassStorage_RX;
+	readPorts[ kMassPortStatus ] = MassStorage_Status;
+
 	/* emulator interface */
 	writePorts[ 0xEE ] = HandleEmulationControl;
 	readPorts[ 0xEE ] = HandleEmulationSignature;
@@ -200,6 +212,13 @@ word mem_read( z80info * z80, word addr )
 }
 
 
+/* the debugger and tracers look at Z80 memory with this - it's not counted */
+word mem_peek( z80info * z80, word addr )
+{
+	return ( regions_peek( mems, addr ) );
+}
+
+
 /* Z80 memory write calls this to write a byte */
 word mem_write( z80info * z80, word addr, byte val )
 {
@@ -5,6 +5,9 @@
  *  2016-Jun-10  Scott Lawrence
  */
 
+/* for ftruncate() and friends under -std=c99 */
+#define _DEFAULT_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>	/* malloc */
 #include <sys/types.h>
@@ -12,10 +15,15 @@
 #include <unistd.h>	/* for rmdir, unlink */
 #include <dirent.h>
 #include <string.h>
+#include <fcntl.h>	/* for open */
+#include <sys/mman.h>	/* for mmap, msync */
+#include <pthread.h>	/* for the read-ahead worker */
 #include "defs.h"
-#include "storage.h"
+#include "hexcodec.h"
+#include "dircache.h"
+#include "xstorage.h"
 #include "rc2014.h"	/* common rc2014 emulator headers */
-#include "../Arduino/SDDrive/Strings.h"
+#include "Strings.h"	/* from the SD drive sketch, via -I */
 
 
 /* ********************************************************************** */
@@ -33,7 +41,12 @@
 
 #define kMS_BufSize  (1024 * 1)
 static char * ms_SendQueue = NULL;
-static int bufPtr = -1;
+
+/* the queue is a ring; bytes are popped at qHead, and there are
+   qCount of them.  (it used to shift the whole buffer down a byte
+   for every byte read, which was 1k of copying per port read) */
+static int qHead = 0;
+static int qCount = 0;
 
 
 /* MS_QueueAvailable
@@ -42,7 +55,7 @@ static int bufPtr = -1;
  */
 int MS_QueueAvailable( void )
 {
-    if( bufPtr > 0 ) return 1;
+    if( qCount > 0 ) return 1;
     return 0;
 }
 
@@ -54,14 +67,28 @@ int MS_QueueAvailable( void )
  */
 int MS_QueueByte( char b )
 {
-    if( bufPtr >= kMS_BufSize ) return 0;
+    if( qCount >= kMS_BufSize ) return 0;
 
-    bufPtr++;
-    ms_SendQueue[ bufPtr ] = b;
+    ms_SendQueue[ (qHead + qCount) % kMS_BufSize ] = b;
+    qCount++;
 
     return 1;
 }
 
+/* MS_QueueBytes
+ *	pushes a run of bytes onto the queue
+ *	returns the number of bytes pushed
+ */
+int MS_QueueBytes( const char * b, size_t len )
+{
+    size_t i;
+
+    for( i=0 ; i<len ; i++ ) {
+	if( !MS_QueueByte( b[i] )) break;
+    }
+    return (int)i;
+}
+
 /* MS_QueueStr
  *	takes the string, pushes it onto the queue
  *	returns the number of bytes pushed
@@ -98,11 +125,17 @@ int MS_QueueHex( unsigned char val )
  */
 int MS_QueueHexString( const char * str )
 {
+    char buf[ 128 + 1 ];
+    size_t n;
     int ret = 0;
 
     while( str && *str ) {
-	ret += MS_QueueHex( *str );
-	str++;
+	n = strlen( str );
+	if( n > 64 ) n = 64;
+	hexencode( buf, (const byte *)str, n, NULL );
+	buf[ n*2 ] = '\0';
+	ret += MS_QueueStr( buf );
+	str += n;
     }
     return ret;
 }
@@ -122,25 +155,18 @@ int MS_QueueHexLong( long val )
 
 
 /* MS_QueuePop
- *	removes the head char off the queue, shifts the rest
+ *	removes the head char off the queue
  *	returns the pulled off character
  */
 char MS_QueuePop( void )
 {
     char retval = 0x00;
-    int x;
 
     /* if there's nothing, return 0 */
-    if( bufPtr >= 0 ) {
-	/* stash the return byte aside */
-	retval = ms_SendQueue[0];
-
-	/* shift them all down */
-	for( x=0 ; x< kMS_BufSize-1 ; x++ )
-	{
-	    ms_SendQueue[x] = ms_SendQueue[x+1];
-	}
-	bufPtr--;
+    if( qCount > 0 ) {
+	retval = ms_SendQueue[ qHead ];
+	qHead = (qHead + 1) % kMS_BufSize;
+	qCount--;
     }
 
     return retval;
@@ -151,7 +177,7 @@ char MS_QueuePop( void )
  */
 int MS_QueueSpace( void )
 {
-    return( kMS_BufSize - bufPtr - 2);
+    return( kMS_BufSize - qCount );
 }
 
 /* MS_QueueDebug
@@ -161,8 +187,8 @@ void MS_QueueDebug( void )
 {
     int x;
     printf( "QUEUE: [\n" );
-    for( x = 0 ; x < kMS_BufSize ; x++ ) {
-	printf( "%c", ms_SendQueue[ x ] );
+    for( x = 0 ; x < qCount ; x++ ) {
+	printf( "%c", ms_SendQueue[ (qHead + x) % kMS_BufSize ] );
     }
 
     printf( "\n]\n" );
@@ -197,6 +223,7 @@ void MassStorage_Init( void )
 	printf( "ERROR: Mass Storage couldn't allocate %d kBytes\n",
 		kMS_BufSize / 1024 );
     }
+    qHead = qCount = 0;
     MassStorage_ClearLine();
 }
 
@@ -207,29 +234,69 @@ void MassStorage_Init( void )
 #define kSD_Path 	"MASS_DRV/"
 
 
+/* MassStorage_Listing_Format
+ *	the PD/PF lines and PE footer for a directory, for DirCache
+ */
+static void MassStorage_Listing_Format( DirCacheText * out,
+					const DirCacheEntry * ents, int nEnts )
+{
+    char buf[ 600 ];
+    char num[ 24 ];
+    size_t n;
+    int nFiles = 0;
+    int nDirs = 0;
+    int i;
+
+    for( i=0 ; i<nEnts ; i++ ) {
+	/* always skip dotpaths */
+	if( !strcmp( ents[i].name, ".." )) continue;
+
+	n = strlen( ents[i].name );
+	if( n > 255 ) n = 255;
+
+	/* output the correct line */
+	if( ents[i].size == kDC_SizeDir ) {
+	    memcpy( buf, "-0:PD=", 6 );
+	    hexencode( buf+6, (const byte *)ents[i].name, n, NULL );
+	    n = 6 + n*2;
+	    nDirs++;
+	} else {
+	    /* "name,size", all in hex */
+	    memcpy( buf, "-0:PF=", 6 );
+	    hexencode( buf+6, (const byte *)ents[i].name, n, NULL );
+	    n = 6 + n*2;
+	    sprintf( num, ",%ld", ents[i].size < 0 ? 0L : ents[i].size );
+	    hexencode( buf+n, (const byte *)num, strlen( num ), NULL );
+	    n += strlen( num ) * 2;
+	    nFiles++;
+	}
+	buf[ n++ ] = '\n';
+	DirCache_Put( out, buf, n );
+    }
+
+    /* footer */
+    sprintf( buf, "-0:PE=%d,%d\n", nFiles, nDirs );
+    DirCache_PutString( out, buf );
+}
+
 /* MassStorage_Do_Listing
  *	Takes a directory list of the passed-in path
  *	Queues all of the strings into the queue.
+ *	The lines come out of the directory cache, so repeated listings
+ *	of a directory that hasn't changed don't touch the filesystem.
  */
 static void MassStorage_Do_Listing( char * path )
 {
     char pathbuf[255];
-
-    struct stat status;
-    struct dirent *theDirEnt;
-    DIR * theDir = NULL;
-    int nFiles = 0;
-    int nDirs = 0;
+    const char * listing;
 
     /* build the path */
-    sprintf( pathbuf, "%s%s", kSD_Path, path );
+    snprintf( pathbuf, sizeof( pathbuf ), "%s%s", kSD_Path, path );
 
     printf( "EMU: SD: ls [%s]\n", pathbuf );
 
-    /* open the directory */
-    theDir = opendir( pathbuf );
-
-    if( !theDir ) {
+    listing = DirCache_Listing( pathbuf, MassStorage_Listing_Format, NULL );
+    if( !listing ) {
 	MS_QueueStr( "-0:" kStr_Error_CmdFail "\n" );
 	return;
     }
@@ -238,48 +305,8 @@ static void MassStorage_Do_Listing( char * path )
     MS_QueueStr( "-0:PB=" );
     MS_QueueStr( path );
     MS_QueueStr( "\n" );
-    
-    /* read the first one */
-    theDirEnt = readdir( theDir );
-    while( theDirEnt ) {
-	int skip = 0;
-
-	/* always skip dotpaths */
-	if( !strcmp( theDirEnt->d_name, "." )) skip = 1;
-	if( !strcmp( theDirEnt->d_name, ".." )) skip = 1;
-
-	if( !skip ) {
-	    /* determine if file or dir */
-	    sprintf( pathbuf, "%s%s/%s", kSD_Path, path, theDirEnt->d_name );
-	    stat( pathbuf, &status );
-
-	    /* output the correct line */
-	    if( S_ISDIR( status.st_mode )) {
-		MS_QueueStr( "-0:PD=" );
-		MS_QueueHexString( theDirEnt->d_name );
-		MS_QueueStr( "\n" );
-		nDirs++;
-	    } else {
-		MS_QueueStr( "-0:PF=" );
-		MS_QueueHexString( theDirEnt->d_name );
-		MS_QueueHex( ',' );
-		MS_QueueHexLong( (long)status.st_size );
-		MS_QueueStr( "\n" );
-		nFiles++;
-	    }
-
-	}
-
 
-	/* get the next one */
-	theDirEnt = readdir( theDir );
-    }
-    closedir( theDir );
-
-    /* footer */
-    /* let's re-use pathbuf just because */
-    sprintf( pathbuf, "-0:PE=%d,%d\n", nFiles, nDirs );
-    MS_QueueStr( pathbuf );
+    MS_QueueStr( listing );
 }
 
 static void MassStorage_Do_MakeDir( char * path )
@@ -290,6 +317,7 @@ static void MassStorage_Do_MakeDir( char * path )
 	printf( "EMU: SD: mkdir [%s]\n", path ); 
 	printf( "         %s\n", pathbuf );
 	mkdir( pathbuf, 0755 );
+	DirCache_Invalidate( NULL );
 	MS_QueueStr( kStr_CmdOK );
 }
 
@@ -303,6 +331,7 @@ static void MassStorage_Do_Remove( char * path )
 	/* let's be stupid and just try to remove the file AND dir */
 	rmdir( pathbuf );
 	unlink( pathbuf );
+	DirCache_Invalidate( NULL );
 	MS_QueueStr( kStr_CmdOK );
 }
 
@@ -310,7 +339,6 @@ static void MassStorage_Do_Remove( char * path )
  * Files
  */
 
-static FILE * readFile = NULL;
 static FILE * writeFile = NULL;
 
 /*
@@ -318,17 +346,21 @@ static FILE * writeFile = NULL;
 	1. open the file
 	2. if fail, send error code, done
 	3. queue begin line
-	4. fillCheck()
-	5. return;
+	4. start the read-ahead worker on the file
+	5. fillCheck()
+	6. return;
+
+    worker
+	1. Read in the next chunk
+	2. encode it as -0:FS= lines (or binary frames)
+	3. if that was the end, add the -0:FE=(size) line
+	4. wait for room in the ring, then add it
+	5. repeat until the end, then close the file
 
     fill check()
-	1. if file closed, return
-	2. While there's space in the queue buffer
-	  2A. Read in the next 16 bytes -> NRead
-	  2B. if read 0 bytes:
-	    2Ba. queue new -0:FE=(size) line
-	  2C. else
-	    2Ca. queue new -0:FS= line
+	1. if no worker, return
+	2. move what's in the ring into the queue buffer
+	3. if the worker's done and the ring is empty, join it
 
     status()
 	1. fill check()
@@ -342,46 +374,232 @@ static FILE * writeFile = NULL;
 	1. close the file, if open
 */
 
+/* binary block mode
+ *
+ *  The guest can ask for the next file read to come in as binary
+ *  frames rather than as -0:FS= hex lines, which is less than half
+ *  the bytes and lets it pull in a whole frame with INIR:
+ *
+ *	~0:B=256	ask for frames of up to 256 bytes
+ *	-0:Nb=256	the frame size we'll use (0 = we won't)
+ *
+ *  The file then comes in as:
+ *
+ *	-0:FB=path
+ *	SOH n <n bytes, n=0 means 256> sum	(repeated)
+ *	EOT
+ *	-0:FE=22
+ *
+ *  where 'sum' is the same as in Nc=, (~sumVal)+1 of the data bytes.
+ *  A whole frame is always queued at once, so once the guest sees the
+ *  SOH and the count, the rest of the frame is there to be read.
+ *
+ *  The mode only lasts for one file; after the EOT we're back to hex.
+ *  The Arduino SDDrive doesn't answer ~0:B at all, so a guest that
+ *  gets no Nb= back just carries on with hex lines.
+ */
+#define kMS_SOH		(0x01)
+#define kMS_EOT		(0x04)
+#define kMS_MaxFrame	(256)
+
+static int binFrame = 0;	/* frame size for the next read, 0 for hex */
+
+static void MassStorage_Binary_Request( char * args )
+{
+    char buf[32];
+    int n = atoi( args );
+
+    if( n < 0 ) n = 0;
+    if( n > kMS_MaxFrame ) n = kMS_MaxFrame;
+    binFrame = n;
+
+    sprintf( buf, "-0:Nb=%d\n", binFrame );
+    MS_QueueStr( buf );
+}
+
+
+/* read-ahead
+ *
+ *  A worker thread reads the file and encodes it (FS lines or binary
+ *  frames, then the footer) into a big ring buffer ahead of the guest.
+ *  All the CPU thread does is copy already-encoded bytes from there
+ *  into the send queue, so a guest load never waits on the disk unless
+ *  it has caught right up with the worker.
+ *
+ *  The worker only adds whole lines and frames to the ring, so the
+ *  "whole frame is there once you see the SOH" rule still holds.
+ */
+#define NPerFill	(16)			/* bytes per FS line */
+#define kRA_Size	(256 * 1024)		/* encoded bytes kept ahead */
+#define kRA_Chunk	(4 * 1024)		/* file bytes read at a time */
+#define kRA_Block	(kRA_Chunk * 3)		/* room to encode a chunk */
+
+typedef struct ReadAhead {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int running;		/* there's a worker to be joined */
+    int stop;			/* worker should give up */
+    int done;			/* worker has put the footer in */
+
+    FILE * fp;			/* only the worker touches this */
+    int frame;			/* binary frame size, 0 for hex lines */
+
+    char buf[ kRA_Size ];
+    size_t head;
+    size_t count;
+} ReadAhead;
+
+static ReadAhead ra = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER
+};
+
+
+/* MassStorage_Encode
+ *	read the next chunk of the file, and encode it into 'out'
+ *	sets *eof (and adds the footer) once the file is all read
+ *	returns the number of bytes put into 'out'
+ */
+static size_t MassStorage_Encode( FILE * fp, int frame, char * out, int * eof )
+{
+    unsigned char data[ kRA_Chunk ];
+    size_t nRead, i, j, n;
+    size_t o = 0;
+    int sum;
+
+    nRead = fread( data, 1, kRA_Chunk, fp );
+
+    for( i=0 ; i<nRead ; i += n ) {
+	if( frame ) {
+	    n = (nRead - i < frame) ? nRead - i : frame;
+	    out[o++] = kMS_SOH;
+	    out[o++] = (char)(n & 0xFF);	/* 256 -> 0 */
+	    sum = 0;
+	    for( j=0 ; j<n ; j++ ) {
+		out[o++] = data[i+j];
+		sum += data[i+j];
+	    }
+	    out[o++] = (char)(((~sum)+1) & 0x0FF);
+
+	} else {
+	    n = (nRead - i < NPerFill) ? nRead - i : NPerFill;
+	    memcpy( out+o, "-0:FS=", 6 );
+	    o += 6;
+	    hexencode( out+o, data+i, n, NULL );
+	    o += n*2;
+	    out[o++] = '\n';
+	}
+    }
+
+    if( nRead < kRA_Chunk ) {
+	/* that's it; the footer goes out in text either way */
+	if( frame ) out[o++] = kMS_EOT;
+	o += sprintf( out+o, "-0:FE=%ld\n", ftell( fp ));
+	*eof = 1;
+    }
+
+    return o;
+}
+
+
+/* MassStorage_ReadAhead_Worker
+ *	the thread that keeps the ring topped up
+ */
+static void * MassStorage_ReadAhead_Worker( void * arg )
+{
+    static char block[ kRA_Block ];
+    size_t len, pos, n;
+    int eof = 0;
+
+    while( !eof ) {
+	len = MassStorage_Encode( ra.fp, ra.frame, block, &eof );
+
+	pthread_mutex_lock( &ra.lock );
+	while( !ra.stop && (kRA_Size - ra.count) < len ) {
+	    pthread_cond_wait( &ra.cond, &ra.lock );
+	}
+	if( ra.stop ) {
+	    pthread_mutex_unlock( &ra.lock );
+	    break;
+	}
+
+	/* in it goes, in (up to) two pieces */
+	pos = (ra.head + ra.count) % kRA_Size;
+	n = (len < kRA_Size - pos) ? len : kRA_Size - pos;
+	memcpy( ra.buf + pos, block, n );
+	memcpy( ra.buf, block + n, len - n );
+	ra.count += len;
+	ra.done = eof;
+
+	pthread_cond_broadcast( &ra.cond );
+	pthread_mutex_unlock( &ra.lock );
+    }
+
+    fclose( ra.fp );
+    ra.fp = NULL;
+    return NULL;
+}
+
+
+/* MassStorage_ReadAhead_Stop
+ *	shut down the worker, and forget anything it had read
+ */
+static void MassStorage_ReadAhead_Stop( void )
+{
+    if( !ra.running ) return;
+
+    pthread_mutex_lock( &ra.lock );
+    ra.stop = 1;
+    pthread_cond_broadcast( &ra.cond );
+    pthread_mutex_unlock( &ra.lock );
+
+    pthread_join( ra.thread, NULL );
+    ra.running = 0;
+    ra.head = ra.count = 0;
+}
+
+
 /* MassStorage_FillCheck
- *	check to see if the file has more content for the queue
+ *	move anything the worker has encoded into the queue
  */
 static void MassStorage_FillCheck( void )
 {
-#define NPerFill (16)	/* queue buf must be this*2+8+pad minimum */
+    size_t n, run;
+    int finished;
 
-    char databuf[ (NPerFill * 2) + 2];
-    char strbuf[512];
-    size_t nRead;
-    int j;
+    /* no file being read, so just return */
+    if( !ra.running ) return;
 
-    /* no file open, so just return */
-    if( readFile == NULL ) return;
+    /* still plenty queued up?  don't bother with the lock */
+    if( MS_QueueSpace() < (kMS_BufSize / 2) ) return;
 
-    /* if there's space, push some more...*/
-    if( MS_QueueSpace() > ( (NPerFill*2) + 8 )) {
-	/* read some data */
-	nRead = fread( databuf, 1, NPerFill, readFile );
+    pthread_mutex_lock( &ra.lock );
 
-	if( nRead > 0 ) {
-	    /* make a queue data message */
-	    MS_QueueStr( "-0:FS=" );
+    /* the guest takes an empty queue to mean the end of the file,
+       so if the worker's fallen behind, we have to wait for it */
+    while( ra.count == 0 && !ra.done && !MS_QueueAvailable() ) {
+	pthread_cond_wait( &ra.cond, &ra.lock );
+    }
 
-	    for( j=0 ; j<nRead ; j++ ) {
-		MS_QueueHex( databuf[j] );
-	    }
+    n = (size_t)MS_QueueSpace();
+    if( n > ra.count ) n = ra.count;
+    while( n > 0 ) {
+	run = (n < kRA_Size - ra.head) ? n : kRA_Size - ra.head;
+	MS_QueueBytes( ra.buf + ra.head, run );
+	ra.head = (ra.head + run) % kRA_Size;
+	ra.count -= run;
+	n -= run;
+    }
+    finished = ( ra.done && ra.count == 0 );
 
-	    MS_QueueStr( "\n" );
+    pthread_cond_broadcast( &ra.cond );
+    pthread_mutex_unlock( &ra.lock );
 
-	} else {
-	    /* no more data, send the footer */
-	    nRead = (size_t)ftell( readFile ); 
-	    fclose( readFile );
-	    readFile = NULL;
-
-	    /* send the footer */
-	    sprintf( strbuf, "-0:FE=%ld\n", (long int)nRead );
-	    MS_QueueStr( strbuf );
-	}
+    if( finished ) {
+	pthread_join( ra.thread, NULL );
+	ra.running = 0;
+	ra.head = 0;
     }
 }
 
@@ -389,15 +607,21 @@ static void MassStorage_FillCheck( void )
 static void MassStorage_File_Start_Read( char * path )
 {
     char pathbuf[255];
+    FILE * fp;
+    int frame;
+
     sprintf( pathbuf, "%s%s", kSD_Path, path );
 
     printf( "EMU: SD: Read from [%s]\n", path ); 
 
-    if( readFile ) {
-	fclose( readFile );
-    }
-    readFile = fopen( pathbuf, "rb" );
-    if( readFile == NULL ) {
+    MassStorage_ReadAhead_Stop();
+
+    /* a binary mode request is good for this one file */
+    frame = binFrame;
+    binFrame = 0;
+
+    fp = fopen( pathbuf, "rb" );
+    if( fp == NULL ) {
 	/* couldn't open file. */
 	printf( "EMU: SD: Can't open %s\n", pathbuf );
 	MS_QueueStr( "-0:" kStr_Error_FileNotFound "\n" );
@@ -409,6 +633,20 @@ static void MassStorage_File_Start_Read( char * path )
     MS_QueueStr( path );
     MS_QueueStr( "\n" );
 
+    /* and set the worker off on the rest */
+    ra.fp = fp;
+    ra.frame = frame;
+    ra.head = ra.count = 0;
+    ra.stop = ra.done = 0;
+    if( pthread_create( &ra.thread, NULL, MassStorage_ReadAhead_Worker, NULL )) {
+	printf( "EMU: SD: Can't start read-ahead for %s\n", pathbuf );
+	fclose( fp );
+	ra.fp = NULL;
+	MS_QueueStr( "-0:" kStr_Error_CmdFail "\n" );
+	return;
+    }
+    ra.running = 1;
+
     /* attempt to put some file data into the send queue */
     MassStorage_FillCheck();
 }
@@ -451,30 +689,30 @@ int HexToVal( const char ch )
     return 0;
 }
 
-static void MassStorage_File_ConsumeString( char * data )
+/* MassStorage_Decode
+ *	pull the bytes out of an FW/SS hex string into 'out'
+ *	the usual clean string goes through hexdecode() in one go; anything
+ *	with junk in it gets the old treatment, skipping non-hex characters
+ *	returns the number of bytes, and adds them onto *sum
+ */
+static size_t MassStorage_Decode( const char * data, unsigned char * out,
+				  size_t max, unsigned long * sum )
 {
-    char buf[64];
-    printf( "EMU: SD: consume data [%s]\n", data ); 
-
-    if( writeFile == NULL || data == NULL ) {
-	MS_QueueStr( "-0:" kStr_Error_NoFileWrite "\n" );
-	return;
-    }
-
-    if( strlen( data ) < 1 ) {
-	MS_QueueStr( "-0:" kStr_Error_NoFileWrite "\n" );
-	return;
-    }
-
-    /* scan the string */
-
+    size_t len = strlen( data );
+    size_t nBytes = 0;
     unsigned char val = 0;
     unsigned char nNibs = 0;
-    int nBytes = 0;
-    int sum = 0;
+
+    if( (len & 1) == 0 && len/2 <= max ) {
+	unsigned long s = 0;
+	if( hexdecode( out, data, len/2, &s ) == len/2 ) {
+	    *sum += s;
+	    return len/2;
+	}
+    }
 
     /* find all alphanum */
-    while( *data != '\0' ) {
+    while( *data != '\0' && nBytes < max ) {
 	if( IsHex( *data )) {
 	    if( nNibs == 0 ) {
 		/* build the byte */
@@ -485,22 +723,41 @@ static void MassStorage_File_ConsumeString( char * data )
 		val = (val & 0xF0) | HexToVal( *data );
 		nNibs = 0;
 
-		/* hand it off to the file */
-		fwrite( &val, 1, 1, writeFile );
-		fflush( writeFile );
-
-		/* statistics */
-		sum += val;
-		nBytes++;
+		out[ nBytes++ ] = val;
+		*sum += val;
 	    }
 	}
 
 	/* Next byte in from the user */
 	data++;
     }
+    return nBytes;
+}
+
+static void MassStorage_File_ConsumeString( char * data )
+{
+    char buf[64];
+    unsigned char bytes[ kMaxLine / 2 + 1 ];
+    size_t nBytes;
+    unsigned long sum = 0;
+    printf( "EMU: SD: consume data [%s]\n", data ); 
+
+    if( writeFile == NULL || data == NULL ) {
+	MS_QueueStr( "-0:" kStr_Error_NoFileWrite "\n" );
+	return;
+    }
+
+    if( strlen( data ) < 1 ) {
+	MS_QueueStr( "-0:" kStr_Error_NoFileWrite "\n" );
+	return;
+    }
 
-    sprintf( buf, "-0:Nc=x%02x,x%02x\n", nBytes, 
-		(unsigned char)(((~sum)+1) &0x0FF) );
+    /* scan the string, and hand it all off to the file */
+    nBytes = MassStorage_Decode( data, bytes, sizeof( bytes ), &sum );
+    fwrite( bytes, 1, nBytes, writeFile );
+    fflush( writeFile );
+
+    sprintf( buf, "-0:Nc=x%02x,x%02x\n", (int)nBytes, HEXCHECK( sum ));
 
     MS_QueueStr( buf );
 }
@@ -509,14 +766,12 @@ static void MassStorage_File_Close( void )
 {
     printf( "EMU: SD: end file.\n" );
 
-    if( readFile != NULL ) {
-	fclose( readFile );
-	readFile = NULL;
-    }
+    MassStorage_ReadAhead_Stop();
 
     if( writeFile != NULL ) {
 	fclose( writeFile );
 	writeFile = NULL;
+	DirCache_Invalidate( NULL );
     }
 }
 
@@ -525,32 +780,305 @@ static void MassStorage_File_Close( void )
  */
 
 
+/*
+    Each drive is a flat disk image file, kept memory mapped so that
+    a sector read or write is just a memcpy into or out of the map
+    rather than an fopen/fseek/fread per sector.
+
+	~0:SR=D,T,S	-0:SB=D,T,S
+			-0:SS=292929...		(NPerFill bytes per line)
+			-0:SE=128
+
+	~0:SW=D,T,S	-0:N2=OK
+	~0:SS=2929...	-0:Nc=xx,yy		(as many as needed)
+	~0:SC		-0:N2=OK
+
+    D is the drive, 'A'-'D' (or 0-3), T and S are the track and sector,
+    both starting at 0.  Data sent with SS goes into the sector set by
+    SW, moving on to the next sector when it fills.
+
+    Writes go into the map, and the pages they touch are marked dirty.
+    SC pushes the dirty pages out to the image file with msync(), and
+    so does the emulator exiting.  Until then the kernel writes them
+    back whenever it likes; reads come from the same map, so they see
+    the new data either way.
+*/
+
+#define kSD_NDrives	(4)
+#define kSD_SecSize	(128)
+#define kSD_SecPerTrack	(32)
+#define kSD_Tracks	(256)	/* 1 megabyte per drive */
+#define kSD_DiskSize	((long)kSD_SecSize * kSD_SecPerTrack * kSD_Tracks)
+
+typedef struct SD_Disk {
+    int fd;
+    byte * map;
+    long size;
+    unsigned char * dirty;	/* one per page */
+} SD_Disk;
+
+static SD_Disk disks[ kSD_NDrives ];
+static int disksInit = 0;
+static long pageSize = 4096;
+
+static long secWrite = -1;	/* byte offset for the next SS data */
+static int secDrive = -1;	/* drive being written */
+
+static void MassStorage_Disk_Close( void );
+
+
+/* MassStorage_Disk_Open
+ *	get the image for drive 'd' mapped in, creating it if needed
+ *	returns NULL if it can't be done
+ */
+static SD_Disk * MassStorage_Disk_Open( int d )
+{
+    char pathbuf[255];
+    struct stat status;
+    SD_Disk * dk;
+    long oldSize;
+    int x;
+
+    if( !disksInit ) {
+	for( x=0 ; x<kSD_NDrives ; x++ ) {
+	    disks[x].fd = -1;
+	    disks[x].map = NULL;
+	}
+	pageSize = sysconf( _SC_PAGESIZE );
+	if( pageSize <= 0 ) pageSize = 4096;
+	disksInit = 1;
+
+	/* make sure the last writes get out when we quit */
+	atexit( MassStorage_Disk_Close );
+    }
+
+    if( d < 0 || d >= kSD_NDrives ) return NULL;
+
+    dk = &disks[d];
+    if( dk->map ) return dk;
+
+    sprintf( pathbuf, "%sDISK_%c.IMG", kSD_Path, 'A' + d );
+
+    dk->fd = open( pathbuf, O_RDWR | O_CREAT, 0644 );
+    if( dk->fd < 0 || fstat( dk->fd, &status ) ) {
+	printf( "EMU: SD: Can't open %s\n", pathbuf );
+	if( dk->fd >= 0 ) close( dk->fd );
+	dk->fd = -1;
+	return NULL;
+    }
+
+    /* new (or short) images get grown to full size */
+    oldSize = (long)status.st_size;
+    dk->size = (oldSize > kSD_DiskSize) ? oldSize : kSD_DiskSize;
+    if( oldSize < dk->size && ftruncate( dk->fd, dk->size ) ) {
+	printf( "EMU: SD: Can't size %s\n", pathbuf );
+	close( dk->fd );
+	dk->fd = -1;
+	return NULL;
+    }
+
+    dk->map = mmap( NULL, dk->size, PROT_READ | PROT_WRITE,
+		    MAP_SHARED, dk->fd, 0 );
+    if( dk->map == MAP_FAILED ) {
+	printf( "EMU: SD: Can't map %s\n", pathbuf );
+	dk->map = NULL;
+	close( dk->fd );
+	dk->fd = -1;
+	return NULL;
+    }
+
+    dk->dirty = calloc( (dk->size + pageSize - 1) / pageSize, 1 );
+
+    /* freshly formatted space is E5, same as the CP/M bios does */
+    if( oldSize < dk->size ) {
+	memset( dk->map + oldSize, 0xE5, dk->size - oldSize );
+	for( x = oldSize / pageSize ; x < (dk->size + pageSize - 1) / pageSize ; x++ ) {
+	    if( dk->dirty ) dk->dirty[x] = 1;
+	}
+    }
+
+    printf( "EMU: SD: Drive %c is %s (%ld kBytes)\n",
+	    'A' + d, pathbuf, dk->size / 1024 );
+    return dk;
+}
+
+
+/* MassStorage_Disk_Flush
+ *	write back any dirty pages on all of the drives
+ */
+static void MassStorage_Disk_Flush( void )
+{
+    SD_Disk * dk;
+    long pages, p, q;
+    int d;
+
+    if( !disksInit ) return;
+
+    for( d=0 ; d<kSD_NDrives ; d++ ) {
+	dk = &disks[d];
+	if( !dk->map ) continue;
+
+	/* no record of what's dirty?  do it all. */
+	if( !dk->dirty ) {
+	    msync( dk->map, dk->size, MS_SYNC );
+	    continue;
+	}
+
+	/* sync each run of dirty pages in one go */
+	pages = (dk->size + pageSize - 1) / pageSize;
+	for( p=0 ; p<pages ; p++ ) {
+	    if( !dk->dirty[p] ) continue;
+
+	    for( q=p ; q<pages && dk->dirty[q] ; q++ ) {
+		dk->dirty[q] = 0;
+	    }
+	    msync( dk->map + (p * pageSize),
+		   ((q * pageSize) > dk->size ? dk->size : (q * pageSize))
+		   - (p * pageSize), MS_SYNC );
+	    p = q;
+	}
+    }
+}
+
+
+/* MassStorage_Disk_Close
+ *	write back and unmap all of the drives (at exit)
+ */
+static void MassStorage_Disk_Close( void )
+{
+    int d;
+
+    MassStorage_Disk_Flush();
+
+    for( d=0 ; d<kSD_NDrives ; d++ ) {
+	if( !disks[d].map ) continue;
+
+	munmap( disks[d].map, disks[d].size );
+	close( disks[d].fd );
+	free( disks[d].dirty );
+	disks[d].map = NULL;
+	disks[d].dirty = NULL;
+	disks[d].fd = -1;
+    }
+}
+
+
+/* MassStorage_Sector_Parse
+ *	"D,T,S" -> drive number and byte offset into the image
+ *	returns 0 if it's good
+ */
+static int MassStorage_Sector_Parse( char * args, int * drive, long * offset )
+{
+    char dc;
+    int track, sector;
+
+    if( sscanf( args, "%c,%d,%d", &dc, &track, &sector ) != 3 ) return -1;
+
+    if( dc >= 'a' && dc <= 'z' ) dc -= 'a' - 'A';
+    if( dc >= 'A' && dc <= 'Z' ) *drive = dc - 'A';
+    else if( dc >= '0' && dc <= '9' ) *drive = dc - '0';
+    else return -1;
+
+    if( track < 0 || sector < 0 || sector >= kSD_SecPerTrack ) return -1;
+
+    *offset = ((long)track * kSD_SecPerTrack + sector) * kSD_SecSize;
+    return 0;
+}
+
+
 static void MassStorage_Sector_Start_Read( char * args )
 {
-	printf( "EMU: SD: Read Sector [%s]\n", args ); 
-	printf( "EMU: SD: unavailable\n" );
+    char strbuf[ (NPerFill * 2) + 16 ];
+    SD_Disk * dk;
+    long offset;
+    int drive;
+    int i;
+
+    secWrite = -1;
+
+    if( MassStorage_Sector_Parse( args, &drive, &offset )
+	|| !(dk = MassStorage_Disk_Open( drive ))
+	|| offset + kSD_SecSize > dk->size ) {
+	printf( "EMU: SD: Read Sector [%s] failed\n", args );
+	MS_QueueStr( "-0:" kStr_Error_CmdFail "\n" );
+	return;
+    }
+
+    /* the guest waits for each answer, so there's room for a whole
+       sector in the queue; just do it all now */
+    if( MS_QueueSpace() < (kSD_SecSize * 2) + 128 + strlen( args )) {
+	MS_QueueStr( "-0:" kStr_Error_CmdFail "\n" );
+	return;
+    }
+
+    MS_QueueStr( "-0:SB=" );
+    MS_QueueStr( args );
+    MS_QueueStr( "\n" );
+
+    for( i=0 ; i<kSD_SecSize ; i += NPerFill ) {
+	memcpy( strbuf, "-0:SS=", 6 );
+	hexencode( strbuf+6, dk->map + offset + i, NPerFill, NULL );
+	strcpy( strbuf + 6 + (NPerFill * 2), "\n" );
+	MS_QueueStr( strbuf );
+    }
+
+    sprintf( strbuf, "-0:SE=%d\n", kSD_SecSize );
+    MS_QueueStr( strbuf );
 }
 
 static void MassStorage_Sector_Start_Write( char * args )
 {
-	printf( "EMU: SD: Write Sector [%s]\n", args ); 
-	printf( "EMU: SD: unavailable\n" );
+    SD_Disk * dk;
+    long offset;
+    int drive;
+
+    secWrite = -1;
+
+    if( MassStorage_Sector_Parse( args, &drive, &offset )
+	|| !(dk = MassStorage_Disk_Open( drive ))
+	|| offset + kSD_SecSize > dk->size ) {
+	printf( "EMU: SD: Write Sector [%s] failed\n", args );
+	MS_QueueStr( "-0:" kStr_Error_NoFileWrite "\n" );
+	return;
+    }
+
+    secDrive = drive;
+    secWrite = offset;
+    MS_QueueStr( "-0:" kStr_CmdOK "\n" );
 }
 
 static void MassStorage_Sector_ConsumeString( char * data )
 {
-	printf( "EMU: SD: consume data [%s]\n", data ); 
+    char buf[64];
+    SD_Disk * dk;
+    unsigned char bytes[ kMaxLine / 2 + 1 ];
+    size_t nBytes, i;
+    unsigned long sum = 0;
+
+    if( secWrite < 0 || data == NULL ) {
+	MS_QueueStr( "-0:" kStr_Error_NoFileWrite "\n" );
+	return;
+    }
+    dk = &disks[ secDrive ];
+
+    /* same as the file version, but into the map */
+    nBytes = MassStorage_Decode( data, bytes, sizeof( bytes ), &sum );
+    for( i=0 ; i<nBytes && secWrite < dk->size ; i++ ) {
+	dk->map[ secWrite ] = bytes[i];
+	if( dk->dirty ) dk->dirty[ secWrite / pageSize ] = 1;
+	secWrite++;
+    }
+
+    sprintf( buf, "-0:Nc=x%02x,x%02x\n", (int)nBytes, HEXCHECK( sum ));
+
+    MS_QueueStr( buf );
 }
 
 static void MassStorage_Sector_Close( void )
 {
-	printf( "EMU: SD: end file.\n" );
-#ifdef NEVER
-	if( fp != NULL ) {
-		fclose( fp );
-		fp = NULL;
-	}
-#endif
+    MassStorage_Disk_Flush();
+    secWrite = -1;
+    MS_QueueStr( "-0:" kStr_CmdOK "\n" );
 }
 
 
@@ -589,13 +1117,25 @@ static void MassStorage_Sector_Close( void )
     ~0:FC	close
     ~0:FS=data	Send string
 
+    ~0:B=n	binary frames of up to n bytes for the next ~0:FR
+		-0:Nb=n
+		(see "binary block mode" above)
+
 	Nc=xx,yy	xx=Nbytes (not nibbles, yy=2's comp invert(sum)+1
 		yy = (~sumVal)+1
     0123
-    ~0:SR=D,T,S	read drive D, Track T, Sector S to buffer
-    ~0:SW=D,T,S	write buffer to drive D, Track T, sector S
-    ~0:SC	close sector file
-    ~0:SS=data	Data from sector read
+    ~0:SR=D,T,S	read drive D, Track T, Sector S
+		-0:SB=D,T,S
+		-0:SS=292929292929292
+		-0:SE=128
+    ~0:SW=D,T,S	write to drive D, Track T, sector S (and on)
+		-0:N2=OK
+		~0:SS=292929292929299A23993
+		-0:Nc=03,99
+		~0:SC
+		-0:N2=OK
+    ~0:SC	flush the drives
+    ~0:SS=data	Data to write
 
  */
 
@@ -627,6 +1167,11 @@ static void MassStorage_ParseLine( char * line )
 	    MS_QueueStr( "-0:" kStr_Size "100" kStr_SizeUnits "\n" );
 	    break;
 
+	/* binary block mode for the next file read */
+	case( 'B' ):
+	    MassStorage_Binary_Request( line+5 );
+	    break;
+
 	/* Path operations */
 	case( 'P' ):
 	    switch( line[4] ) {
@@ -721,6 +1266,7 @@ void MassStorage_TX( byte ch )
     char lba[2] = { '\0', '\0' };
 
     /* printf( "EMU: SD: read 0x%02x\n\r", ch ); */
+    z80stats.storeout++;
 
     if( ch == '\r' || ch == '\n' || ch == '\0' )
     {
@@ -750,6 +1296,7 @@ byte MassStorage_RX( void )
     MassStorage_FillCheck();
 
     /* then pop something off (if applicable) */
+    if( MS_QueueAvailable() ) z80stats.storein++;
     return MS_QueuePop();
 }
 
@@ -766,7 +1313,7 @@ byte MassStorage_Status( void )
     /* see if there's more to go into the queue */
     MassStorage_FillCheck();
 
-    if( bufPtr >= 0 ) {
+    if( MS_QueueAvailable() ) {
 	sts |= kPRS_RxDataReady; /* data is available to read */
     }
 
@@ -0,0 +1,241 @@
+#!/usr/bin/env python3
+#
+# bastest.py  --  check the host-side BASIC tokenizer against the ROM
+#
+#   Starts the emulator on a pty in a scratch directory laid out like
+#   the SD card (LL/ROM/BASIC32.ROM, LL/BAS/...), and for each program
+#   uses the console's ESC} commands to put it into the guest:
+#
+#	type  -  typed in, so the ROM's own CRUNCH tokenizes it
+#	load  -  tokenized on the host (Basic_Crunch) and poked into RAM
+#	again -  the "load" listing, saved and loaded back in
+#
+#   After each one it saves the program back out (Basic_ReadProgram and
+#   Basic_ProgramList) and asks BASIC for FRE(0).  "type" and "load"
+#   must give the same listing and size - the host tokenizes like the
+#   ROM - and so must "load" and "again": crunch -> list -> crunch comes
+#   back the same.
+#
+#   Lines that can't be typed in (an '@' kills the line, '_' rubs out,
+#   and the ROM only takes 72 characters) are left out of the first
+#   comparison; "load" and "again" get the whole file.
+#
+#	python3 utils/bastest.py [-e emulator] [file.bas ...]
+#
+#   (the emulator defaults to bin/llichen80emu, the programs to
+#   ../prg/BASIC/*.bas)  Exits 0 if it all checks out.
+#
+#   2026-10-19
+
+import glob
+import os
+import pty
+import re
+import select
+import shutil
+import signal
+import sys
+import tempfile
+import time
+
+
+ESC = "\x1b"
+BEL = "\x07"
+ROM = "basic32.rom"
+TYPEMAX = 72		# GETLIN's buffer
+
+failures = 0
+
+
+def check(what, ok, detail=""):
+    global failures
+    print("%-40s %s%s" % (what, "ok" if ok else "FAILED",
+                          "" if ok or not detail else "  (" + detail + ")"))
+    if not ok:
+        failures += 1
+
+
+class Console:
+    """the emulator, on the other end of a pty"""
+
+    def __init__(self, argv, cwd):
+        self.pid, self.fd = pty.fork()
+        if self.pid == 0:
+            try:
+                os.chdir(cwd)
+                os.execvp(argv[0], argv)
+            finally:
+                os._exit(127)
+        self.text = ""
+
+    def send(self, s):
+        os.write(self.fd, s.encode("latin-1"))
+
+    def command(self, cmd):
+        """an ESC} command, as if typed at the console"""
+        self.send(ESC + "}" + cmd + BEL)
+
+    def expect(self, pattern, secs=30):
+        """wait for 'pattern' in the output; returns the match, and
+           drops everything up to it"""
+        rx = re.compile(pattern)
+        end = time.time() + secs
+        while True:
+            m = rx.search(self.text)
+            if m:
+                self.text = self.text[m.end():]
+                return m
+            left = end - time.time()
+            if left <= 0:
+                raise IOError("timed out waiting for %r" % pattern)
+            r, _, _ = select.select([self.fd], [], [], left)
+            if r:
+                try:
+                    data = os.read(self.fd, 65536)
+                except OSError:
+                    data = b""
+                if not data:
+                    raise EOFError("the emulator went away")
+                self.text += data.decode("latin-1").replace("\r", "")
+
+    def free(self):
+        """FRE(0), once everything before it has gone in"""
+        self.send('PRINT "FRE=";FRE(0)\r')
+        return int(self.expect(r"FRE= *(-?\d+) *\n").group(1))
+
+    def close(self):
+        os.kill(self.pid, signal.SIGKILL)
+        os.waitpid(self.pid, 0)
+        os.close(self.fd)
+
+
+def new(con):
+    """NEW, and wait for its Ok - BASIC's break check eats anything
+       typed while a statement runs, and a load goes straight into RAM
+       so mustn't be followed by a NEW still in the typeahead"""
+    con.send("NEW\r")
+    con.expect(r"NEW\nOk\n")
+
+
+def save(con, name):
+    """save the guest's program to BAS/name; returns its line count"""
+    con.command("save BAS/" + name)
+    m = con.expect(re.escape("BAS/" + name) + r": (Saved (\d+) lines|[^\n]*)\n")
+    if m.group(2) is None:
+        raise IOError("save: " + m.group(1))
+    return int(m.group(2))
+
+
+def load(con, name):
+    """load BAS/name, tokenized on the host"""
+    con.command("load BAS/" + name)
+    m = con.expect(re.escape("BAS/" + name) + r": ([^\n]*)\n")
+    if not m.group(1).startswith("Loaded"):
+        raise IOError("load: " + m.group(1))
+    con.expect(r"clear\nOk\n")	# it types this in after
+
+
+def typable(line):
+    return "@" not in line and "_" not in line and len(line) <= TYPEMAX
+
+
+def one(con, bas, path):
+    base = os.path.basename(path)
+    name = os.path.splitext(base)[0][:8].upper()
+    shutil.copy(path, os.path.join(bas, name + ".BAS"))
+
+    with open(path, "rb") as f:
+        lines = f.read().decode("latin-1").splitlines()
+    typed = [l for l in lines if typable(l)]
+    with open(os.path.join(bas, name + ".TYP"), "wb") as f:
+        f.write("".join(l + "\n" for l in typed).encode("latin-1"))
+    skipped = len(lines) - len(typed)
+
+    try:
+        # the ROM tokenizes what can be typed
+        new(con)
+        con.command("type BAS/%s.TYP" % name)
+        rom_free = con.free()
+        rom_lines = save(con, name + ".ROM")
+
+        # we tokenize the same
+        new(con)
+        load(con, name + ".TYP")
+        host_free = con.free()
+        host_lines = save(con, name + ".HST")
+
+        # then all of it, and our own listing of that back in again
+        new(con)
+        load(con, name + ".BAS")
+        all_free = con.free()
+        save(con, name + ".ALL")
+
+        new(con)
+        load(con, name + ".ALL")
+        again_free = con.free()
+        save(con, name + ".RT")
+
+    except (IOError, EOFError) as e:
+        check(base, False, str(e))
+        return
+
+    def text(ext):
+        with open(os.path.join(bas, name + ext), "rb") as f:
+            return f.read()
+
+    check("%s: %d lines, like the ROM" % (base, host_lines),
+          host_lines == rom_lines and text(".HST") == text(".ROM")
+          and host_free == rom_free,
+          "%d lines, FRE %d; the ROM has %d lines, FRE %d"
+          % (host_lines, host_free, rom_lines, rom_free))
+    if skipped:
+        print("  (%d lines can't be typed in)" % skipped)
+    check("  crunch -> list -> crunch",
+          text(".RT") == text(".ALL") and again_free == all_free,
+          "FRE %d, was %d" % (again_free, all_free))
+
+
+def main(argv):
+    here = os.path.dirname(os.path.abspath(argv[0]))
+    top = os.path.join(here, "..", "..")
+    emulator = os.path.join(here, "..", "bin", "llichen80emu")
+
+    args = argv[1:]
+    if args[:1] == ["-e"]:
+        emulator = os.path.abspath(args[1])
+        args = args[2:]
+    files = args or sorted(glob.glob(os.path.join(top, "prg", "BASIC", "*.bas")))
+
+    # an SD card with just the ROM on it
+    card = tempfile.mkdtemp(prefix="bastest")
+    bas = os.path.join(card, "LL", "BAS")
+    os.makedirs(os.path.join(card, "LL", "ROM"))
+    os.makedirs(bas)
+    shutil.copy(os.path.join(top, "prg", "ROMs", ROM),
+                os.path.join(card, "LL", "ROM", "BASIC32.ROM"))
+
+    con = Console([emulator], card)
+    try:
+        con.expect(r"Memory top\?", 10)
+        con.send("\r")
+        con.expect(r"Ok\n", 10)
+
+        for path in files:
+            if os.path.getsize(path) == 0:
+                print("%-40s skipped (empty)" % os.path.basename(path))
+                continue
+            one(con, bas, path)
+
+    except (IOError, EOFError) as e:
+        check("starting BASIC", False, str(e))
+
+    finally:
+        con.close()
+        shutil.rmtree(card)
+
+    print("%d failed" % failures if failures else "all ok")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
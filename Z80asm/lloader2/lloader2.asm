@@ -758,6 +758,10 @@ fBasic56:
 DoBoot:
 	ld	hl, #cmd_bootfile
 DoBootB:
+	push	hl		; save the file request
+	call	MSBinaryMode	; can the drive send us binary frames?
+	pop	hl
+	push	af		; a=0 if it can
 	call	SendSDCommand
 
 
@@ -767,12 +771,27 @@ DoBootB:
 
 	in	a, (SDStatus)
 	and	#DataReady
-	jr	nz, hexload	; make sure we have something loaded
+	jr	nz, fileload	; make sure we have something loaded
+	pop	af
 	ld	hl, #str_nofile	; print out an error message
 	call	Print
 
 	xor	a
 	ret
+
+fileload:
+	pop	af
+	cp	#0x00		; binary frames?
+	jr	nz, hexload	; nope. the old way.
+	call	MSBinaryLoad	; yep. pull them all in
+	cp	#0x00		; all of them good?
+	jr	z, LoadDone	; yep.
+
+	ld	hl, #str_badload ; nope. don't run half a file
+	call	Print
+
+	xor	a
+	ret
 	
 
 hexload:
@@ -888,6 +907,9 @@ MSToken_FileBegin	= 0x21	;  B
 MSToken_FileEnd		= 0x22	;  E
 MSToken_FileString	= 0x23	;  S
 
+MSToken_Note		= 0x30	; N  first byte of a NOTE token
+MSToken_NoteBinary	= 0x31	;  b
+
 
 ; MSGetHeader
 ;	scans through to the current character being '='
@@ -942,6 +964,8 @@ MSREquals:
 	jr	z, MSRP
 	cp	#'F		; file stuff
 	jr	z, MSRF
+	cp	#'N		; notifications
+	jr	z, MSRN
 	ld	a, #MSToken_Unknown
 	ret
 
@@ -986,6 +1010,16 @@ MSRF:
 	ld	a, #MSToken_Unknown
 	ret
 
+MSRN:
+	ld	a, b		; check the subtoken
+
+	ld	c, #MSToken_NoteBinary
+	cp	#'b		; binary frame size
+	jr 	z, MSRetC
+
+	ld	a, #MSToken_Unknown
+	ret
+
 MSRetC:
 	ld	a, c		; token code is in 'C'
 	ret
@@ -1080,6 +1114,122 @@ __deConsume:
 	jr	__deLoop
 	
 
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+; Binary block transfers
+;	~0:B=256 asks the drive to send the next file as binary frames:
+;		SOH  n  <n bytes, n=0 means 256>  checksum
+;	then an EOT, then the usual -0:FE= line.  A whole frame is there
+;	by the time we see its SOH, so we can INIR it in one go.
+;	The Arduino SDDrive doesn't answer ~0:B, so we stay with hex.
+
+MS_SOH	= 0x01
+MS_EOT	= 0x04
+
+; MSBinaryMode
+;	ask the drive for binary frames
+;	returns a=0 if it agreed, nonzero if we need to use hex lines
+MSBinaryMode:
+	ld	hl, #cmd_binary
+	call	SendSDCommand
+
+	; give the drive a moment to answer
+	ld	bc, #0x0000
+__mbmWait:
+	in	a, (SDStatus)
+	and	#DataReady
+	jr	nz, __mbmReply	; got something
+	dec	bc
+	ld	a, b
+	or	c
+	jr	nz, __mbmWait
+	inc	a		; nothing.  a=1
+	ret
+
+__mbmReply:
+	call	MSGetHeader	; -0:Nb= ?
+	push	af
+	call	MSSkipToNewline	; the frame size. we asked for 256 anyway.
+	pop	af
+	cp	#MSToken_NoteBinary
+	ret	nz		; didn't understand us
+	xor	a		; a=0, binary it is
+	ret
+
+; MSBinaryLoad
+;	read in a binary framed file to (hl)
+;	skips anything before the first frame (the FB= line)
+;	returns with hl just past the data, a=0 if ok, a=1 on a bad checksum
+;	(in which case the rest of the frames are read and thrown away)
+;	or if the data runs out before the end of the frames
+MSBinaryLoad:
+	in	a, (SDStatus)
+	and	#DataReady	; more bytes to read?
+	jp	z, __mblFail	; nope. truncated, or the drive went away
+
+	in	a, (SDData)
+	cp	#MS_SOH		; start of a frame?
+	jr	z, __mblFrame
+	cp	#MS_EOT		; end of the frames?
+	jr	nz, MSBinaryLoad ; nope. header text, skip it
+
+	call	MSSkipToNewline	; the FE= line
+	xor	a
+	ret
+
+__mblFrame:
+	in	a, (SDData)	; byte count (0 = 256)
+	ld	b, a
+	ld	c, #SDData
+	push	hl		; start of the frame
+	push	bc		; and its size
+	inir			; pull it all in
+
+	; add up what we just got
+	pop	bc
+	pop	de
+	xor	a
+__mblSum:
+	ex	de, hl
+	add	a, (hl)
+	inc	hl
+	ex	de, hl
+	djnz	__mblSum
+
+	; adding on the checksum should get us to zero
+	ld	d, a
+	in	a, (SDData)
+	add	a, d
+	jr	z, MSBinaryLoad	; good frame, next!
+
+	ld	hl, #str_badframe
+	call	Print
+
+	; skip the rest, so the drive is back at the start of a line
+__mblDrain:
+	in	a, (SDStatus)
+	and	#DataReady	; more bytes to read?
+	jr	z, __mblFail	; nope.
+	in	a, (SDData)
+	cp	#MS_EOT		; end of the frames?
+	jr	z, __mblEnd
+	cp	#MS_SOH		; another frame?
+	jr	nz, __mblDrain	; nope. skip it
+
+	in	a, (SDData)	; byte count (0 = 256)
+	ld	b, a
+__mblSkip:
+	in	a, (SDData)	; throw away the data
+	djnz	__mblSkip
+	in	a, (SDData)	; and its checksum
+	jr	__mblDrain
+
+__mblEnd:
+	call	MSSkipToNewline	; the FE= line
+__mblFail:
+	ld	a, #1
+	ret
+
+
 ; DecodeCatFromSD
 ;	take the data coming in, and based on the tag, do something:
 ;
@@ -1213,6 +1363,15 @@ str_line:
 cmd_directory:
 	.asciz	"\n~0:PL /\n"
 
+cmd_binary:
+	.asciz	"\n~0:B=256\n"
+
+str_badframe:
+	.asciz	"Bad checksum in binary frame.\n\r"
+
+str_badload:
+	.asciz	"Load failed. Not restarting.\n\r"
+
 cmd_info:
 	.asciz	"\n~0:I\n"
 
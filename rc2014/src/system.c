@@ -45,6 +45,9 @@ void system_init( z80info * z80 )
 /* this gets called before each opcode is run. */
 void system_poll( z80info * z80 )
 {
+    /* keep the cached host clock fresh */
+    TimeSource_Poll();
+
     /* poll the buffered console handler */
     FromConsoleBuffered_PollConsole();
 
@@ -66,7 +69,7 @@ void system_poll( z80info * z80 )
 /* Port IO */
 
 
-byte HandleEmulationSignature( void ) { return 'A'; }
+byte HandleEmulationSignature( void ) { return stats_guestread( 'A' ); }
 
 
 /* Z80 "OUT" instruction calls this if EXTERNAL_IO is defined */
@@ -151,6 +154,13 @@ word mem_read( z80info * z80, word addr )
 }
 
 
+/* the debugger and tracers look at Z80 memory with this - it's not counted */
+word mem_peek( z80info * z80, word addr )
+{
+    return ( regions_peek( mems, addr ) );
+}
+
+
 /* Z80 memory write calls this to write a byte */
 word mem_write( z80info * z80, word addr, byte val )
 {
@@ -77,6 +77,15 @@ int Filter_ToConsoleAvailable()
     return 1;
 }
 
+// Filter_ToConsoleTake
+//  take everything in the ToConsole buffer at once
+const byte * Filter_ToConsoleTake( size_t * len )
+{
+    *len = (size_t)(tcPos + 1);
+    tcPos = -1;
+    return (const byte *)ToConsoleBuffer;
+}
+
 // Filter_ToConsoleGet
 //  get something from the ToConsole buffer
 byte Filter_ToConsoleGet()
@@ -214,6 +223,16 @@ void Filter_ToConsole( byte data )
     }
 }
 
+/* a run of them, one at a time */
+void Filter_ToConsoleBuf( const byte * data, size_t len )
+{
+    size_t i;
+
+    for( i=0 ; i<len ; i++ ) {
+	Filter_ToConsole( data[i] );
+    }
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 // to remote buffer stuff 
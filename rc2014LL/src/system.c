@@ -82,6 +82,9 @@ void system_poll( z80info * z80 )
     /* NMI -> call 0x0066 */
     /* INTR -> call 0x0038 (IM1) */
 
+    /* keep the cached host clock fresh */
+    TimeSource_Poll();
+
     FromConsoleBuffered_PollConsole();
 
     if( FromConsoleBuffer_Available() ) 
@@ -107,7 +110,7 @@ void myHandlePortWrite00( const byte data )
 }
 
 
-byte HandleEmulationSignature( void ) { return 'B'; }
+byte HandleEmulationSignature( void ) { return stats_guestread( 'B' ); }
 
 /* ********************************************************************** */
 
@@ -180,6 +183,13 @@ word mem_read( z80info * z80, word addr )
 }
 
 
+/* the debugger and tracers look at Z80 memory with this - it's not counted */
+word mem_peek( z80info * z80, word addr )
+{
+    return ( regions_peek( mems, addr ) );
+}
+
+
 /* Z80 memory write calls this to write a byte */
 word mem_write( z80info * z80, word addr, byte val )
 {
@@ -13,7 +13,7 @@
 #include <dirent.h>
 #include <string.h>
 #include "defs.h"
-#include "storage.h"
+#include "xstorage.h"
 #include "rc2014.h"	/* common rc2014 emulator headers */
 #include "../Arduino/SDDrive/Strings.h"
 
@@ -524,6 +524,11 @@ static void MassStorage_File_Close( void )
  * Sectors
  */
 
+/*
+    Only stubbed here.  This copy isn't in the rc2014LL build or on any
+    port; the RC2014-LL's SD drive is emulated by Llichen80, whose
+    xstorage.c backs these with mapped disk images (MASS_DRV/DISK_x.IMG).
+*/
 
 static void MassStorage_Sector_Start_Read( char * args )
 {
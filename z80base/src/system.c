@@ -140,6 +140,13 @@ word mem_read( z80info * z80, word addr )
 }
 
 
+/* the debugger and tracers look at Z80 memory with this - it's not counted */
+word mem_peek( z80info * z80, word addr )
+{
+    return ( z80->mem[ addr ] );
+}
+
+
 /* Z80 memory write calls this to write a byte */
 word mem_write( z80info * z80, word addr, byte val )
 {
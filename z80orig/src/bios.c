@@ -18,6 +18,8 @@
 #include <sys/types.h>
 #include "cpmdisc.h"
 #include "defs.h"
+#include "callgraph.h"
+#include "stats.h"
 
 #ifdef macintosh
 #include <stat.h>
@@ -25,6 +27,39 @@
 #include <sys/stat.h>
 #endif
 
+/* Disc images are mmap'd where we can, so that a sector read or write
+   is a memcpy to or from the map rather than an fseek + fread/fwrite.
+   -DNO_MMAP_DISCS goes back to stdio. */
+#if defined UNIX && !defined NO_MMAP_DISCS
+#	define MMAP_DISCS
+#	include <unistd.h>
+#	include <sys/mman.h>
+#endif
+
+/* If a drive's image file is a directory instead, it's presented as a
+   CP/M drive with the same geometry; see hostdisc.c.  -DNO_HOST_DISCS
+   turns that off. */
+#if defined UNIX && !defined NO_HOST_DISCS
+#	define HOST_DISCS
+#	include "hostdisc.h"
+#endif
+
+/* With host directory drives, the BDOS file calls for the drives named
+   in $CPM_BDOS_TRAP (e.g. "CD") are done on the host files by name
+   instead of a sector at a time through the BDOS; see hostdisc_bdos().
+   The BDOS's entry jump goes through a stub that does a BIOS call
+   first.  -DNO_BDOS_TRAP leaves the BDOS alone. */
+#if defined HOST_DISCS && !defined NO_BDOS_TRAP
+#	define BDOS_TRAP
+#endif
+
+/* When written sectors get pushed out to the image files (mmap only):
+	-DDISC_FLUSH_WRITE	after every sector write
+	-DDISC_FLUSH_SECS=n	when writing, if it's been n seconds
+	otherwise		only at warm boot (closeall) and finish()
+   Either way the data is in the OS's hands as soon as it's written,
+   so this only matters if the machine itself goes down. */
+
 /* definition of: extern unsigned char	cpm_array[]; */
 #include "cpm.c"
 
@@ -71,6 +106,10 @@
 /* just a marker for future expansion */
 #define END_OF_BIOS	(TIMEBUF + TIMEBUFSIZE)
 
+/* BDOS_TRAP's stub: LD A,BDOSCALL / OUT (0FFH),A / JP <BDOS's entry> */
+#define TRAPSTUB	END_OF_BIOS
+#define BDOSCALL	24	/* the BIOS call it makes */
+
 
 /* ST-506 HD sector info (floppy defs are in cpmdisc.h for makedisc.c) */
 #define	HDSECTORSPERTRACK	64
@@ -96,6 +135,122 @@
 /* forward declarations: */
 static void seldisc(z80info *z80);
 
+/* the image file for drive 'd' - 'buf' needs 16 bytes */
+static char *
+drivepath(int d, char *buf)
+{
+	strcpy(buf, d < NUMHDISCS ? "drives/A-Hdrive" : "A-drive");
+	*buf += d;		/* set the 1st letter to the drive name */
+	return buf;
+}
+
+#ifdef HOST_DISCS
+#	define HOSTDISC(z80, d)	((z80)->drivehost[d] != NULL)
+
+/* pull the geometry a host directory drive needs out of a DPB */
+static void
+readdpb(z80info *z80, word dpb, hostgeom *g)
+{
+	int al = (MEM(dpb + 9) << 8) | MEM(dpb + 10);
+
+	g->spt = MEM(dpb) | (MEM(dpb + 1) << 8);
+	g->bsh = MEM(dpb + 2);
+	g->exm = MEM(dpb + 4);
+	g->dsm = MEM(dpb + 5) | (MEM(dpb + 6) << 8);
+	g->drm = MEM(dpb + 7) | (MEM(dpb + 8) << 8);
+	g->off = MEM(dpb + 13) | (MEM(dpb + 14) << 8);
+
+	/* AL0/AL1 have a bit set, from the top, per directory block */
+	for (g->dirblocks = 0; g->dirblocks < 16 &&
+			(al & (0x8000 >> g->dirblocks)); g->dirblocks++)
+		;
+}
+
+/* drive 'd' if its image is a directory, opening it if need be */
+static hostdisc *
+hostdrive(z80info *z80, int d, const char *path)
+{
+	struct stat statbuf;
+	hostgeom g;
+
+	if (z80->drivehost[d] != NULL || stat(path, &statbuf) != 0 ||
+			!S_ISDIR(statbuf.st_mode))
+		return z80->drivehost[d];
+
+	readdpb(z80, d < NUMHDISCS ? HDPBLOCK : DPBLOCK, &g);
+	z80->drivehost[d] = hostdisc_open(path, &g);
+
+	if (z80->drivehost[d] == NULL)
+		fprintf(stderr, "seldisc(): Cannot use directory '%s'!\r\n", path);
+	return z80->drivehost[d];
+}
+#else
+#	define HOSTDISC(z80, d)	FALSE
+#endif
+
+
+#ifdef MMAP_DISCS
+
+/* msync whatever has been written to a drive since the last time */
+static void
+flushdisc(z80info *z80, int drive)
+{
+	long pg = sysconf(_SC_PAGESIZE);
+	long lo = z80->drivedirtylo[drive];
+	long hi = z80->drivedirtyhi[drive];
+
+	if (z80->drivemap[drive] == NULL || lo > hi)
+		return;
+
+	lo -= lo % pg;		/* msync wants a page-aligned start */
+
+	if (msync(z80->drivemap[drive] + lo, hi - lo, MS_SYNC) != 0)
+		fprintf(stderr, "flushdisc(): msync failure on drive %d!\r\n",
+			drive);
+
+	z80->drivedirtylo[drive] = 1;
+	z80->drivedirtyhi[drive] = 0;
+}
+
+/* note that a drive has been written to, and maybe flush it */
+static void
+dirtydisc(z80info *z80, int drive, long lo, long hi)
+{
+#ifdef DISC_FLUSH_SECS
+	static time_t lastflush = 0;
+	time_t now;
+#endif
+
+	if (z80->drivedirtylo[drive] > z80->drivedirtyhi[drive])
+	{
+		z80->drivedirtylo[drive] = lo;
+		z80->drivedirtyhi[drive] = hi;
+	}
+	else
+	{
+		if (lo < z80->drivedirtylo[drive])
+			z80->drivedirtylo[drive] = lo;
+		if (hi > z80->drivedirtyhi[drive])
+			z80->drivedirtyhi[drive] = hi;
+	}
+
+#if defined DISC_FLUSH_WRITE
+	flushdisc(z80, drive);
+#elif defined DISC_FLUSH_SECS
+	now = time(NULL);
+	if (now - lastflush >= DISC_FLUSH_SECS)
+	{
+		int i;
+
+		for (i = 0; i < MAXDISCS; i++)
+			flushdisc(z80, i);
+		lastflush = now;
+	}
+#endif
+}
+
+#endif	/* MMAP_DISCS */
+
 
 static void
 closeall(z80info *z80)
@@ -104,6 +259,21 @@ closeall(z80info *z80)
 
 	for (i = 0; i < MAXDISCS; i++)
 	{
+#ifdef HOST_DISCS
+		if (z80->drivehost[i] != NULL)
+		{
+			hostdisc_close(z80->drivehost[i]);
+			z80->drivehost[i] = NULL;
+		}
+#endif
+#ifdef MMAP_DISCS
+		if (z80->drivemap[i] != NULL)
+		{
+			flushdisc(z80, i);
+			munmap(z80->drivemap[i], z80->drivemaplen[i]);
+			z80->drivemap[i] = NULL;
+		}
+#endif
 		if (z80->drives[i] != NULL)
 		{
 			fclose(z80->drives[i]);
@@ -141,6 +311,28 @@ warmboot(z80info *z80)
 	SETMEM(0x0006, ((BDOS+6) & 0xFF));
 	SETMEM(0x0007, ((BDOS+6) >> 8));
 
+#ifdef BDOS_TRAP
+	/* send the BDOS's own entry jump through the stub, so that 0006
+	   still says where the TPA ends */
+	if (z80->bdostraps && MEM(BDOS + 6) == 0xC3)
+	{
+		SETMEM(TRAPSTUB, 0x3E);		/* LD A,BDOSCALL */
+		SETMEM(TRAPSTUB + 1, BDOSCALL);
+		SETMEM(TRAPSTUB + 2, 0xD3);	/* OUT (0FFH),A */
+		SETMEM(TRAPSTUB + 3, 0xFF);
+		SETMEM(TRAPSTUB + 4, 0xC3);	/* JP <where it went> */
+		SETMEM(TRAPSTUB + 5, MEM(BDOS + 7));
+		SETMEM(TRAPSTUB + 6, MEM(BDOS + 8));
+		SETMEM(BDOS + 7, TRAPSTUB & 0xFF);
+		SETMEM(BDOS + 8, TRAPSTUB >> 8);
+	}
+
+	/* the BDOS starts over, and so does what we know of it */
+	z80->bdosdrive = z80->drive;
+	z80->bdosdma = DEFAULTBUF;
+	z80->bdossearch = -1;
+#endif
+
 	/* fake BIOS entry points */
 	for (i = 0; i < NENTRY; i++)
 	{
@@ -279,6 +471,19 @@ static void
 boot(z80info *z80)
 {
 	z80->drive = 0;
+
+#ifdef BDOS_TRAP
+	{
+		const char *p = getenv("CPM_BDOS_TRAP");
+
+		z80->bdostraps = 0;
+		z80->bdosuser = 0;
+		for (; p != NULL && *p != '\0'; p++)
+			if (toupper(*p) >= 'A' && toupper(*p) < 'A' + MAXDISCS)
+				z80->bdostraps |= 1 << (toupper(*p) - 'A');
+	}
+#endif
+
 	warmboot(z80);
 }
 
@@ -357,11 +562,9 @@ home(z80info *z80)
 static void
 seldisc(z80info *z80)
 {
-	char hdrivebuf[] = "drives/A-Hdrive";
-	char drivebuf[] = "A-drive";
-	char *drivestr = C < NUMHDISCS ? hdrivebuf : drivebuf;
+	char drivebuf[16];
+	char *drivestr = drivepath(C, drivebuf);
 
-	*drivestr += C;		/* set the 1st letter to the drive name */
 	H = 0;
 	L = 0;
 
@@ -372,7 +575,12 @@ seldisc(z80info *z80)
 		return;
 	}
 
+#ifdef HOST_DISCS
 	if (z80->drives[C] == NULL)
+		hostdrive(z80, C, drivestr);
+#endif
+
+	if (z80->drives[C] == NULL && !HOSTDISC(z80, C))
 	{
 		struct stat statbuf;
 		long secs;
@@ -419,6 +627,39 @@ seldisc(z80info *z80)
 
 		z80->drives[C] = fp;
 		z80->drivelen[C] = secs * SECTORSIZE;
+
+#ifdef MMAP_DISCS
+		{
+			/* map the whole disc, even past the end of the file, so
+			   growing it is just an ftruncate; pages past the end
+			   aren't touched until the file covers them */
+			long maplen = SECTORSIZE * (long)(C < NUMHDISCS ?
+				HDSECTORSPERTRACK * HDTRACKSPERDISC :
+				SECTORSPERTRACK * TRACKSPERDISC);
+			void *map;
+
+			fflush(fp);
+			if (maplen < z80->drivelen[C])
+				maplen = z80->drivelen[C];
+
+			map = mmap(NULL, maplen, PROT_READ | PROT_WRITE,
+					MAP_SHARED, fileno(fp), 0);
+
+			if (map == MAP_FAILED)
+			{
+				/* stdio will still do */
+				fprintf(stderr, "seldisc(): Cannot mmap '%s'!\r\n",
+						drivestr);
+			}
+			else
+			{
+				z80->drivemap[C] = map;
+				z80->drivemaplen[C] = maplen;
+				z80->drivedirtylo[C] = 1;
+				z80->drivedirtyhi[C] = 0;
+			}
+		}
+#endif
 	}
 
 	z80->drive = C;
@@ -481,6 +722,15 @@ rdsector(z80info *z80)
 	FILE *fp = z80->drives[drive];
 	long len = z80->drivelen[drive];
 
+#ifdef HOST_DISCS
+	if (HOSTDISC(z80, drive))
+	{
+		A = hostdisc_read(z80->drivehost[drive], offset / SECTORSIZE,
+				&(z80->mem[z80->dma]));
+		return;
+	}
+#endif
+
 	if (fp == NULL)
 	{
 		fprintf(stderr, "rdsector(): file/drive %d not open!\r\n",
@@ -496,6 +746,24 @@ rdsector(z80info *z80)
 	    return;
 	}
 
+#ifdef MMAP_DISCS
+	if (z80->drivemap[drive] != NULL)
+	{
+		if (offset < 0 || offset + SECTORSIZE > len)
+		{
+			fprintf(stderr, "rdsector(): bad offset=0x%lX!\r\n",
+				offset);
+			A = 1;
+			return;
+		}
+
+		memcpy(&(z80->mem[z80->dma]), z80->drivemap[drive] + offset,
+			SECTORSIZE);
+		A = 0;
+		return;
+	}
+#endif
+
 	if (fseek(fp, offset, SEEK_SET) != 0)
 	{
 		fprintf(stderr, "rdsector(): fseek failure offset=0x%lX!\r\n",
@@ -526,6 +794,15 @@ wrsector(z80info *z80)
 	FILE *fp = z80->drives[drive];
 	long len = z80->drivelen[drive];
 
+#ifdef HOST_DISCS
+	if (HOSTDISC(z80, drive))
+	{
+		A = hostdisc_write(z80->drivehost[drive], offset / SECTORSIZE,
+				&(z80->mem[z80->dma]));
+		return;
+	}
+#endif
+
 	if (fp == NULL)
 	{
 		fprintf(stderr, "wrsector(): file/drive %d not open!\r\n",
@@ -534,6 +811,46 @@ wrsector(z80info *z80)
 		return;
 	}
 
+#ifdef MMAP_DISCS
+	if (z80->drivemap[drive] != NULL)
+	{
+		byte *map = z80->drivemap[drive];
+
+		if (offset < 0 || offset + SECTORSIZE > z80->drivemaplen[drive])
+		{
+			fprintf(stderr, "wrsector(): bad offset=0x%lX!\r\n",
+				offset);
+			A = 1;
+			return;
+		}
+
+		if (offset + SECTORSIZE > len)
+		{
+			/* grow the file (sparse), then fill the gap the way
+			   the stdio version does */
+			if (ftruncate(fileno(fp), offset + SECTORSIZE) != 0)
+			{
+				fprintf(stderr, "wrsector(): write failure!\r\n");
+				A = 1;
+				return;
+			}
+
+			if (offset > len)
+			{
+				memset(map + len, 0xE5, offset - len);
+				dirtydisc(z80, drive, len, offset);
+			}
+
+			z80->drivelen[drive] = offset + SECTORSIZE;
+		}
+
+		memcpy(map + offset, &(z80->mem[z80->dma]), SECTORSIZE);
+		dirtydisc(z80, drive, offset, offset + SECTORSIZE);
+		A = 0;
+		return;
+	}
+#endif
+
 	if (len && offset > len)
 	{
 		char buf[SECTORSIZE];
@@ -587,9 +904,10 @@ wrsector(z80info *z80)
 static void
 secttran(z80info *z80)
 {
-	if (z80->drive < NUMHDISCS)
+	if (z80->drive < NUMHDISCS || HOSTDISC(z80, z80->drive))
 	{
-		/* simple sector translation for hard disc */
+		/* simple sector translation for hard disc, and for host
+		   directories, where there's nothing to gain from skew */
 		HL = BC + 1;
 
 		if (BC >= HDSECTORSPERTRACK)
@@ -818,6 +1136,7 @@ closeunix(z80info *z80)
 static void
 finish(z80info *z80)
 {
+	closeall(z80);
 	z_resetterm();
 	exit(0);
 }
@@ -861,6 +1180,100 @@ dotime(z80info *z80)
     SETMEM(HL + 4, ((t->tm_sec / 10) << 4) + (t->tm_sec % 10));
 }
 
+#ifdef BDOS_TRAP
+/*  Every BDOS call comes through here first, from the stub the BDOS's
+    entry jump was pointed at.  The calls that change the drive, DMA
+    address or user are watched on their way through; the file calls
+    for the drives in $CPM_BDOS_TRAP are done here and return straight
+    to the caller.  Anything else carries on into the BDOS.
+ */
+static void
+bdostrap(z80info *z80)
+{
+	int fn = C;
+	int d;
+	byte ret;
+	hostdisc *hd;
+	char drivebuf[16];
+
+	/* only from the stub, not from BIOS entry 24 */
+	if (PC != TRAPSTUB + 4)
+		return;
+
+	switch (fn)
+	{
+	case 13:			/* reset disc system */
+		z80->bdosdrive = 0;
+		z80->bdosdma = DEFAULTBUF;
+		return;
+
+	case 14:			/* select disc */
+		z80->bdosdrive = E & 0x0F;
+		return;
+
+	case 26:			/* set DMA address */
+		z80->bdosdma = DE;
+		return;
+
+	case 32:			/* get/set user code */
+		if (E != 0xFF)
+			z80->bdosuser = E & 0x0F;
+		return;
+
+	case 18:			/* search next - goes where the first one did */
+		if (z80->bdossearch < 0 || z80->bdosdma > 0x10000L - 128)
+			return;
+		hd = z80->drivehost[z80->bdossearch];
+		if (hd == NULL)
+			return;
+		hostdisc_bdos(hd, fn, z80->bdosuser, &z80->mem[z80->bdosdma],
+				&z80->mem[z80->bdosdma], &ret);
+		break;
+
+	case 15: case 16: case 17: case 19: case 20: case 21: case 22:
+	case 23: case 30: case 33: case 34: case 35: case 36: case 40:
+		if (fn == 17)
+			z80->bdossearch = -1;
+
+		/* the FCB and DMA buffer mustn't run off the end */
+		if (DE > 0x10000L - 36 || z80->bdosdma > 0x10000L - 128)
+			return;
+
+		d = MEM(DE);
+		d = (d == 0 || d == '?') ? z80->bdosdrive : d - 1;
+
+		if (d >= MAXDISCS || !(z80->bdostraps & (1 << d)))
+			return;
+		if ((hd = hostdrive(z80, d, drivepath(d, drivebuf))) == NULL)
+			return;
+
+		if (!hostdisc_bdos(hd, fn, z80->bdosuser, &z80->mem[DE],
+				&z80->mem[z80->bdosdma], &ret))
+			return;
+		if (fn == 17)
+			z80->bdossearch = d;
+		break;
+
+	default:
+		return;
+	}
+
+	/* records read and written count as storage */
+	if (ret == 0 && (fn == 20 || fn == 33))
+		z80stats.storein += SECTORSIZE;
+	else if (ret == 0 && (fn == 21 || fn == 34 || fn == 40))
+		z80stats.storeout += SECTORSIZE;
+
+	/* done - return to the caller as the BDOS would */
+	A = L = ret;
+	B = H = 0;
+	PC = MEM(SP) | (MEM(SP + 1) << 8);
+	SP += 2;
+	if (z80->callgraph)
+		callgraph_ret(z80->callgraph, z80);
+}
+#endif
+
 void
 bios(z80info *z80, int fn)
 {
@@ -889,7 +1302,10 @@ bios(z80info *z80, int fn)
 		wrunix,		/* 20 */
 		closeunix,	/* 21 */
 		finish,		/* 22 */
-		dotime		/* 23 */
+		dotime,		/* 23 */
+#ifdef BDOS_TRAP
+		bdostrap	/* 24 */
+#endif
 	};
 
 	if (fn < 0 || fn >= sizeof bioscall / sizeof *bioscall)
@@ -899,5 +1315,11 @@ bios(z80info *z80, int fn)
 	}
 
 	bioscall[fn](z80);
+
+	if (fn == 13 && A == 0)
+		z80stats.storein += SECTORSIZE;
+	else if (fn == 14 && A == 0)
+		z80stats.storeout += SECTORSIZE;
+
 	/* let z80 handle return */
 }
@@ -0,0 +1,788 @@
+/*-----------------------------------------------------------------------*\
+ |  breaks.c  --  breakpoints and watchpoints with conditions            |
+ |                                                                       |
+ |  A condition is parsed once into a tree of nodes, each with the       |
+ |  function that works it out, so checking one is a few indirect calls  |
+ |  rather than another parse.  Sub-trees that are all constants are     |
+ |  worked out as they're built.                                         |
+ |                                                                       |
+ |  An exec breakpoint is looked at only when an opcode is fetched from  |
+ |  its address (fetch_mem() in main.c, from FETCH() in z80.c), so the   |
+ |  operand bytes of an instruction - read with PC at them - are data    |
+ |  reads, and never stop it mid-instruction.                            |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "breaks.h"
+#include "symtab.h"
+
+#ifdef MEM_BREAK
+
+
+#define M_BREAKS	(M_EXEC_BREAK | M_READ_WATCH | M_WRITE_WATCH)
+
+enum { EXEC, READ, WRITE, ACCESS, IOIN, IOOUT };
+
+static const char *whens[] =
+{
+	"exec", "read", "write", "access", "io_in", "io_out", NULL
+};
+
+enum { RA, RF, RB, RC, RD, RE, RH, RL, RAF, RBC, RDE, RHL,
+	RSP, RPC, RIX, RIY, RI, RR };
+
+static const char *regs[] =
+{
+	"a", "f", "b", "c", "d", "e", "h", "l", "af", "bc", "de", "hl",
+	"sp", "pc", "ix", "iy", "i", "r", NULL
+};
+
+
+/* what the z80 was doing when the breakpoint was looked at */
+typedef struct hit
+{
+	word addr;
+	byte val;
+	byte port;
+} hit;
+
+typedef struct node node;
+typedef long (*evalfn)(const node *n, z80info *z80, const hit *h);
+
+struct node
+{
+	evalfn eval;
+	node *l, *r;
+	long k;			/* a constant, or which register */
+};
+
+typedef struct brk
+{
+	int n;
+	int when;
+	long lo, hi;		/* addresses or ports */
+	node *cond;		/* NULL for always */
+	unsigned long hits;
+	unsigned long after;	/* hits to let by */
+	char *text;
+	struct brk *next;
+} brk;
+
+struct breaks
+{
+	brk *list;
+	int nextn;
+	byte ports[2][0x100];	/* [out][port] - any breakpoints on it */
+};
+
+
+/*-----------------------------------------------------------------------*\
+ |  the compiled conditions
+\*-----------------------------------------------------------------------*/
+
+#define EV(n)	((n)->eval((n), z80, h))
+
+static long
+ekonst(const node *n, z80info *z80, const hit *h)
+{
+	return n->k;
+}
+
+static long
+ereg(const node *n, z80info *z80, const hit *h)
+{
+	switch (n->k)
+	{
+	case RA:	return A;
+	case RF:	return F;
+	case RB:	return B;
+	case RC:	return C;
+	case RD:	return D;
+	case RE:	return E;
+	case RH:	return H;
+	case RL:	return L;
+	case RAF:	return AF;
+	case RBC:	return BC;
+	case RDE:	return DE;
+	case RHL:	return HL;
+	case RSP:	return SP;
+	case RPC:	return PC;
+	case RIX:	return IX;
+	case RIY:	return IY;
+	case RI:	return I;
+	case RR:	return R;
+	}
+	return 0;
+}
+
+static long
+eaddr(const node *n, z80info *z80, const hit *h)
+{
+	return h->addr;
+}
+
+static long
+evalue(const node *n, z80info *z80, const hit *h)
+{
+	return h->val;
+}
+
+static long
+eport(const node *n, z80info *z80, const hit *h)
+{
+	return h->port;
+}
+
+/* [n] - peeked, so as not to set anything else off */
+static long
+epeek(const node *n, z80info *z80, const hit *h)
+{
+	return Z80MEMPEEK(EV(n->l));
+}
+
+static long eneg(const node *n, z80info *z80, const hit *h) { return -EV(n->l); }
+static long enot(const node *n, z80info *z80, const hit *h) { return !EV(n->l); }
+static long ecpl(const node *n, z80info *z80, const hit *h) { return ~EV(n->l); }
+
+static long eadd(const node *n, z80info *z80, const hit *h) { return EV(n->l) + EV(n->r); }
+static long esub(const node *n, z80info *z80, const hit *h) { return EV(n->l) - EV(n->r); }
+static long eand(const node *n, z80info *z80, const hit *h) { return EV(n->l) & EV(n->r); }
+static long eor(const node *n, z80info *z80, const hit *h) { return EV(n->l) | EV(n->r); }
+static long exor(const node *n, z80info *z80, const hit *h) { return EV(n->l) ^ EV(n->r); }
+static long eeq(const node *n, z80info *z80, const hit *h) { return EV(n->l) == EV(n->r); }
+static long ene(const node *n, z80info *z80, const hit *h) { return EV(n->l) != EV(n->r); }
+static long elt(const node *n, z80info *z80, const hit *h) { return EV(n->l) < EV(n->r); }
+static long ele(const node *n, z80info *z80, const hit *h) { return EV(n->l) <= EV(n->r); }
+static long egt(const node *n, z80info *z80, const hit *h) { return EV(n->l) > EV(n->r); }
+static long ege(const node *n, z80info *z80, const hit *h) { return EV(n->l) >= EV(n->r); }
+static long eland(const node *n, z80info *z80, const hit *h) { return EV(n->l) && EV(n->r); }
+static long elor(const node *n, z80info *z80, const hit *h) { return EV(n->l) || EV(n->r); }
+
+static void
+freenode(node *n)
+{
+	if (n == NULL)
+		return;
+	freenode(n->l);
+	freenode(n->r);
+	free(n);
+}
+
+static node *
+mknode(evalfn eval, node *l, node *r, long k)
+{
+	node *n = calloc(1, sizeof *n);
+
+	if (n == NULL)
+	{
+		freenode(l);
+		freenode(r);
+		return NULL;
+	}
+
+	n->eval = eval;
+	n->l = l;
+	n->r = r;
+	n->k = k;
+
+	/* nothing in it can change - work it out now */
+	if (eval != ekonst && eval != epeek && (l == NULL || l->eval == ekonst) &&
+			(r == NULL || r->eval == ekonst) && (l || r))
+	{
+		n->k = eval(n, NULL, NULL);
+		n->eval = ekonst;
+		freenode(n->l);
+		freenode(n->r);
+		n->l = n->r = NULL;
+	}
+	return n;
+}
+
+
+/*-----------------------------------------------------------------------*\
+ |  the parser  --  recursive descent, C's precedence
+\*-----------------------------------------------------------------------*/
+
+typedef struct parser
+{
+	const char *p;
+	char *err;
+	size_t errlen;
+	int failed;
+} parser;
+
+static void
+fail(parser *ps, const char *why)
+{
+	if (!ps->failed)
+		snprintf(ps->err, ps->errlen, "%s at \"%.20s\"", why, ps->p);
+	ps->failed = TRUE;
+}
+
+static void
+skipws(parser *ps)
+{
+	while (isspace((unsigned char)*ps->p))
+		ps->p++;
+}
+
+static int
+iswordch(int c)
+{
+	return isalnum(c) || c == '_' || c == '.' || c == '$';
+}
+
+/* the operator 'op' - but not the front of a longer one */
+static int
+acceptop(parser *ps, const char *op)
+{
+	static const char *twos[] = { "&&", "||", "==", "!=", "<=", ">=", "..", NULL };
+	size_t n = strlen(op);
+	int i;
+
+	skipws(ps);
+	if (strncmp(ps->p, op, n) != 0)
+		return FALSE;
+	if (n == 1)
+		for (i = 0; twos[i]; i++)
+			if (strncmp(ps->p, twos[i], 2) == 0)
+				return FALSE;
+	ps->p += n;
+	return TRUE;
+}
+
+static int
+wordlen(const char *s)
+{
+	int n = 0;
+
+	if (!isalpha((unsigned char)*s) && *s != '_')
+		return 0;
+	while (iswordch((unsigned char)s[n]) && !(s[n] == '.' && s[n + 1] == '.'))
+		n++;
+	return n;
+}
+
+static int
+acceptword(parser *ps, const char *word)
+{
+	size_t n = strlen(word);
+
+	skipws(ps);
+	if (wordlen(ps->p) != (int)n || strncmp(ps->p, word, n) != 0)
+		return FALSE;
+	ps->p += n;
+	return TRUE;
+}
+
+static int
+atword(parser *ps, const char *word)
+{
+	const char *p = ps->p;
+	int found = acceptword(ps, word);
+
+	ps->p = p;
+	return found;
+}
+
+static int
+atend(parser *ps)
+{
+	skipws(ps);
+	return *ps->p == '\0';
+}
+
+/* 0x1f, $1f, 1fh, 31 */
+static int
+number(parser *ps, long *val)
+{
+	const char *s = ps->p;
+	char *end;
+	size_t n;
+
+	if (*s == '$' && isxdigit((unsigned char)s[1]))
+	{
+		*val = strtol(s + 1, &end, 16);
+		ps->p = end;
+		return TRUE;
+	}
+	if (!isdigit((unsigned char)*s))
+		return FALSE;
+
+	if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+	{
+		*val = strtol(s + 2, &end, 16);
+		ps->p = end;
+		return TRUE;
+	}
+
+	for (n = 0; isxdigit((unsigned char)s[n]); n++)
+		;
+	if (s[n] == 'h' || s[n] == 'H')
+	{
+		*val = strtol(s, NULL, 16);
+		ps->p = s + n + 1;
+		return TRUE;
+	}
+
+	*val = strtol(s, &end, 10);
+	ps->p = end;
+	return TRUE;
+}
+
+static node *expr(parser *ps);
+
+static node *
+primary(parser *ps)
+{
+	char name[64];
+	long val;
+	word addr;
+	node *n;
+	int len, i;
+
+	skipws(ps);
+
+	if (acceptop(ps, "("))
+	{
+		n = expr(ps);
+		if (n && !acceptop(ps, ")"))
+		{
+			fail(ps, "missing )");
+			freenode(n);
+			return NULL;
+		}
+		return n;
+	}
+
+	if (acceptop(ps, "["))
+	{
+		n = expr(ps);
+		if (n && !acceptop(ps, "]"))
+		{
+			fail(ps, "missing ]");
+			freenode(n);
+			return NULL;
+		}
+		return n ? mknode(epeek, n, NULL, 0) : NULL;
+	}
+
+	if (number(ps, &val))
+		return mknode(ekonst, NULL, NULL, val);
+
+	if ((len = wordlen(ps->p)) == 0)
+	{
+		fail(ps, "expected a value");
+		return NULL;
+	}
+
+	if (len >= (int)sizeof name)
+		len = sizeof name - 1;
+	memcpy(name, ps->p, len);
+	name[len] = '\0';
+	for (i = 0; name[i]; i++)
+		name[i] = tolower((unsigned char)name[i]);
+
+	for (i = 0; regs[i]; i++)
+		if (strcmp(name, regs[i]) == 0)
+		{
+			ps->p += len;
+			return mknode(ereg, NULL, NULL, i);
+		}
+
+	if (strcmp(name, "addr") == 0 || strcmp(name, "val") == 0 ||
+			strcmp(name, "port") == 0)
+	{
+		ps->p += len;
+		return mknode(name[0] == 'a' ? eaddr : name[0] == 'v' ? evalue :
+				eport, NULL, NULL, 0);
+	}
+
+	/* a label - as it was written */
+	memcpy(name, ps->p, len);
+	if (symtab_find(name, &addr) == 0)
+	{
+		ps->p += len;
+		return mknode(ekonst, NULL, NULL, addr);
+	}
+
+	fail(ps, "unknown name");
+	return NULL;
+}
+
+static node *
+unary(parser *ps)
+{
+	node *n;
+
+	if (acceptop(ps, "!"))
+		return (n = unary(ps)) ? mknode(enot, n, NULL, 0) : NULL;
+	if (acceptop(ps, "~"))
+		return (n = unary(ps)) ? mknode(ecpl, n, NULL, 0) : NULL;
+	if (acceptop(ps, "-"))
+		return (n = unary(ps)) ? mknode(eneg, n, NULL, 0) : NULL;
+	return primary(ps);
+}
+
+/* one level of left-associative binary operators */
+typedef struct binop
+{
+	const char *op;
+	evalfn eval;
+} binop;
+
+static const binop levels[][5] =
+{
+	{ { "||", elor } },
+	{ { "&&", eland } },
+	{ { "|", eor } },
+	{ { "^", exor } },
+	{ { "&", eand } },
+	{ { "==", eeq }, { "!=", ene } },
+	{ { "<=", ele }, { ">=", ege }, { "<", elt }, { ">", egt } },
+	{ { "+", eadd }, { "-", esub } },
+};
+
+#define NLEVELS	(int)(sizeof levels / sizeof levels[0])
+
+static node *
+binary(parser *ps, int level)
+{
+	node *l, *r;
+	int i;
+
+	if (level == NLEVELS)
+		return unary(ps);
+
+	if ((l = binary(ps, level + 1)) == NULL)
+		return NULL;
+
+again:
+	for (i = 0; levels[level][i].op; i++)
+		if (acceptop(ps, levels[level][i].op))
+		{
+			if ((r = binary(ps, level + 1)) == NULL)
+			{
+				freenode(l);
+				return NULL;
+			}
+			if ((l = mknode(levels[level][i].eval, l, r, 0)) == NULL)
+				return NULL;
+			goto again;
+		}
+
+	return l;
+}
+
+static node *
+expr(parser *ps)
+{
+	return binary(ps, 0);
+}
+
+/* an address or port - sums of constants, so "&&" can follow */
+static int
+constant(parser *ps, long *val)
+{
+	node *n = binary(ps, NLEVELS - 1);
+
+	if (n == NULL)
+		return FALSE;
+	if (n->eval != ekonst)
+	{
+		fail(ps, "expected a constant");
+		freenode(n);
+		return FALSE;
+	}
+	*val = n->k;
+	freenode(n);
+	return TRUE;
+}
+
+/* a "pc == n" that has to be true for all of 'n' to be */
+static int
+findpc(const node *n, long *pc)
+{
+	if (n->eval == eland)
+		return findpc(n->l, pc) || findpc(n->r, pc);
+	if (n->eval != eeq)
+		return FALSE;
+
+	if (n->l->eval == ereg && n->l->k == RPC && n->r->eval == ekonst)
+		*pc = n->r->k;
+	else if (n->r->eval == ereg && n->r->k == RPC && n->l->eval == ekonst)
+		*pc = n->l->k;
+	else
+		return FALSE;
+	return TRUE;
+}
+
+
+/*-----------------------------------------------------------------------*\
+ |  the list
+\*-----------------------------------------------------------------------*/
+
+/* flag the addresses and ports that have something on them */
+static void
+mark(z80info *z80)
+{
+	breaks *bs = z80->breaks;
+	long i;
+	brk *b;
+
+	for (i = 0; i < 0x10000L; i++)
+		z80->membrk[i] &= ~M_BREAKS;
+	memset(bs->ports, 0, sizeof bs->ports);
+
+	for (b = bs->list; b != NULL; b = b->next)
+		for (i = b->lo; i <= b->hi; i++)
+			switch (b->when)
+			{
+			case EXEC:	z80->membrk[i] |= M_EXEC_BREAK; break;
+			case READ:	z80->membrk[i] |= M_READ_WATCH; break;
+			case WRITE:	z80->membrk[i] |= M_WRITE_WATCH; break;
+			case ACCESS:	z80->membrk[i] |= M_READ_WATCH | M_WRITE_WATCH; break;
+			case IOIN:	bs->ports[0][i] = TRUE; break;
+			case IOOUT:	bs->ports[1][i] = TRUE; break;
+			}
+}
+
+int
+breaks_add(z80info *z80, const char *text, char *err, size_t errlen)
+{
+	parser ps;
+	brk *b, **bp;
+	long max;
+	int i;
+
+	if (z80->breaks == NULL &&
+			(z80->breaks = calloc(1, sizeof *z80->breaks)) == NULL)
+	{
+		snprintf(err, errlen, "out of memory");
+		return 0;
+	}
+
+	if ((b = calloc(1, sizeof *b)) == NULL ||
+			(b->text = malloc(strlen(text) + 1)) == NULL)
+	{
+		free(b);
+		snprintf(err, errlen, "out of memory");
+		return 0;
+	}
+	strcpy(b->text, text);
+	b->text[strcspn(b->text, "\r\n")] = '\0';
+
+	ps.p = text;
+	ps.err = err;
+	ps.errlen = errlen;
+	ps.failed = FALSE;
+
+	/* when */
+	b->when = -1;
+	for (i = 0; whens[i]; i++)
+		if (acceptword(&ps, whens[i]))
+		{
+			b->when = i;
+			max = (i == IOIN || i == IOOUT) ? 0xFF : 0xFFFF;
+
+			if (!constant(&ps, &b->lo))
+				goto bad;
+			b->hi = b->lo;
+			if (acceptop(&ps, "..") && !constant(&ps, &b->hi))
+				goto bad;
+			if (b->lo < 0 || b->hi > max || b->lo > b->hi)
+			{
+				fail(&ps, "bad range");
+				goto bad;
+			}
+			break;
+		}
+
+	/* and if - after a "when" it takes an "if" (or "&&") */
+	if (b->when < 0 ? !atend(&ps) && !atword(&ps, "after") :
+			acceptword(&ps, "if") || acceptop(&ps, "&&"))
+	{
+		if ((b->cond = expr(&ps)) == NULL)
+			goto bad;
+	}
+
+	if (acceptword(&ps, "after"))
+	{
+		long n;
+
+		if (!constant(&ps, &n))
+			goto bad;
+		b->after = n;
+	}
+
+	if (!atend(&ps))
+	{
+		fail(&ps, "extra stuff");
+		goto bad;
+	}
+
+	if (b->when < 0)
+	{
+		if (b->cond == NULL || !findpc(b->cond, &b->lo))
+		{
+			snprintf(err, errlen, "say when: exec, read, write, access, "
+					"io_in, io_out or pc ==");
+			goto bad;
+		}
+		b->when = EXEC;
+		b->lo = b->hi = (word)b->lo;
+	}
+
+	/* a condition that's always true is no condition */
+	if (b->cond && b->cond->eval == ekonst)
+	{
+		if (b->cond->k == 0)
+		{
+			snprintf(err, errlen, "that can never happen");
+			goto bad;
+		}
+		freenode(b->cond);
+		b->cond = NULL;
+	}
+
+	b->n = ++z80->breaks->nextn;
+	for (bp = &z80->breaks->list; *bp != NULL; bp = &(*bp)->next)
+		;
+	*bp = b;
+	mark(z80);
+	return b->n;
+
+bad:
+	freenode(b->cond);
+	free(b->text);
+	free(b);
+	return 0;
+}
+
+int
+breaks_delete(z80info *z80, int n)
+{
+	brk *b, **bp;
+	int found = FALSE;
+
+	if (z80->breaks == NULL)
+		return n == 0 ? 0 : 1;
+
+	for (bp = &z80->breaks->list; (b = *bp) != NULL; )
+		if (n == 0 || b->n == n)
+		{
+			*bp = b->next;
+			freenode(b->cond);
+			free(b->text);
+			free(b);
+			found = TRUE;
+		}
+		else
+			bp = &b->next;
+
+	mark(z80);
+	return n == 0 || found ? 0 : 1;
+}
+
+void
+breaks_list(z80info *z80, FILE *fp)
+{
+	brk *b;
+
+	if (z80->breaks == NULL || z80->breaks->list == NULL)
+	{
+		fprintf(fp, "    No conditional breakpoints.\n");
+		return;
+	}
+
+	for (b = z80->breaks->list; b != NULL; b = b->next)
+		fprintf(fp, "    %2d: %-40s %lu hits\n", b->n, b->text, b->hits);
+}
+
+
+/*-----------------------------------------------------------------------*\
+ |  the checks
+\*-----------------------------------------------------------------------*/
+
+static int
+check(z80info *z80, int when, long at, const hit *h)
+{
+	brk *b;
+
+	for (b = z80->breaks->list; b != NULL; b = b->next)
+	{
+		if (at < b->lo || at > b->hi)
+			continue;
+		if (b->when != when && !(b->when == ACCESS &&
+				(when == READ || when == WRITE)))
+			continue;
+		if (b->cond && !b->cond->eval(b->cond, z80, h))
+			continue;
+		if (++b->hits > b->after)
+			return b->n;
+	}
+	return 0;
+}
+
+int
+breaks_exec(z80info *z80)
+{
+	hit h;
+
+	if (z80->breaks == NULL || !(z80->membrk[PC] & M_EXEC_BREAK))
+		return 0;
+
+	h.addr = PC;
+	h.val = Z80MEMPEEK(PC);
+	h.port = 0;
+	return check(z80, EXEC, PC, &h);
+}
+
+int
+breaks_read(z80info *z80, word addr)
+{
+	hit h;
+
+	if (z80->breaks == NULL || !(z80->membrk[addr] & M_READ_WATCH))
+		return 0;
+
+	h.addr = addr;
+	h.val = Z80MEMPEEK(addr);
+	h.port = 0;
+	return check(z80, READ, addr, &h);
+}
+
+int
+breaks_write(z80info *z80, word addr, byte val)
+{
+	hit h;
+
+	if (z80->breaks == NULL || !(z80->membrk[addr] & M_WRITE_WATCH))
+		return 0;
+
+	h.addr = addr;
+	h.val = val;
+	h.port = 0;
+	return check(z80, WRITE, addr, &h);
+}
+
+int
+breaks_io(z80info *z80, int out, byte port, byte val)
+{
+	hit h;
+
+	if (z80->breaks == NULL || !z80->breaks->ports[out != 0][port])
+		return 0;
+
+	h.addr = port;
+	h.val = val;
+	h.port = port;
+	return check(z80, out ? IOOUT : IOIN, port, &h);
+}
+
+#endif	/* MEM_BREAK */
@@ -0,0 +1,56 @@
+/*-----------------------------------------------------------------------*\
+ |  breaks.h  --  breakpoints and watchpoints with conditions            |
+ |                                                                       |
+ |  Each is written as "when, and if", e.g.                              |
+ |                                                                       |
+ |      exec 0x1234 if a > 0x40                                          |
+ |      pc == 0x1234 && a > 0x40      (the same thing)                   |
+ |      write 0x8000..0x80ff                                             |
+ |      read buffer if val == 0x1a after 3                               |
+ |      io_out 0x38                                                      |
+ |      io_in 0x00..0x01 if val != 0                                     |
+ |                                                                       |
+ |  "when" is exec, read, write, access (read or write), io_in or       |
+ |  io_out and an address or port, or a range of them; or it's left      |
+ |  to a "pc == n" in the condition.  The condition is C-like, over the  |
+ |  registers, addr and val (what was read or written), port, [n] (the  |
+ |  byte at n), numbers (0x1f, $1f, 1fh or 31) and names from symtab.    |
+ |  "after n" lets the first n hits go by.                               |
+ |                                                                       |
+ |  The conditions are compiled to trees of little functions, and are    |
+ |  only looked at for the addresses and ports they're about: the        |
+ |  addresses are flagged in membrk, so the rest of memory costs no more |
+ |  than it did.                                                         |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+#ifndef __BREAKS_H_
+#define __BREAKS_H_
+
+#include <stdio.h>
+#include "defs.h"
+
+#ifdef MEM_BREAK
+
+typedef struct breaks breaks;
+
+
+/* add one - returns its number, or 0 with why not in 'err' */
+int breaks_add(z80info *z80, const char *text, char *err, size_t errlen);
+
+/* remove number 'n', or all of them if 'n' is 0 - returns 0 if ok */
+int breaks_delete(z80info *z80, int n);
+
+void breaks_list(z80info *z80, FILE *fp);
+
+/* these are called from where each kind can happen, and return the
+   number of a breakpoint that should stop the z80 there, or 0 */
+int breaks_exec(z80info *z80);
+int breaks_read(z80info *z80, word addr);
+int breaks_write(z80info *z80, word addr, byte val);
+int breaks_io(z80info *z80, int out, byte port, byte val);
+
+#endif	/* MEM_BREAK */
+
+#endif
@@ -0,0 +1,433 @@
+/*-----------------------------------------------------------------------*\
+ |  callgraph.c  --  who calls whom, and what it costs                   |
+ |                                                                       |
+ |  Real code doesn't always return the way it was called.  It pops     |
+ |  its return address and jumps, it pushes an address and RETs to it,  |
+ |  and it switches stacks (the BDOS does, and most ISRs).  So a return  |
+ |  is only matched to a call when the slot it came from and the address |
+ |  it went to are both what the call left behind - anywhere down the    |
+ |  shadow stack, with the frames above it taken to have been abandoned. |
+ |  A return that matches nothing is just a jump.                        |
+ |                                                                       |
+ |  Inclusive cycles for a routine only count its outermost activation, |
+ |  so recursion isn't counted twice.                                    |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "callgraph.h"
+#include "symtab.h"
+
+
+#define ROOT		0x10000L	/* what nothing called */
+#define NROUTINES	(ROOT + 1)
+#define MAXDEPTH	256
+
+/* keys for the cost tables */
+#define LINEKEY(fn, pc)		(((unsigned long long)(fn) << 16) | (pc))
+#define ARCKEY(fn, site, to)	(((unsigned long long)(fn) << 33) | \
+					((unsigned long long)(site) << 17) | (to))
+#define KEYFN(k)		((long)((k) >> 16))
+#define ARCFN(k)		((long)((k) >> 33))
+#define ARCSITE(k)		((word)((k) >> 17))
+#define ARCTO(k)		((long)((k) & 0x1FFFF))
+
+
+typedef struct frame
+{
+	long fn;		/* where it was called to, or ROOT */
+	word site;		/* where it was called from */
+	word slot;		/* where its return address is */
+	word ret;		/* and what that is */
+	unsigned long long entry;	/* cycles when called */
+} frame;
+
+/* cycles by routine and instruction, or by call arc */
+typedef struct cost
+{
+	unsigned long long key;		/* 0 if unused, else key + 1 */
+	unsigned long long cycles;
+	unsigned long calls;
+} cost;
+
+typedef struct costs
+{
+	cost *tab;
+	long n, max;
+} costs;
+
+struct callgraph
+{
+	unsigned long long start;	/* cycle count when started */
+	unsigned long long last;	/* ...and when last charged */
+	word lastpc;
+
+	frame stack[MAXDEPTH];
+	int depth;
+	unsigned long strays;		/* returns that matched no call */
+
+	costs lines;			/* exclusive */
+	costs arcs;			/* inclusive, by call */
+
+	unsigned long long excl[NROUTINES];
+	unsigned long long incl[NROUTINES];
+	unsigned long calls[NROUTINES];
+	int active[NROUTINES];		/* frames of each on the stack */
+};
+
+
+/*-----------------------------------------------------------------------*\
+ |  cost tables  --  open hashing, kept at most half full
+\*-----------------------------------------------------------------------*/
+
+static long
+slotof(unsigned long long key, long max)
+{
+	key ^= key >> 29;
+	key *= 0x9E3779B97F4A7C15ULL;
+	return (long)(key >> 32) & (max - 1);
+}
+
+static cost *
+costof(costs *c, unsigned long long key)
+{
+	cost *n;
+	long i, j;
+
+	key++;
+
+	if (c->n * 2 >= c->max)
+	{
+		long max = c->max ? c->max * 2 : 4096;
+
+		if ((n = calloc(max, sizeof *n)) == NULL)
+			return NULL;
+		for (i = 0; i < c->max; i++)
+			if (c->tab[i].key)
+			{
+				for (j = slotof(c->tab[i].key, max); n[j].key;
+						j = (j + 1) & (max - 1))
+					;
+				n[j] = c->tab[i];
+			}
+		free(c->tab);
+		c->tab = n;
+		c->max = max;
+	}
+
+	for (i = slotof(key, c->max); c->tab[i].key; i = (i + 1) & (c->max - 1))
+		if (c->tab[i].key == key)
+			return &c->tab[i];
+
+	c->tab[i].key = key;
+	c->n++;
+	return &c->tab[i];
+}
+
+/* the used entries, sorted by key (and back to the real keys) */
+static int
+bykey(const void *a, const void *b)
+{
+	const cost *x = a, *y = b;
+
+	return x->key < y->key ? -1 : x->key > y->key;
+}
+
+static cost *
+sorted(costs *c)
+{
+	cost *s = malloc((c->n ? c->n : 1) * sizeof *s);
+	long i, n = 0;
+
+	if (s == NULL)
+		return NULL;
+	for (i = 0; i < c->max; i++)
+		if (c->tab[i].key)
+		{
+			s[n] = c->tab[i];
+			s[n++].key--;
+		}
+	qsort(s, n, sizeof *s, bykey);
+	return s;
+}
+
+
+/*-----------------------------------------------------------------------*\
+ |  the shadow stack
+\*-----------------------------------------------------------------------*/
+
+/* give the cycles since last time to whatever was running */
+static void
+charge(callgraph *cg, z80info *z80)
+{
+	unsigned long long d = z80->cycles - cg->last;
+	long fn = cg->stack[cg->depth - 1].fn;
+	cost *c;
+
+	if (d == 0)
+		return;
+
+	cg->excl[fn] += d;
+	if ((c = costof(&cg->lines, LINEKEY(fn, cg->lastpc))) != NULL)
+		c->cycles += d;
+	cg->last = z80->cycles;
+}
+
+/* frame 'i' is done with (or is being totted up so far) */
+static void
+credit(callgraph *cg, int i, int leaving)
+{
+	frame *f = &cg->stack[i];
+	unsigned long long d = cg->last - f->entry;
+	cost *c = costof(&cg->arcs, ARCKEY(cg->stack[i - 1].fn, f->site, f->fn));
+	int j;
+
+	if (c != NULL)
+		c->cycles += d;
+
+	if (leaving)
+	{
+		if (--cg->active[f->fn] == 0)
+			cg->incl[f->fn] += d;
+	}
+	else
+	{
+		for (j = 1; j < i && cg->stack[j].fn != f->fn; j++)
+			;
+		if (j == i)
+			cg->incl[f->fn] += d;
+	}
+
+	f->entry = cg->last;
+}
+
+/* bring everything up to date, without ending anything */
+static void
+settle(callgraph *cg, z80info *z80)
+{
+	int i;
+
+	charge(cg, z80);
+	for (i = 1; i < cg->depth; i++)
+		credit(cg, i, FALSE);
+	cg->incl[ROOT] = cg->last - cg->start;
+}
+
+callgraph *
+callgraph_start(z80info *z80)
+{
+	callgraph *cg = calloc(1, sizeof *cg);
+
+	if (cg == NULL)
+		return NULL;
+
+	cg->start = cg->last = z80->cycles;
+	cg->lastpc = PC;
+	cg->stack[0].fn = ROOT;
+	cg->stack[0].entry = z80->cycles;
+	cg->depth = 1;
+	cg->active[ROOT] = 1;
+	return cg;
+}
+
+void
+callgraph_step(callgraph *cg, z80info *z80)
+{
+	charge(cg, z80);
+	cg->lastpc = PC;
+}
+
+void
+callgraph_call(callgraph *cg, z80info *z80, int len)
+{
+	frame *f;
+	cost *c;
+
+	charge(cg, z80);
+
+	/* too deep - let the oldest go */
+	if (cg->depth == MAXDEPTH)
+	{
+		credit(cg, 1, TRUE);
+		memmove(&cg->stack[1], &cg->stack[2],
+				(MAXDEPTH - 2) * sizeof cg->stack[0]);
+		cg->depth--;
+	}
+
+	f = &cg->stack[cg->depth++];
+	f->fn = PC;
+	f->slot = SP;
+	f->ret = Z80MEMPEEK(SP) | (Z80MEMPEEK(SP + 1) << 8);
+	f->site = f->ret - len;
+	f->entry = cg->last;
+
+	cg->calls[f->fn]++;
+	cg->active[f->fn]++;
+	if ((c = costof(&cg->arcs, ARCKEY(cg->stack[cg->depth - 2].fn,
+			f->site, f->fn))) != NULL)
+		c->calls++;
+
+	cg->lastpc = PC;
+}
+
+void
+callgraph_ret(callgraph *cg, z80info *z80)
+{
+	word slot = SP - 2;
+	int k;
+
+	charge(cg, z80);
+	cg->lastpc = PC;
+
+	for (k = cg->depth - 1; k > 0; k--)
+		if (cg->stack[k].slot == slot && cg->stack[k].ret == PC)
+			break;
+
+	if (k == 0)
+	{
+		cg->strays++;
+		return;
+	}
+
+	while (cg->depth > k)
+		credit(cg, --cg->depth, TRUE);
+}
+
+void
+callgraph_stop(callgraph *cg)
+{
+	if (cg == NULL)
+		return;
+
+	free(cg->lines.tab);
+	free(cg->arcs.tab);
+	free(cg);
+}
+
+
+/*-----------------------------------------------------------------------*\
+ |  reports
+\*-----------------------------------------------------------------------*/
+
+static void
+putfn(FILE *fp, long fn)
+{
+	if (fn == ROOT)
+		fprintf(fp, "(top)");
+	else
+		symtab_print(fp, (word)fn);
+}
+
+int
+callgraph_report(callgraph *cg, z80info *z80, const char *path)
+{
+	FILE *fp;
+	cost *lines, *arcs;
+	long i = 0, j = 0, fn;
+
+	settle(cg, z80);
+
+	if ((fp = fopen(path, "w")) == NULL)
+		return 1;
+
+	lines = sorted(&cg->lines);
+	arcs = sorted(&cg->arcs);
+	if (lines == NULL || arcs == NULL)
+	{
+		free(lines);
+		free(arcs);
+		fclose(fp);
+		return 1;
+	}
+
+	fprintf(fp, "# callgrind format\n");
+	fprintf(fp, "version: 1\n");
+	fprintf(fp, "creator: z80 callgraph\n");
+	fprintf(fp, "positions: instr\n");
+	fprintf(fp, "events: Cycles\n");
+	fprintf(fp, "summary: %llu\n", cg->last - cg->start);
+
+	/* both are sorted by routine first, so go through them together */
+	while (i < cg->lines.n || j < cg->arcs.n)
+	{
+		if (j == cg->arcs.n ||
+				(i < cg->lines.n && KEYFN(lines[i].key) <= ARCFN(arcs[j].key)))
+			fn = KEYFN(lines[i].key);
+		else
+			fn = ARCFN(arcs[j].key);
+
+		fprintf(fp, "\nfn=");
+		putfn(fp, fn);
+		putc('\n', fp);
+
+		for (; i < cg->lines.n && KEYFN(lines[i].key) == fn; i++)
+			fprintf(fp, "0x%.4X %llu\n",
+					(unsigned)(lines[i].key & 0xFFFF), lines[i].cycles);
+
+		for (; j < cg->arcs.n && ARCFN(arcs[j].key) == fn; j++)
+		{
+			fprintf(fp, "cfn=");
+			putfn(fp, ARCTO(arcs[j].key));
+			fprintf(fp, "\ncalls=%lu 0x%.4lX\n", arcs[j].calls,
+					ARCTO(arcs[j].key));
+			fprintf(fp, "0x%.4X %llu\n", ARCSITE(arcs[j].key),
+					arcs[j].cycles);
+		}
+	}
+
+	free(lines);
+	free(arcs);
+	return fclose(fp) != 0;
+}
+
+typedef struct routine
+{
+	long fn;
+	unsigned long long incl;
+} routine;
+
+static int
+byincl(const void *a, const void *b)
+{
+	const routine *x = a, *y = b;
+
+	if (x->incl != y->incl)
+		return x->incl < y->incl ? 1 : -1;
+	return x->fn < y->fn ? -1 : x->fn > y->fn;
+}
+
+void
+callgraph_summary(callgraph *cg, z80info *z80, FILE *fp, int n)
+{
+	routine *r = malloc(NROUTINES * sizeof *r);
+	long fn, nr = 0;
+	int i;
+
+	if (r == NULL)
+		return;
+
+	settle(cg, z80);
+	for (fn = 0; fn < NROUTINES; fn++)
+		if (cg->incl[fn] || cg->excl[fn])
+		{
+			r[nr].fn = fn;
+			r[nr++].incl = cg->incl[fn];
+		}
+	qsort(r, nr, sizeof *r, byincl);
+
+	fprintf(fp, "   inclusive     exclusive      calls  routine\n");
+	for (i = 0; i < nr && i < n; i++)
+	{
+		fprintf(fp, "%12llu  %12llu  %9lu  ", r[i].incl,
+				cg->excl[r[i].fn], cg->calls[r[i].fn]);
+		putfn(fp, r[i].fn);
+		putc('\n', fp);
+	}
+	if (cg->strays)
+		fprintf(fp, "(%lu returns matched no call)\n", cg->strays);
+
+	free(r);
+}
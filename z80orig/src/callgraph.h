@@ -0,0 +1,45 @@
+/*-----------------------------------------------------------------------*\
+ |  callgraph.h  --  who calls whom, and what it costs                   |
+ |                                                                       |
+ |  The z80 core tells this about every CALL, RST, interrupt and         |
+ |  return, and it keeps a shadow of the call stack from that.  Each     |
+ |  routine (named by where it was called to) gets the cycles spent in   |
+ |  it, and in it and everything it calls; each call site gets how often |
+ |  it was taken and what it cost.  That's written out in callgrind's    |
+ |  format, for kcachegrind or callgrind_annotate.                       |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+#ifndef __CALLGRAPH_H_
+#define __CALLGRAPH_H_
+
+#include <stdio.h>
+#include "defs.h"
+
+
+typedef struct callgraph callgraph;
+
+
+callgraph *callgraph_start(z80info *z80);
+
+/* called before each instruction */
+void callgraph_step(callgraph *cg, z80info *z80);
+
+/* called once the return address is pushed and PC is at the routine.
+   the call was made from 'len' bytes before that return address - 3
+   for a CALL, 1 for an RST, 0 for an interrupt */
+void callgraph_call(callgraph *cg, z80info *z80, int len);
+
+/* called once a return address has been popped into PC */
+void callgraph_ret(callgraph *cg, z80info *z80);
+
+/* write the callgrind file.  returns 0 if ok */
+int callgraph_report(callgraph *cg, z80info *z80, const char *path);
+
+/* the 'n' routines with the most inclusive cycles, one to a line */
+void callgraph_summary(callgraph *cg, z80info *z80, FILE *fp, int n);
+
+void callgraph_stop(callgraph *cg);
+
+#endif
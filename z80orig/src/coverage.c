@@ -0,0 +1,516 @@
+/*-----------------------------------------------------------------------*\
+ |  coverage.c  --  which addresses the z80 has run, read and written    |
+ |                                                                       |
+ |  The listing lines that matter look like (see symtab.c)               |
+ |                                                                       |
+ |     0047 3E 40         [ 7]   47 SendSDCommand: ld a,#0x40            |
+ |                           48 ; a comment                              |
+ |     0049 41 42 43 44 45 46                                            |
+ |                                                                       |
+ |  - an address, code bytes, cycles, the line number and the source;    |
+ |  a line that's only a line number (no address) is a comment or some   |
+ |  such; and one with no line number is the rest of the bytes of the    |
+ |  line before.  Line numbers are the ones in the file being read at    |
+ |  the time, so an .include starts its file's count over at 1, and we   |
+ |  know we're back out of it once its last line has gone by (or, if     |
+ |  it can't be read for its length, when the numbers go backwards).     |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+#define _DEFAULT_SOURCE		/* for realpath under -std=c99 */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include "coverage.h"
+#include "symtab.h"
+#include "heatmap.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX	1024
+#endif
+
+#define MAXINCLUDE	16	/* .includes within .includes */
+
+
+coverage *
+coverage_start(z80info *z80, int data)
+{
+	coverage *cv = calloc(1, sizeof *cv);
+#ifdef MEM_BREAK
+	long i;
+#endif
+
+	if (cv == NULL)
+	{
+		fprintf(stderr, "Cannot allocate the coverage maps!\r\n");
+		return NULL;
+	}
+
+#ifdef MEM_BREAK
+	cv->data = data;
+	if (data)
+		for (i = 0; i < 0x10000L; i++)
+			z80->membrk[i] |= M_ACCESS;
+#endif
+	return cv;
+}
+
+void
+coverage_access(coverage *cv, z80info *z80, word addr, int write)
+{
+	COVER_SET(write ? cv->written : cv->read, addr);
+
+#ifdef MEM_BREAK
+	/* nothing more to learn about this one */
+	if (COVER_GET(cv->read, addr) && COVER_GET(cv->written, addr) &&
+			z80heat == NULL)
+		z80->membrk[addr] &= ~M_ACCESS;
+#endif
+}
+
+void
+coverage_stop(coverage *cv, z80info *z80)
+{
+#ifdef MEM_BREAK
+	long i;
+
+	if (cv->data && z80heat == NULL)
+		for (i = 0; i < 0x10000L; i++)
+			z80->membrk[i] &= ~M_ACCESS;
+#endif
+	free(cv);
+}
+
+
+static long
+count(const byte *map)
+{
+	long i, n = 0;
+
+	for (i = 0; i < 0x10000L; i++)
+		if (COVER_GET(map, i))
+			n++;
+	return n;
+}
+
+void
+coverage_summary(coverage *cv, FILE *fp)
+{
+	long addr, start, end, ranges = 0;
+
+	fprintf(fp, "    %ld addresses run", count(cv->exec));
+	if (cv->data)
+		fprintf(fp, ", %ld read, %ld written", count(cv->read),
+				count(cv->written));
+	fprintf(fp, "\n");
+
+	for (addr = 0; addr < 0x10000L; addr++)
+	{
+		if (!COVER_GET(cv->exec, addr))
+			continue;
+
+		/* a gap of up to 3 is the rest of an instruction */
+		start = end = addr;
+		for (addr++; addr < 0x10000L && addr - end <= 4; addr++)
+			if (COVER_GET(cv->exec, addr))
+				end = addr;
+		addr = end;
+
+		if (++ranges <= 20)
+		{
+			fprintf(fp, "    %.4lX-%.4lX  ", start, end);
+			symtab_print(fp, (word)start);
+			fprintf(fp, "\n");
+		}
+	}
+	if (ranges > 20)
+		fprintf(fp, "    ...and %ld more\n", ranges - 20);
+}
+
+
+/*-----------------------------------------------------------------------*\
+ |  lcov, from the listings
+\*-----------------------------------------------------------------------*/
+
+typedef struct srcfile
+{
+	char *path;
+	int *lines;		/* by line number: -1 not code, else run or not */
+	int nlines;
+	struct srcfile *next;
+} srcfile;
+
+typedef struct
+{
+	srcfile *sf;
+	int length;		/* lines in the file, or 0 if not known */
+	int last;		/* last line number seen in it */
+} including;
+
+
+static int
+isdecimal(const char *s, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		if (!isdigit((unsigned char)s[i]))
+			return FALSE;
+	return len > 0;
+}
+
+static int
+ishexword(const char *s, size_t len)
+{
+	size_t i;
+
+	if (len < 4 || len > 8)
+		return FALSE;
+	for (i = 0; i < len; i++)
+		if (!isxdigit((unsigned char)s[i]))
+			return FALSE;
+	return TRUE;
+}
+
+/* code bytes - two hex digits, maybe with a relocation flag (-f, -ff)
+   after */
+static int
+isbyte(const char *s, size_t len)
+{
+	return (len == 2 || (len == 3 && strchr("`*rsupqRSUPQ", s[2]))) &&
+			isxdigit((unsigned char)s[0]) && isxdigit((unsigned char)s[1]);
+}
+
+static size_t
+toklen(const char *s)
+{
+	size_t n = 0;
+
+	while (s[n] && !isspace((unsigned char)s[n]))
+		n++;
+	return n;
+}
+
+static const char *
+skipspace(const char *s)
+{
+	while (isspace((unsigned char)*s))
+		s++;
+	return s;
+}
+
+/* pick a listing line apart.  returns its line number, or 0 if it has
+   none; '*addr' gets -1 if it has no address */
+static int
+listing(const char *line, long *addr, int *nbytes, const char **src)
+{
+	const char *p = skipspace(line), *next;
+	size_t len = toklen(p);
+
+	*addr = -1;
+	*nbytes = 0;
+	*src = "";
+
+	/* just a line number, and maybe some source - which won't start
+	   with a number, as the line number after an address would */
+	next = skipspace(p + len);
+	if (isdecimal(p, len) && (*next == '\0' ||
+			(!isbyte(next, toklen(next)) && *next != '[' &&
+			!isdecimal(next, toklen(next)))))
+	{
+		*src = next;
+		return atoi(p);
+	}
+
+	if (!ishexword(p, len))
+		return 0;
+	*addr = strtol(p, NULL, 16);
+
+	for (p = next; *p; p = next)
+	{
+		len = toklen(p);
+		next = skipspace(p + len);
+
+		/* the cycles, "[ 7]" or "[11]" */
+		if (*p == '[')
+		{
+			while (*next && !memchr(p, ']', len))
+			{
+				p = next;
+				len = toklen(p);
+				next = skipspace(p + len);
+			}
+			continue;
+		}
+
+		/* the line number is the number before the source */
+		if (isdecimal(p, len) && ((*next == '\0' && *nbytes == 0) ||
+				(*next && *next != '[' && !isbyte(next, toklen(next)) &&
+				!isdecimal(next, toklen(next)))))
+		{
+			*src = next;
+			return atoi(p);
+		}
+
+		if (!isbyte(p, len))
+			break;
+		(*nbytes)++;
+	}
+	return 0;
+}
+
+/* the first thing in the source after any labels */
+static const char *
+statement(const char *src)
+{
+	const char *p = skipspace(src);
+	size_t n;
+
+	for (;;)
+	{
+		for (n = 0; isalnum((unsigned char)p[n]) || p[n] == '_' ||
+				p[n] == '.' || p[n] == '$'; n++)
+			;
+		if (n == 0 || p[n] != ':')
+			return p;
+		p = skipspace(p + n + (p[n + 1] == ':' ? 2 : 1));
+	}
+}
+
+/* the file named in '.include "name"', relative to 'dir' */
+static int
+includes(const char *stmt, const char *dir, char *path, size_t size)
+{
+	const char *q, *e;
+	size_t n, d;
+
+	if (strncmp(stmt, ".include", 8) != 0 || (q = strchr(stmt, '"')) == NULL ||
+			(e = strchr(q + 1, '"')) == NULL)
+		return FALSE;
+
+	n = (size_t)(e - q - 1);
+	if (q[1] == '/')
+		dir = "";
+	d = strlen(dir);
+	if (d + n + 2 > size)
+		return FALSE;
+
+	memcpy(path, dir, d);
+	if (d > 0)
+		path[d++] = '/';
+	memcpy(path + d, q + 1, n);
+	path[d + n] = '\0';
+	return TRUE;
+}
+
+static int
+linesin(const char *path)
+{
+	FILE *fp = fopen(path, "r");
+	int c, n = 0, last = '\n';
+
+	if (fp == NULL)
+		return 0;
+	while ((c = getc(fp)) != EOF)
+	{
+		if (c == '\n')
+			n++;
+		last = c;
+	}
+	fclose(fp);
+	return last == '\n' ? n : n + 1;
+}
+
+static srcfile *
+source(srcfile **files, const char *path)
+{
+	char real[PATH_MAX];
+	srcfile *sf;
+
+	if (realpath(path, real) != NULL)
+		path = real;
+
+	for (sf = *files; sf != NULL; sf = sf->next)
+		if (strcmp(sf->path, path) == 0)
+			return sf;
+
+	if ((sf = calloc(1, sizeof *sf)) == NULL ||
+			(sf->path = malloc(strlen(path) + 1)) == NULL)
+	{
+		free(sf);
+		return NULL;
+	}
+	strcpy(sf->path, path);
+	sf->next = *files;
+	*files = sf;
+	return sf;
+}
+
+static void
+mark(srcfile *sf, int line, int ran)
+{
+	int *more, n;
+
+	if (sf == NULL || line <= 0)
+		return;
+
+	if (line >= sf->nlines)
+	{
+		n = sf->nlines ? sf->nlines : 256;
+		while (n <= line)
+			n *= 2;
+		if ((more = realloc(sf->lines, n * sizeof *more)) == NULL)
+			return;
+		memset(more + sf->nlines, 0xFF, (n - sf->nlines) * sizeof *more);
+		sf->lines = more;
+		sf->nlines = n;
+	}
+
+	if (sf->lines[line] < ran)
+		sf->lines[line] = ran;
+}
+
+/* one listing's worth of lines into 'files' */
+static int
+readlisting(coverage *cv, const char *lst, srcfile **files)
+{
+	char line[512], dir[PATH_MAX], path[PATH_MAX];
+	including inc[MAXINCLUDE];
+	const char *slash, *src, *stmt;
+	FILE *fp;
+	long addr;
+	int lineno, nbytes, depth = 0;
+
+	if ((fp = fopen(lst, "r")) == NULL)
+		return 1;
+
+	/* foo.lst is foo.asm's */
+	slash = strrchr(lst, '/');
+	snprintf(dir, sizeof dir, "%.*s", slash ? (int)(slash - lst) : 0, lst);
+	snprintf(path, sizeof path, "%.*s.asm",
+			(int)(strrchr(lst, '.') - lst), lst);
+	inc[0].sf = source(files, path);
+	inc[0].length = 0;
+	inc[0].last = 0;
+
+	while (fgets(line, sizeof line, fp) != NULL)
+	{
+		if (strstr(line, "Symbol Table") || strstr(line, "Area Table"))
+			break;
+		if ((lineno = listing(line, &addr, &nbytes, &src)) == 0)
+			continue;
+
+		/* out of an .include? */
+		while (depth > 0 && (inc[depth].length > 0 ?
+				inc[depth].last >= inc[depth].length :
+				lineno <= inc[depth].last))
+			depth--;
+		inc[depth].last = lineno;
+
+		stmt = statement(src);
+		if (addr >= 0 && nbytes > 0 && *stmt != '.')
+			mark(inc[depth].sf, lineno, COVER_GET(cv->exec, addr) ? 1 : 0);
+
+		if (depth + 1 < MAXINCLUDE && includes(stmt, dir, path, sizeof path))
+		{
+			depth++;
+			inc[depth].sf = source(files, path);
+			inc[depth].length = linesin(path);
+			inc[depth].last = 0;
+		}
+	}
+
+	fclose(fp);
+	return 0;
+}
+
+static int
+lcov(coverage *cv, const char *path, const char *lists)
+{
+	char lst[PATH_MAX];
+	srcfile *files = NULL, *sf, *next;
+	const char *p = lists, *dot;
+	FILE *fp;
+	size_t n;
+	int i, found, hit, err = 0;
+
+	while (*p)
+	{
+		n = strcspn(p, ":,");
+		if (n > 0 && n < sizeof lst)
+		{
+			memcpy(lst, p, n);
+			lst[n] = '\0';
+
+			/* listings only - a map has no lines to go by */
+			dot = strrchr(lst, '.');
+			if (dot && (strcmp(dot, ".lst") == 0 || strcmp(dot, ".rst") == 0)
+					&& readlisting(cv, lst, &files) != 0)
+				fprintf(stderr, "Cannot read %s!\r\n", lst);
+		}
+		p += n;
+		if (*p)
+			p++;
+	}
+
+	if (files == NULL)
+		return 0;
+
+	if ((fp = fopen(path, "w")) == NULL)
+		err = 1;
+
+	for (sf = files; sf != NULL; sf = next)
+	{
+		next = sf->next;
+
+		if (fp != NULL)
+		{
+			fprintf(fp, "TN:z80\nSF:%s\n", sf->path);
+			for (found = hit = 0, i = 1; i < sf->nlines; i++)
+				if (sf->lines[i] >= 0)
+				{
+					fprintf(fp, "DA:%d,%d\n", i, sf->lines[i]);
+					found++;
+					hit += sf->lines[i] > 0;
+				}
+			fprintf(fp, "LF:%d\nLH:%d\nend_of_record\n", found, hit);
+		}
+
+		free(sf->lines);
+		free(sf->path);
+		free(sf);
+	}
+
+	if (fp != NULL && fclose(fp) != 0)
+		err = 1;
+	return err;
+}
+
+int
+coverage_report(coverage *cv, const char *prefix, const char *lists)
+{
+	char path[PATH_MAX];
+	FILE *fp;
+	int err = 0;
+
+	snprintf(path, sizeof path, "%s.bin", prefix);
+	if ((fp = fopen(path, "wb")) == NULL)
+		return 1;
+	if (fwrite(cv->exec, sizeof cv->exec, 1, fp) != 1 ||
+			fwrite(cv->read, sizeof cv->read, 1, fp) != 1 ||
+			fwrite(cv->written, sizeof cv->written, 1, fp) != 1)
+		err = 1;
+	if (fclose(fp) != 0)
+		err = 1;
+
+	if (lists != NULL)
+	{
+		snprintf(path, sizeof path, "%s.info", prefix);
+		err |= lcov(cv, path, lists);
+	}
+	return err;
+}
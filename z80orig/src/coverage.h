@@ -0,0 +1,58 @@
+/*-----------------------------------------------------------------------*\
+ |  coverage.h  --  which addresses the z80 has run, read and written    |
+ |                                                                       |
+ |  A bit for each address, set as an instruction is fetched from it;    |
+ |  that's one OR per instruction.  Reads and writes can be kept too,    |
+ |  through membrk (M_ACCESS), but only until an address has been        |
+ |  both read and written, after which it goes back to full speed        |
+ |  (unless the heatmap wants it too).                                   |
+ |                                                                       |
+ |  At the end the maps are saved, exec then read then written, 8K       |
+ |  each (bit n of byte a is address a*8+n), and the exec map is turned  |
+ |  into an lcov tracefile for genhtml and the like, by way of the       |
+ |  ASxxxx listings (foo.lst) of the code - each line that assembled     |
+ |  into an instruction is counted against its line in the .asm, and     |
+ |  in the files it .includes.                                           |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+#ifndef __COVERAGE_H_
+#define __COVERAGE_H_
+
+#include <stdio.h>
+#include "defs.h"
+
+
+#define COVERAGE_DEFPREFIX	"z80cover"	/* .bin and .info */
+
+typedef struct coverage
+{
+	byte exec[0x10000L / 8];
+	byte read[0x10000L / 8];
+	byte written[0x10000L / 8];
+	int data;		/* the read and written maps are being kept */
+} coverage;
+
+#define COVER_SET(map, addr)	((map)[(word)(addr) >> 3] |= 1 << ((addr) & 7))
+#define COVER_GET(map, addr)	((map)[(word)(addr) >> 3] & 1 << ((addr) & 7))
+
+
+/* start with nothing covered - 'data' to keep reads and writes as well
+   (only with MEM_BREAK) */
+coverage *coverage_start(z80info *z80, int data);
+
+/* from read_mem()/write_mem(), for an address with M_ACCESS on */
+void coverage_access(coverage *cv, z80info *z80, word addr, int write);
+
+/* how much has been run, and where */
+void coverage_summary(coverage *cv, FILE *fp);
+
+/* write 'prefix'.bin, and 'prefix'.info from the listings in 'lists'
+   (separated by ':' or ',', as for symtab_loadlist - .map files and
+   such are passed over) if there are any.  return 0 if ok */
+int coverage_report(coverage *cv, const char *prefix, const char *lists);
+
+void coverage_stop(coverage *cv, z80info *z80);
+
+#endif
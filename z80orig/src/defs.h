@@ -133,6 +133,9 @@ typedef struct z80info
     byte iff, iff2, imode;
     byte reset, nmi, intr, halt;
 
+    /* T-states executed since the z80 struct was created */
+    unsigned long long cycles;
+
     /* these point to the addresses of the above registers */
     byte *reg[8];
     word *regpairaf[4];
@@ -145,6 +148,10 @@ typedef struct z80info
     boolean trace;		/* trace mode off/on */
     boolean step;		/* step-trace mode off/on */
     int sig;		/* caught a signal */
+    struct tracering *tracering;	/* binary trace, or NULL */
+    struct profile *profile;	/* PC sampler, or NULL */
+    struct callgraph *callgraph;	/* shadow call stack, or NULL */
+    struct coverage *coverage;	/* addresses run, or NULL */
 #ifdef BUILD_CPM
     int syscall;	/* CP/M syscall to be done */
     int biosfn;		/* BIOS function be done */
@@ -156,6 +163,18 @@ typedef struct z80info
     word sector;
     FILE *drives[MAXDISCS];
     long drivelen[MAXDISCS];
+    byte *drivemap[MAXDISCS];	/* mmap'd image, or NULL */
+    long drivemaplen[MAXDISCS];
+    long drivedirtylo[MAXDISCS];	/* written since last flush, or lo > hi */
+    long drivedirtyhi[MAXDISCS];
+    struct hostdisc *drivehost[MAXDISCS];	/* host directory drives */
+
+    /* what the BDOS has been told, for the BDOS trap */
+    unsigned bdostraps;		/* drives whose file calls we do, 1 << n */
+    int bdosdrive;
+    int bdosuser;
+    word bdosdma;
+    int bdossearch;		/* drive search first was done on, or -1 */
 #endif
 
     /* 64k bytes - may be allocated separately if desired */
@@ -165,6 +184,8 @@ typedef struct z80info
     /* one for each byte of memory for breaks, memory-mapped I/O, etc */
     byte membrk[0x10000L];
     long numbrks;
+    struct breaks *breaks;	/* ones with conditions, or NULL */
+    struct gdbstub *gdb;	/* remote debugger, or NULL */
 #endif
 } z80info;
 
@@ -187,6 +208,7 @@ void reset_handle( z80info * z80 );
 #ifdef EXTERNAL_MEM
 void mem_init( z80info *z80 );
 word mem_read( z80info * z80, word addr );
+word mem_peek( z80info * z80, word addr );	/* no stats, no heatmap */
 word mem_write( z80info * z80, word addr, byte val );
 #endif
 
@@ -207,10 +229,12 @@ void io_input( z80info *z80, byte haddr, byte laddr, byte *val );
 #ifdef EXTERNAL_MEM
     /* we use the external mem_*() functions */
     #define Z80MEMREAD( A ) 	 mem_read( z80, (word)(A) )
+    #define Z80MEMPEEK( A ) 	 mem_peek( z80, (word)(A) )
     #define Z80MEMWRITE( A, V )  mem_write( z80, (word)(A), (byte)(V) )
 #else
     /* we use the internal direct access */
     #define Z80MEMREAD( A ) 	 z80->mem[(word)(A)]
+    #define Z80MEMPEEK( A ) 	 z80->mem[(word)(A)]
     #define Z80MEMWRITE( A, V )  (z80->mem[(word)(A)] = (byte)(V))
 #endif
 
@@ -230,17 +254,28 @@ void io_input( z80info *z80, byte haddr, byte laddr, byte *val );
 		(z80->membrk[(word)(addr)] ?	\
 		write_mem(z80, addr, val) :	\
 		Z80MEMWRITE( addr, val ) )
+/* the same for an opcode fetch, which is the only place the exec
+   breakpoints are looked at - not the operand bytes after it */
+#    define FETCH(addr)	\
+		(z80->membrk[(word)(addr)] ?	\
+		fetch_mem(z80, addr) :	\
+		Z80MEMREAD( addr ) )
 
 	/* various flags for "membrk" - others may be added */
 #	define M_BREAKPOINT	0x01		/* breakpoint */
 #	define M_READ_PROTECT	0x02		/* read-protected memory */
 #	define M_WRITE_PROTECT	0x04		/* write-protected memory */
 #	define M_MEM_MAPPED_IO	0x08		/* memory-mapped I/O addr */
+#	define M_EXEC_BREAK	0x10		/* breakpoint with a condition */
+#	define M_READ_WATCH	0x20		/* read watchpoint */
+#	define M_WRITE_WATCH	0x40		/* write watchpoint */
+#	define M_ACCESS		0x80		/* coverage/heatmap want reads/writes */
 
 #else
 //#    define MEM(addr)         z80->mem[(word)(addr)]
 //#    define SETMEM(addr, val) (z80->mem[(word)(addr)] = (byte)(val))
 #    define MEM(addr)         Z80MEMREAD( addr )
+#    define FETCH(addr)       Z80MEMREAD( addr )
 #    define SETMEM(addr, val) Z80MEMWRITE( addr, val )
 #endif
 
@@ -302,6 +337,13 @@ extern void delete_z80info(z80info *z80);
 
 extern boolean z80_emulator(z80info *z80, int count);
 
+/* cycles.c - T-states, indexed by the opcode following any prefix */
+extern const byte z80_cycles_main[0x100];
+extern const byte z80_cycles_cb[0x100];
+extern const byte z80_cycles_ed[0x100];
+extern const byte z80_cycles_xy[0x100];
+extern const byte z80_cycles_xycb[0x100];
+
 /* main.c */
 extern void z_resetterm(void);	/* standard mode */
 extern void z_setterm(void);	/* fancy capture mode */
@@ -311,6 +353,7 @@ extern boolean input(z80info *z80, byte haddr, byte laddr, byte *val);
 extern void output(z80info *z80, byte haddr, byte laddr, byte data);
 
 extern word read_mem(z80info *z80, word addr);
+extern word fetch_mem(z80info *z80, word addr);
 extern word write_mem(z80info *z80, word addr, byte val);
 
 extern void haltcpu(z80info *z80);
@@ -323,8 +366,7 @@ extern void bios(z80info *z80, int fn);
 extern void sysreset(z80info *z80);
 #endif
 
-/* disassem.c */
-extern int disassemlen(z80info *z80);
+/* disassem.c - see disassem.h for the rest */
 extern int disassem(z80info *z80, word start, FILE *fp);
 
 #endif /* __DEFS_H_ */
@@ -2,7 +2,8 @@
  |  disassem.c  --  Z80 disassembler                                     |
  |                                                                       |
  |  Originally by T.J. Merritt but modified and debugged to run in the   |
- |  Z80 emulator instead of being standalone.                            |
+ |  Z80 emulator instead of being standalone.  Now driven by tables, so  |
+ |  that it's reentrant and fast enough for whole traces and ROMs.      |
  |                                                                       |
  |  Copyright 1986-1988 by Parag Patel.  All Rights Reserved.            |
  |  Copyright 1994-1995 by CodeGen, Inc.  All Rights Reserved.           |
@@ -12,842 +13,830 @@
 #include <stdio.h>
 #include <string.h>
 #include "defs.h"
+#include "disassem.h"
 
 
-#define bits(l,r) (((z80->mem[loc]) >> (r)) & mask[(l) - (r)])
-#define put_cc(cc) put_str(cc_names[cc])
-
-#define OPC_LD "LD    "
-#define OPC_INC "INC   "
-#define OPC_DEC "DEC   "
-#define OPC_ADD "ADD   "
-#define OPC_RET "RET   "
-#define OPC_POP "POP   "
-#define OPC_EXX "EXX   "
-#define OPC_JP "JP    "
-#define OPC_OUT "OUT   "
-#define OPC_IN "IN    "
-#define OPC_EX "EX    "
-#define OPC_DI "DI    "
-#define OPC_EI "EI    "
-#define OPC_CALL "CALL  "
-#define OPC_PUSH "PUSH  "
 #define OPC_ILLEGAL "***"
-#define OPC_RST "RST   "
 
-static int
-mask[] =
-{
-	0x001,
-	0x003,
-	0x007,
-	0x00F,
-	0x01F,
-	0x03F,
-	0x07F,
-	0x0FF
-};
+/* An opcode's operands are written as they're printed, with these for
+   the parts that depend on the bytes that follow or on a DD/FD prefix:
 
-static char *
-rr_names[] =
-{
-	"B",
-	"C",
-	"D",
-	"E",
-	"H",
-	"L",
-	"(HL)",
-	"A"
-};
+	%n	a byte
+	%w	a word
+	%a	a word that's where it jumps or calls to
+	%j	a relative jump
+	%t	a restart
+	%h	HL, IX or IY
+	%m	(HL), (IX+d) or (IY+d)
 
-static char *
-dd_names[] =
-{
-	"BC",
-	"DE",
-	"HL",
-	"SP"
-};
+   With a DD or FD prefix, an opcode without %h or %m isn't one the z80
+   here does (nor are the undocumented IXH and IXL). */
 
-static char *
-qq_names[] =
+typedef struct opcode
 {
-	"BC",
-	"DE",
-	"HL",
-	"AF"
-};
-
-static char *
-cc_names[] =
+	const char *mnemonic;	/* NULL if there's no such instruction */
+	const char *operands;
+	int flow;		/* DIS_ */
+	int more;		/* extra T-states when taken / repeating */
+} opcode;
+
+/* unprefixed, and DD/FD */
+static const opcode
+main_ops[0x100] =
 {
-	"NZ",
-	"Z",
-	"NC",
-	"C",
-	"PO",
-	"PE",
-	"P",
-	"M"
+	{ "NOP",  "" },				/* 00 */
+	{ "LD",   "BC,%w" },			/* 01 */
+	{ "LD",   "(BC),A" },			/* 02 */
+	{ "INC",  "BC" },			/* 03 */
+	{ "INC",  "B" },			/* 04 */
+	{ "DEC",  "B" },			/* 05 */
+	{ "LD",   "B,%n" },			/* 06 */
+	{ "RLCA", "" },				/* 07 */
+	{ "EX",   "AF,AF'" },			/* 08 */
+	{ "ADD",  "%h,BC" },			/* 09 */
+	{ "LD",   "A,(BC)" },			/* 0A */
+	{ "DEC",  "BC" },			/* 0B */
+	{ "INC",  "C" },			/* 0C */
+	{ "DEC",  "C" },			/* 0D */
+	{ "LD",   "C,%n" },			/* 0E */
+	{ "RRCA", "" },				/* 0F */
+	{ "DJNZ", "%j", DIS_JUMP | DIS_COND, 5 },	/* 10 */
+	{ "LD",   "DE,%w" },			/* 11 */
+	{ "LD",   "(DE),A" },			/* 12 */
+	{ "INC",  "DE" },			/* 13 */
+	{ "INC",  "D" },			/* 14 */
+	{ "DEC",  "D" },			/* 15 */
+	{ "LD",   "D,%n" },			/* 16 */
+	{ "RLA",  "" },				/* 17 */
+	{ "JR",   "%j", DIS_JUMP },		/* 18 */
+	{ "ADD",  "%h,DE" },			/* 19 */
+	{ "LD",   "A,(DE)" },			/* 1A */
+	{ "DEC",  "DE" },			/* 1B */
+	{ "INC",  "E" },			/* 1C */
+	{ "DEC",  "E" },			/* 1D */
+	{ "LD",   "E,%n" },			/* 1E */
+	{ "RRA",  "" },				/* 1F */
+	{ "JR",   "NZ,%j", DIS_JUMP | DIS_COND, 5 },	/* 20 */
+	{ "LD",   "%h,%w" },			/* 21 */
+	{ "LD",   "(%w),%h" },			/* 22 */
+	{ "INC",  "%h" },			/* 23 */
+	{ "INC",  "H" },			/* 24 */
+	{ "DEC",  "H" },			/* 25 */
+	{ "LD",   "H,%n" },			/* 26 */
+	{ "DAA",  "" },				/* 27 */
+	{ "JR",   "Z,%j", DIS_JUMP | DIS_COND, 5 },	/* 28 */
+	{ "ADD",  "%h,%h" },			/* 29 */
+	{ "LD",   "%h,(%w)" },			/* 2A */
+	{ "DEC",  "%h" },			/* 2B */
+	{ "INC",  "L" },			/* 2C */
+	{ "DEC",  "L" },			/* 2D */
+	{ "LD",   "L,%n" },			/* 2E */
+	{ "CPL",  "" },				/* 2F */
+	{ "JR",   "NC,%j", DIS_JUMP | DIS_COND, 5 },	/* 30 */
+	{ "LD",   "SP,%w" },			/* 31 */
+	{ "LD",   "(%w),A" },			/* 32 */
+	{ "INC",  "SP" },			/* 33 */
+	{ "INC",  "%m" },			/* 34 */
+	{ "DEC",  "%m" },			/* 35 */
+	{ "LD",   "%m,%n" },			/* 36 */
+	{ "SCF",  "" },				/* 37 */
+	{ "JR",   "C,%j", DIS_JUMP | DIS_COND, 5 },	/* 38 */
+	{ "ADD",  "%h,SP" },			/* 39 */
+	{ "LD",   "A,(%w)" },			/* 3A */
+	{ "DEC",  "SP" },			/* 3B */
+	{ "INC",  "A" },			/* 3C */
+	{ "DEC",  "A" },			/* 3D */
+	{ "LD",   "A,%n" },			/* 3E */
+	{ "CCF",  "" },				/* 3F */
+	{ "LD",   "B,B" },			/* 40 */
+	{ "LD",   "B,C" },			/* 41 */
+	{ "LD",   "B,D" },			/* 42 */
+	{ "LD",   "B,E" },			/* 43 */
+	{ "LD",   "B,H" },			/* 44 */
+	{ "LD",   "B,L" },			/* 45 */
+	{ "LD",   "B,%m" },			/* 46 */
+	{ "LD",   "B,A" },			/* 47 */
+	{ "LD",   "C,B" },			/* 48 */
+	{ "LD",   "C,C" },			/* 49 */
+	{ "LD",   "C,D" },			/* 4A */
+	{ "LD",   "C,E" },			/* 4B */
+	{ "LD",   "C,H" },			/* 4C */
+	{ "LD",   "C,L" },			/* 4D */
+	{ "LD",   "C,%m" },			/* 4E */
+	{ "LD",   "C,A" },			/* 4F */
+	{ "LD",   "D,B" },			/* 50 */
+	{ "LD",   "D,C" },			/* 51 */
+	{ "LD",   "D,D" },			/* 52 */
+	{ "LD",   "D,E" },			/* 53 */
+	{ "LD",   "D,H" },			/* 54 */
+	{ "LD",   "D,L" },			/* 55 */
+	{ "LD",   "D,%m" },			/* 56 */
+	{ "LD",   "D,A" },			/* 57 */
+	{ "LD",   "E,B" },			/* 58 */
+	{ "LD",   "E,C" },			/* 59 */
+	{ "LD",   "E,D" },			/* 5A */
+	{ "LD",   "E,E" },			/* 5B */
+	{ "LD",   "E,H" },			/* 5C */
+	{ "LD",   "E,L" },			/* 5D */
+	{ "LD",   "E,%m" },			/* 5E */
+	{ "LD",   "E,A" },			/* 5F */
+	{ "LD",   "H,B" },			/* 60 */
+	{ "LD",   "H,C" },			/* 61 */
+	{ "LD",   "H,D" },			/* 62 */
+	{ "LD",   "H,E" },			/* 63 */
+	{ "LD",   "H,H" },			/* 64 */
+	{ "LD",   "H,L" },			/* 65 */
+	{ "LD",   "H,%m" },			/* 66 */
+	{ "LD",   "H,A" },			/* 67 */
+	{ "LD",   "L,B" },			/* 68 */
+	{ "LD",   "L,C" },			/* 69 */
+	{ "LD",   "L,D" },			/* 6A */
+	{ "LD",   "L,E" },			/* 6B */
+	{ "LD",   "L,H" },			/* 6C */
+	{ "LD",   "L,L" },			/* 6D */
+	{ "LD",   "L,%m" },			/* 6E */
+	{ "LD",   "L,A" },			/* 6F */
+	{ "LD",   "%m,B" },			/* 70 */
+	{ "LD",   "%m,C" },			/* 71 */
+	{ "LD",   "%m,D" },			/* 72 */
+	{ "LD",   "%m,E" },			/* 73 */
+	{ "LD",   "%m,H" },			/* 74 */
+	{ "LD",   "%m,L" },			/* 75 */
+	{ "HALT", "" },				/* 76 */
+	{ "LD",   "%m,A" },			/* 77 */
+	{ "LD",   "A,B" },			/* 78 */
+	{ "LD",   "A,C" },			/* 79 */
+	{ "LD",   "A,D" },			/* 7A */
+	{ "LD",   "A,E" },			/* 7B */
+	{ "LD",   "A,H" },			/* 7C */
+	{ "LD",   "A,L" },			/* 7D */
+	{ "LD",   "A,%m" },			/* 7E */
+	{ "LD",   "A,A" },			/* 7F */
+	{ "ADD",  "A,B" },			/* 80 */
+	{ "ADD",  "A,C" },			/* 81 */
+	{ "ADD",  "A,D" },			/* 82 */
+	{ "ADD",  "A,E" },			/* 83 */
+	{ "ADD",  "A,H" },			/* 84 */
+	{ "ADD",  "A,L" },			/* 85 */
+	{ "ADD",  "A,%m" },			/* 86 */
+	{ "ADD",  "A,A" },			/* 87 */
+	{ "ADC",  "A,B" },			/* 88 */
+	{ "ADC",  "A,C" },			/* 89 */
+	{ "ADC",  "A,D" },			/* 8A */
+	{ "ADC",  "A,E" },			/* 8B */
+	{ "ADC",  "A,H" },			/* 8C */
+	{ "ADC",  "A,L" },			/* 8D */
+	{ "ADC",  "A,%m" },			/* 8E */
+	{ "ADC",  "A,A" },			/* 8F */
+	{ "SUB",  "B" },			/* 90 */
+	{ "SUB",  "C" },			/* 91 */
+	{ "SUB",  "D" },			/* 92 */
+	{ "SUB",  "E" },			/* 93 */
+	{ "SUB",  "H" },			/* 94 */
+	{ "SUB",  "L" },			/* 95 */
+	{ "SUB",  "%m" },			/* 96 */
+	{ "SUB",  "A" },			/* 97 */
+	{ "SBC",  "A,B" },			/* 98 */
+	{ "SBC",  "A,C" },			/* 99 */
+	{ "SBC",  "A,D" },			/* 9A */
+	{ "SBC",  "A,E" },			/* 9B */
+	{ "SBC",  "A,H" },			/* 9C */
+	{ "SBC",  "A,L" },			/* 9D */
+	{ "SBC",  "A,%m" },			/* 9E */
+	{ "SBC",  "A,A" },			/* 9F */
+	{ "AND",  "B" },			/* A0 */
+	{ "AND",  "C" },			/* A1 */
+	{ "AND",  "D" },			/* A2 */
+	{ "AND",  "E" },			/* A3 */
+	{ "AND",  "H" },			/* A4 */
+	{ "AND",  "L" },			/* A5 */
+	{ "AND",  "%m" },			/* A6 */
+	{ "AND",  "A" },			/* A7 */
+	{ "XOR",  "B" },			/* A8 */
+	{ "XOR",  "C" },			/* A9 */
+	{ "XOR",  "D" },			/* AA */
+	{ "XOR",  "E" },			/* AB */
+	{ "XOR",  "H" },			/* AC */
+	{ "XOR",  "L" },			/* AD */
+	{ "XOR",  "%m" },			/* AE */
+	{ "XOR",  "A" },			/* AF */
+	{ "OR",   "B" },			/* B0 */
+	{ "OR",   "C" },			/* B1 */
+	{ "OR",   "D" },			/* B2 */
+	{ "OR",   "E" },			/* B3 */
+	{ "OR",   "H" },			/* B4 */
+	{ "OR",   "L" },			/* B5 */
+	{ "OR",   "%m" },			/* B6 */
+	{ "OR",   "A" },			/* B7 */
+	{ "CP",   "B" },			/* B8 */
+	{ "CP",   "C" },			/* B9 */
+	{ "CP",   "D" },			/* BA */
+	{ "CP",   "E" },			/* BB */
+	{ "CP",   "H" },			/* BC */
+	{ "CP",   "L" },			/* BD */
+	{ "CP",   "%m" },			/* BE */
+	{ "CP",   "A" },			/* BF */
+	{ "RET",  "NZ", DIS_RET | DIS_COND, 6 },	/* C0 */
+	{ "POP",  "BC" },			/* C1 */
+	{ "JP",   "NZ,%a", DIS_JUMP | DIS_COND },	/* C2 */
+	{ "JP",   "%a", DIS_JUMP },		/* C3 */
+	{ "CALL", "NZ,%a", DIS_CALL | DIS_COND, 7 },	/* C4 */
+	{ "PUSH", "BC" },			/* C5 */
+	{ "ADD",  "A,%n" },			/* C6 */
+	{ "RST",  "%t", DIS_CALL },		/* C7 */
+	{ "RET",  "Z", DIS_RET | DIS_COND, 6 },	/* C8 */
+	{ "RET",  "", DIS_RET },		/* C9 */
+	{ "JP",   "Z,%a", DIS_JUMP | DIS_COND },	/* CA */
+	{ NULL },				/* CB */
+	{ "CALL", "Z,%a", DIS_CALL | DIS_COND, 7 },	/* CC */
+	{ "CALL", "%a", DIS_CALL },		/* CD */
+	{ "ADC",  "A,%n" },			/* CE */
+	{ "RST",  "%t", DIS_CALL },		/* CF */
+	{ "RET",  "NC", DIS_RET | DIS_COND, 6 },	/* D0 */
+	{ "POP",  "DE" },			/* D1 */
+	{ "JP",   "NC,%a", DIS_JUMP | DIS_COND },	/* D2 */
+	{ "OUT",  "(%n),A" },			/* D3 */
+	{ "CALL", "NC,%a", DIS_CALL | DIS_COND, 7 },	/* D4 */
+	{ "PUSH", "DE" },			/* D5 */
+	{ "SUB",  "%n" },			/* D6 */
+	{ "RST",  "%t", DIS_CALL },		/* D7 */
+	{ "RET",  "C", DIS_RET | DIS_COND, 6 },	/* D8 */
+	{ "EXX",  "" },				/* D9 */
+	{ "JP",   "C,%a", DIS_JUMP | DIS_COND },	/* DA */
+	{ "IN",   "A,(%n)" },			/* DB */
+	{ "CALL", "C,%a", DIS_CALL | DIS_COND, 7 },	/* DC */
+	{ NULL },				/* DD */
+	{ "SBC",  "A,%n" },			/* DE */
+	{ "RST",  "%t", DIS_CALL },		/* DF */
+	{ "RET",  "PO", DIS_RET | DIS_COND, 6 },	/* E0 */
+	{ "POP",  "%h" },			/* E1 */
+	{ "JP",   "PO,%a", DIS_JUMP | DIS_COND },	/* E2 */
+	{ "EX",   "(SP),%h" },			/* E3 */
+	{ "CALL", "PO,%a", DIS_CALL | DIS_COND, 7 },	/* E4 */
+	{ "PUSH", "%h" },			/* E5 */
+	{ "AND",  "%n" },			/* E6 */
+	{ "RST",  "%t", DIS_CALL },		/* E7 */
+	{ "RET",  "PE", DIS_RET | DIS_COND, 6 },	/* E8 */
+	{ "JP",   "(%h)", DIS_JUMP },		/* E9 */
+	{ "JP",   "PE,%a", DIS_JUMP | DIS_COND },	/* EA */
+	{ "EX",   "DE,HL" },			/* EB */
+	{ "CALL", "PE,%a", DIS_CALL | DIS_COND, 7 },	/* EC */
+	{ NULL },				/* ED */
+	{ "XOR",  "%n" },			/* EE */
+	{ "RST",  "%t", DIS_CALL },		/* EF */
+	{ "RET",  "P", DIS_RET | DIS_COND, 6 },	/* F0 */
+	{ "POP",  "AF" },			/* F1 */
+	{ "JP",   "P,%a", DIS_JUMP | DIS_COND },	/* F2 */
+	{ "DI",   "" },				/* F3 */
+	{ "CALL", "P,%a", DIS_CALL | DIS_COND, 7 },	/* F4 */
+	{ "PUSH", "AF" },			/* F5 */
+	{ "OR",   "%n" },			/* F6 */
+	{ "RST",  "%t", DIS_CALL },		/* F7 */
+	{ "RET",  "M", DIS_RET | DIS_COND, 6 },	/* F8 */
+	{ "LD",   "SP,%h" },			/* F9 */
+	{ "JP",   "M,%a", DIS_JUMP | DIS_COND },	/* FA */
+	{ "EI",   "" },				/* FB */
+	{ "CALL", "M,%a", DIS_CALL | DIS_COND, 7 },	/* FC */
+	{ NULL },				/* FD */
+	{ "CP",   "%n" },			/* FE */
+	{ "RST",  "%t", DIS_CALL }		/* FF */
 };
 
-static char *
-op_names[] =
+/* ED-prefixed */
+static const opcode
+ed_ops[0x100] =
 {
-	"ADD   A,",
-	"ADC   A,",
-	"SUB   ",
-	"SBC   A,",
-	"AND   ",
-	"XOR   ",
-	"OR    ",
-	"CP    ",
+	{ NULL },				/* 00 */
+	{ NULL },				/* 01 */
+	{ NULL },				/* 02 */
+	{ NULL },				/* 03 */
+	{ NULL },				/* 04 */
+	{ NULL },				/* 05 */
+	{ NULL },				/* 06 */
+	{ NULL },				/* 07 */
+	{ NULL },				/* 08 */
+	{ NULL },				/* 09 */
+	{ NULL },				/* 0A */
+	{ NULL },				/* 0B */
+	{ NULL },				/* 0C */
+	{ NULL },				/* 0D */
+	{ NULL },				/* 0E */
+	{ NULL },				/* 0F */
+	{ NULL },				/* 10 */
+	{ NULL },				/* 11 */
+	{ NULL },				/* 12 */
+	{ NULL },				/* 13 */
+	{ NULL },				/* 14 */
+	{ NULL },				/* 15 */
+	{ NULL },				/* 16 */
+	{ NULL },				/* 17 */
+	{ NULL },				/* 18 */
+	{ NULL },				/* 19 */
+	{ NULL },				/* 1A */
+	{ NULL },				/* 1B */
+	{ NULL },				/* 1C */
+	{ NULL },				/* 1D */
+	{ NULL },				/* 1E */
+	{ NULL },				/* 1F */
+	{ NULL },				/* 20 */
+	{ NULL },				/* 21 */
+	{ NULL },				/* 22 */
+	{ NULL },				/* 23 */
+	{ NULL },				/* 24 */
+	{ NULL },				/* 25 */
+	{ NULL },				/* 26 */
+	{ NULL },				/* 27 */
+	{ NULL },				/* 28 */
+	{ NULL },				/* 29 */
+	{ NULL },				/* 2A */
+	{ NULL },				/* 2B */
+	{ NULL },				/* 2C */
+	{ NULL },				/* 2D */
+	{ NULL },				/* 2E */
+	{ NULL },				/* 2F */
+	{ NULL },				/* 30 */
+	{ NULL },				/* 31 */
+	{ NULL },				/* 32 */
+	{ NULL },				/* 33 */
+	{ NULL },				/* 34 */
+	{ NULL },				/* 35 */
+	{ NULL },				/* 36 */
+	{ NULL },				/* 37 */
+	{ NULL },				/* 38 */
+	{ NULL },				/* 39 */
+	{ NULL },				/* 3A */
+	{ NULL },				/* 3B */
+	{ NULL },				/* 3C */
+	{ NULL },				/* 3D */
+	{ NULL },				/* 3E */
+	{ NULL },				/* 3F */
+	{ "IN",   "B,(C)" },			/* 40 */
+	{ "OUT",  "(C),B" },			/* 41 */
+	{ "SBC",  "HL,BC" },			/* 42 */
+	{ "LD",   "(%w),BC" },			/* 43 */
+	{ "NEG",  "" },				/* 44 */
+	{ "RETN", "", DIS_RET },		/* 45 */
+	{ "IM",   "0" },			/* 46 */
+	{ "LD",   "I,A" },			/* 47 */
+	{ "IN",   "C,(C)" },			/* 48 */
+	{ "OUT",  "(C),C" },			/* 49 */
+	{ "ADC",  "HL,BC" },			/* 4A */
+	{ "LD",   "BC,(%w)" },			/* 4B */
+	{ NULL },				/* 4C */
+	{ "RETI", "", DIS_RET },		/* 4D */
+	{ NULL },				/* 4E */
+	{ "LD",   "R,A" },			/* 4F */
+	{ "IN",   "D,(C)" },			/* 50 */
+	{ "OUT",  "(C),D" },			/* 51 */
+	{ "SBC",  "HL,DE" },			/* 52 */
+	{ "LD",   "(%w),DE" },			/* 53 */
+	{ NULL },				/* 54 */
+	{ NULL },				/* 55 */
+	{ "IM",   "1" },			/* 56 */
+	{ "LD",   "A,I" },			/* 57 */
+	{ "IN",   "E,(C)" },			/* 58 */
+	{ "OUT",  "(C),E" },			/* 59 */
+	{ "ADC",  "HL,DE" },			/* 5A */
+	{ "LD",   "DE,(%w)" },			/* 5B */
+	{ NULL },				/* 5C */
+	{ NULL },				/* 5D */
+	{ "IM",   "2" },			/* 5E */
+	{ "LD",   "A,R" },			/* 5F */
+	{ "IN",   "H,(C)" },			/* 60 */
+	{ "OUT",  "(C),H" },			/* 61 */
+	{ "SBC",  "HL,HL" },			/* 62 */
+	{ "LD",   "(%w),HL" },			/* 63 */
+	{ NULL },				/* 64 */
+	{ NULL },				/* 65 */
+	{ NULL },				/* 66 */
+	{ "RRD",  "" },				/* 67 */
+	{ "IN",   "L,(C)" },			/* 68 */
+	{ "OUT",  "(C),L" },			/* 69 */
+	{ "ADC",  "HL,HL" },			/* 6A */
+	{ "LD",   "HL,(%w)" },			/* 6B */
+	{ NULL },				/* 6C */
+	{ NULL },				/* 6D */
+	{ NULL },				/* 6E */
+	{ "RLD",  "" },				/* 6F */
+	{ "IN",   "(C)" },			/* 70 */
+	{ NULL },				/* 71 */
+	{ "SBC",  "HL,SP" },			/* 72 */
+	{ "LD",   "(%w),SP" },			/* 73 */
+	{ NULL },				/* 74 */
+	{ NULL },				/* 75 */
+	{ NULL },				/* 76 */
+	{ NULL },				/* 77 */
+	{ "IN",   "A,(C)" },			/* 78 */
+	{ "OUT",  "(C),A" },			/* 79 */
+	{ "ADC",  "HL,SP" },			/* 7A */
+	{ "LD",   "SP,(%w)" },			/* 7B */
+	{ NULL },				/* 7C */
+	{ NULL },				/* 7D */
+	{ NULL },				/* 7E */
+	{ NULL },				/* 7F */
+	{ NULL },				/* 80 */
+	{ NULL },				/* 81 */
+	{ NULL },				/* 82 */
+	{ NULL },				/* 83 */
+	{ NULL },				/* 84 */
+	{ NULL },				/* 85 */
+	{ NULL },				/* 86 */
+	{ NULL },				/* 87 */
+	{ NULL },				/* 88 */
+	{ NULL },				/* 89 */
+	{ NULL },				/* 8A */
+	{ NULL },				/* 8B */
+	{ NULL },				/* 8C */
+	{ NULL },				/* 8D */
+	{ NULL },				/* 8E */
+	{ NULL },				/* 8F */
+	{ NULL },				/* 90 */
+	{ NULL },				/* 91 */
+	{ NULL },				/* 92 */
+	{ NULL },				/* 93 */
+	{ NULL },				/* 94 */
+	{ NULL },				/* 95 */
+	{ NULL },				/* 96 */
+	{ NULL },				/* 97 */
+	{ NULL },				/* 98 */
+	{ NULL },				/* 99 */
+	{ NULL },				/* 9A */
+	{ NULL },				/* 9B */
+	{ NULL },				/* 9C */
+	{ NULL },				/* 9D */
+	{ NULL },				/* 9E */
+	{ NULL },				/* 9F */
+	{ "LDI",  "" },				/* A0 */
+	{ "CPI",  "" },				/* A1 */
+	{ "INI",  "" },				/* A2 */
+	{ "OUTI", "" },				/* A3 */
+	{ NULL },				/* A4 */
+	{ NULL },				/* A5 */
+	{ NULL },				/* A6 */
+	{ NULL },				/* A7 */
+	{ "LDD",  "" },				/* A8 */
+	{ "CPD",  "" },				/* A9 */
+	{ "IND",  "" },				/* AA */
+	{ "OUTD", "" },				/* AB */
+	{ NULL },				/* AC */
+	{ NULL },				/* AD */
+	{ NULL },				/* AE */
+	{ NULL },				/* AF */
+	{ "LDIR", "", DIS_REPEAT, 5 },		/* B0 */
+	{ "CPIR", "", DIS_REPEAT, 5 },		/* B1 */
+	{ "INIR", "", DIS_REPEAT, 5 },		/* B2 */
+	{ "OTIR", "", DIS_REPEAT, 5 },		/* B3 */
+	{ NULL },				/* B4 */
+	{ NULL },				/* B5 */
+	{ NULL },				/* B6 */
+	{ NULL },				/* B7 */
+	{ "LDDR", "", DIS_REPEAT, 5 },		/* B8 */
+	{ "CPDR", "", DIS_REPEAT, 5 },		/* B9 */
+	{ "INDR", "", DIS_REPEAT, 5 },		/* BA */
+	{ "OTDR", "", DIS_REPEAT, 5 },		/* BB */
+	{ NULL },				/* BC */
+	{ NULL },				/* BD */
+	{ NULL },				/* BE */
+	{ NULL },				/* BF */
+	{ NULL },				/* C0 */
+	{ NULL },				/* C1 */
+	{ NULL },				/* C2 */
+	{ NULL },				/* C3 */
+	{ NULL },				/* C4 */
+	{ NULL },				/* C5 */
+	{ NULL },				/* C6 */
+	{ NULL },				/* C7 */
+	{ NULL },				/* C8 */
+	{ NULL },				/* C9 */
+	{ NULL },				/* CA */
+	{ NULL },				/* CB */
+	{ NULL },				/* CC */
+	{ NULL },				/* CD */
+	{ NULL },				/* CE */
+	{ NULL },				/* CF */
+	{ NULL },				/* D0 */
+	{ NULL },				/* D1 */
+	{ NULL },				/* D2 */
+	{ NULL },				/* D3 */
+	{ NULL },				/* D4 */
+	{ NULL },				/* D5 */
+	{ NULL },				/* D6 */
+	{ NULL },				/* D7 */
+	{ NULL },				/* D8 */
+	{ NULL },				/* D9 */
+	{ NULL },				/* DA */
+	{ NULL },				/* DB */
+	{ NULL },				/* DC */
+	{ NULL },				/* DD */
+	{ NULL },				/* DE */
+	{ NULL },				/* DF */
+	{ NULL },				/* E0 */
+	{ NULL },				/* E1 */
+	{ NULL },				/* E2 */
+	{ NULL },				/* E3 */
+	{ NULL },				/* E4 */
+	{ NULL },				/* E5 */
+	{ NULL },				/* E6 */
+	{ NULL },				/* E7 */
+	{ NULL },				/* E8 */
+	{ NULL },				/* E9 */
+	{ NULL },				/* EA */
+	{ NULL },				/* EB */
+	{ NULL },				/* EC */
+	{ NULL },				/* ED */
+	{ NULL },				/* EE */
+	{ NULL },				/* EF */
+	{ NULL },				/* F0 */
+	{ NULL },				/* F1 */
+	{ NULL },				/* F2 */
+	{ NULL },				/* F3 */
+	{ NULL },				/* F4 */
+	{ NULL },				/* F5 */
+	{ NULL },				/* F6 */
+	{ NULL },				/* F7 */
+	{ NULL },				/* F8 */
+	{ NULL },				/* F9 */
+	{ NULL },				/* FA */
+	{ NULL },				/* FB */
+	{ NULL },				/* FC */
+	{ NULL },				/* FD */
+	{ NULL },				/* FE */
+	{ NULL }				/* FF */
 };
 
-static char *
-jr_op_names[] =
+/* CB-prefixed - these go by the bits of the opcode */
+static const char *
+shift_names[] =
 {
-	0,
-	0,
-	"DJNZ  ",
-	"JR    ",
-	"JR    NZ,",
-	"JR    Z,",
-	"JR    NC,",
-	"JR    C,"
+	"RLC", "RRC", "RL", "RR", "SLA", "SRA", NULL, "SRL"
 };
 
-static char *
-log_op_names[] =
+static const char *
+bit_names[] =
 {
-	"RLCA",
-	"RRCA",
-	"RLA",
-	"RRA",
-	"DAA",
-	"CPL",
-	"SCF",
-	"CCF"
+	NULL, "BIT", "RES", "SET"
 };
 
-static char *
-shf_op_names[] =
+static const char *
+reg_names[] =
 {
-	"RLC   ",
-	"RRC   ",
-	"RL    ",
-	"RR    ",
-	"SLA   ",
-	"SRA   ",
-	"SLL?  ",
-	"SRL   "
+	"B", "C", "D", "E", "H", "L", "%m", "A"
 };
 
-static char *
-bit_op_names[] =
-{
-	0,
-	"BIT   ",
-	"RES   ",
-	"SET   ",
-};
+static const char
+hexdigits[] = "0123456789ABCDEF";
 
-static char *
-rep_op_names[] =
-{
-	"LDI",
-	"CPI",
-	"INI",
-	"OUTI",
-	"LDD",
-	"CPD",
-	"IND",
-	"OUTD",
-	"LDIR",
-	"CPIR",
-	"INIR",
-	"OTIR",
-	"LDDR",
-	"CPDR",
-	"INDR",
-	"OTDR"
-};
 
-static char *index_reg;
-static int str_length;
-static FILE *fp;
+/*-----------------------------------------------------------------------*\
+ |  decoding
+\*-----------------------------------------------------------------------*/
 
-static void
-put_byte(byte b)
+typedef struct decoder
 {
-	fprintf(fp, "%02X", b & 0x0FF);
-	str_length += 2;
-}
-
-static void
-put_addr(z80info *z80, int loc)
+	disread rd;
+	void *ctx;
+	disinstr *d;
+	const char *ixy;	/* "IX" or "IY" after a prefix, else NULL */
+	int disp;		/* its displacement, or -1 if not read yet */
+	char *out, *end;
+} decoder;
+
+static byte
+fetch(decoder *dc)
 {
-	put_byte(z80->mem[loc]);
-	put_byte(z80->mem[(loc - 1) & 0x0FFFF]);
-}
+	disinstr *d = dc->d;
+	byte b = dc->rd(dc->ctx, (word)(d->addr + d->len));
 
-static void
-put_word(word w)
-{
-	fprintf(fp, "%04X", w & 0x0FFFF);
-	str_length += 4;
+	d->bytes[d->len++] = b;
+	return b;
 }
 
 static void
-put_digit(byte digit)
+put_str(decoder *dc, const char *s)
 {
-	fprintf(fp, "%01X", digit & 0x00F);
-	str_length += 1;
+	while (*s && dc->out < dc->end)
+		*dc->out++ = *s++;
 }
 
 static void
-put_char(char ch)
+put_hex(decoder *dc, unsigned v, int digits)
 {
-	putc(ch, fp);
-	str_length += 1;
+	while (digits-- > 0 && dc->out < dc->end)
+		*dc->out++ = hexdigits[(v >> (digits * 4)) & 0xF];
 }
 
+/* write out an opcode's operands, reading what they need as we go */
 static void
-put_str(char *str)
+operands(decoder *dc, const char *fmt)
 {
-	fprintf(fp, "%s", str);
-	str_length += strlen(str);
-}
+	disinstr *d = dc->d;
+	word w;
+	int e;
 
-static void
-put_reg(z80info *z80, int reg_num, int loc)
-{
-	int d;
-	
-	if (index_reg && (reg_num == 6))
+	for (; *fmt; fmt++)
 	{
-		put_str("(");
-		put_str(index_reg);
-		d = (signed char)z80->mem[loc + 1];
-
-		if (d < 0)
-		{
-			put_str("-");
-			put_byte(-d);
-		}
-		else
+		if (*fmt != '%')
 		{
-			put_str("+");
-			put_byte(d);
+			if (dc->out < dc->end)
+				*dc->out++ = *fmt;
+			continue;
 		}
 
-		put_str(")");
-	}
-	else
-	{
-		put_str(rr_names[reg_num]);
-	}
-}
-
-static void 
-put_dd_reg(int reg_num)
-{
-	if (index_reg)
-	{
-		if (reg_num == 2)
-			put_str(index_reg);
-		else if (reg_num == 3)
-			put_str("SP");
-		else
-			put_str(OPC_ILLEGAL);
-	}
-	else
-		put_str(dd_names[reg_num]);
-}
-
-static void
-put_qq_reg(int reg_num)
-{
-	if (index_reg)
-	{
-		if (reg_num == 2)
-			put_str(index_reg);
-		else
-			put_str(OPC_ILLEGAL);
-	}
-	else
-		put_str(qq_names[reg_num]);
-}
-
-int
-disassemlen(z80info *z80)
-{
-	return str_length;
-}
-
-int
-disassem(z80info *z80, word start, FILE *file)
-{
-	word loc;
-	int byte_count;
-	byte last_byte;
-
-	loc = start;
-	byte_count = 0;
-	str_length = 0;
-
-	if (file != NULL)
-	{
-		fp = file;
-		index_reg = NULL;
-	}
-
-	switch (bits(7,6))
-	{
-	case 0:
-		switch (bits(3,0))
+		switch (*++fmt)
 		{
-		case 0:
-		case 8:
-			if (bits(5,3) == 0)
-			{
-				put_str("NOP");
-				break;
-			}
-
-			if (bits(5,3) == 1)
-			{
-				put_str("EX    AF,AF'");
-				break;
-			}
-
-			put_str(jr_op_names[bits(5,3)]);
-			loc++;
-			byte_count++;
-			put_word((signed char)z80->mem[loc] + (int)loc + 1);
+		case 'n':
+			put_hex(dc, fetch(dc), 2);
 			break;
 
-		case 1:
-			put_str(OPC_LD);
-			put_dd_reg(bits(5,4));
-			put_char(',');
-			byte_count += 2;
-			loc += 2;
-			put_addr(z80, loc);
+		case 'w':
+		case 'a':
+			w = fetch(dc);
+			w |= fetch(dc) << 8;
+			put_hex(dc, w, 4);
+			if (*fmt == 'a')
+				d->target = w;
 			break;
 
-		case 2:
-			last_byte = z80->mem[loc];
-			put_str(OPC_LD);
-
-			switch (bits(5,4))
-			{
-			case 0:
-				put_str("(BC)");
-				break;
-
-			case 1:
-				put_str("(DE)");
-				break;
-
-			case 2:
-			case 3:
-				put_char('(');
-				byte_count += 2;
-				loc += 2;
-				put_addr(z80, loc);
-				put_char(')');
-				break;
-			}
-
-			if ((last_byte & 0x030) == 0x020)
-			{
-				put_char(',');
-
-				if (index_reg)
-					put_str(index_reg);
-				else
-					put_str("HL");
-			}
-			else
-			{
-				put_str(",A");
-			}
-
+		case 'j':
+			e = (signed char)fetch(dc);
+			w = (word)(d->addr + d->len + e);
+			put_hex(dc, w, 4);
+			d->target = w;
 			break;
 
-		case 3:
-			put_str(OPC_INC);
-			put_dd_reg(bits(5,4));
+		case 't':
+			w = d->bytes[d->len - 1] & 0x38;
+			put_hex(dc, w, 2);
+			d->target = w;
 			break;
 
-		case 4:
-		case 0x0C:
-			put_str(OPC_INC);
-			put_reg(z80, bits(5,3), loc);
+		case 'h':
+			put_str(dc, dc->ixy ? dc->ixy : "HL");
 			break;
 
-		case 5:
-		case 0x0D:
-			put_str(OPC_DEC);
-			put_reg(z80, bits(5,3), loc);
-			break;
-
-		case 6:
-		case 0x0E:
-			put_str(OPC_LD);
-			put_reg(z80, bits(5,3), loc);
-			put_char(',');
-
-			if (index_reg && (bits(5,3) == 6))
-			{
-				loc++;
-				byte_count++;
-			}
-
-			loc++;
-			byte_count++;
-			put_byte(z80->mem[loc]);
-			break;
-
-		case 7:
-		case 0x0F:
-			put_str(log_op_names[bits(5,3)]);
-			break;
-
-		case 9:
-			put_str(OPC_ADD);
-			put_str("HL,");
-			put_dd_reg(bits(5,4));
-			break;
-
-		case 0x0A:
-			put_str(OPC_LD);
-
-			if (bits(5,4) == 2)
+		case 'm':
+			if (dc->ixy == NULL)
 			{
-				if (index_reg)
-				{
-					put_str(index_reg);
-					put_str(",");
-				}
-				else
-					put_str("HL,");
-			}
-			else
-			{
-				put_str("A,");
-			}
-
-			switch (bits(5,4))
-			{
-			case 0:
-				put_str("(BC)");
-				break;
-
-			case 1:
-				put_str("(DE)");
-				break;
-
-			case 2:
-			case 3:
-				put_char('(');
-				byte_count += 2;
-				loc += 2;
-				put_addr(z80, loc);
-				put_char(')');
+				put_str(dc, "(HL)");
 				break;
 			}
-
-			break;
-
-		case 0x0B:
-			put_str(OPC_DEC);
-			put_dd_reg(bits(5,4));
+			if (dc->disp < 0)
+				dc->disp = fetch(dc);
+			e = (signed char)dc->disp;
+			put_str(dc, "(");
+			put_str(dc, dc->ixy);
+			put_str(dc, e < 0 ? "-" : "+");
+			put_hex(dc, e < 0 ? -e : e, 2);
+			put_str(dc, ")");
 			break;
 		}
+	}
+}
 
-		break;
-
-	case 1:
-		/* if ((bits(5,3) != 6) && (bits(2,0) != 6)) */
-		if (z80->mem[loc] == 0x76)
-		{
-			put_str("HALT");
-		}
-		else
-		{
-			put_str(OPC_LD);
-			put_reg(z80, bits(5,3), loc);
-			put_char(',');
-			put_reg(z80, bits(2,0), loc);
-		}
-
-		break;
+/* the CB-prefixed ones, after DD CB d if it's indexed */
+static const char *
+bitops(decoder *dc, byte op)
+{
+	const char *name;
+	int reg = op & 7;
 
-	case 2:
-		put_str(op_names[bits(5,3)]);
-		put_reg(z80, bits(2,0), loc);
-		break;
+	/* DD CB d op only does (IX+d) */
+	if (dc->ixy && reg != 6)
+		return NULL;
 
-	case 3:
-		if (z80->mem[loc] == 0xCB)
-		{
-			loc++;
-			byte_count++;
+	if ((op >> 6) == 0)
+	{
+		if ((name = shift_names[(op >> 3) & 7]) == NULL)
+			return NULL;
+	}
+	else
+	{
+		name = bit_names[op >> 6];
+		put_hex(dc, (op >> 3) & 7, 1);
+		put_str(dc, ",");
+	}
 
-			if (bits(7,6) == 0)
-			{
-				put_str(shf_op_names[bits(5,3)]);
-			}
-			else
-			{
-				put_str(bit_op_names[bits(7,6)]);
-				put_digit(bits(5,3));
-				put_char(',');
-			}
+	operands(dc, reg_names[reg]);
+	return name;
+}
 
-			put_reg(z80, bits(2,0), loc);
-			break;
-		}
+int
+disassemble(disread rd, void *ctx, word addr, disinstr *d)
+{
+	decoder dc;
+	const opcode *o = NULL;
+	const char *name = NULL;
+	byte op;
+
+	dc.rd = rd;
+	dc.ctx = ctx;
+	dc.d = d;
+	dc.ixy = NULL;
+	dc.disp = -1;
+	dc.out = d->operands;
+	dc.end = d->operands + sizeof d->operands - 1;
+
+	d->addr = addr;
+	d->len = 0;
+	d->flow = DIS_NEXT;
+	d->target = -1;
+
+	op = fetch(&dc);
+	d->cycles = z80_cycles_main[op];
+
+	if (op == 0xDD || op == 0xFD)
+	{
+		dc.ixy = op == 0xDD ? "IX" : "IY";
+		op = fetch(&dc);
+		d->cycles += z80_cycles_xy[op];
+	}
 
-		/*if ((z80->mem[loc] & 0x0DD) == 0x0DD)*/
-		if (z80->mem[loc] == 0xDD)
+	if (op == 0xCB)
+	{
+		if (dc.ixy)
 		{
-			if (bits(5,5))
-				index_reg = "IY";
-			else
-				index_reg = "IX";
-
-			byte_count = disassem(z80, loc + 1, NULL);
-			loc += byte_count;
-
-			break;
+			dc.disp = fetch(&dc);
+			op = fetch(&dc);
+			d->cycles += z80_cycles_xycb[op];
 		}
-
-		if (z80->mem[loc] == 0xED)
+		else
 		{
-			loc++;
-			byte_count++;
-
-			switch (bits(7,6))
-			{
-			case 0:
-				put_str(OPC_ILLEGAL);
-				break;
-
-			case 1:
-				switch (bits(3,0))
-				{
-				case 0:
-				case 8:
-					put_str("IN    ");
-					put_reg(z80, bits(5,3), loc);
-					put_str(",[C]");
-					break;
-
-				case 1:
-				case 9:
-					put_str("OUT   [C],");
-					put_reg(z80, bits(5,3), loc);
-					break;
-
-				case 2:
-					put_str("SBC   HL,");
-					put_dd_reg(bits(5,4));
-					break;
-
-				case 0xA:
-					put_str("ADC   HL,");
-					put_dd_reg(bits(5,4));
-					break;
-
-				case 3:
-					put_str(OPC_LD);
-					put_char('(');
-					put_addr(z80, loc + 2);
-					put_str("),");
-					put_dd_reg(bits(5,4));
-					byte_count += 2;
-					loc += 2;
-					break;
-
-				case 0xB:
-					put_str(OPC_LD);
-					put_dd_reg(bits(5,4));
-					put_str(",(");
-					byte_count += 2;
-					loc += 2;
-					put_addr(z80, loc);
-					put_char(')');
-					break;
-
-				case 4:
-					if (bits(5,4) == 0)
-						put_str("NEG");
-					else
-						put_str(OPC_ILLEGAL);
-
-					break;
-
-				case 0xC:
-					put_str(OPC_ILLEGAL);
-					break;
-
-				case 5:
-					if (bits(5,4) == 0)
-						put_str("RETN");
-					else
-						put_str(OPC_ILLEGAL);
-
-					break;
-
-				case 0xD:
-					if (bits(5,4) == 0)
-						put_str("RETI");
-					else
-						put_str(OPC_ILLEGAL);
-
-					break;
-
-				case 6:
-					if (bits(5,4) == 0)
-						put_str("IM    0");
-					else if (bits(5,4) == 1)
-						put_str("IM    1");
-					else
-						put_str(OPC_ILLEGAL);
-
-					break;
-
-				case 0xE:
-					if (bits(5,4) == 1)
-						put_str("IM    2");
-					else
-						put_str(OPC_ILLEGAL);
-					break;
-
-				case 7:
-					if (bits(5,4) == 0)
-						put_str("LD    I,A");
-					else if (bits(5,4) == 1)
-						put_str("LD    A,I");
-					else if (bits(5,4) == 2)
-						put_str("RRD");
-					else
-						put_str(OPC_ILLEGAL);
-
-					break;
-
-				case 0xF:
-					if (bits(5,4) == 0)
-						put_str("LD    R,A");
-					else if (bits(5,4) == 1)
-						put_str("LD    A,R");
-					else if (bits(5,4) == 2)
-						put_str("RLD");
-					else
-						put_str(OPC_ILLEGAL);
-
-					break;
-				}
-
-			    break;
-
-			case 2:
-			    if (bits(5,5) == 0)
-			    {
-				    put_str(OPC_ILLEGAL);
-				    break;
-			    }
-
-			    if (bits(2,2) == 1)
-			    {
-				    put_str(OPC_ILLEGAL);
-				    break;
-			    }
-
-			    put_str(rep_op_names[
-				    ((z80->mem[loc] >> 1) & 0xC)
-				    | (z80->mem[loc] & 3)
-				    ]);
-			    break;
-
-			case 3:
-			    put_str(OPC_ILLEGAL);
-			    break;
-			}
-
-			break;
+			op = fetch(&dc);
+			d->cycles += z80_cycles_cb[op];
 		}
-
-		if ((z80->mem[loc] & 0x06) == 0x06)
+		name = bitops(&dc, op);
+	}
+	else if (op == 0xED)
+	{
+		if (dc.ixy == NULL)
 		{
-			put_str(op_names[bits(5,3)]);
-			loc++;
-			byte_count++;
-			put_byte(z80->mem[loc]);
-			break;
+			op = fetch(&dc);
+			d->cycles += z80_cycles_ed[op];
+			o = &ed_ops[op];
 		}
+	}
+	else
+	{
+		o = &main_ops[op];
 
-		switch (bits(2,0))
-		{
-		case 0:
-			put_str(OPC_RET);
-			put_cc(bits(5,3));
-			break;
-
-		case 1:
-			switch (bits(5,3))
-			{
-			case 0:
-			case 2:
-			case 4:
-			case 6:
-				put_str(OPC_POP);
-				put_qq_reg(bits(5,4));
-				break;
-
-			case 1:
-				put_str(OPC_RET);
-				break;
-
-			case 3:
-				put_str(OPC_EXX);
-				break;
-
-			case 5:
-				put_str(OPC_JP);
-
-				if (index_reg)
-				{
-					put_str("(");
-					put_str( index_reg);
-					put_str(")");
-				}
-				else
-					put_str("(HL)");
-
-				break;
-
-			case 7:
-				put_str(OPC_LD);
-				put_str("SP,");
-
-				if (index_reg)
-					put_str(index_reg);
-				else
-					put_str("HL");
-
-				break;
-			}
-
-			break;
-
-		case 2:
-			put_str(OPC_JP);
-			put_cc(bits(5,3));
-			put_char(',');
-			byte_count += 2;
-			loc += 2;
-			put_addr(z80, loc);
-			break;
-
-		case 3:
-			switch (bits(5,3))
-			{
-			case 0:
-				put_str(OPC_JP);
-				byte_count += 2;
-				loc += 2;
-				put_addr(z80, loc);
-				break;
-
-			case 2:
-				loc++;
-				byte_count++;
-				put_str(OPC_OUT);
-				put_char('(');
-				put_byte(z80->mem[loc]);
-				put_str("),A");
-				break;
-
-			case 3:
-				loc++;
-				byte_count++;
-				put_str(OPC_IN);
-				put_str("A,(");
-				put_byte(z80->mem[loc]);
-				put_char(')');
-				break;
-
-			case 4:
-				put_str(OPC_EX);
-				put_str("(SP),");
-
-				if (index_reg)
-					put_str(index_reg);
-				else
-					put_str("HL");
-
-				break;
-
-			case 5:
-				put_str(OPC_EX);
-				put_str("HL,DE");
-				break;
+		/* the prefix has to have something to change */
+		if (dc.ixy && o->mnemonic && !strstr(o->operands, "%h") &&
+				!strstr(o->operands, "%m"))
+			o = NULL;
+	}
 
-			case 6:
-				put_str(OPC_DI);
-				break;
+	if (o != NULL && (name = o->mnemonic) != NULL)
+	{
+		operands(&dc, o->operands);
+		d->flow = o->flow;
+		d->taken = d->cycles + o->more;
+	}
+	else
+		d->taken = d->cycles;
 
-			case 7:
-				put_str(OPC_EI);
-				break;
-			}
+	if (name == NULL)
+	{
+		name = OPC_ILLEGAL;
+		dc.out = d->operands;
+		d->flow = DIS_NEXT;
+		d->target = -1;
+	}
 
-			break;
+	*dc.out = '\0';
+	strcpy(d->mnemonic, name);
+	return d->len;
+}
 
-		case 4:
-			put_str(OPC_CALL);
-			put_cc(bits(5,3));
-			put_char(',');
-			byte_count += 2;
-			loc += 2;
-			put_addr(z80, loc);
-			break;
 
-		case 5:
-			if (bits(3,3))
-			{
-				put_str(OPC_CALL);
-				byte_count += 2;
-				loc += 2;
-				put_addr(z80, loc);
-			}
-			else
-			{
-				put_str(OPC_PUSH);
-				put_qq_reg(bits(5,4));
-			}
+/*-----------------------------------------------------------------------*\
+ |  output
+\*-----------------------------------------------------------------------*/
 
-			break;
+int
+disassem_text(const disinstr *d, char *buf, size_t size)
+{
+	if (d->operands[0] == '\0')
+		return snprintf(buf, size, "%s", d->mnemonic);
+	return snprintf(buf, size, "%-6s%s", d->mnemonic, d->operands);
+}
 
-		case 6:
-			put_str(OPC_ILLEGAL);
-			break;
+byte
+disassem_mem(void *ctx, word addr)
+{
+	z80info *z80 = ctx;
 
-		case 7:
-			put_str(OPC_RST);
-			put_byte(z80->mem[loc] & 0x038);
-			break;
-		}
+	return Z80MEMPEEK(addr);
+}
 
-		break;
-	}
+/* print the instruction at 'start' - returns its length */
+int
+disassem(z80info *z80, word start, FILE *fp)
+{
+	disinstr d;
+	char buf[40];
 
-	loc++;
-	byte_count++;
-	return byte_count;
+	disassemble(disassem_mem, z80, start, &d);
+	disassem_text(&d, buf, sizeof buf);
+	fputs(buf, fp);
+	return d.len;
 }
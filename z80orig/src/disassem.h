@@ -0,0 +1,57 @@
+/*-----------------------------------------------------------------------*\
+ |  disassem.h  --  Z80 disassembler                                     |
+ |                                                                       |
+ |  disassemble() decodes one instruction into a disinstr, taking its   |
+ |  bytes from a function the caller gives it - z80 memory, a trace      |
+ |  record, a ROM image in a buffer - so it keeps nothing of its own     |
+ |  between calls and any number of them can be going at once.          |
+ |                                                                       |
+ |  The T-states come from the same tables the CPU counts with.         |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+#ifndef __DISASSEM_H_
+#define __DISASSEM_H_
+
+#include <stddef.h>
+#include "defs.h"
+
+
+/* where the bytes come from */
+typedef byte (*disread)(void *ctx, word addr);
+
+/* what an instruction does to the flow of control */
+#define DIS_NEXT	0	/* just goes on to the next one */
+#define DIS_JUMP	1
+#define DIS_CALL	2	/* CALL or RST */
+#define DIS_RET		3
+#define DIS_REPEAT	4	/* LDIR and co - may go round again */
+#define DIS_COND	0x10	/* or'd in when it's only sometimes */
+#define DIS_FLOW(f)	((f) & 0x0F)
+
+typedef struct disinstr
+{
+	word addr;
+	int len;		/* 1 to 4 bytes */
+	byte bytes[4];
+	char mnemonic[8];	/* "***" if the z80 here doesn't do it */
+	char operands[24];
+	int cycles;		/* T-states - not taken, or the last time round */
+	int taken;		/* ...and taken, or going round again */
+	int flow;		/* DIS_ */
+	long target;		/* where it goes to, or -1 if not known here */
+} disinstr;
+
+
+/* decode the instruction at 'addr' - returns its length */
+int disassemble(disread rd, void *ctx, word addr, disinstr *d);
+
+/* "LD    A,(IX+05)" into 'buf' - returns its length */
+int disassem_text(const disinstr *d, char *buf, size_t size);
+
+/* a disread for a z80info's memory, through the side-effect free peek -
+   no memory-mapped I/O, and nothing counted */
+byte disassem_mem(void *ctx, word addr);
+
+#endif
@@ -0,0 +1,707 @@
+/*-----------------------------------------------------------------------*\
+ |  gdbstub.c  --  GDB's remote serial protocol, on a local socket       |
+ |                                                                       |
+ |  While the debugger has the z80 stopped, we sit in serve() answering  |
+ |  its packets until it says to go on.  A stop can come from:           |
+ |                                                                       |
+ |    - attaching, or a ^C from the debugger (between runs),             |
+ |    - an exec breakpoint, from the opcode fetch - before it runs,      |
+ |    - a watchpoint, which sets HALT so haltcpu() gets us once the      |
+ |      instruction that set it off is done,                             |
+ |    - a step, which sets HALT the same way.  A step can start right    |
+ |      at an instruction boundary, where haltcpu() is about to be        |
+ |      called before anything runs, so it's only done once the cycle    |
+ |      count has moved.                                                 |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+#define _DEFAULT_SOURCE		/* for the socket calls under -std=c99 */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gdbstub.h"
+
+#ifdef GDB_STUB
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "breaks.h"
+
+
+#define PACKETMAX	4096
+#define MAXPOINTS	64
+#define NREGS		13		/* af bc de hl sp pc ix iy af' bc' de' hl' ir */
+
+/* a breakpoint the debugger asked for, and its number in breaks.c */
+typedef struct point
+{
+	int n;
+	int type;		/* as in the Z packet: 0, 1 exec; 2 write; 3 read; 4 both */
+	word addr;
+	int len;
+} point;
+
+struct gdbstub
+{
+	int listenfd;
+	int fd;			/* the debugger, or -1 */
+	int peek;		/* a byte read ahead, or -1 */
+	int noack;
+
+	int stepping;
+	unsigned long long stepcycles;	/* the cycle count it started at */
+
+	int pending;		/* a watchpoint to report, as index + 1 */
+	word pendaddr;
+
+	point points[MAXPOINTS];
+	int npoints;
+};
+
+
+/*-----------------------------------------------------------------------*\
+ |  packets
+\*-----------------------------------------------------------------------*/
+
+static const char hexdigits[] = "0123456789abcdef";
+
+static int
+hexval(int c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+static int
+getbyte(gdbstub *gdb)
+{
+	unsigned char c;
+	ssize_t n;
+
+	if (gdb->peek >= 0)
+	{
+		n = gdb->peek;
+		gdb->peek = -1;
+		return (int)n;
+	}
+
+	do
+		n = recv(gdb->fd, &c, 1, 0);
+	while (n < 0 && errno == EINTR);
+
+	return n == 1 ? c : -1;
+}
+
+static int
+putbytes(gdbstub *gdb, const char *s, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0)
+	{
+		if ((n = send(gdb->fd, s, len, 0)) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		s += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* the next packet into 'buf' - its length, or -1 if the debugger's gone */
+static int
+getpacket(gdbstub *gdb, char *buf)
+{
+	int c, len, sum, check;
+
+	for (;;)
+	{
+		/* ^C and stray acks are of no interest while we're stopped */
+		while ((c = getbyte(gdb)) != '$')
+			if (c < 0)
+				return -1;
+
+		for (len = 0, sum = 0; (c = getbyte(gdb)) != '#'; )
+		{
+			if (c < 0)
+				return -1;
+			if (len < PACKETMAX - 1)
+				buf[len++] = c;
+			sum += c;
+		}
+		buf[len] = '\0';
+
+		if ((c = getbyte(gdb)) < 0 || (check = getbyte(gdb)) < 0)
+			return -1;
+		check = (hexval(c) << 4) | hexval(check);
+
+		if (gdb->noack)
+			return len;
+		if ((sum & 0xFF) == check)
+			return putbytes(gdb, "+", 1) == 0 ? len : -1;
+		if (putbytes(gdb, "-", 1) != 0)
+			return -1;
+	}
+}
+
+static int
+putpacket(gdbstub *gdb, const char *s)
+{
+	char buf[PACKETMAX + 4];
+	int sum = 0, len, tries, c;
+
+	for (len = 0; s[len] && len < PACKETMAX; len++)
+		sum += (unsigned char)s[len];
+
+	buf[0] = '$';
+	memcpy(buf + 1, s, len);
+	buf[len + 1] = '#';
+	buf[len + 2] = hexdigits[(sum >> 4) & 0xF];
+	buf[len + 3] = hexdigits[sum & 0xF];
+
+	for (tries = 0; tries < 5; tries++)
+	{
+		if (putbytes(gdb, buf, len + 4) != 0)
+			return -1;
+		if (gdb->noack)
+			return 0;
+
+		/* wait for the ack - anything but a nak will do */
+		if ((c = getbyte(gdb)) < 0)
+			return -1;
+		if (c != '-')
+		{
+			if (c != '+')
+				gdb->peek = c;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+
+/*-----------------------------------------------------------------------*\
+ |  the z80
+\*-----------------------------------------------------------------------*/
+
+static word
+getreg(z80info *z80, int n)
+{
+	switch (n)
+	{
+	case 0:		return AF;
+	case 1:		return BC;
+	case 2:		return DE;
+	case 3:		return HL;
+	case 4:		return SP;
+	case 5:		return PC;
+	case 6:		return IX;
+	case 7:		return IY;
+	case 8:		return AF2;
+	case 9:		return BC2;
+	case 10:	return DE2;
+	case 11:	return HL2;
+	case 12:	return (I << 8) | R;
+	}
+	return 0;
+}
+
+static void
+setreg(z80info *z80, int n, word v)
+{
+	switch (n)
+	{
+	case 0:		AF = v; break;
+	case 1:		BC = v; break;
+	case 2:		DE = v; break;
+	case 3:		HL = v; break;
+	case 4:		SP = v; break;
+	case 5:		PC = v; break;
+	case 6:		IX = v; break;
+	case 7:		IY = v; break;
+	case 8:		AF2 = v; break;
+	case 9:		BC2 = v; break;
+	case 10:	DE2 = v; break;
+	case 11:	HL2 = v; break;
+	case 12:	I = v >> 8; R = v & 0xFF; break;
+	}
+}
+
+static char *
+puthex16(char *p, word v)
+{
+	/* little-endian, as the target has it */
+	*p++ = hexdigits[(v >> 4) & 0xF];
+	*p++ = hexdigits[v & 0xF];
+	*p++ = hexdigits[(v >> 12) & 0xF];
+	*p++ = hexdigits[(v >> 8) & 0xF];
+	return p;
+}
+
+static int
+gethex16(const char *p, word *v)
+{
+	int d[4], i;
+
+	for (i = 0; i < 4; i++)
+		if ((d[i] = hexval(p[i])) < 0)
+			return FALSE;
+	*v = (d[2] << 12) | (d[3] << 8) | (d[0] << 4) | d[1];
+	return TRUE;
+}
+
+/* "addr,len" - and where it stopped */
+static int
+addrlen(const char *p, unsigned long *addr, unsigned long *len, char **end)
+{
+	char *e;
+
+	*addr = strtoul(p, &e, 16);
+	if (*e != ',')
+		return FALSE;
+	*len = strtoul(e + 1, &e, 16);
+	*end = e;
+	return TRUE;
+}
+
+static void
+readmem(z80info *z80, const char *args, char *reply)
+{
+	unsigned long addr, len, i;
+	char *e;
+	byte b;
+
+	if (!addrlen(args, &addr, &len, &e) || len > (PACKETMAX - 1) / 2)
+	{
+		strcpy(reply, "E01");
+		return;
+	}
+
+	/* through the bus, as the z80 would see it */
+	for (i = 0; i < len; i++)
+	{
+		b = Z80MEMREAD( addr + i );
+		*reply++ = hexdigits[b >> 4];
+		*reply++ = hexdigits[b & 0xF];
+	}
+	*reply = '\0';
+}
+
+static void
+writemem(z80info *z80, const char *args, char *reply)
+{
+	unsigned long addr, len, i;
+	char *e;
+	int hi, lo;
+
+	if (!addrlen(args, &addr, &len, &e) || *e != ':')
+	{
+		strcpy(reply, "E01");
+		return;
+	}
+
+	for (i = 0, e++; i < len; i++, e += 2)
+	{
+		if ((hi = hexval(e[0])) < 0 || (lo = hexval(e[1])) < 0)
+		{
+			strcpy(reply, "E02");
+			return;
+		}
+		Z80MEMWRITE( addr + i, (hi << 4) | lo );
+	}
+	strcpy(reply, "OK");
+}
+
+static void
+setpoint(gdbstub *gdb, z80info *z80, const char *args, int set, char *reply)
+{
+	static const char *whens[] = { "exec", "exec", "write", "read", "access" };
+	unsigned long type, addr, len;
+	char text[64], err[100], *e;
+	int i, n;
+
+	type = strtoul(args, &e, 10);
+	if (*e != ',' || type > 4 || !addrlen(e + 1, &addr, &len, &e) ||
+			addr > 0xFFFF)
+	{
+		strcpy(reply, "E01");
+		return;
+	}
+	if (type < 2 || len == 0)
+		len = 1;
+	if (addr + len > 0x10000)
+		len = 0x10000 - addr;
+
+	for (i = 0; i < gdb->npoints; i++)
+		if (gdb->points[i].type == (int)type &&
+				gdb->points[i].addr == addr && gdb->points[i].len == (int)len)
+			break;
+
+	if (!set)
+	{
+		if (i < gdb->npoints)
+		{
+			breaks_delete(z80, gdb->points[i].n);
+			gdb->points[i] = gdb->points[--gdb->npoints];
+		}
+		strcpy(reply, "OK");
+		return;
+	}
+
+	if (i < gdb->npoints)
+	{
+		strcpy(reply, "OK");
+		return;
+	}
+	if (gdb->npoints == MAXPOINTS)
+	{
+		strcpy(reply, "E02");
+		return;
+	}
+
+	snprintf(text, sizeof text, "%s 0x%lX..0x%lX", whens[type], addr,
+			addr + len - 1);
+	if ((n = breaks_add(z80, text, err, sizeof err)) == 0)
+	{
+		strcpy(reply, "E03");
+		return;
+	}
+
+	gdb->points[gdb->npoints].n = n;
+	gdb->points[gdb->npoints].type = type;
+	gdb->points[gdb->npoints].addr = addr;
+	gdb->points[gdb->npoints].len = len;
+	gdb->npoints++;
+	strcpy(reply, "OK");
+}
+
+/* the debugger's gone - take its breakpoints with it */
+static void
+drop(gdbstub *gdb, z80info *z80)
+{
+	while (gdb->npoints > 0)
+		breaks_delete(z80, gdb->points[--gdb->npoints].n);
+
+	close(gdb->fd);
+	gdb->fd = -1;
+	gdb->peek = -1;
+	gdb->noack = FALSE;
+	gdb->stepping = FALSE;
+	gdb->pending = 0;
+	fprintf(stderr, "\r\n[debugger detached]\r\n");
+}
+
+/* stopped - answer packets until told to go on.  'why' is the stop
+   reply to send first, or NULL if the debugger will ask */
+static void
+serve(gdbstub *gdb, z80info *z80, const char *why)
+{
+	static char buf[PACKETMAX], reply[PACKETMAX];
+	char stop[64];
+	unsigned long v;
+	char *p, *e;
+	word w;
+	int i;
+
+	snprintf(stop, sizeof stop, "%s", why ? why : "S05");
+	if (why != NULL && putpacket(gdb, stop) != 0)
+	{
+		drop(gdb, z80);
+		return;
+	}
+
+	while (getpacket(gdb, buf) >= 0)
+	{
+		*reply = '\0';
+
+		switch (buf[0])
+		{
+		case '?':
+			strcpy(reply, stop);
+			break;
+
+		case 'g':
+			for (i = 0, p = reply; i < NREGS; i++)
+				p = puthex16(p, getreg(z80, i));
+			*p = '\0';
+			break;
+
+		case 'G':
+			for (i = 0, p = buf + 1; i < NREGS && gethex16(p, &w); i++, p += 4)
+				setreg(z80, i, w);
+			strcpy(reply, "OK");
+			break;
+
+		case 'p':
+			if ((v = strtoul(buf + 1, NULL, 16)) < NREGS)
+				*puthex16(reply, getreg(z80, v)) = '\0';
+			else
+				strcpy(reply, "E01");
+			break;
+
+		case 'P':
+			v = strtoul(buf + 1, &e, 16);
+			if (v < NREGS && *e == '=' && gethex16(e + 1, &w))
+			{
+				setreg(z80, v, w);
+				strcpy(reply, "OK");
+			}
+			else
+				strcpy(reply, "E01");
+			break;
+
+		case 'm':
+			readmem(z80, buf + 1, reply);
+			break;
+
+		case 'M':
+			writemem(z80, buf + 1, reply);
+			break;
+
+		case 'Z':
+		case 'z':
+			setpoint(gdb, z80, buf + 1, buf[0] == 'Z', reply);
+			break;
+
+		case 'c':
+		case 's':
+			if (buf[1])
+				PC = strtoul(buf + 1, NULL, 16);
+			if (buf[0] == 's')
+			{
+				gdb->stepping = TRUE;
+				gdb->stepcycles = z80->cycles;
+				z80->event = TRUE;
+				z80->halt = TRUE;
+			}
+			return;
+
+		case 'D':
+			putpacket(gdb, "OK");
+			drop(gdb, z80);
+			return;
+
+		case 'k':
+			drop(gdb, z80);
+			return;
+
+		case 'H':
+			strcpy(reply, "OK");
+			break;
+
+		case 'q':
+			if (strncmp(buf, "qSupported", 10) == 0)
+				snprintf(reply, sizeof reply, "PacketSize=%x;swbreak+;"
+						"hwbreak+;QStartNoAckMode+", PACKETMAX - 1);
+			else if (strcmp(buf, "qAttached") == 0)
+				strcpy(reply, "1");
+			break;
+
+		case 'Q':
+			if (strcmp(buf, "QStartNoAckMode") == 0)
+			{
+				putpacket(gdb, "OK");
+				gdb->noack = TRUE;
+				continue;
+			}
+			break;
+		}
+
+		if (putpacket(gdb, reply) != 0)
+			break;
+	}
+
+	drop(gdb, z80);
+}
+
+
+/*-----------------------------------------------------------------------*\
+ |  the outside
+\*-----------------------------------------------------------------------*/
+
+gdbstub *
+gdbstub_open(int port)
+{
+	struct sockaddr_in sa;
+	gdbstub *gdb;
+	int on = 1;
+
+	if ((gdb = calloc(1, sizeof *gdb)) == NULL)
+		return NULL;
+	gdb->fd = -1;
+	gdb->peek = -1;
+
+	memset(&sa, 0, sizeof sa);
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(port);
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if ((gdb->listenfd = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+			setsockopt(gdb->listenfd, SOL_SOCKET, SO_REUSEADDR,
+				&on, sizeof on) < 0 ||
+			bind(gdb->listenfd, (struct sockaddr *)&sa, sizeof sa) < 0 ||
+			listen(gdb->listenfd, 1) < 0 ||
+			fcntl(gdb->listenfd, F_SETFL, O_NONBLOCK) < 0)
+	{
+		perror("gdb stub");
+		if (gdb->listenfd >= 0)
+			close(gdb->listenfd);
+		free(gdb);
+		return NULL;
+	}
+
+	/* the console is read a byte at a time, so that waiting on it
+	   with select() means what it says */
+	setvbuf(stdin, NULL, _IONBF, 0);
+
+	fprintf(stderr, "[gdb stub on 127.0.0.1:%d]\r\n", port);
+	return gdb;
+}
+
+void
+gdbstub_poll(gdbstub *gdb, z80info *z80)
+{
+	struct timeval tv = { 0, 0 };
+	fd_set fds;
+	int on = 1, c;
+
+	if (gdb->fd < 0)
+	{
+		if ((gdb->fd = accept(gdb->listenfd, NULL, NULL)) < 0)
+			return;
+
+		setsockopt(gdb->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+		fprintf(stderr, "\r\n[debugger attached]\r\n");
+
+		/* it'll want to find us stopped */
+		serve(gdb, z80, NULL);
+		return;
+	}
+
+	FD_ZERO(&fds);
+	FD_SET(gdb->fd, &fds);
+	if (select(gdb->fd + 1, &fds, NULL, NULL, &tv) <= 0)
+		return;
+
+	if ((c = getbyte(gdb)) < 0)
+		drop(gdb, z80);
+	else if (c == 0x03)
+		serve(gdb, z80, "T02");
+	else if (c == '$')
+	{
+		/* a packet while we run - stop and answer it */
+		gdb->peek = c;
+		serve(gdb, z80, NULL);
+	}
+}
+
+void
+gdbstub_halt(gdbstub *gdb, z80info *z80)
+{
+	static const char *kinds[] = { "", "", "watch", "rwatch", "awatch" };
+	char why[64];
+	int i;
+
+	if (gdb->fd < 0)
+		return;
+
+	if (gdb->stepping)
+	{
+		/* not a single instruction done yet - come back after one */
+		if (z80->cycles == gdb->stepcycles)
+		{
+			z80->event = TRUE;
+			z80->halt = TRUE;
+			return;
+		}
+		gdb->stepping = FALSE;
+		serve(gdb, z80, "S05");
+	}
+	else if (gdb->pending)
+	{
+		i = gdb->pending - 1;
+		gdb->pending = 0;
+		snprintf(why, sizeof why, "T05%s:%x;", kinds[gdb->points[i].type],
+				gdb->pendaddr);
+		serve(gdb, z80, why);
+	}
+}
+
+int
+gdbstub_wait(gdbstub *gdb, z80info *z80, int fd)
+{
+	fd_set fds;
+	int other;
+
+	for (;;)
+	{
+		other = gdb->fd >= 0 ? gdb->fd : gdb->listenfd;
+
+		FD_ZERO(&fds);
+		FD_SET(fd, &fds);
+		FD_SET(other, &fds);
+		if (select((fd > other ? fd : other) + 1, &fds, NULL, NULL, NULL) < 0)
+		{
+			if (errno == EINTR)
+				return -1;
+			continue;
+		}
+
+		if (FD_ISSET(other, &fds))
+			gdbstub_poll(gdb, z80);
+		if (FD_ISSET(fd, &fds))
+			return 0;
+	}
+}
+
+int
+gdbstub_owns(gdbstub *gdb, int n)
+{
+	int i;
+
+	for (i = 0; i < gdb->npoints; i++)
+		if (gdb->points[i].n == n)
+			return TRUE;
+	return FALSE;
+}
+
+void
+gdbstub_hit(gdbstub *gdb, z80info *z80, int n, word addr)
+{
+	int i;
+
+	for (i = 0; i < gdb->npoints && gdb->points[i].n != n; i++)
+		;
+	if (i == gdb->npoints)
+		return;
+
+	if (gdb->points[i].type < 2)
+		serve(gdb, z80, gdb->points[i].type == 0 ? "T05swbreak:;" :
+				"T05hwbreak:;");
+	else if (!gdb->pending)
+	{
+		gdb->pending = i + 1;
+		gdb->pendaddr = addr;
+		z80->event = TRUE;
+		z80->halt = TRUE;
+	}
+}
+
+#endif	/* GDB_STUB */
@@ -0,0 +1,54 @@
+/*-----------------------------------------------------------------------*\
+ |  gdbstub.h  --  GDB's remote serial protocol, on a local socket       |
+ |                                                                       |
+ |  With Z80_GDB_PORT=n set, the emulator listens on 127.0.0.1:n and a   |
+ |  debugger can attach with "target remote :n" while the console goes  |
+ |  on being the z80's.  It gets the registers (in the order of GDB's    |
+ |  z80 target: af bc de hl sp pc ix iy af' bc' de' hl' ir), memory as  |
+ |  the z80 sees it, breakpoints, watchpoints and single steps.          |
+ |                                                                       |
+ |  Nothing is added to the z80's loop.  The socket is looked at         |
+ |  between runs of instructions, and while the console waits for a key; |
+ |  breakpoints are ones from breaks.c, and steps come back through      |
+ |  haltcpu().                                                           |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+#ifndef __GDBSTUB_H_
+#define __GDBSTUB_H_
+
+#include "defs.h"
+
+#if defined UNIX && defined MEM_BREAK
+#	define GDB_STUB
+#endif
+
+#ifdef GDB_STUB
+
+typedef struct gdbstub gdbstub;
+
+
+/* listen on 127.0.0.1:'port' - NULL if we can't */
+gdbstub *gdbstub_open(int port);
+
+/* between runs - take a new client, or a ^C from the one we have */
+void gdbstub_poll(gdbstub *gdb, z80info *z80);
+
+/* from haltcpu() - finish a step, or report a watchpoint */
+void gdbstub_halt(gdbstub *gdb, z80info *z80);
+
+/* wait for 'fd' to be readable, looking after the debugger meanwhile.
+   returns -1 (errno EINTR) if a signal came instead */
+int gdbstub_wait(gdbstub *gdb, z80info *z80, int fd);
+
+/* is breakpoint 'n' (from breaks.c) one of the debugger's? */
+int gdbstub_owns(gdbstub *gdb, int n);
+
+/* breakpoint 'n' came true at 'addr': an exec one stops right here,
+   before the instruction; the others at the end of it */
+void gdbstub_hit(gdbstub *gdb, z80info *z80, int n, word addr);
+
+#endif	/* GDB_STUB */
+
+#endif
@@ -0,0 +1,277 @@
+/*-----------------------------------------------------------------------*\
+ |  heatmap.c  --  where the z80's memory traffic goes                   |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "heatmap.h"
+#include "coverage.h"
+#include "symtab.h"
+
+
+heatmap *z80heat = NULL;
+
+/* ' ' for nothing, '@' for the busiest */
+static const char shades[] = " .:-=+*#%@";
+#define NSHADES		(int)(sizeof shades - 2)
+
+
+heatmap *
+heatmap_start(z80info *z80)
+{
+	heatmap *hm = calloc(1, sizeof *hm);
+#ifdef MEM_BREAK
+	long i;
+#endif
+
+	if (hm == NULL)
+	{
+		fprintf(stderr, "Cannot allocate the heatmap!\r\n");
+		return NULL;
+	}
+
+#ifdef MEM_BREAK
+	for (i = 0; i < 0x10000L; i++)
+		z80->membrk[i] |= M_ACCESS;
+#endif
+	z80heat = hm;
+	return hm;
+}
+
+void
+heatmap_access(heatmap *hm, z80info *z80, word addr, int how)
+{
+	hm->page[how][addr >> 8]++;
+	if (how != HEAT_WRITE)
+		return;
+
+	/* a push, call or interrupt - the high byte at SP, then the low one
+	   at SP again */
+	if (addr == SP && (word)(addr + 1) == hm->lastwrite &&
+			(!hm->pushed || SP < hm->splow))
+	{
+		hm->pushed = TRUE;
+		hm->splow = SP;
+		hm->splowpc = PC;
+	}
+	hm->lastwrite = addr;
+}
+
+void
+heatmap_region(int n, long offset, int write)
+{
+	if (z80heat == NULL || n < 0 || n >= STATS_REGIONS || offset < 0)
+		return;
+
+	if (write)
+		z80heat->region[n].writes[(offset >> 8) & 0xFF]++;
+	else
+		z80heat->region[n].reads[(offset >> 8) & 0xFF]++;
+}
+
+void
+heatmap_stop(heatmap *hm, z80info *z80)
+{
+#ifdef MEM_BREAK
+	coverage *cv = z80->coverage;
+	long i;
+
+	/* leave on only what coverage still wants */
+	for (i = 0; i < 0x10000L; i++)
+		if (cv != NULL && cv->data &&
+				!(COVER_GET(cv->read, i) && COVER_GET(cv->written, i)))
+			z80->membrk[i] |= M_ACCESS;
+		else
+			z80->membrk[i] &= ~M_ACCESS;
+#endif
+
+	if (z80heat == hm)
+		z80heat = NULL;
+	free(hm);
+}
+
+
+/*-----------------------------------------------------------------------*\
+ |  the reports
+\*-----------------------------------------------------------------------*/
+
+static int
+bits(unsigned long long n)
+{
+	int b = 0;
+
+	for (; n; n >>= 1)
+		b++;
+	return b;
+}
+
+/* 'n' against the biggest there is, from 0 for none to 'top' - on a
+   log scale, or one busy page would leave all the rest blank */
+static int
+level(unsigned long long n, unsigned long long max, int top)
+{
+	int l;
+
+	if (n == 0)
+		return 0;
+	l = bits(n) * top / bits(max);
+	return l > 0 ? l : 1;
+}
+
+static unsigned long long
+busiest(const unsigned long long *c, int n)
+{
+	unsigned long long max = 0;
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (c[i] > max)
+			max = c[i];
+	return max;
+}
+
+static unsigned long long
+total(heatmap *hm, int page)
+{
+	return hm->page[HEAT_FETCH][page] + hm->page[HEAT_READ][page] +
+			hm->page[HEAT_WRITE][page];
+}
+
+static void
+regions(heatmap *hm, FILE *fp)
+{
+	unsigned long long both[0x100], max;
+	int i, p, npages;
+
+	for (i = 0; i < z80stats.nregions; i++)
+	{
+		npages = (int)((z80stats.region[i].size + 0xFF) >> 8);
+		if (npages > 0x100)
+			npages = 0x100;
+
+		for (p = 0; p < npages; p++)
+			both[p] = hm->region[i].reads[p] + hm->region[i].writes[p];
+		max = busiest(both, npages);
+
+		fprintf(fp, "    region %-2d %.4lX-%.4lX", i,
+				z80stats.region[i].base,
+				z80stats.region[i].base + z80stats.region[i].size - 1);
+		for (p = 0; p < npages; p++)
+		{
+			if (p % 64 == 0)
+				fprintf(fp, "\n      ");
+			putc(shades[level(both[p], max, NSHADES)], fp);
+		}
+		fprintf(fp, "\n");
+	}
+}
+
+void
+heatmap_print(heatmap *hm, FILE *fp)
+{
+	static const char *const kinds[3] = { "fetch", "read", "write" };
+	unsigned long long max[3], t, best;
+	int done[0x100] = { 0 };
+	int how, row, col, i, p, top;
+
+	for (how = 0; how < 3; how++)
+		max[how] = busiest(hm->page[how], 0x100);
+
+	fprintf(fp, "    Pages of 256 bytes, from ' ' for none through \"%s\""
+			" to the busiest\n\n", shades + 1);
+	fprintf(fp, "           fetch               read                write\n");
+	fprintf(fp, "           0123456789ABCDEF    0123456789ABCDEF"
+			"    0123456789ABCDEF\n");
+	for (row = 0; row < 0x10; row++)
+	{
+		fprintf(fp, "    %X000   ", row);
+		for (how = 0; how < 3; how++)
+		{
+			for (col = 0; col < 0x10; col++)
+				putc(shades[level(hm->page[how][row << 4 | col],
+						max[how], NSHADES)], fp);
+			fprintf(fp, how < 2 ? "    " : "\n");
+		}
+	}
+
+	/* the busiest, most first */
+	fprintf(fp, "\n");
+	for (i = 0; i < 10; i++)
+	{
+		for (top = -1, best = 0, p = 0; p < 0x100; p++)
+			if (!done[p] && (t = total(hm, p)) > best)
+			{
+				best = t;
+				top = p;
+			}
+		if (top < 0)
+			break;
+		done[top] = TRUE;
+
+		fprintf(fp, "    %.2Xxx", top);
+		for (how = 0; how < 3; how++)
+			fprintf(fp, "  %s %llu", kinds[how], hm->page[how][top]);
+		fprintf(fp, "  ");
+		symtab_print(fp, (word)(top << 8));
+		fprintf(fp, "\n");
+	}
+
+	if (hm->pushed)
+	{
+		fprintf(fp, "\n    Stack low-water mark %.4X, PC ", hm->splow);
+		symtab_print(fp, hm->splowpc);
+		fprintf(fp, "\n");
+	}
+
+	if (z80stats.nregions > 0)
+	{
+		fprintf(fp, "\n    Regions, reads and writes:\n");
+		regions(hm, fp);
+	}
+}
+
+static int
+ppm(heatmap *hm, const char *path)
+{
+	unsigned long long max[3];
+	FILE *fp;
+	int how, x, y, page;
+
+	if ((fp = fopen(path, "wb")) == NULL)
+		return 1;
+
+	for (how = 0; how < 3; how++)
+		max[how] = busiest(hm->page[how], 0x100);
+
+	fprintf(fp, "P6\n256 256\n255\n");
+	for (y = 0; y < 0x100; y++)
+		for (x = 0; x < 0x100; x++)
+		{
+			page = (y >> 4) << 4 | x >> 4;
+			putc(level(hm->page[HEAT_WRITE][page], max[HEAT_WRITE], 255), fp);
+			putc(level(hm->page[HEAT_READ][page], max[HEAT_READ], 255), fp);
+			putc(level(hm->page[HEAT_FETCH][page], max[HEAT_FETCH], 255), fp);
+		}
+
+	return fclose(fp) != 0;
+}
+
+int
+heatmap_report(heatmap *hm, const char *prefix)
+{
+	char path[1024];
+	FILE *fp;
+	int err = 0;
+
+	snprintf(path, sizeof path, "%s.txt", prefix);
+	if ((fp = fopen(path, "w")) == NULL)
+		return 1;
+	heatmap_print(hm, fp);
+	if (fclose(fp) != 0)
+		err = 1;
+
+	snprintf(path, sizeof path, "%s.ppm", prefix);
+	return err | ppm(hm, path);
+}
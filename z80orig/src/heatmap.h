@@ -0,0 +1,69 @@
+/*-----------------------------------------------------------------------*\
+ |  heatmap.h  --  where the z80's memory traffic goes                   |
+ |                                                                       |
+ |  Fetches, reads and writes are counted by 256-byte page of the z80's  |
+ |  64K, and reads and writes by page of each memory region as well, so  |
+ |  a bank that's paged out has its own.  Every push is looked at for    |
+ |  the lowest the stack has been.                                       |
+ |                                                                       |
+ |  The z80's side comes through membrk (M_ACCESS), so it costs nothing  |
+ |  while it's off and a call per access while it's on; the regions'    |
+ |  side is memregion.c looking at z80heat.  It's written up as text    |
+ |  and as a PPM picture, a 16x16 block of pixels for each page: red     |
+ |  for writes, green for reads and blue for fetches.                    |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+#ifndef __HEATMAP_H_
+#define __HEATMAP_H_
+
+#include <stdio.h>
+#include "defs.h"
+#include "stats.h"
+
+
+#define HEATMAP_DEFPREFIX	"z80heat"	/* .txt and .ppm */
+
+#define HEAT_FETCH	0
+#define HEAT_READ	1
+#define HEAT_WRITE	2
+
+typedef struct heatmap
+{
+	unsigned long long page[3][0x100];	/* by HEAT_, by high byte */
+
+	/* the regions (memregion.c), by page from their start */
+	struct
+	{
+		unsigned long long reads[0x100], writes[0x100];
+	} region[STATS_REGIONS];
+
+	int pushed;		/* anything at all */
+	word splow;		/* the lowest SP written to */
+	word splowpc;		/* PC (after the opcode) when it was */
+	word lastwrite;		/* to know a push by */
+} heatmap;
+
+/* the one that's on, or NULL */
+extern heatmap *z80heat;
+
+
+/* start counting, from nothing */
+heatmap *heatmap_start(z80info *z80);
+
+/* from fetch_mem()/read_mem()/write_mem() */
+void heatmap_access(heatmap *hm, z80info *z80, word addr, int how);
+
+/* from memregion.c - 'offset' into region 'n' */
+void heatmap_region(int n, long offset, int write);
+
+/* the text version */
+void heatmap_print(heatmap *hm, FILE *fp);
+
+/* write 'prefix'.txt and 'prefix'.ppm.  return 0 if ok */
+int heatmap_report(heatmap *hm, const char *prefix);
+
+void heatmap_stop(heatmap *hm, z80info *z80);
+
+#endif
@@ -0,0 +1,251 @@
+/*-----------------------------------------------------------------------*\
+ |  hexcodec.c  --  ASCII hex encoding and decoding of whole spans       |
+ |                                                                       |
+ |  The vector kernels do 16 (SSE2) or 32 (AVX2) bytes per pass and      |
+ |  leave anything shorter, or anything with a bad digit in it, to the   |
+ |  byte-at-a-time code, which also finds exactly where decoding has     |
+ |  to stop.  Build with -mavx2 for the AVX2 kernels; SSE2 is always     |
+ |  there on x86-64.  -DNO_SIMD_HEX turns them all off.                  |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+
+#include "hexcodec.h"
+
+#if !defined NO_SIMD_HEX && defined __AVX2__
+#	define HEX_AVX2
+#	include <immintrin.h>
+#elif !defined NO_SIMD_HEX && defined __SSE2__
+#	define HEX_SSE2
+#	include <emmintrin.h>
+#endif
+
+
+static const char hexdigits[] = "0123456789abcdef";
+
+
+/*-----------------------------------------------------------------------*\
+ |  hexval  --  value of a hex digit, or -1
+\*-----------------------------------------------------------------------*/
+
+static int
+hexval(int c)
+{
+    if ('0' <= c && c <= '9')
+        return c - '0';
+    c |= 0x20;
+    if ('a' <= c && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+
+#if defined HEX_SSE2 || defined HEX_AVX2
+
+/* the same steps at either width:
+    digits: c - '0' is 0..9
+    letters: (c | 0x20) - 'a' is 0..5, and is worth 10 more
+    anything else makes the whole block go the slow way */
+#ifdef HEX_AVX2
+#	define V		__m256i
+#	define VW		32
+#	define vload(p)		_mm256_loadu_si256((const __m256i *)(p))
+#	define vstore(p, v)	_mm256_storeu_si256((__m256i *)(p), v)
+#	define vset1(c)		_mm256_set1_epi8(c)
+#	define vset16(c)	_mm256_set1_epi16(c)
+#	define vzero()		_mm256_setzero_si256()
+#	define vadd8(a, b)	_mm256_add_epi8(a, b)
+#	define vsub8(a, b)	_mm256_sub_epi8(a, b)
+#	define vsubs8(a, b)	_mm256_subs_epu8(a, b)
+#	define vcmpeq8(a, b)	_mm256_cmpeq_epi8(a, b)
+#	define vcmpgt8(a, b)	_mm256_cmpgt_epi8(a, b)
+#	define vand(a, b)	_mm256_and_si256(a, b)
+#	define vor(a, b)	_mm256_or_si256(a, b)
+#	define vsll16(a, n)	_mm256_slli_epi16(a, n)
+#	define vsrl16(a, n)	_mm256_srli_epi16(a, n)
+#	define vpacku16(a, b)	_mm256_packus_epi16(a, b)
+#	define vmask8(a)	((unsigned)_mm256_movemask_epi8(a))
+#	define VMASKALL		0xFFFFFFFFu
+#else
+#	define V		__m128i
+#	define VW		16
+#	define vload(p)		_mm_loadu_si128((const __m128i *)(p))
+#	define vstore(p, v)	_mm_storeu_si128((__m128i *)(p), v)
+#	define vset1(c)		_mm_set1_epi8(c)
+#	define vset16(c)	_mm_set1_epi16(c)
+#	define vzero()		_mm_setzero_si128()
+#	define vadd8(a, b)	_mm_add_epi8(a, b)
+#	define vsub8(a, b)	_mm_sub_epi8(a, b)
+#	define vsubs8(a, b)	_mm_subs_epu8(a, b)
+#	define vcmpeq8(a, b)	_mm_cmpeq_epi8(a, b)
+#	define vcmpgt8(a, b)	_mm_cmpgt_epi8(a, b)
+#	define vand(a, b)	_mm_and_si128(a, b)
+#	define vor(a, b)	_mm_or_si128(a, b)
+#	define vsll16(a, n)	_mm_slli_epi16(a, n)
+#	define vsrl16(a, n)	_mm_srli_epi16(a, n)
+#	define vpacku16(a, b)	_mm_packus_epi16(a, b)
+#	define vmask8(a)	((unsigned)_mm_movemask_epi8(a))
+#	define VMASKALL		0xFFFFu
+#endif
+
+
+/*-----------------------------------------------------------------------*\
+ |  vnibbles  --  turn VW hex digits into their values
+ |  returns 0 if any of them isn't a hex digit
+\*-----------------------------------------------------------------------*/
+
+static int
+vnibbles(V c, V *out)
+{
+    V zero = vzero();
+    V d = vsub8(c, vset1('0'));
+    V l = vsub8(vor(c, vset1(0x20)), vset1('a'));
+    V isd = vcmpeq8(vsubs8(d, vset1(9)), zero);     /* d <= 9 */
+    V isl = vcmpeq8(vsubs8(l, vset1(5)), zero);     /* l <= 5 */
+
+    if (vmask8(vor(isd, isl)) != VMASKALL)
+        return 0;
+
+    *out = vor(vand(isd, d), vand(isl, vadd8(l, vset1(10))));
+    return 1;
+}
+
+/*-----------------------------------------------------------------------*\
+ |  vpairs  --  squash hi,lo nibble pairs into one byte per 16-bit lane
+\*-----------------------------------------------------------------------*/
+
+static V
+vpairs(V n)
+{
+    return vor(vand(vsll16(n, 4), vset16(0x00FF)), vsrl16(n, 8));
+}
+
+/*-----------------------------------------------------------------------*\
+ |  vdigits  --  turn nibble values 0..15 into lowercase hex digits
+\*-----------------------------------------------------------------------*/
+
+static V
+vdigits(V n)
+{
+    V gt9 = vcmpgt8(n, vset1(9));
+    return vadd8(vadd8(n, vset1('0')), vand(gt9, vset1('a' - '0' - 10)));
+}
+
+
+/*-----------------------------------------------------------------------*\
+ |  vsum  --  add up the bytes in a vector
+\*-----------------------------------------------------------------------*/
+
+static unsigned long
+vsum(V b)
+{
+#ifdef HEX_AVX2
+    __m256i s = _mm256_sad_epu8(b, _mm256_setzero_si256());
+    return (unsigned long)(_mm256_extract_epi64(s, 0) +
+            _mm256_extract_epi64(s, 1) + _mm256_extract_epi64(s, 2) +
+            _mm256_extract_epi64(s, 3));
+#else
+    __m128i s = _mm_sad_epu8(b, _mm_setzero_si128());
+    return (unsigned long)(_mm_cvtsi128_si32(s) +
+            _mm_cvtsi128_si32(_mm_srli_si128(s, 8)));
+#endif
+}
+
+#endif /* HEX_SSE2 || HEX_AVX2 */
+
+
+/*-----------------------------------------------------------------------*\
+ |  hexdecode  --  hex digit pairs to bytes
+\*-----------------------------------------------------------------------*/
+
+size_t
+hexdecode(byte *dst, const char *src, size_t n, unsigned long *sum)
+{
+    size_t i = 0;
+    unsigned long s = 0;
+    int hi, lo;
+
+#if defined HEX_SSE2 || defined HEX_AVX2
+    /* VW bytes out of 2*VW digits per pass */
+    V na, nb, out;
+
+    for (; i + VW <= n; i += VW)
+    {
+        if (!vnibbles(vload(src + 2*i), &na) ||
+            !vnibbles(vload(src + 2*i + VW), &nb))
+            break;
+
+        out = vpacku16(vpairs(na), vpairs(nb));
+#ifdef HEX_AVX2
+        /* packus works within each 128 bit lane; put the quads back */
+        out = _mm256_permute4x64_epi64(out, 0xD8);
+#endif
+        vstore(dst + i, out);
+        s += vsum(out);
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        hi = hexval((unsigned char)src[2*i]);
+        lo = (hi < 0) ? -1 : hexval((unsigned char)src[2*i + 1]);
+        if (lo < 0)
+            break;
+
+        dst[i] = (byte)((hi << 4) | lo);
+        s += dst[i];
+    }
+
+    if (sum)
+        *sum += s;
+    return i;
+}
+
+
+/*-----------------------------------------------------------------------*\
+ |  hexencode  --  bytes to lowercase hex digit pairs
+\*-----------------------------------------------------------------------*/
+
+void
+hexencode(char *dst, const byte *src, size_t n, unsigned long *sum)
+{
+    size_t i = 0;
+    unsigned long s = 0;
+
+#if defined HEX_SSE2 || defined HEX_AVX2
+    V b, hi, lo, mask = vset1(0x0F);
+
+    for (; i + VW <= n; i += VW)
+    {
+        b = vload(src + i);
+        s += vsum(b);
+
+        hi = vdigits(vand(vsrl16(b, 4), mask));
+        lo = vdigits(vand(b, mask));
+
+#ifdef HEX_AVX2
+        {
+            /* unpack works within each 128 bit lane too */
+            __m256i ul = _mm256_unpacklo_epi8(hi, lo);
+            __m256i uh = _mm256_unpackhi_epi8(hi, lo);
+            vstore(dst + 2*i, _mm256_permute2x128_si256(ul, uh, 0x20));
+            vstore(dst + 2*i + VW, _mm256_permute2x128_si256(ul, uh, 0x31));
+        }
+#else
+        vstore(dst + 2*i, _mm_unpacklo_epi8(hi, lo));
+        vstore(dst + 2*i + VW, _mm_unpackhi_epi8(hi, lo));
+#endif
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        dst[2*i] = hexdigits[src[i] >> 4];
+        dst[2*i + 1] = hexdigits[src[i] & 0x0F];
+        s += src[i];
+    }
+
+    if (sum)
+        *sum += s;
+}
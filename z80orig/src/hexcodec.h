@@ -0,0 +1,34 @@
+/*-----------------------------------------------------------------------*\
+ |  hexcodec.h  --  ASCII hex encoding and decoding of whole spans       |
+ |                                                                       |
+ |  Used by the hex file loader and the mass storage protocol.  The      |
+ |  conversions run 16 or 32 bytes at a time with SSE2 or AVX2 when the  |
+ |  compiler has them turned on, and a byte at a time otherwise.         |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+#ifndef __HEXCODEC_H_
+#define __HEXCODEC_H_
+
+#include <stddef.h>
+#include "defs.h"
+
+
+/* decode up to 'n' bytes worth of hex digit pairs from 'src' (which
+   must have at least 2*n characters in it) into 'dst'.  Upper or lower
+   case digits are fine.  Stops at the first pair that isn't two hex
+   digits, and returns the number of bytes decoded.
+   If 'sum' isn't NULL, the decoded bytes are added onto it. */
+size_t hexdecode(byte *dst, const char *src, size_t n, unsigned long *sum);
+
+/* encode 'n' bytes from 'src' into 2*n lowercase hex digits at 'dst'.
+   No terminator is added.  If 'sum' isn't NULL, the bytes are added
+   onto it. */
+void hexencode(char *dst, const byte *src, size_t n, unsigned long *sum);
+
+/* the two's complement checksum byte for a sum, as used in Intel hex
+   records and the mass storage Nc= replies */
+#define HEXCHECK(sum)	((byte)((~(sum) + 1) & 0xFF))
+
+#endif
@@ -0,0 +1,1301 @@
+/*-----------------------------------------------------------------------*\
+ |  hostdisc.c  --  a host directory dressed up as a CP/M 2.2 drive      |
+ |                                                                       |
+ |  The first time the drive is touched the host directory is read,     |
+ |  and each file that has a legal 8.3 name is given directory entries  |
+ |  and a run of blocks.  User areas 1-15 are the subdirectories "1"    |
+ |  to "15".  No file data is read until CP/M asks for a sector, and    |
+ |  then it comes straight out of the host file.                        |
+ |                                                                       |
+ |  Going the other way, the BDOS writes file data into blocks it has   |
+ |  allocated before any directory entry says whose they are.  Those    |
+ |  are held here until an entry claims them, and from then on writes   |
+ |  go straight through to the host file.  Each directory sector that   |
+ |  is written is compared entry by entry with what we had, and the     |
+ |  differences are made into creates, renames, deletes and size        |
+ |  changes on the host.                                                |
+ |                                                                       |
+ |  hostdisc_bdos() skips all that for the file calls it's given, and   |
+ |  works on the host files by name.                                    |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "hostdisc.h"
+
+
+#define RECSIZE		128
+#define ENTRYSIZE	32
+#define NUMUSERS	16
+#define EMPTY		0xE5	/* unused directory entries and blocks */
+#define CPMEOF		0x1A	/* fills out the last record of a file */
+
+
+/* files the BDOS calls have open */
+#define TRAPFILES	8
+
+typedef struct hostfile
+{
+	char *hostname;		/* name in the host directory; NULL if unused */
+	int user;
+	byte name[11];		/* CP/M name, no attribute bits */
+	int fd;			/* opened when first needed, or -1 */
+	int nentries;		/* directory entries that are ours */
+	long records;		/* size as far as CP/M knows */
+} hostfile;
+
+struct hostdisc
+{
+	char *path;
+	hostgeom g;
+	int scanned;
+
+	int blocksize;		/* in bytes */
+	int rpb;		/* records per block */
+	int ptrsize;		/* 1 or 2 bytes per block number */
+	int perentry;		/* block numbers per directory entry */
+	int nentries;
+
+	byte *dir;		/* the directory, as CP/M sees it */
+	int *entfile;		/* which file each entry belongs to, or -1 */
+
+	int *blkfile;		/* which file owns each block, or -1 */
+	long *blkindex;		/* ...and which of its blocks it is */
+	byte **pending;		/* written but not yet claimed */
+
+	hostfile *files;
+	int nfiles;
+
+	/* for hostdisc_bdos() */
+	struct
+	{
+		int user;
+		byte name[11];
+		int fd;		/* -1 if the slot is free */
+	} trap[TRAPFILES];
+	int nexttrap;		/* slot to reuse when they're all taken */
+	byte *found;		/* search first's entries, for search next */
+	int nfound, nextfound;
+};
+
+
+/*-----------------------------------------------------------------------*\
+ |  directory entries
+\*-----------------------------------------------------------------------*/
+
+static int
+isactive(const byte *e)
+{
+	return e[0] < NUMUSERS;
+}
+
+/* the logical extent number of the last extent in an entry */
+static long
+extentof(const byte *e)
+{
+	return (e[12] & 0x1F) | ((long)(e[14] & 0x3F) << 5);
+}
+
+/* how many records the file has, up to the end of this entry */
+static long
+recordsto(const byte *e)
+{
+	return extentof(e) * 128 + e[15];
+}
+
+/* the first block of the file that this entry maps */
+static long
+firstblock(hostdisc *hd, const byte *e)
+{
+	return (extentof(e) / (hd->g.exm + 1)) * hd->perentry;
+}
+
+static int
+blockat(hostdisc *hd, const byte *e, int i)
+{
+	if (hd->ptrsize == 1)
+		return e[16 + i];
+	return e[16 + 2 * i] | (e[16 + 2 * i + 1] << 8);
+}
+
+/* fill in entry 'k' (counting from 0) of a file with 'recs' records,
+   all but the block numbers */
+static void
+fillentry(hostdisc *hd, byte *e, int user, const byte *name, long recs,
+	int k, int ro)
+{
+	long r, last;
+
+	memset(e, 0, ENTRYSIZE);
+	e[0] = user;
+	memcpy(e + 1, name, 11);
+	if (ro)
+		e[9] |= 0x80;
+
+	/* records in this entry, and the extent they end in */
+	r = recs - (long)k * hd->perentry * hd->rpb;
+	if (r > (long)hd->perentry * hd->rpb)
+		r = (long)hd->perentry * hd->rpb;
+	if (r > 0)
+	{
+		last = (long)k * hd->perentry * hd->rpb + r - 1;
+		e[12] = (last / 128) & 0x1F;
+		e[14] = (last / 128) >> 5;
+		e[15] = (last + 1) - (last / 128) * 128;
+	}
+}
+
+/* how many entries a file of 'recs' records takes */
+static int
+entriesfor(hostdisc *hd, long recs)
+{
+	long nblocks = (recs + hd->rpb - 1) / hd->rpb;
+
+	return nblocks ? (nblocks + hd->perentry - 1) / hd->perentry : 1;
+}
+
+/*-----------------------------------------------------------------------*\
+ |  host names
+\*-----------------------------------------------------------------------*/
+
+/* turn a host name into a CP/M one, if it can be - return FALSE if not */
+static int
+cpmname(const char *host, byte *name)
+{
+	const char *dot = strrchr(host, '.');
+	int i, n, c;
+
+	memset(name, ' ', 11);
+	n = dot ? dot - host : (int)strlen(host);
+
+	if (n < 1 || n > 8 || (dot && strlen(dot + 1) > 3))
+		return FALSE;
+
+	for (i = 0; host[i] != '\0'; i++)
+	{
+		c = (unsigned char)host[i];
+
+		if (host + i == dot)
+			continue;
+		if (c <= ' ' || c >= 0x7F || strchr("<>.,;:=?*[]%|()/\\\"", c))
+			return FALSE;
+
+		c = toupper(c);
+		if (dot && host + i > dot)
+			name[8 + (host + i - dot - 1)] = c;
+		else
+			name[i] = c;
+	}
+
+	return TRUE;
+}
+
+/* and back again, in lower case, for files CP/M makes */
+static char *
+hostname(const byte *name)
+{
+	char buf[13];
+	int i, n = 0;
+
+	for (i = 0; i < 8 && name[i] != ' '; i++)
+		buf[n++] = tolower(name[i]);
+	if (name[8] != ' ')
+	{
+		buf[n++] = '.';
+		for (i = 8; i < 11 && name[i] != ' '; i++)
+			buf[n++] = tolower(name[i]);
+	}
+	buf[n] = '\0';
+
+	return strdup(buf);
+}
+
+/* the host path of a file, or of a user area if 'f' is NULL */
+static void
+hostpath(hostdisc *hd, int user, const hostfile *f, char *buf, size_t len)
+{
+	if (user == 0)
+		snprintf(buf, len, "%s/%s", hd->path, f ? f->hostname : "");
+	else
+		snprintf(buf, len, "%s/%d/%s", hd->path, user,
+				f ? f->hostname : "");
+}
+
+
+/*-----------------------------------------------------------------------*\
+ |  files
+\*-----------------------------------------------------------------------*/
+
+static int
+findfile(hostdisc *hd, int user, const byte *name)
+{
+	int i;
+
+	for (i = 0; i < hd->nfiles; i++)
+		if (hd->files[i].hostname && hd->files[i].user == user &&
+				memcmp(hd->files[i].name, name, 11) == 0)
+			return i;
+	return -1;
+}
+
+static int
+newfile(hostdisc *hd, int user, const byte *name, char *host)
+{
+	hostfile *f;
+	int i;
+
+	for (i = 0; i < hd->nfiles; i++)
+		if (hd->files[i].hostname == NULL)
+			break;
+
+	if (i == hd->nfiles)
+	{
+		f = realloc(hd->files, (hd->nfiles + 1) * sizeof *f);
+		if (f == NULL)
+			return -1;
+		hd->files = f;
+		hd->nfiles++;
+	}
+
+	f = &hd->files[i];
+	memset(f, 0, sizeof *f);
+	f->hostname = host;
+	f->user = user;
+	memcpy(f->name, name, 11);
+	f->fd = -1;
+	return i;
+}
+
+static void
+dropfile(hostdisc *hd, int fi)
+{
+	hostfile *f = &hd->files[fi];
+
+	if (f->fd >= 0)
+		close(f->fd);
+	free(f->hostname);
+	f->hostname = NULL;
+	f->fd = -1;
+}
+
+/* open the host file if it isn't already */
+static int
+openfile(hostdisc *hd, int fi, int flags)
+{
+	hostfile *f = &hd->files[fi];
+	char path[1024];
+
+	if (f->fd >= 0)
+		return f->fd;
+
+	hostpath(hd, f->user, f, path, sizeof path);
+	f->fd = open(path, O_RDWR | flags, 0666);
+
+	if (f->fd < 0 && !(flags & O_CREAT))
+		f->fd = open(path, O_RDONLY);
+	if (f->fd < 0)
+		fprintf(stderr, "hostdisc: cannot open '%s'!\r\n", path);
+
+	return f->fd;
+}
+
+
+/*-----------------------------------------------------------------------*\
+ |  scan  --  build the directory from what's on the host
+\*-----------------------------------------------------------------------*/
+
+static void
+scanuser(hostdisc *hd, int user, int *nextent, int *nextblock)
+{
+	char path[1024];
+	DIR *dp;
+	struct dirent *de;
+	struct stat st;
+	byte name[11];
+	long recs, nblocks, blk;
+	int nent, fi, k, i;
+	byte *e;
+
+	hostpath(hd, user, NULL, path, sizeof path);
+	if ((dp = opendir(path)) == NULL)
+		return;
+
+	while ((de = readdir(dp)) != NULL)
+	{
+		if (de->d_name[0] == '.' || !cpmname(de->d_name, name))
+			continue;
+
+		hostpath(hd, user, NULL, path, sizeof path);
+		strncat(path, de->d_name, sizeof path - strlen(path) - 1);
+		if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+			continue;
+
+		if (findfile(hd, user, name) >= 0)
+		{
+			fprintf(stderr, "hostdisc: '%s' clashes with another "
+				"name, skipped\r\n", path);
+			continue;
+		}
+
+		recs = (st.st_size + RECSIZE - 1) / RECSIZE;
+		nblocks = (recs + hd->rpb - 1) / hd->rpb;
+		nent = entriesfor(hd, recs);
+
+		if (*nextent + nent > hd->nentries ||
+				*nextblock + nblocks > hd->g.dsm + 1)
+		{
+			fprintf(stderr, "hostdisc: no room for '%s', skipped\r\n",
+				path);
+			continue;
+		}
+
+		if ((fi = newfile(hd, user, name, strdup(de->d_name))) < 0)
+			break;
+		hd->files[fi].records = recs;
+
+		for (k = 0; k < nent; k++)
+		{
+			e = &hd->dir[ENTRYSIZE * *nextent];
+			fillentry(hd, e, user, name, recs, k, access(path, W_OK) != 0);
+
+			for (i = 0; i < hd->perentry && nblocks > 0; i++)
+			{
+				blk = (*nextblock)++;
+				nblocks--;
+
+				if (hd->ptrsize == 1)
+					e[16 + i] = blk;
+				else
+				{
+					e[16 + 2 * i] = blk & 0xFF;
+					e[16 + 2 * i + 1] = blk >> 8;
+				}
+				hd->blkfile[blk] = fi;
+				hd->blkindex[blk] = (long)k * hd->perentry + i;
+			}
+
+			hd->entfile[*nextent] = fi;
+			hd->files[fi].nentries++;
+			(*nextent)++;
+		}
+	}
+
+	closedir(dp);
+}
+
+static void
+scan(hostdisc *hd)
+{
+	int nextent = 0;
+	int nextblock = hd->g.dirblocks;
+	int user;
+
+	hd->scanned = TRUE;
+	for (user = 0; user < NUMUSERS; user++)
+		scanuser(hd, user, &nextent, &nextblock);
+}
+
+/* forget the scan, so the next sector read or write does a new one */
+static void
+unscan(hostdisc *hd)
+{
+	int i;
+
+	for (i = 0; i < hd->nfiles; i++)
+		if (hd->files[i].hostname)
+			dropfile(hd, i);
+	for (i = 0; i <= hd->g.dsm; i++)
+	{
+		free(hd->pending[i]);
+		hd->pending[i] = NULL;
+		hd->blkfile[i] = -1;
+	}
+	for (i = 0; i < hd->nentries; i++)
+		hd->entfile[i] = -1;
+	memset(hd->dir, EMPTY, hd->nentries * ENTRYSIZE);
+	hd->scanned = FALSE;
+}
+
+
+/*-----------------------------------------------------------------------*\
+ |  directory writes
+\*-----------------------------------------------------------------------*/
+
+/* make the host file the size CP/M now thinks it is */
+static void
+resize(hostdisc *hd, int fi)
+{
+	hostfile *f = &hd->files[fi];
+	long recs = 0;
+	int i;
+
+	for (i = 0; i < hd->nentries; i++)
+		if (hd->entfile[i] == fi && recordsto(&hd->dir[ENTRYSIZE * i]) > recs)
+			recs = recordsto(&hd->dir[ENTRYSIZE * i]);
+
+	if (recs != f->records && openfile(hd, fi, 0) >= 0)
+	{
+		if (ftruncate(f->fd, recs * RECSIZE) != 0)
+			fprintf(stderr, "hostdisc: cannot resize '%s'!\r\n",
+				f->hostname);
+		f->records = recs;
+	}
+}
+
+/* entry 'n' is about to change from 'old' to 'new' */
+static void
+changeentry(hostdisc *hd, int n, const byte *old, const byte *new)
+{
+	char from[1024], to[1024];
+	int ofi = hd->entfile[n];
+	int fi = -1;
+	long base;
+	int i, b;
+	byte name[11];
+
+	/* let go of the old entry's blocks */
+	if (ofi >= 0)
+	{
+		for (i = 0; i < hd->perentry; i++)
+		{
+			b = blockat(hd, old, i);
+			if (b >= hd->g.dirblocks && b <= hd->g.dsm &&
+					hd->blkfile[b] == ofi)
+				hd->blkfile[b] = -1;
+		}
+		hd->files[ofi].nentries--;
+		hd->entfile[n] = -1;
+	}
+
+	if (isactive(new))
+	{
+		for (i = 0; i < 11; i++)
+			name[i] = new[1 + i] & 0x7F;
+
+		fi = findfile(hd, new[0], name);
+
+		if (fi < 0 && ofi >= 0 && new[0] == hd->files[ofi].user)
+		{
+			/* renamed - the other entries will follow along */
+			hostfile *f = &hd->files[ofi];
+			char *h = hostname(name);
+
+			hostpath(hd, f->user, f, from, sizeof from);
+			free(f->hostname);
+			f->hostname = h;
+			memcpy(f->name, name, 11);
+			hostpath(hd, f->user, f, to, sizeof to);
+
+			if (rename(from, to) != 0)
+				fprintf(stderr, "hostdisc: cannot rename '%s'!\r\n",
+					from);
+			fi = ofi;
+		}
+		else if (fi < 0)
+		{
+			/* a new file */
+			if (new[0] != 0)
+			{
+				hostpath(hd, new[0], NULL, to, sizeof to);
+				mkdir(to, 0777);
+			}
+			fi = newfile(hd, new[0], name, hostname(name));
+			if (fi >= 0 && openfile(hd, fi, O_CREAT | O_TRUNC) < 0)
+			{
+				dropfile(hd, fi);
+				fi = -1;
+			}
+		}
+	}
+
+	/* the old file is gone if that was its last entry */
+	if (ofi >= 0 && ofi != fi && hd->files[ofi].nentries == 0)
+	{
+		hostpath(hd, hd->files[ofi].user, &hd->files[ofi], from,
+			sizeof from);
+		dropfile(hd, ofi);
+		if (unlink(from) != 0 && errno != ENOENT)
+			fprintf(stderr, "hostdisc: cannot delete '%s'!\r\n", from);
+	}
+
+	if (fi < 0)
+		return;
+
+	/* claim the new entry's blocks, and write out what's been waiting */
+	hd->entfile[n] = fi;
+	hd->files[fi].nentries++;
+	base = firstblock(hd, new);
+
+	for (i = 0; i < hd->perentry; i++)
+	{
+		b = blockat(hd, new, i);
+		if (b < hd->g.dirblocks || b > hd->g.dsm)
+			continue;
+
+		hd->blkfile[b] = fi;
+		hd->blkindex[b] = base + i;
+
+		if (hd->pending[b])
+		{
+			if (openfile(hd, fi, 0) < 0 ||
+				pwrite(hd->files[fi].fd, hd->pending[b], hd->blocksize,
+					(base + i) * hd->blocksize) != hd->blocksize)
+				fprintf(stderr, "hostdisc: write failure on '%s'!\r\n",
+					hd->files[fi].hostname);
+			free(hd->pending[b]);
+			hd->pending[b] = NULL;
+		}
+	}
+}
+
+/*-----------------------------------------------------------------------*\
+ |  BDOS calls  --  file functions done by name, straight on the host
+\*-----------------------------------------------------------------------*/
+
+/* a host file that matched */
+typedef struct hostmatch
+{
+	int user;
+	byte name[11];
+	char *host;
+	long records;
+	int ro;
+} hostmatch;
+
+static int
+wildmatch(const byte *pat, const byte *name)
+{
+	int i;
+
+	for (i = 0; i < 11; i++)
+		if ((pat[i] & 0x7F) != '?' && (pat[i] & 0x7F) != name[i])
+			return FALSE;
+	return TRUE;
+}
+
+static void
+freematches(hostmatch *m, int n)
+{
+	while (n > 0)
+		free(m[--n].host);
+	free(m);
+}
+
+/* everything in user area 'user' (or all of them if it's -1) that
+   'pat' matches.  return how many, or -1 if out of memory */
+static int
+matchfiles(hostdisc *hd, int user, const byte *pat, hostmatch **out)
+{
+	char path[1024];
+	DIR *dp;
+	struct dirent *de;
+	struct stat st;
+	hostmatch *m = NULL, *nm;
+	int n = 0, u, i;
+	byte name[11];
+
+	for (u = (user < 0 ? 0 : user); u < (user < 0 ? NUMUSERS : user + 1);
+			u++)
+	{
+		hostpath(hd, u, NULL, path, sizeof path);
+		if ((dp = opendir(path)) == NULL)
+			continue;
+
+		while ((de = readdir(dp)) != NULL)
+		{
+			if (de->d_name[0] == '.' || !cpmname(de->d_name, name) ||
+					!wildmatch(pat, name))
+				continue;
+
+			hostpath(hd, u, NULL, path, sizeof path);
+			strncat(path, de->d_name, sizeof path - strlen(path) - 1);
+			if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+				continue;
+
+			/* first one wins if two host names make the same one */
+			for (i = 0; i < n; i++)
+				if (m[i].user == u && memcmp(m[i].name, name, 11) == 0)
+					break;
+			if (i < n)
+				continue;
+
+			if ((nm = realloc(m, (n + 1) * sizeof *m)) == NULL ||
+				(nm[n].host = strdup(de->d_name)) == NULL)
+			{
+				closedir(dp);
+				freematches(nm ? nm : m, n);
+				return -1;
+			}
+			m = nm;
+			m[n].user = u;
+			memcpy(m[n].name, name, 11);
+			m[n].records = (st.st_size + RECSIZE - 1) / RECSIZE;
+			m[n].ro = access(path, W_OK) != 0;
+			n++;
+		}
+		closedir(dp);
+	}
+
+	*out = m;
+	return n;
+}
+
+/* the file's descriptor, opening it if it isn't already */
+static int
+trapfd(hostdisc *hd, int user, const byte *name, int flags)
+{
+	char path[1024];
+	hostmatch *m;
+	hostfile f;
+	int i, n, fd;
+
+	for (i = 0; i < TRAPFILES; i++)
+		if (hd->trap[i].fd >= 0 && hd->trap[i].user == user &&
+				memcmp(hd->trap[i].name, name, 11) == 0)
+			return hd->trap[i].fd;
+
+	if (flags & O_CREAT)
+		f.hostname = hostname(name);
+	else if ((n = matchfiles(hd, user, name, &m)) > 0)
+	{
+		f.hostname = strdup(m[0].host);
+		freematches(m, n);
+	}
+	else
+		return -1;
+
+	if (f.hostname == NULL)
+		return -1;
+	hostpath(hd, user, &f, path, sizeof path);
+	free(f.hostname);
+
+	if ((fd = open(path, O_RDWR | flags, 0666)) < 0 && !(flags & O_CREAT))
+		fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	i = hd->nexttrap;
+	hd->nexttrap = (i + 1) % TRAPFILES;
+	if (hd->trap[i].fd >= 0)
+		close(hd->trap[i].fd);
+	hd->trap[i].user = user;
+	memcpy(hd->trap[i].name, name, 11);
+	hd->trap[i].fd = fd;
+	return fd;
+}
+
+/* close whatever we have open that 'pat' matches */
+static void
+trapforget(hostdisc *hd, int user, const byte *pat)
+{
+	int i;
+
+	for (i = 0; i < TRAPFILES; i++)
+		if (hd->trap[i].fd >= 0 && hd->trap[i].user == user &&
+				wildmatch(pat, hd->trap[i].name))
+		{
+			close(hd->trap[i].fd);
+			hd->trap[i].fd = -1;
+		}
+}
+
+/* the FCB's sequential position, in records */
+static long
+seqrec(const byte *fcb)
+{
+	return ((long)(fcb[14] & 0x3F) * 32 + (fcb[12] & 0x1F)) * 128 + fcb[32];
+}
+
+/* move the FCB to record 'rec' of a file with 'recs' in it */
+static void
+setseq(byte *fcb, long rec, long recs)
+{
+	long rc = recs - (rec & ~127L);
+
+	fcb[12] = (rec >> 7) & 0x1F;
+	fcb[14] = (rec >> 12) & 0x3F;
+	fcb[32] = rec & 0x7F;
+	fcb[15] = rc < 0 ? 0 : (rc > 128 ? 128 : rc);
+}
+
+static long
+filerecs(int fd)
+{
+	struct stat st;
+
+	if (fstat(fd, &st) != 0)
+		return 0;
+	return (st.st_size + RECSIZE - 1) / RECSIZE;
+}
+
+static byte
+readrec(int fd, long rec, byte *dma)
+{
+	ssize_t n;
+
+	memset(dma, CPMEOF, RECSIZE);
+	n = pread(fd, dma, RECSIZE, rec * RECSIZE);
+	return n > 0 ? 0 : 1;		/* 1 is reading past the end */
+}
+
+static byte
+writerec(int fd, long rec, const byte *dma)
+{
+	return pwrite(fd, dma, RECSIZE, rec * RECSIZE) == RECSIZE ? 0 : 2;
+}
+
+/* search first - take a copy of everything that matches, as the
+   directory entries CP/M would have found */
+static byte
+searchfirst(hostdisc *hd, int user, const byte *fcb)
+{
+	byte pat[11], *e;
+	hostmatch *m;
+	int n, i, k, j, nent;
+	int all = (fcb[0] == '?');
+	long blk = 0, nblocks, span = hd->g.dsm + 1 - hd->g.dirblocks;
+
+	free(hd->found);
+	hd->found = NULL;
+	hd->nfound = hd->nextfound = 0;
+
+	if (all)
+		memset(pat, '?', 11);
+	else
+		memcpy(pat, fcb + 1, 11);
+
+	if ((n = matchfiles(hd, all ? -1 : user, pat, &m)) <= 0)
+		return 0xFF;
+
+	for (i = 0; i < n; i++)
+	{
+		nent = entriesfor(hd, m[i].records);
+		if ((e = realloc(hd->found, (hd->nfound + nent) * ENTRYSIZE))
+				== NULL)
+			break;
+		hd->found = e;
+		nblocks = (m[i].records + hd->rpb - 1) / hd->rpb;
+
+		for (k = 0; k < nent; k++)
+		{
+			e = hd->found + hd->nfound * ENTRYSIZE;
+			fillentry(hd, e, m[i].user, m[i].name, m[i].records, k,
+				m[i].ro);
+
+			/* the extent has to be asked for, unless it's '?' */
+			if (!all && fcb[12] != '?' &&
+				((e[12] & ~hd->g.exm) != (fcb[12] & ~hd->g.exm) ||
+					(e[14] & 0x3F) != (fcb[14] & 0x3F)))
+			{
+				nblocks -= hd->perentry;
+				continue;
+			}
+
+			/* made up block numbers, but the right number of them,
+			   for anything that counts them to get the size */
+			for (j = 0; j < hd->perentry && nblocks > 0; j++, nblocks--)
+			{
+				long b = hd->g.dirblocks + blk++ % span;
+
+				if (hd->ptrsize == 1)
+					e[16 + j] = b;
+				else
+				{
+					e[16 + 2 * j] = b & 0xFF;
+					e[16 + 2 * j + 1] = b >> 8;
+				}
+			}
+			hd->nfound++;
+		}
+	}
+	freematches(m, n);
+
+	return hd->nfound ? 0 : 0xFF;
+}
+
+static byte
+searchnext(hostdisc *hd, byte *dma)
+{
+	if (hd->nextfound >= hd->nfound)
+		return 0xFF;
+
+	/* it's always the first of the four in the "directory record" */
+	memset(dma, EMPTY, RECSIZE);
+	memcpy(dma, hd->found + hd->nextfound++ * ENTRYSIZE, ENTRYSIZE);
+	return 0;
+}
+
+/* the FCB's name without its attribute bits */
+static void
+fcbname(const byte *fcb, byte *name)
+{
+	int i;
+
+	for (i = 0; i < 11; i++)
+		name[i] = fcb[1 + i] & 0x7F;
+}
+
+static int
+haswild(const byte *name)
+{
+	int i;
+
+	for (i = 0; i < 11; i++)
+		if ((name[i] & 0x7F) == '?')
+			return TRUE;
+	return FALSE;
+}
+
+static byte
+openfcb(hostdisc *hd, int user, byte *fcb)
+{
+	hostmatch *m;
+	int n, fd;
+	long x = (long)(fcb[14] & 0x3F) * 32 + (fcb[12] & 0x1F), recs;
+
+	if ((n = matchfiles(hd, user, fcb + 1, &m)) <= 0)
+		return 0xFF;
+
+	/* an extent past the end isn't there */
+	if (x > 0 && m[0].records <= x * 128)
+	{
+		freematches(m, n);
+		return 0xFF;
+	}
+
+	memcpy(fcb + 1, m[0].name, 11);
+	if (m[0].ro)
+		fcb[9] |= 0x80;
+	fd = trapfd(hd, user, m[0].name, 0);
+	freematches(m, n);
+
+	if (fd < 0)
+		return 0xFF;
+
+	/* the record count for this extent; the position is left alone */
+	recs = filerecs(fd) - x * 128;
+	fcb[13] = 0;
+	fcb[15] = recs > 128 ? 128 : recs;
+	memset(fcb + 16, 0, 16);
+	return 0;
+}
+
+static byte
+makefcb(hostdisc *hd, int user, byte *fcb)
+{
+	char path[1024];
+	byte name[11];
+
+	fcbname(fcb, name);
+	if (haswild(name))
+		return 0xFF;
+
+	if (user != 0)
+	{
+		hostpath(hd, user, NULL, path, sizeof path);
+		mkdir(path, 0777);
+	}
+
+	/* only the first extent starts the file over */
+	trapforget(hd, user, name);
+	if (trapfd(hd, user, name, O_CREAT |
+			((fcb[12] & 0x1F) == 0 && (fcb[14] & 0x3F) == 0 ? O_TRUNC : 0))
+			< 0)
+		return 0xFF;
+
+	fcb[13] = 0;
+	fcb[15] = 0;
+	memset(fcb + 16, 0, 16);
+	return 0;
+}
+
+static byte
+deletefcb(hostdisc *hd, int user, const byte *fcb)
+{
+	char path[1024];
+	hostmatch *m;
+	hostfile f;
+	int n, i;
+	byte r = 0xFF;
+
+	if ((n = matchfiles(hd, user, fcb + 1, &m)) <= 0)
+		return 0xFF;
+
+	trapforget(hd, user, fcb + 1);
+	for (i = 0; i < n; i++)
+	{
+		if (m[i].ro)
+			continue;
+		f.hostname = m[i].host;
+		hostpath(hd, user, &f, path, sizeof path);
+		if (unlink(path) == 0)
+			r = 0;
+	}
+	freematches(m, n);
+	return r;
+}
+
+static byte
+renamefcb(hostdisc *hd, int user, const byte *fcb)
+{
+	char from[1024], to[1024];
+	byte name[11];
+	hostmatch *m;
+	hostfile f;
+	int n, i;
+
+	for (i = 0; i < 11; i++)
+		name[i] = fcb[17 + i] & 0x7F;
+	if (haswild(name) || (n = matchfiles(hd, user, fcb + 1, &m)) <= 0)
+		return 0xFF;
+
+	trapforget(hd, user, fcb + 1);
+	f.hostname = m[0].host;
+	hostpath(hd, user, &f, from, sizeof from);
+	freematches(m, n);
+
+	if ((f.hostname = hostname(name)) == NULL)
+		return 0xFF;
+	hostpath(hd, user, &f, to, sizeof to);
+	free(f.hostname);
+
+	return rename(from, to) == 0 ? 0 : 0xFF;
+}
+
+/* the read-only attribute is the only one that means anything here */
+static byte
+setattrs(hostdisc *hd, int user, const byte *fcb)
+{
+	char path[1024];
+	struct stat st;
+	hostmatch *m;
+	hostfile f;
+	int n;
+
+	if ((n = matchfiles(hd, user, fcb + 1, &m)) <= 0)
+		return 0xFF;
+
+	f.hostname = m[0].host;
+	hostpath(hd, user, &f, path, sizeof path);
+	freematches(m, n);
+
+	if (stat(path, &st) == 0)
+		chmod(path, (fcb[9] & 0x80) ? (st.st_mode & ~0222) :
+			(st.st_mode | 0200));
+	trapforget(hd, user, fcb + 1);
+	return 0;
+}
+
+
+/*-----------------------------------------------------------------------*\
+ |  public
+\*-----------------------------------------------------------------------*/
+
+hostdisc *
+hostdisc_open(const char *path, const hostgeom *g)
+{
+	hostdisc *hd = calloc(1, sizeof *hd);
+	int i;
+
+	if (hd == NULL)
+		return NULL;
+	for (i = 0; i < TRAPFILES; i++)
+		hd->trap[i].fd = -1;
+
+	hd->path = strdup(path);
+	hd->g = *g;
+	hd->blocksize = RECSIZE << g->bsh;
+	hd->rpb = 1 << g->bsh;
+	hd->ptrsize = (g->dsm > 255) ? 2 : 1;
+	hd->perentry = 16 / hd->ptrsize;
+	hd->nentries = g->drm + 1;
+
+	hd->dir = malloc(hd->nentries * ENTRYSIZE);
+	hd->entfile = malloc(hd->nentries * sizeof *hd->entfile);
+	hd->blkfile = malloc((g->dsm + 1) * sizeof *hd->blkfile);
+	hd->blkindex = calloc(g->dsm + 1, sizeof *hd->blkindex);
+	hd->pending = calloc(g->dsm + 1, sizeof *hd->pending);
+
+	if (!hd->path || !hd->dir || !hd->entfile || !hd->blkfile ||
+			!hd->blkindex || !hd->pending)
+	{
+		hostdisc_close(hd);
+		return NULL;
+	}
+
+	memset(hd->dir, EMPTY, hd->nentries * ENTRYSIZE);
+	for (i = 0; i < hd->nentries; i++)
+		hd->entfile[i] = -1;
+	for (i = 0; i <= g->dsm; i++)
+		hd->blkfile[i] = -1;
+
+	return hd;
+}
+
+void
+hostdisc_close(hostdisc *hd)
+{
+	int i;
+
+	if (hd == NULL)
+		return;
+
+	for (i = 0; i < hd->nfiles; i++)
+		if (hd->files[i].hostname)
+			dropfile(hd, i);
+	if (hd->pending)
+		for (i = 0; i <= hd->g.dsm; i++)
+			free(hd->pending[i]);
+	for (i = 0; i < TRAPFILES; i++)
+		if (hd->trap[i].fd >= 0)
+			close(hd->trap[i].fd);
+
+	free(hd->found);
+	free(hd->files);
+	free(hd->pending);
+	free(hd->blkindex);
+	free(hd->blkfile);
+	free(hd->entfile);
+	free(hd->dir);
+	free(hd->path);
+	free(hd);
+}
+
+int
+hostdisc_read(hostdisc *hd, long rec, byte *buf)
+{
+	long b, off;
+	int fi;
+
+	if (!hd->scanned)
+		scan(hd);
+
+	rec -= (long)hd->g.off * hd->g.spt;
+	b = rec / hd->rpb;
+
+	if (rec < 0 || b > hd->g.dsm)
+	{
+		/* the system tracks, or off the end */
+		memset(buf, EMPTY, RECSIZE);
+		return 0;
+	}
+
+	if (b < hd->g.dirblocks)
+	{
+		off = rec * RECSIZE;
+		memset(buf, EMPTY, RECSIZE);
+		if (off < (long)hd->nentries * ENTRYSIZE)
+			memcpy(buf, hd->dir + off, RECSIZE);
+		return 0;
+	}
+
+	off = (rec % hd->rpb) * RECSIZE;
+
+	if ((fi = hd->blkfile[b]) >= 0)
+	{
+		memset(buf, CPMEOF, RECSIZE);
+		if (openfile(hd, fi, 0) < 0 ||
+			pread(hd->files[fi].fd, buf, RECSIZE,
+				hd->blkindex[b] * hd->blocksize + off) < 0)
+			return 1;
+	}
+	else if (hd->pending[b])
+		memcpy(buf, hd->pending[b] + off, RECSIZE);
+	else
+		memset(buf, EMPTY, RECSIZE);
+
+	return 0;
+}
+
+int
+hostdisc_write(hostdisc *hd, long rec, const byte *buf)
+{
+	long b, off;
+	int fi, i, n;
+
+	if (!hd->scanned)
+		scan(hd);
+
+	rec -= (long)hd->g.off * hd->g.spt;
+	b = rec / hd->rpb;
+
+	if (rec < 0 || b > hd->g.dsm)
+		return 0;		/* nothing to keep there */
+
+	if (b < hd->g.dirblocks)
+	{
+		/* see what changed, one entry at a time */
+		off = rec * RECSIZE;
+		if (off >= (long)hd->nentries * ENTRYSIZE)
+			return 0;
+
+		for (i = 0; i < RECSIZE / ENTRYSIZE; i++)
+		{
+			byte *e = hd->dir + off + i * ENTRYSIZE;
+			const byte *ne = buf + i * ENTRYSIZE;
+
+			if (memcmp(e, ne, ENTRYSIZE) == 0)
+				continue;
+
+			n = off / ENTRYSIZE + i;
+			fi = hd->entfile[n];
+			changeentry(hd, n, e, ne);
+			memcpy(e, ne, ENTRYSIZE);
+
+			if (hd->entfile[n] >= 0)
+				resize(hd, hd->entfile[n]);
+			if (fi >= 0 && fi != hd->entfile[n] && hd->files[fi].hostname)
+				resize(hd, fi);
+		}
+		return 0;
+	}
+
+	off = (rec % hd->rpb) * RECSIZE;
+
+	if ((fi = hd->blkfile[b]) >= 0)
+	{
+		if (openfile(hd, fi, 0) < 0 ||
+			pwrite(hd->files[fi].fd, buf, RECSIZE,
+				hd->blkindex[b] * hd->blocksize + off) != RECSIZE)
+			return 1;
+		return 0;
+	}
+
+	/* nobody's yet - hang on to it until a directory entry says */
+	if (hd->pending[b] == NULL)
+	{
+		if ((hd->pending[b] = malloc(hd->blocksize)) == NULL)
+			return 1;
+		memset(hd->pending[b], EMPTY, hd->blocksize);
+	}
+	memcpy(hd->pending[b] + off, buf, RECSIZE);
+	return 0;
+}
+
+int
+hostdisc_bdos(hostdisc *hd, int fn, int user, byte *fcb, byte *dma,
+	byte *ret)
+{
+	byte name[11];
+	long rec, recs;
+	int fd;
+
+	fcbname(fcb, name);
+
+	switch (fn)
+	{
+	case 15:			/* open file */
+		*ret = openfcb(hd, user, fcb);
+		return TRUE;
+
+	case 16:			/* close file - nothing to write back */
+		fd = trapfd(hd, user, name, 0);
+		*ret = fd < 0 ? 0xFF : 0;
+		return TRUE;
+
+	case 17:			/* search first */
+		*ret = searchfirst(hd, user, fcb);
+		if (*ret == 0)
+			*ret = searchnext(hd, dma);
+		return TRUE;
+
+	case 18:			/* search next */
+		*ret = searchnext(hd, dma);
+		return TRUE;
+
+	case 19:			/* delete file */
+		*ret = deletefcb(hd, user, fcb);
+		break;
+
+	case 20:			/* read sequential */
+	case 33:			/* read random */
+		if ((fd = trapfd(hd, user, name, 0)) < 0)
+		{
+			*ret = fn == 20 ? 1 : 4;
+			return TRUE;
+		}
+		if (fn == 33 && fcb[35] != 0)
+		{
+			*ret = 6;
+			return TRUE;
+		}
+		rec = fn == 20 ? seqrec(fcb) : fcb[33] | (fcb[34] << 8);
+		*ret = readrec(fd, rec, dma);
+		if (fn == 20 && *ret == 0)
+			rec++;
+		setseq(fcb, rec, filerecs(fd));
+		return TRUE;
+
+	case 21:			/* write sequential */
+	case 34:			/* write random */
+	case 40:			/* write random with zero fill */
+		if ((fd = trapfd(hd, user, name, 0)) < 0)
+		{
+			*ret = fn == 21 ? 2 : 5;
+			return TRUE;
+		}
+		if (fn != 21 && fcb[35] != 0)
+		{
+			*ret = 6;
+			return TRUE;
+		}
+		/* the host fills any gap with zeroes, which takes care of 40 */
+		rec = fn == 21 ? seqrec(fcb) : fcb[33] | (fcb[34] << 8);
+		*ret = writerec(fd, rec, dma);
+		if (fn == 21 && *ret == 0)
+			rec++;
+		setseq(fcb, rec, filerecs(fd));
+		break;
+
+	case 22:			/* make file */
+		*ret = makefcb(hd, user, fcb);
+		break;
+
+	case 23:			/* rename file */
+		*ret = renamefcb(hd, user, fcb);
+		break;
+
+	case 30:			/* set file attributes */
+		*ret = setattrs(hd, user, fcb);
+		break;
+
+	case 35:			/* compute file size */
+		if ((fd = trapfd(hd, user, name, 0)) < 0)
+		{
+			*ret = 0xFF;
+			return TRUE;
+		}
+		recs = filerecs(fd);
+		fcb[33] = recs & 0xFF;
+		fcb[34] = (recs >> 8) & 0xFF;
+		fcb[35] = recs >> 16;
+		*ret = 0;
+		return TRUE;
+
+	case 36:			/* set random record */
+		rec = seqrec(fcb);
+		fcb[33] = rec & 0xFF;
+		fcb[34] = (rec >> 8) & 0xFF;
+		fcb[35] = rec >> 16;
+		*ret = 0;
+		return TRUE;
+
+	default:
+		return FALSE;
+	}
+
+	/* the host files changed under the sector level view */
+	if (hd->scanned)
+		unscan(hd);
+	return TRUE;
+}
@@ -0,0 +1,47 @@
+/*-----------------------------------------------------------------------*\
+ |  hostdisc.h  --  a host directory dressed up as a CP/M 2.2 drive      |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+#ifndef __HOSTDISC_H_
+#define __HOSTDISC_H_
+
+#include "defs.h"
+
+
+/* the drive's shape, as its DPB describes it */
+typedef struct hostgeom
+{
+	int spt;		/* 128 byte records per track */
+	int bsh;		/* block shift - a block is 128 << bsh bytes */
+	int exm;		/* extent mask */
+	int dsm;		/* highest block number */
+	int drm;		/* highest directory entry number */
+	int dirblocks;		/* blocks the directory takes (AL0/AL1) */
+	int off;		/* reserved tracks */
+} hostgeom;
+
+typedef struct hostdisc hostdisc;
+
+
+/* present 'path' as a drive - nothing is read until it's used */
+hostdisc *hostdisc_open(const char *path, const hostgeom *g);
+
+/* forget it - anything written but never claimed by a directory
+   entry (a file that was never closed) is lost, as it would be */
+void hostdisc_close(hostdisc *hd);
+
+/* read or write 128 byte record number 'rec', counting from the
+   start of track 0.  return 0 if ok */
+int hostdisc_read(hostdisc *hd, long rec, byte *buf);
+int hostdisc_write(hostdisc *hd, long rec, const byte *buf);
+
+/* do BDOS function 'fn' on the host files by name, for user area
+   'user'.  'fcb' and 'dma' point at the caller's FCB and DMA buffer.
+   Returns TRUE with the BDOS's return code in *ret if it was a file
+   function it knows, FALSE if the BDOS should do it */
+int hostdisc_bdos(hostdisc *hd, int fn, int user, byte *fcb, byte *dma,
+	byte *ret);
+
+#endif
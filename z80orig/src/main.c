@@ -15,10 +15,23 @@
 #include <errno.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdarg.h>
 
 #include <sys/select.h>
 
 #include "defs.h"
+#include "disassem.h"
+#include "hexcodec.h"
+#include "tracering.h"
+#include "profile.h"
+#include "symtab.h"
+#include "callgraph.h"
+#include "breaks.h"
+#include "gdbstub.h"
+#include "stats.h"
+#include "ophist.h"
+#include "coverage.h"
+#include "heatmap.h"
 
 /* If external IO is to be included, we need these protos */
 #ifdef EXTERNAL_IO
@@ -86,10 +99,27 @@ struct termios oldterm;    /* for raw terminal I/O */
 static int keybd = -1;            /* to check keyboard for data */
 #endif
 
+static char profprefix[256] = "z80prof";    /* where the profile goes */
+static char cgpath[256] = "callgrind.out.z80";    /* ...and the call graph */
+static char coverprefix[256] = COVERAGE_DEFPREFIX;    /* ...and the coverage */
+static char listings[1024];        /* the files names came from, for it */
+static char heatprefix[256] = HEATMAP_DEFPREFIX;    /* ...and the heatmap */
+
 
 static void dumptrace(z80info *z80);
 
 
+/* remember a list of .lst/.map files, so coverage can find its lines */
+static void
+addlistings(const char *list)
+{
+    size_t n = strlen(listings);
+
+    if (*list != '\0')
+        snprintf(listings + n, sizeof listings - n, "%s%s",
+                n ? "," : "", list);
+}
+
 
 
 /*-----------------------------------------------------------------------*\
@@ -221,6 +251,7 @@ command(z80info *z80)
     unsigned int i, j, t, e;
     char str[256], *s;
     FILE *fp;
+    disinstr dis;
     static word pe = 0;
     static word po = 0;
 #ifdef AUTORUN
@@ -273,7 +304,12 @@ loop:    /* "infinite" loop */
         printf( "  (b)oot CP/M ");
 #endif
         printf("   (w)write memory to file  (x),(y)-set/clear breakpoint\n");
-        printf("   (o)output to \"logfile\"\n\n");
+        printf("        (x takes conditions too: pc==1234h && a>40h,\n");
+        printf("         write 8000h..80ffh, io_out 38h if val==0)\n");
+        printf("   (o)output to \"logfile\"  (j)binary trace ring on/off\n");
+        printf("   (f)profile on/off  (k)call graph on/off\n");
+        printf("   (n)ames from .lst/.map files  (i)nstrumentation counters\n");
+        printf("   (u)sed-code coverage on/off  (m)emory heatmap on/off\n\n");
         printf("   (!)fork shell  (?)command list  (v)ersion\n\n");
         break;
 
@@ -319,6 +355,7 @@ loop:    /* "infinite" loop */
     case 'q':                /* quit */
         if (logfile != NULL)
             fclose(logfile);
+        tracering_close(z80->tracering);
 
         exit(0);
         break;
@@ -340,6 +377,179 @@ loop:    /* "infinite" loop */
         printf("    Trace %s\n", z80->trace ? "on" : "off");
         break;
 
+    case 'j':                /* binary trace on/off */
+        if (z80->tracering != NULL)
+        {
+            if (tracering_inmemory(z80->tracering))
+            {
+                printf("    Save it to? (<CR> to throw it away) ");
+                if(fgets(str, sizeof(str), stdin)){};
+                str[strcspn(str, "\r\n")] = '\0';
+
+                if (*str != '\0' && tracering_save(z80->tracering, str) != 0)
+                    printf("Cannot write %s!\n", str);
+            }
+
+            tracering_close(z80->tracering);
+            z80->tracering = NULL;
+            printf("    Binary trace off.\n");
+        }
+        else
+        {
+            printf("    Trace file name? (<CR> for memory) ");
+            if(fgets(str, sizeof(str), stdin)){};
+            str[strcspn(str, "\r\n")] = '\0';
+
+            for (s = str; isspace(*s); s++)
+                ;
+
+            z80->tracering = tracering_open(*s ? s : NULL, 0);
+
+            if (z80->tracering != NULL)
+                printf("    Binary trace on.\n");
+        }
+
+        break;
+
+    case 'f':                /* profile on/off */
+        if (z80->profile != NULL)
+        {
+            printf("    Report to? (%s) ", profprefix);
+            if(fgets(str, sizeof(str), stdin)){};
+            str[strcspn(str, "\r\n")] = '\0';
+
+            for (s = str; isspace(*s); s++)
+                ;
+            if (*s != '\0')
+                snprintf(profprefix, sizeof profprefix, "%s", s);
+
+            if (profile_report(z80->profile, z80, profprefix) != 0)
+                printf("Cannot write %s.txt/.folded!\n", profprefix);
+            else
+                printf("    Wrote %s.txt and %s.folded\n",
+                        profprefix, profprefix);
+
+            profile_stop(z80->profile);
+            z80->profile = NULL;
+            printf("    Profile off.\n");
+        }
+        else
+        {
+            printf("    Sample every how many cycles? (%d) ",
+                    PROFILE_DEFPERIOD);
+            if(fgets(str, sizeof(str), stdin)){};
+
+            z80->profile = profile_start(z80, atol(str));
+
+            if (z80->profile != NULL)
+                printf("    Profile on.\n");
+        }
+
+        break;
+
+    case 'k':                /* call graph on/off */
+        if (z80->callgraph != NULL)
+        {
+            printf("    Callgrind file? (%s) ", cgpath);
+            if(fgets(str, sizeof(str), stdin)){};
+            str[strcspn(str, "\r\n")] = '\0';
+
+            for (s = str; isspace(*s); s++)
+                ;
+            if (*s != '\0')
+                snprintf(cgpath, sizeof cgpath, "%s", s);
+
+            callgraph_summary(z80->callgraph, z80, stdout, 15);
+            if (callgraph_report(z80->callgraph, z80, cgpath) != 0)
+                printf("Cannot write %s!\n", cgpath);
+
+            callgraph_stop(z80->callgraph);
+            z80->callgraph = NULL;
+            printf("    Call graph off.\n");
+        }
+        else
+        {
+            z80->callgraph = callgraph_start(z80);
+
+            if (z80->callgraph != NULL)
+                printf("    Call graph on.\n");
+        }
+
+        break;
+
+    case 'm':                /* heatmap on/off */
+        if (z80heat != NULL)
+        {
+            printf("    Heatmap file prefix? (%s) ", heatprefix);
+            if(fgets(str, sizeof(str), stdin)){};
+            str[strcspn(str, "\r\n")] = '\0';
+
+            for (s = str; isspace(*s); s++)
+                ;
+            if (*s != '\0')
+                snprintf(heatprefix, sizeof heatprefix, "%s", s);
+
+            heatmap_print(z80heat, stdout);
+            if (heatmap_report(z80heat, heatprefix) != 0)
+                printf("Cannot write %s.txt/.ppm!\n", heatprefix);
+
+            heatmap_stop(z80heat, z80);
+            printf("    Heatmap off.\n");
+        }
+        else if (heatmap_start(z80) != NULL)
+            printf("    Heatmap on.\n");
+
+        break;
+
+    case 'n':                /* load symbols */
+        printf("    Listing or map files? ");
+        if(fgets(str, sizeof(str), stdin)){};
+        str[strcspn(str, "\r\n")] = '\0';
+
+        for (s = str; isspace(*s); s++)
+            ;
+
+        i = symtab_loadlist(s);
+        printf("    %d names, %d in all\n", i, symtab_count());
+        addlistings(s);
+        break;
+
+    case 'u':                /* coverage on/off */
+        if (z80->coverage != NULL)
+        {
+            printf("    Coverage file prefix? (%s) ", coverprefix);
+            if(fgets(str, sizeof(str), stdin)){};
+            str[strcspn(str, "\r\n")] = '\0';
+
+            for (s = str; isspace(*s); s++)
+                ;
+            if (*s != '\0')
+                snprintf(coverprefix, sizeof coverprefix, "%s", s);
+
+            coverage_summary(z80->coverage, stdout);
+            if (coverage_report(z80->coverage, coverprefix, listings) != 0)
+                printf("Cannot write %s.bin/.info!\n", coverprefix);
+
+            coverage_stop(z80->coverage, z80);
+            z80->coverage = NULL;
+            printf("    Coverage off.\n");
+        }
+        else
+        {
+            printf("    Reads and writes too? (n) ");
+            if(fgets(str, sizeof(str), stdin)){};
+
+            z80->coverage = coverage_start(z80, tolower(*str) == 'y');
+            if (z80->coverage != NULL)
+                printf("    Coverage on.\n");
+        }
+
+        break;
+
+    case 'i':                /* instrumentation counters */
+        stats_print(stdout);
+        break;
+
     case 's':                /* toggle step-trace mode */
         z80->step = !z80->step;
         printf("    Step-trace %s\n", z80->step ? "on" : "off");
@@ -423,13 +633,32 @@ loop:    /* "infinite" loop */
 
     case 'x':            /* set breakpoint */
 #ifdef MEM_BREAK
-        printf("    Set breakpoint at loc? (A for abort): ");
+        printf("    Set breakpoint at loc or when? (A for abort, L to list): ");
         /*if(gets(str)){};*/
         if(fgets(str, sizeof(str), stdin)){};
+        str[strcspn(str, "\r\n")] = '\0';
 
         if (tolower(*str) == 'a' || *str == '\0')
             break;
 
+        if (tolower(*str) == 'l' && str[1] == '\0')
+        {
+            breaks_list(z80, stdout);
+            break;
+        }
+
+        /* anything but a bare address is a condition - see breaks.h */
+        if (str[strspn(str, "0123456789abcdefABCDEF")] != '\0')
+        {
+            char err[100];
+
+            if ((i = breaks_add(z80, str, err, sizeof err)) == 0)
+                printf("    %s\n", err);
+            else
+                printf("    Breakpoint %u set\n", i);
+            break;
+        }
+
         sscanf(str, "%x", &t);
 
         if (/* t < 0 || */ t >= sizeof z80->mem)
@@ -451,7 +680,7 @@ loop:    /* "infinite" loop */
 
     case 'y':            /* clear breakpoints */
 #ifdef MEM_BREAK
-        printf("    Clear breakpoint at loc? (A for all) : ");
+        printf("    Clear breakpoint at loc or #n? (A for all) : ");
         /*if(gets(str)){};*/
         if(fgets(str, sizeof(str), stdin)){};
 
@@ -461,10 +690,21 @@ loop:    /* "infinite" loop */
                 z80->membrk[i] &= ~M_BREAKPOINT;
 
             z80->numbrks = 0;
+            breaks_delete(z80, 0);
             printf("    All breakpoints cleared\n");
             break;
         }
 
+        if (*str == '#')
+        {
+            if (sscanf(str + 1, "%u", &t) != 1 || t == 0 ||
+                    breaks_delete(z80, t) != 0)
+                printf("    No breakpoint %s", str);
+            else
+                printf("    Breakpoint %u cleared\n", t);
+            break;
+        }
+
         sscanf(str, "%x", &t);
 
         if ( /* t < 0 || */  t >= sizeof z80->mem)
@@ -494,16 +734,12 @@ loop:    /* "infinite" loop */
 
         for (i = 0; i < 0x10; i++)
         {
-            printf("  %.4X:    ", pe);
-            j = pe;
-            pe += disassem(z80, pe, stdout);
-            t = disassemlen(z80);
-
-            while (t++ < 15)
-                putchar(' ');
+            pe += disassemble(disassem_mem, z80, pe, &dis);
+            disassem_text(&dis, str, sizeof str);
+            printf("  %.4X:    %-15s", dis.addr, str);
 
-            while (j < pe)
-                printf("  %.2X", z80->mem[j++]);
+            for (j = 0; j < (unsigned)dis.len; j++)
+                printf("  %.2X", dis.bytes[j]);
 
             printf("\n");
         }
@@ -658,92 +894,57 @@ dumptrace(z80info *z80)
 
 
 
-#define HEXVAL(c)    (('0' <= (c) && (c) <= '9') ? (c) - '0' :\
-            (('a' <= (c) && (c) <= 'f') ? (c) - 'a' + 10 :\
-            (('A' <= (c) && (c) <= 'F') ? (c) - 'A' + 10 :\
-                -1 )))
-
-static int
-gethex(FILE *fp)
-{
-    int i, j;
-
-    i = getc(fp);
-    j = getc(fp);
-
-    if (i < 0 || j < 0)
-        return -1;
-
-    i = HEXVAL(i);
-    j = HEXVAL(j);
-
-    if (i < 0 || j < 0)
-        return -1;
-
-    return (i << 4) | j;
-}
-
+/* an Intel hex record is at most ":" + 2*(255 data + 5) digits + "\r\n" */
+#define HEXLINE_MAX    (1 + (2 * (255 + 5)) + 3)
 
 static int
 loadhex(z80info *z80, FILE *fp)
 {
     int start = TRUE;
     int len, line, i;
-    word addr, check, t;
-
-    for (line = 1; getc(fp) >= 0; line++)        /* should be a ':' */
+    size_t need;
+    word addr;
+    unsigned long check;
+    char buf[HEXLINE_MAX];
+    byte rec[255 + 5];
+
+    /* each record is decoded in one go:  len, addr hi, addr lo, type,
+       data..., checksum -- all of which add up to zero */
+    for (line = 1; fgets(buf, sizeof(buf), fp) != NULL; line++)
     {
-        if ((len = gethex(fp)) <= 0)
+        /* buf[0] should be a ':' */
+        if (hexdecode(rec, buf + 1, 1, NULL) != 1)
             break;
 
-        check = len;
-
-        if ((i = gethex(fp)) < 0)
+        len = rec[0];
+        if (len <= 0)
             break;
 
-        addr = (word)i;
-        check += addr;
+        need = len + 5;
+        if (strlen(buf + 1) < 2 * need)
+            break;
 
-        if ((i = gethex(fp)) < 0)
+        check = 0;
+        if (hexdecode(rec, buf + 1, need, &check) != need)
             break;
 
-        t = (word)i;
-        check += t;
-        addr = (addr << 8) | t;
+        addr = (word)((rec[1] << 8) | rec[2]);
 
         if (start)
             PC = addr, start = FALSE;
 
-        if ((i = gethex(fp)) < 0)        /* ??? */
-            break;
-
-        check += (word)i;
-
-        while (len-- > 0)
+        for (i = 0; i < len; i++)
         {
-            if ((i = gethex(fp)) < 0)
-                break;
-
-            t = (word)i;
-            check += t;
-            z80->mem[addr] = t;
+            z80->mem[addr] = rec[4 + i];
             addr++;
         }
 
-        if ((i = gethex(fp)) < 0)        /* checksum */
-            break;
-
-        t = (word)i;
-
-        if ((t + check) & 0xFF)
+        if (check & 0xFF)
         {
             fprintf(stderr, "%d: Checksum error: %.2X != 0!\r\n",
-                    line, (t + check) & 0xFF);
+                    line, (unsigned)(check & 0xFF));
             return FALSE;
         }
-
-        if (getc(fp) < 0)        /* should be a '\n' */
-            break;
     }
 
     return TRUE;
@@ -857,6 +1058,33 @@ loadfile(z80info *z80, const char *fname)
 
 
 
+#ifdef MEM_BREAK
+/* breakpoint 'n' came true at 'addr' - stop for whoever set it */
+static void
+stopat(z80info *z80, int n, word addr, const char *fmt, ...)
+{
+    va_list ap;
+
+#ifdef GDB_STUB
+    if (z80->gdb != NULL && gdbstub_owns(z80->gdb, n))
+    {
+        gdbstub_hit(z80->gdb, z80, n, addr);
+        return;
+    }
+#endif
+
+    fprintf(stderr, "\r\nBreakpoint %d", n);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "\r\n");
+
+    dumptrace(z80);
+    command(z80);
+}
+#endif
+
+
 /* input  --  z80 input instruction  --  this function is called whenever
    an input ports is referenced from the z80 to handle the real I/O  --
    it returns a byte to the z80 just like the real I/O instruction  --
@@ -867,6 +1095,9 @@ loadfile(z80info *z80, const char *fname)
 boolean
 input(z80info *z80, byte haddr, byte laddr, byte *val)
 {
+#ifdef MEM_BREAK
+    int i;
+#endif
 #ifdef EXTERNAL_IO
     io_input( z80, haddr, laddr, val );
 #else
@@ -918,6 +1149,13 @@ input(z80info *z80, byte haddr, byte laddr, byte *val)
             }
 #else    /* TCGETA */
             fflush(stdout);
+#ifdef GDB_STUB
+            /* look after the debugger while we wait */
+            if (z80->gdb != NULL &&
+                    gdbstub_wait(z80->gdb, z80, fileno(stdin)) < 0)
+                data = -1;
+            else
+#endif
             data = getchar();
 
             while ((data < 0 && errno == EINTR) ||
@@ -930,6 +1168,7 @@ input(z80info *z80, byte haddr, byte laddr, byte *val)
         }
 
         *val = data & 0x7F;
+        z80stats.conin++;
         break;
 
     /* return 0xFF if we have a character waiting to be read - save the
@@ -954,6 +1193,11 @@ input(z80info *z80, byte haddr, byte laddr, byte *val)
 #endif
         break;
 
+    /* the counters, as in stats.h */
+    case 0xEE:
+        *val = stats_guestread(0xFF);
+        break;
+
     /* default - prompt the user for an input byte */
     default:
         z_resetterm();
@@ -965,6 +1209,15 @@ input(z80info *z80, byte haddr, byte laddr, byte *val)
         break;
     }
 
+#endif
+
+    z80stats.portin[laddr]++;
+
+#ifdef MEM_BREAK
+    if (z80->breaks && (i = breaks_io(z80, FALSE, laddr, *val)) != 0)
+    {
+        stopat(z80, i, laddr, ": in %.2X from port %.2X", *val, laddr);
+    }
 #endif
     return TRUE;
 }
@@ -979,6 +1232,20 @@ input(z80info *z80, byte haddr, byte laddr, byte *val)
 void
 output(z80info *z80, byte haddr, byte laddr, byte data)
 {
+#ifdef MEM_BREAK
+    int i;
+#endif
+
+    z80stats.portout[laddr]++;
+
+#ifdef MEM_BREAK
+
+    if (z80->breaks && (i = breaks_io(z80, TRUE, laddr, data)) != 0)
+    {
+        stopat(z80, i, laddr, ": out %.2X to port %.2X", data, laddr);
+    }
+#endif
+
 #ifdef EXTERNAL_IO
     io_output( z80, haddr, laddr, data );
 #else
@@ -1002,9 +1269,13 @@ output(z80info *z80, byte haddr, byte laddr, byte data)
     } else if (laddr == 0) {
         /* output a character to the screen */
         putchar(data);
+        z80stats.conout++;
 
         if (logfile != NULL)
             putc(data, logfile);
+    } else if (laddr == 0xEE) {
+        /* pick a counter for the z80 to read */
+        stats_guestwrite(data);
     } else {
         /* dump the data for our user */
         printf("OUTPUT: addr = %X%X  DATA = %X\r\n", haddr, laddr,data);
@@ -1055,12 +1326,19 @@ haltcpu(z80info *z80)
         bios(z80, z80->biosfn);
     }
 #endif
+
+#ifdef GDB_STUB
+    /* the end of a step, or a watchpoint, for the debugger */
+    if (z80->gdb != NULL)
+        gdbstub_halt(z80->gdb, z80);
+#endif
 }
 
-word
-read_mem(z80info *z80, word addr)
-{
 #ifdef MEM_BREAK
+/* one of the original kinds of break - say what it was and stop */
+static word
+readtrap(z80info *z80, word addr)
+{
     if (z80->membrk[addr] & M_BREAKPOINT)
     {
         fprintf(stderr, "\r\nBreak at 0x%X\r\n", addr);
@@ -1081,6 +1359,59 @@ read_mem(z80info *z80, word addr)
 
     dumptrace(z80);
     command(z80);
+
+    return Z80MEMREAD( addr );
+}
+#endif    /* MEM_BREAK */
+
+word
+read_mem(z80info *z80, word addr)
+{
+#ifdef MEM_BREAK
+    int n;
+
+    if (z80heat != NULL)
+        heatmap_access(z80heat, z80, addr, HEAT_READ);
+
+    /* the ones with conditions only stop us when they come true */
+    if (!(z80->membrk[addr] & (M_BREAKPOINT | M_READ_PROTECT |
+            M_WRITE_PROTECT | M_MEM_MAPPED_IO)))
+    {
+        if ((z80->membrk[addr] & M_ACCESS) && z80->coverage != NULL)
+            coverage_access(z80->coverage, z80, addr, FALSE);
+        if ((n = breaks_read(z80, addr)) != 0)
+            stopat(z80, n, addr, ": read %.2X at 0x%X", z80->mem[addr], addr);
+        return Z80MEMREAD( addr );
+    }
+
+    return readtrap(z80, addr);
+#else
+    return Z80MEMREAD( addr );
+#endif    /* MEM_BREAK */
+}
+
+/* the opcode fetch (FETCH() in z80.c) - the operand bytes come through
+   read_mem() like any other read */
+word
+fetch_mem(z80info *z80, word addr)
+{
+#ifdef MEM_BREAK
+    int n;
+
+    if (z80heat != NULL)
+        heatmap_access(z80heat, z80, addr, HEAT_FETCH);
+
+    if (z80->membrk[addr] & (M_BREAKPOINT | M_READ_PROTECT |
+            M_WRITE_PROTECT | M_MEM_MAPPED_IO))
+        return readtrap(z80, addr);
+
+    if ((n = breaks_exec(z80)) != 0)
+    {
+        stopat(z80, n, addr, " at 0x%X", addr);
+
+        /* PC may have been moved while we were stopped */
+        return Z80MEMREAD( PC );
+    }
 #endif    /* MEM_BREAK */
 
     return Z80MEMREAD( addr );
@@ -1090,6 +1421,21 @@ word
 write_mem(z80info *z80, word addr, byte val)
 {
 #ifdef MEM_BREAK
+    int n;
+
+    if (z80heat != NULL)
+        heatmap_access(z80heat, z80, addr, HEAT_WRITE);
+
+    if (!(z80->membrk[addr] & (M_BREAKPOINT | M_READ_PROTECT |
+            M_WRITE_PROTECT | M_MEM_MAPPED_IO)))
+    {
+        if ((z80->membrk[addr] & M_ACCESS) && z80->coverage != NULL)
+            coverage_access(z80->coverage, z80, addr, TRUE);
+        if ((n = breaks_write(z80, addr, val)) != 0)
+            stopat(z80, n, addr, ": write %.2X to 0x%X", val, addr);
+        return Z80MEMWRITE( addr, val );
+    }
+
     if (z80->membrk[addr] & M_BREAKPOINT)
     {
         fprintf(stderr, "\r\nBreak at 0x%X\r\n", addr);
@@ -1173,6 +1519,53 @@ sigusr1( int s )
 }
 
 
+/* a profile, call graph, coverage or heatmap still running when we
+   leave gets written up anyway, the counters get a last line, and the opcode counts
+   (if they're being kept) are written out */
+static void
+profatexit( void )
+{
+    if (z80 != NULL && z80->profile != NULL)
+    {
+        if (profile_report(z80->profile, z80, profprefix) != 0)
+            fprintf(stderr, "Cannot write %s.txt/.folded!\r\n", profprefix);
+        profile_stop(z80->profile);
+        z80->profile = NULL;
+    }
+
+    if (z80 != NULL && z80->callgraph != NULL)
+    {
+        if (callgraph_report(z80->callgraph, z80, cgpath) != 0)
+            fprintf(stderr, "Cannot write %s!\r\n", cgpath);
+        callgraph_stop(z80->callgraph);
+        z80->callgraph = NULL;
+    }
+
+    if (z80 != NULL && z80->coverage != NULL)
+    {
+        if (coverage_report(z80->coverage, coverprefix, listings) != 0)
+            fprintf(stderr, "Cannot write %s.bin/.info!\r\n", coverprefix);
+        coverage_stop(z80->coverage, z80);
+        z80->coverage = NULL;
+    }
+
+    if (z80 != NULL && z80heat != NULL)
+    {
+        if (heatmap_report(z80heat, heatprefix) != 0)
+            fprintf(stderr, "Cannot write %s.txt/.ppm!\r\n", heatprefix);
+        heatmap_stop(z80heat, z80);
+    }
+
+    stats_close();
+
+#ifdef OPCODE_HISTOGRAM
+    /* the instruction mix, to $Z80_OPHIST or z80ops.txt */
+    if (ophist_save(getenv("Z80_OPHIST")) != 0)
+        fprintf(stderr, "Cannot write the opcode histogram!\r\n");
+#endif
+}
+
+
 void Full_Z80Reset( z80info *z80, int inittermtoo )
 {
 #ifdef SYSTEM_POLL
@@ -1204,6 +1597,10 @@ main(int argc, const char *argv[])
 #ifdef BUILD_CPM
     const char *s;
 #endif
+    const char *trace, *prof, *syms, *cg, *st, *cover, *heat;
+#ifdef GDB_STUB
+    const char *gdbport;
+#endif
 
     printf( "\n" );
     printf( "Z80 System Emulator\n" );
@@ -1225,7 +1622,114 @@ main(int argc, const char *argv[])
     if (z80 == NULL)
         return -1;
 
+    stats_init(z80);
+
 	Full_Z80Reset( z80, 1 );
+
+    /* Z80_TRACE_RING=file[,records] starts the binary trace right away;
+       being a file, it's still there if we crash */
+    if ((trace = getenv("Z80_TRACE_RING")) != NULL)
+    {
+        char path[256];
+        const char *comma = strchr(trace, ',');
+        size_t n = comma ? (size_t)(comma - trace) : strlen(trace);
+
+        if (n >= sizeof path)
+            n = sizeof path - 1;
+        memcpy(path, trace, n);
+        path[n] = '\0';
+
+        z80->tracering = tracering_open(*path ? path : NULL,
+                comma ? atol(comma + 1) : 0);
+    }
+
+    /* Z80_SYMBOLS=file[:file...] names addresses for the profile, from
+       the .lst and .map files the Z80asm builds leave */
+    if ((syms = getenv("Z80_SYMBOLS")) != NULL)
+    {
+        symtab_loadlist(syms);
+        addlistings(syms);
+    }
+
+    /* Z80_PROFILE=prefix[,period] profiles the whole run, and writes
+       prefix.txt and prefix.folded on the way out */
+    if ((prof = getenv("Z80_PROFILE")) != NULL)
+    {
+        const char *comma = strchr(prof, ',');
+        size_t n = comma ? (size_t)(comma - prof) : strlen(prof);
+
+        if (n >= sizeof profprefix)
+            n = sizeof profprefix - 1;
+        if (n > 0)
+        {
+            memcpy(profprefix, prof, n);
+            profprefix[n] = '\0';
+        }
+
+        z80->profile = profile_start(z80, comma ? atol(comma + 1) : 0);
+    }
+
+#ifdef GDB_STUB
+    /* Z80_GDB_PORT=n lets a debugger in on 127.0.0.1:n - see gdbstub.h */
+    if ((gdbport = getenv("Z80_GDB_PORT")) != NULL && atoi(gdbport) > 0)
+        z80->gdb = gdbstub_open(atoi(gdbport));
+#endif
+
+    /* Z80_CALLGRAPH=file keeps the shadow call stack for the whole run,
+       and writes a callgrind file on the way out */
+    if ((cg = getenv("Z80_CALLGRAPH")) != NULL)
+    {
+        if (*cg != '\0')
+            snprintf(cgpath, sizeof cgpath, "%s", cg);
+        z80->callgraph = callgraph_start(z80);
+    }
+
+    /* Z80_COVERAGE=prefix[,data] keeps the coverage maps for the whole
+       run (and the reads and writes, with ",data"), and writes prefix.bin
+       and prefix.info on the way out */
+    if ((cover = getenv("Z80_COVERAGE")) != NULL)
+    {
+        const char *comma = strchr(cover, ',');
+        size_t n = comma ? (size_t)(comma - cover) : strlen(cover);
+
+        if (n >= sizeof coverprefix)
+            n = sizeof coverprefix - 1;
+        if (n > 0)
+        {
+            memcpy(coverprefix, cover, n);
+            coverprefix[n] = '\0';
+        }
+
+        z80->coverage = coverage_start(z80,
+                comma != NULL && strcmp(comma + 1, "data") == 0);
+    }
+
+    /* Z80_HEATMAP=prefix counts memory traffic by page for the whole
+       run, and writes prefix.txt and prefix.ppm on the way out */
+    if ((heat = getenv("Z80_HEATMAP")) != NULL)
+    {
+        if (*heat != '\0')
+            snprintf(heatprefix, sizeof heatprefix, "%s", heat);
+        heatmap_start(z80);
+    }
+
+    /* Z80_STATS=file[,seconds] appends the counters to file as a line
+       of JSON every so often (10 seconds), and at the end */
+    if ((st = getenv("Z80_STATS")) != NULL)
+    {
+        char path[256];
+        const char *comma = strchr(st, ',');
+        size_t n = comma ? (size_t)(comma - st) : strlen(st);
+
+        if (n >= sizeof path)
+            n = sizeof path - 1;
+        memcpy(path, st, n);
+        path[n] = '\0';
+
+        if (stats_open(path, comma ? atoi(comma + 1) : 0) != 0)
+            fprintf(stderr, "Cannot write %s!\r\n", path);
+    }
+    atexit(profatexit);
     
 #if defined BeBox_TurnedOff
     /* try to open the keyboard for non-blocking read */
@@ -1320,5 +1824,11 @@ main(int argc, const char *argv[])
 #else
         z80_emulator(z80, 100000);
 #endif
+
+#ifdef GDB_STUB
+        if (z80->gdb != NULL)
+            gdbstub_poll(z80->gdb, z80);
+#endif
+        stats_tick();
     }
 }
@@ -0,0 +1,239 @@
+/*-----------------------------------------------------------------------*\
+ |  ophist.c  --  how often each opcode is run                           |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ophist.h"
+
+#ifdef OPCODE_HISTOGRAM
+
+#include "disassem.h"
+
+
+/* an instruction is known by its space and opcode - space << 8 | op */
+#define OPID(space, op)		((space) << 8 | (op))
+
+#define PAIRBITS	16
+#define NPAIRS		(1 << PAIRBITS)
+#define PAIRSFULL	(NPAIRS / 4 * 3)
+#define NREPORTPAIRS	100
+
+static unsigned long long counts[OPS_NSPACES][0x100];
+
+/* pairs, hashed on first << 11 | second - a key of 0 is an empty slot,
+   so they're kept one up */
+static struct
+{
+	unsigned long key;
+	unsigned long long n;
+} pairs[NPAIRS];
+static int npairs;
+static unsigned long long pairsmissed;	/* once the table's full */
+
+static int previd = -1;
+
+static const char *const spacenames[OPS_NSPACES] =
+{
+	"", "CB", "ED", "DD", "FD", "DDCB", "FDCB"
+};
+
+
+static void
+pair(int first, int second)
+{
+	unsigned long key = ((unsigned long)first << 11 | second) + 1;
+	unsigned i = (unsigned)((key * 2654435761UL) & 0xFFFFFFFFUL)
+			>> (32 - PAIRBITS);
+
+	while (pairs[i].key != 0 && pairs[i].key != key)
+		i = (i + 1) & (NPAIRS - 1);
+
+	if (pairs[i].key == 0)
+	{
+		if (npairs >= PAIRSFULL)
+		{
+			pairsmissed++;
+			return;
+		}
+		pairs[i].key = key;
+		npairs++;
+	}
+	pairs[i].n++;
+}
+
+void
+ophist_count(int space, byte op)
+{
+	int id;
+
+	if (space == OPS_BASE && (op == 0xCB || op == 0xDD || op == 0xED ||
+			op == 0xFD))
+		return;
+	if ((space == OPS_DD || space == OPS_FD) && op == 0xCB)
+		return;
+
+	counts[space][op]++;
+
+	id = OPID(space, op);
+	if (previd >= 0)
+		pair(previd, id);
+	previd = id;
+}
+
+
+/*-----------------------------------------------------------------------*\
+ |  the report
+\*-----------------------------------------------------------------------*/
+
+typedef struct
+{
+	unsigned long long n;
+	int first, second;	/* OPIDs - second is -1 for one on its own */
+} entry;
+
+static int
+bycount(const void *a, const void *b)
+{
+	const entry *ea = a, *eb = b;
+
+	if (ea->n != eb->n)
+		return ea->n < eb->n ? 1 : -1;
+	if (ea->first != eb->first)
+		return ea->first - eb->first;
+	return ea->second - eb->second;
+}
+
+static byte
+fromcode(void *ctx, word addr)
+{
+	return ((byte *)ctx)[addr & 3];
+}
+
+/* "DDCB 06  RLC   (IX+00)" - the displacements and immediates are 0 */
+static void
+name(int id, char *buf, size_t size)
+{
+	int space = id >> 8;
+	byte op = id & 0xFF;
+	byte code[4] = { 0, 0, 0, 0 };
+	disinstr d;
+
+	switch (space)
+	{
+	case OPS_BASE:	code[0] = op;				break;
+	case OPS_CB:	code[0] = 0xCB;	code[1] = op;		break;
+	case OPS_ED:	code[0] = 0xED;	code[1] = op;		break;
+	case OPS_DD:	code[0] = 0xDD;	code[1] = op;		break;
+	case OPS_FD:	code[0] = 0xFD;	code[1] = op;		break;
+	case OPS_DDCB:	code[0] = 0xDD;	code[1] = 0xCB;	code[3] = op;	break;
+	case OPS_FDCB:	code[0] = 0xFD;	code[1] = 0xCB;	code[3] = op;	break;
+	}
+
+	disassemble(fromcode, code, 0, &d);
+	if (d.operands[0] != '\0')
+		snprintf(buf, size, "%4s %.2X  %-5s %s", spacenames[space], op,
+				d.mnemonic, d.operands);
+	else
+		snprintf(buf, size, "%4s %.2X  %s", spacenames[space], op,
+				d.mnemonic);
+}
+
+static double
+percent(unsigned long long n, unsigned long long of)
+{
+	return of ? 100.0 * n / of : 0.0;
+}
+
+void
+ophist_report(FILE *fp)
+{
+	unsigned long long total = 0, spacetotal[OPS_NSPACES] = { 0 };
+	unsigned long long pairtotal = 0, cum = 0;
+	entry *e;
+	int n, i, s, op;
+	char a[48], b[48];
+
+	if ((e = malloc(sizeof *e * (OPS_NSPACES * 0x100 > NPAIRS ?
+			OPS_NSPACES * 0x100 : NPAIRS))) == NULL)
+		return;
+
+	for (s = 0; s < OPS_NSPACES; s++)
+		for (op = 0; op < 0x100; op++)
+			spacetotal[s] += counts[s][op];
+	for (s = 0; s < OPS_NSPACES; s++)
+		total += spacetotal[s];
+
+	fprintf(fp, "Instruction mix: %llu instructions\n\n", total);
+	fprintf(fp, "  space          count       %%\n");
+	for (s = 0; s < OPS_NSPACES; s++)
+		fprintf(fp, "  %-5s %14llu  %6.2f\n", s ? spacenames[s] : "base",
+				spacetotal[s], percent(spacetotal[s], total));
+
+	/* every opcode that ran, most first */
+	for (n = 0, s = 0; s < OPS_NSPACES; s++)
+		for (op = 0; op < 0x100; op++)
+			if (counts[s][op])
+			{
+				e[n].n = counts[s][op];
+				e[n].first = OPID(s, op);
+				e[n++].second = -1;
+			}
+	qsort(e, n, sizeof *e, bycount);
+
+	fprintf(fp, "\n%d opcodes run\n\n", n);
+	fprintf(fp, "           count       %%    cum%%  opcode\n");
+	for (i = 0; i < n; i++)
+	{
+		cum += e[i].n;
+		name(e[i].first, a, sizeof a);
+		fprintf(fp, "  %14llu  %6.2f  %6.2f  %s\n", e[i].n,
+				percent(e[i].n, total), percent(cum, total), a);
+	}
+
+	/* and the pairs */
+	for (n = 0, i = 0; i < NPAIRS; i++)
+		if (pairs[i].key != 0)
+		{
+			e[n].n = pairs[i].n;
+			e[n].first = (pairs[i].key - 1) >> 11;
+			e[n++].second = (pairs[i].key - 1) & 0x7FF;
+			pairtotal += pairs[i].n;
+		}
+	qsort(e, n, sizeof *e, bycount);
+
+	fprintf(fp, "\n%d pairs seen", n);
+	if (pairsmissed)
+		fprintf(fp, " (and %llu more not counted - the table was full)",
+				pairsmissed);
+	fprintf(fp, ", the top %d\n\n", n < NREPORTPAIRS ? n : NREPORTPAIRS);
+	fprintf(fp, "           count       %%  first"
+			"                         then\n");
+	for (i = 0; i < n && i < NREPORTPAIRS; i++)
+	{
+		name(e[i].first, a, sizeof a);
+		name(e[i].second, b, sizeof b);
+		fprintf(fp, "  %14llu  %6.2f  %-28s  %s\n", e[i].n,
+				percent(e[i].n, pairtotal + pairsmissed), a, b);
+	}
+
+	free(e);
+}
+
+int
+ophist_save(const char *path)
+{
+	FILE *fp;
+
+	if (path == NULL || *path == '\0')
+		path = OPHIST_DEFPATH;
+	if ((fp = fopen(path, "w")) == NULL)
+		return 1;
+
+	ophist_report(fp);
+	return fclose(fp) != 0;
+}
+
+#endif	/* OPCODE_HISTOGRAM */
@@ -0,0 +1,48 @@
+/*-----------------------------------------------------------------------*\
+ |  ophist.h  --  how often each opcode is run                           |
+ |                                                                       |
+ |  Built with -DOPCODE_HISTOGRAM, the z80's loop counts every           |
+ |  instruction it runs by its opcode in each of the prefix spaces,     |
+ |  and each pair of one instruction followed by the next.  The mix is   |
+ |  written up when the emulator leaves, to z80ops.txt or $Z80_OPHIST.   |
+ |                                                                       |
+ |  Without it the calls in z80.c aren't there at all.                   |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+#ifndef __OPHIST_H_
+#define __OPHIST_H_
+
+#include <stdio.h>
+#include "defs.h"
+
+#ifdef OPCODE_HISTOGRAM
+
+/* the prefix spaces */
+#define OPS_BASE	0
+#define OPS_CB		1
+#define OPS_ED		2
+#define OPS_DD		3	/* IX */
+#define OPS_FD		4	/* IY */
+#define OPS_DDCB	5
+#define OPS_FDCB	6
+#define OPS_NSPACES	7
+
+#define OPHIST_DEFPATH	"z80ops.txt"
+
+
+/* the z80 has decoded opcode 'op' in 'space'.  a prefix (CB, DD, ED,
+   FD in the base space, CB after DD or FD) isn't counted - the
+   instruction it leads to is */
+void ophist_count(int space, byte op);
+
+/* the sorted report */
+void ophist_report(FILE *fp);
+
+/* the report into 'path' (NULL for the default).  return 0 if ok */
+int ophist_save(const char *path);
+
+#endif	/* OPCODE_HISTOGRAM */
+
+#endif
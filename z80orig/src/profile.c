@@ -0,0 +1,376 @@
+/*-----------------------------------------------------------------------*\
+ |  profile.c  --  where the z80's time goes                             |
+ |                                                                       |
+ |  There's no record of calls to go by, so the stack is walked the     |
+ |  way a debugger does without frame info: each word from SP up that    |
+ |  points just past a CALL (or an RST other than RST 38H) is taken to   |
+ |  be a return address.  Now and then data looks like one; that's the   |
+ |  price of not tracking calls.                                         |
+ |                                                                       |
+ |  Each frame is folded down to the start of its routine as the        |
+ |  sample is taken, so stacks that differ only in where in a routine    |
+ |  they were come out the same.                                         |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "profile.h"
+#include "symtab.h"
+
+
+#define WALKWORDS	64	/* stack words looked at */
+#define MAXDEPTH	32	/* frames kept */
+#define TOPROUTINES	50	/* in the report */
+#define TOPDETAIL	10	/* routines whose instructions are listed */
+#define TOPINSTRS	10	/* ...and how many of those */
+
+
+/* one distinct stack, leaf first */
+typedef struct stack
+{
+	unsigned long count;
+	unsigned long hash;
+	int depth;
+	long frames;		/* into 'pool' */
+} stack;
+
+struct profile
+{
+	long period;
+	unsigned long long next;	/* cycle count of the next sample */
+	unsigned long long firstcycle;
+	unsigned long samples;
+	unsigned long counts[0x10000];	/* samples by PC */
+
+	stack *stacks;		/* open hash, 'nstacks' of 'maxstacks' used */
+	long nstacks, maxstacks;
+	word *pool;
+	long npool, maxpool;
+};
+
+
+/*-----------------------------------------------------------------------*\
+ |  stacks
+\*-----------------------------------------------------------------------*/
+
+static int
+iscallsite(z80info *z80, word ret)
+{
+	byte op = Z80MEMPEEK(ret - 3);
+	byte rst = Z80MEMPEEK(ret - 1);
+
+	/* CALL nn, CALL cc,nn */
+	if (op == 0xCD || (op & 0xC7) == 0xC4)
+		return 3;
+	/* RST n - but FF is too common in empty memory to trust */
+	if ((rst & 0xC7) == 0xC7 && rst != 0xFF)
+		return 1;
+	return 0;
+}
+
+/* the start of the routine 'addr' is in, if there's a name for it */
+static word
+fold(word addr)
+{
+	word base;
+
+	return symtab_lookup(addr, &base) ? base : addr;
+}
+
+static unsigned long
+hashof(const word *f, int depth)
+{
+	unsigned long h = 5381;
+	int i;
+
+	for (i = 0; i < depth; i++)
+		h = h * 33 + f[i];
+	return h;
+}
+
+static int
+growstacks(profile *pf)
+{
+	stack *old = pf->stacks, *n;
+	long oldmax = pf->maxstacks, i, j;
+	long max = oldmax ? oldmax * 2 : 1024;
+
+	if ((n = calloc(max, sizeof *n)) == NULL)
+		return FALSE;
+
+	for (i = 0; i < oldmax; i++)
+		if (old[i].count)
+		{
+			for (j = old[i].hash % max; n[j].count; j = (j + 1) % max)
+				;
+			n[j] = old[i];
+		}
+
+	free(old);
+	pf->stacks = n;
+	pf->maxstacks = max;
+	return TRUE;
+}
+
+static void
+addstack(profile *pf, const word *f, int depth)
+{
+	unsigned long h = hashof(f, depth);
+	stack *s;
+	word *np;
+	long i;
+
+	if (pf->nstacks * 2 >= pf->maxstacks && !growstacks(pf))
+		return;
+
+	for (i = h % pf->maxstacks; pf->stacks[i].count; i = (i + 1) % pf->maxstacks)
+	{
+		s = &pf->stacks[i];
+		if (s->hash == h && s->depth == depth &&
+				memcmp(pf->pool + s->frames, f, depth * sizeof *f) == 0)
+		{
+			s->count++;
+			return;
+		}
+	}
+
+	if (pf->npool + depth > pf->maxpool)
+	{
+		long max = pf->maxpool ? pf->maxpool * 2 : 16384;
+
+		if ((np = realloc(pf->pool, max * sizeof *np)) == NULL)
+			return;
+		pf->pool = np;
+		pf->maxpool = max;
+	}
+
+	s = &pf->stacks[i];
+	s->count = 1;
+	s->hash = h;
+	s->depth = depth;
+	s->frames = pf->npool;
+	memcpy(pf->pool + pf->npool, f, depth * sizeof *f);
+	pf->npool += depth;
+	pf->nstacks++;
+}
+
+
+/*-----------------------------------------------------------------------*\
+ |  sampling
+\*-----------------------------------------------------------------------*/
+
+profile *
+profile_start(z80info *z80, long period)
+{
+	profile *pf = calloc(1, sizeof *pf);
+
+	if (pf == NULL)
+		return NULL;
+
+	pf->period = period > 0 ? period : PROFILE_DEFPERIOD;
+	pf->firstcycle = z80->cycles;
+	pf->next = z80->cycles + pf->period;
+	return pf;
+}
+
+void
+profile_sample(profile *pf, z80info *z80)
+{
+	word f[MAXDEPTH], sp = SP, ret;
+	int depth = 0, i, n;
+
+	if (z80->cycles < pf->next)
+		return;
+
+	/* an instruction can go past more than one sample point */
+	while (pf->next <= z80->cycles)
+		pf->next += pf->period;
+
+	pf->samples++;
+	pf->counts[PC]++;
+
+	f[depth++] = fold(PC);
+	for (i = 0; i < WALKWORDS && depth < MAXDEPTH; i++, sp += 2)
+	{
+		ret = Z80MEMPEEK(sp) | (Z80MEMPEEK(sp + 1) << 8);
+		if ((n = iscallsite(z80, ret)) != 0)
+			f[depth++] = fold(ret - n);
+		if (sp >= 0xFFFE)
+			break;
+	}
+
+	addstack(pf, f, depth);
+}
+
+void
+profile_stop(profile *pf)
+{
+	if (pf == NULL)
+		return;
+
+	free(pf->stacks);
+	free(pf->pool);
+	free(pf);
+}
+
+
+/*-----------------------------------------------------------------------*\
+ |  reports
+\*-----------------------------------------------------------------------*/
+
+typedef struct routine
+{
+	word base;
+	const char *name;	/* NULL if it's just a page */
+	unsigned long count;
+} routine;
+
+static int
+bycount(const void *a, const void *b)
+{
+	const routine *x = a, *y = b;
+
+	if (x->count != y->count)
+		return x->count < y->count ? 1 : -1;
+	return x->base - y->base;
+}
+
+/* samples by routine - or by 256 byte page where there are no names */
+static int
+routines(profile *pf, routine *r)
+{
+	long pc;
+	int n = 0;
+	word base;
+	const char *name;
+
+	for (pc = 0; pc < 0x10000; pc++)
+	{
+		if (pf->counts[pc] == 0)
+			continue;
+
+		if ((name = symtab_lookup(pc, &base)) == NULL)
+			base = pc & 0xFF00;
+
+		if (n == 0 || r[n - 1].base != base || r[n - 1].name != name)
+		{
+			r[n].base = base;
+			r[n].name = name;
+			r[n].count = 0;
+			n++;
+		}
+		r[n - 1].count += pf->counts[pc];
+	}
+	return n;
+}
+
+static void
+hotspots(profile *pf, z80info *z80, FILE *fp, const routine *r)
+{
+	routine top[TOPINSTRS];
+	unsigned long c;
+	long pc, end;
+	int n = 0, i;
+	word base;
+
+	/* to the next name, or the end of the page */
+	end = r->name ? 0x10000 : r->base + 0x100;
+	for (pc = r->base; pc < end; pc++)
+	{
+		if (r->name && pc > r->base &&
+				symtab_lookup(pc, &base) != NULL && base == pc)
+			break;
+		c = pf->counts[pc];
+		if (c == 0 || (n == TOPINSTRS && c <= top[n - 1].count))
+			continue;
+
+		/* keep the biggest few, in order */
+		i = n < TOPINSTRS ? n++ : n - 1;
+		for (; i > 0 && top[i - 1].count < c; i--)
+			top[i] = top[i - 1];
+		top[i].base = pc;
+		top[i].count = c;
+	}
+
+	fprintf(fp, "\n");
+	symtab_print(fp, r->base);
+	fprintf(fp, ":\n");
+	for (i = 0; i < n; i++)
+	{
+		fprintf(fp, "  %8lu %5.1f%%  %.4X  ", top[i].count,
+			100.0 * top[i].count / pf->samples, top[i].base);
+		disassem(z80, top[i].base, fp);
+		fprintf(fp, "\n");
+	}
+}
+
+int
+profile_report(profile *pf, z80info *z80, const char *prefix)
+{
+	char path[1024];
+	FILE *fp;
+	routine *r;
+	stack *s;
+	int n, i, j;
+	long k;
+
+	/* the report */
+	snprintf(path, sizeof path, "%s.txt", prefix);
+	if ((fp = fopen(path, "w")) == NULL)
+		return 1;
+	if ((r = malloc(0x10000 * sizeof *r)) == NULL)
+	{
+		fclose(fp);
+		return 1;
+	}
+
+	n = routines(pf, r);
+	qsort(r, n, sizeof *r, bycount);
+
+	fprintf(fp, "%lu samples, one every %ld cycles, over %llu cycles\n",
+		pf->samples, pf->period, z80->cycles - pf->firstcycle);
+	fprintf(fp, "%d names known\n\n", symtab_count());
+	fprintf(fp, "   samples       %%  addr  routine\n");
+
+	for (i = 0; i < n && i < TOPROUTINES; i++)
+	{
+		fprintf(fp, "  %8lu  %5.1f%%  %.4X  ", r[i].count,
+			100.0 * r[i].count / (pf->samples ? pf->samples : 1), r[i].base);
+		if (r[i].name)
+			fprintf(fp, "%s\n", r[i].name);
+		else
+			fprintf(fp, "(page %.2XXX)\n", r[i].base >> 8);
+	}
+
+	for (i = 0; i < n && i < TOPDETAIL; i++)
+		hotspots(pf, z80, fp, &r[i]);
+
+	free(r);
+	if (fclose(fp) != 0)
+		return 1;
+
+	/* the stacks, outermost first, as flamegraph.pl wants them */
+	snprintf(path, sizeof path, "%s.folded", prefix);
+	if ((fp = fopen(path, "w")) == NULL)
+		return 1;
+
+	for (k = 0; k < pf->maxstacks; k++)
+	{
+		s = &pf->stacks[k];
+		if (s->count == 0)
+			continue;
+
+		for (j = s->depth - 1; j >= 0; j--)
+		{
+			symtab_print(fp, pf->pool[s->frames + j]);
+			if (j > 0)
+				putc(';', fp);
+		}
+		fprintf(fp, " %lu\n", s->count);
+	}
+
+	return fclose(fp) != 0;
+}
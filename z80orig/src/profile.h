@@ -0,0 +1,35 @@
+/*-----------------------------------------------------------------------*\
+ |  profile.h  --  where the z80's time goes                             |
+ |                                                                       |
+ |  Every so many cycles the PC is taken, along with the return          |
+ |  addresses found on the z80's stack.  At the end that's written up    |
+ |  as a report of the hottest routines (by the names in symtab) and     |
+ |  their hottest instructions, and as "collapsed" stacks for            |
+ |  flamegraph.pl and the like.                                          |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+#ifndef __PROFILE_H_
+#define __PROFILE_H_
+
+#include "defs.h"
+
+
+#define PROFILE_DEFPERIOD	997	/* cycles - odd, so loops don't beat */
+
+typedef struct profile profile;
+
+
+/* start sampling every 'period' cycles (0 for the default) */
+profile *profile_start(z80info *z80, long period);
+
+/* called before each instruction; takes a sample if one is due */
+void profile_sample(profile *pf, z80info *z80);
+
+/* write 'prefix'.txt and 'prefix'.folded.  return 0 if ok */
+int profile_report(profile *pf, z80info *z80, const char *prefix);
+
+void profile_stop(profile *pf);
+
+#endif
@@ -0,0 +1,272 @@
+/*-----------------------------------------------------------------------*\
+ |  stats.c  --  counters for what the emulator has been doing           |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+#define _DEFAULT_SOURCE		/* for clock_gettime under -std=c99 */
+
+#include <stdio.h>
+#include <time.h>
+#include "stats.h"
+
+
+emustats z80stats;
+
+static z80info *statz80;	/* for its cycle count */
+static double started;
+
+/* the periodic file */
+static FILE *statfp;
+static int statsecs;
+static double nextwrite;
+static double lastt;		/* when the last line was written */
+static unsigned long long lastcycles;
+
+/* what the z80 has asked for */
+static byte latch[8];
+static int latched;		/* bytes of it still to go */
+
+
+static double
+now(void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+	return (double)time(NULL);
+#endif
+}
+
+void
+stats_init(z80info *z80)
+{
+	statz80 = z80;
+	started = lastt = now();
+	lastcycles = z80->cycles;
+}
+
+void
+stats_region(int n, long base, long size)
+{
+	if (n < 0 || n >= STATS_REGIONS)
+		return;
+
+	z80stats.region[n].base = base;
+	z80stats.region[n].size = size;
+	if (n >= z80stats.nregions)
+		z80stats.nregions = n + 1;
+}
+
+
+static unsigned long long
+cycles(void)
+{
+	return statz80 != NULL ? statz80->cycles : 0;
+}
+
+static double
+mhz(unsigned long long c, double secs)
+{
+	return secs > 0 ? c / secs / 1e6 : 0.0;
+}
+
+/* all the ports, or all the regions' reads or writes */
+static unsigned long long
+ports(const unsigned long long *c)
+{
+	unsigned long long t = 0;
+	int i;
+
+	for (i = 0; i < 0x100; i++)
+		t += c[i];
+	return t;
+}
+
+static unsigned long long
+memory(int writes)
+{
+	unsigned long long t = 0;
+	int i;
+
+	for (i = 0; i < z80stats.nregions; i++)
+		t += writes ? z80stats.region[i].writes : z80stats.region[i].reads;
+	return t;
+}
+
+static unsigned long long
+counter(int n)
+{
+	switch (n)
+	{
+	case STATS_INSTRUCTIONS:	return z80stats.instructions;
+	case STATS_CYCLES:		return cycles();
+	case STATS_KHZ:			return (unsigned long long)
+					(mhz(cycles(), now() - started) * 1000);
+	case STATS_INTERRUPTS:		return z80stats.interrupts;
+	case STATS_POLLS:		return z80stats.polls;
+	case STATS_PORTIN:		return ports(z80stats.portin);
+	case STATS_PORTOUT:		return ports(z80stats.portout);
+	case STATS_MEMREAD:		return memory(FALSE);
+	case STATS_MEMWRITE:		return memory(TRUE);
+	case STATS_CONIN:		return z80stats.conin;
+	case STATS_CONOUT:		return z80stats.conout;
+	case STATS_STOREIN:		return z80stats.storein;
+	case STATS_STOREOUT:		return z80stats.storeout;
+	}
+	return 0;
+}
+
+
+/*-----------------------------------------------------------------------*\
+ |  reports
+\*-----------------------------------------------------------------------*/
+
+void
+stats_print(FILE *fp)
+{
+	double secs = now() - started;
+	int i;
+
+	fprintf(fp, "    %.1f seconds, %llu instructions, %llu cycles, "
+			"%.3f MHz\n", secs, z80stats.instructions, cycles(),
+			mhz(cycles(), secs));
+	fprintf(fp, "    interrupts %llu, polls %llu\n",
+			z80stats.interrupts, z80stats.polls);
+	fprintf(fp, "    console in %llu out %llu, storage in %llu out %llu\n",
+			z80stats.conin, z80stats.conout,
+			z80stats.storein, z80stats.storeout);
+
+	for (i = 0; i < z80stats.nregions; i++)
+		fprintf(fp, "    memory %.4lX-%.4lX  reads %llu  writes %llu\n",
+				z80stats.region[i].base,
+				z80stats.region[i].base + z80stats.region[i].size - 1,
+				z80stats.region[i].reads, z80stats.region[i].writes);
+
+	for (i = 0; i < 0x100; i++)
+		if (z80stats.portin[i] || z80stats.portout[i])
+			fprintf(fp, "    port %.2X  in %llu  out %llu\n", i,
+					z80stats.portin[i], z80stats.portout[i]);
+}
+
+static void
+jsonports(FILE *fp, const char *name, const unsigned long long *c)
+{
+	const char *sep = "";
+	int i;
+
+	fprintf(fp, "\"%s\":{", name);
+	for (i = 0; i < 0x100; i++)
+		if (c[i])
+		{
+			fprintf(fp, "%s\"%.2x\":%llu", sep, i, c[i]);
+			sep = ",";
+		}
+	fprintf(fp, "}");
+}
+
+void
+stats_json(FILE *fp)
+{
+	double t = now();
+	unsigned long long c = cycles();
+	int i;
+
+	fprintf(fp, "{\"time\":%.3f,\"instructions\":%llu,\"cycles\":%llu,"
+			"\"mhz\":%.3f,\"mhz_now\":%.3f,",
+			t - started, z80stats.instructions, c,
+			mhz(c, t - started), mhz(c - lastcycles, t - lastt));
+	fprintf(fp, "\"interrupts\":%llu,\"polls\":%llu,"
+			"\"console_in\":%llu,\"console_out\":%llu,"
+			"\"storage_in\":%llu,\"storage_out\":%llu,",
+			z80stats.interrupts, z80stats.polls,
+			z80stats.conin, z80stats.conout,
+			z80stats.storein, z80stats.storeout);
+
+	fprintf(fp, "\"regions\":[");
+	for (i = 0; i < z80stats.nregions; i++)
+		fprintf(fp, "%s{\"base\":%ld,\"size\":%ld,\"reads\":%llu,"
+				"\"writes\":%llu}", i ? "," : "",
+				z80stats.region[i].base, z80stats.region[i].size,
+				z80stats.region[i].reads, z80stats.region[i].writes);
+	fprintf(fp, "],");
+
+	jsonports(fp, "port_in", z80stats.portin);
+	fprintf(fp, ",");
+	jsonports(fp, "port_out", z80stats.portout);
+	fprintf(fp, "}\n");
+
+	lastt = t;
+	lastcycles = c;
+}
+
+
+/*-----------------------------------------------------------------------*\
+ |  the periodic file
+\*-----------------------------------------------------------------------*/
+
+int
+stats_open(const char *path, int secs)
+{
+	if ((statfp = fopen(path, "a")) == NULL)
+		return 1;
+
+	statsecs = secs > 0 ? secs : 10;
+	nextwrite = now() + statsecs;
+	return 0;
+}
+
+void
+stats_tick(void)
+{
+	double t;
+
+	if (statfp == NULL || (t = now()) < nextwrite)
+		return;
+
+	stats_json(statfp);
+	fflush(statfp);
+	nextwrite = t + statsecs;
+}
+
+void
+stats_close(void)
+{
+	if (statfp == NULL)
+		return;
+
+	stats_json(statfp);
+	fclose(statfp);
+	statfp = NULL;
+}
+
+
+/*-----------------------------------------------------------------------*\
+ |  the z80's side
+\*-----------------------------------------------------------------------*/
+
+void
+stats_guestwrite(byte data)
+{
+	unsigned long long c;
+	int i;
+
+	if (!(data & 0x80) || (data & 0x7F) >= STATS_NCOUNTERS)
+		return;
+
+	c = counter(data & 0x7F);
+	for (i = 0; i < 8; i++, c >>= 8)
+		latch[i] = (byte)c;
+	latched = 8;
+}
+
+byte
+stats_guestread(byte sig)
+{
+	if (latched == 0)
+		return sig;
+	return latch[8 - latched--];
+}
@@ -0,0 +1,90 @@
+/*-----------------------------------------------------------------------*\
+ |  stats.h  --  counters for what the emulator has been doing           |
+ |                                                                       |
+ |  The core and the devices bump these as they go; they're plain        |
+ |  increments, so they're always on.  They can be looked at from the   |
+ |  debugger ('i'), written to a file every so often as a line of JSON  |
+ |  (Z80_STATS=file[,seconds]), and read by the z80 itself:              |
+ |                                                                       |
+ |      OUT (0EEh),80h+n    takes a copy of counter n                     |
+ |      IN  A,(0EEh)        x8 gets it, low byte first                    |
+ |                                                                       |
+ |  after which IN from 0EEh goes back to what it was (the signature).   |
+ |  The counters, by n, are STATS_* below.                               |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+#ifndef __STATS_H_
+#define __STATS_H_
+
+#include <stdio.h>
+#include "defs.h"
+
+
+/* counters the z80 can ask for */
+#define STATS_INSTRUCTIONS	0
+#define STATS_CYCLES		1
+#define STATS_KHZ		2	/* emulated speed, overall */
+#define STATS_INTERRUPTS	3
+#define STATS_POLLS		4
+#define STATS_PORTIN		5	/* all ports */
+#define STATS_PORTOUT		6
+#define STATS_MEMREAD		7	/* all regions */
+#define STATS_MEMWRITE		8
+#define STATS_CONIN		9
+#define STATS_CONOUT		10
+#define STATS_STOREIN		11
+#define STATS_STOREOUT		12
+#define STATS_NCOUNTERS		13
+
+#define STATS_REGIONS		16
+
+typedef struct emustats
+{
+	unsigned long long instructions;
+	unsigned long long interrupts;	/* NMIs and INTs taken */
+	unsigned long long polls;	/* system_poll() calls */
+	unsigned long long portin[0x100];
+	unsigned long long portout[0x100];
+	unsigned long long conin;	/* console bytes */
+	unsigned long long conout;
+	unsigned long long storein;	/* disc/storage bytes */
+	unsigned long long storeout;
+
+	/* memory, for systems whose memory is in regions (memregion.c) */
+	int nregions;
+	struct
+	{
+		long base, size;
+		unsigned long long reads, writes;
+	} region[STATS_REGIONS];
+} emustats;
+
+extern emustats z80stats;
+
+
+/* start the clock (and say which z80 the counters are for) */
+void stats_init(z80info *z80);
+
+/* memregion.c says where region 'n' is */
+void stats_region(int n, long base, long size);
+
+/* a report for people */
+void stats_print(FILE *fp);
+
+/* one line of JSON */
+void stats_json(FILE *fp);
+
+/* Z80_STATS - append a line to 'path' every 'secs' seconds, and once
+   more at the end.  returns 0 if ok */
+int stats_open(const char *path, int secs);
+void stats_tick(void);		/* between runs - writes if it's time */
+void stats_close(void);
+
+/* the z80's side, on port 0xEE - a read gives the selected counter's
+   next byte, or 'sig' if there isn't one */
+byte stats_guestread(byte sig);
+void stats_guestwrite(byte data);
+
+#endif
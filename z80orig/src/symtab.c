@@ -0,0 +1,322 @@
+/*-----------------------------------------------------------------------*\
+ |  symtab.c  --  names for z80 addresses                                |
+ |                                                                       |
+ |  An ASxxxx listing line with a label on it looks like                 |
+ |                                                                       |
+ |     0047 3E 40         [ 7]   47 SendSDCommand: ld a,#0x40            |
+ |                                                                       |
+ |  - the address, the code bytes (maybe with relocation marks and a    |
+ |  cycle count), the decimal line number and then the source, which     |
+ |  starts with the label.  A map lists the globals under a "Value       |
+ |  Global" heading, value first.  Local labels (10$:) are left out.     |
+ |                                                                       |
+ |  The table is kept sorted by address, for the lookups.                |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "symtab.h"
+
+
+typedef struct symbol
+{
+	word addr;
+	char *name;
+	int seq;		/* order loaded, to keep ties in order */
+} symbol;
+
+static symbol *syms = NULL;
+static int nsyms = 0;
+static int maxsyms = 0;
+static int sorted = TRUE;
+static int nextseq = 0;
+
+
+static int
+ishexword(const char *s, size_t len)
+{
+	size_t i;
+
+	if (len < 4 || len > 8)
+		return FALSE;
+	for (i = 0; i < len; i++)
+		if (!isxdigit((unsigned char)s[i]))
+			return FALSE;
+	return TRUE;
+}
+
+static int
+isdecimal(const char *s, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		if (!isdigit((unsigned char)s[i]))
+			return FALSE;
+	return len > 0;
+}
+
+/* how long the label at 's' is, or 0 if there isn't one */
+static size_t
+labellen(const char *s)
+{
+	size_t n = 0;
+
+	if (!isalpha((unsigned char)*s) && *s != '_' && *s != '.')
+		return 0;
+	while (isalnum((unsigned char)s[n]) || s[n] == '_' || s[n] == '.')
+		n++;
+	return n;
+}
+
+static void
+add(word addr, const char *name, size_t len)
+{
+	symbol *n;
+	int i;
+
+	/* the same label from a listing and its map */
+	for (i = 0; i < nsyms; i++)
+		if (syms[i].addr == addr && strlen(syms[i].name) == len &&
+				strncmp(syms[i].name, name, len) == 0)
+			return;
+
+	if (nsyms == maxsyms)
+	{
+		maxsyms = maxsyms ? maxsyms * 2 : 256;
+		if ((n = realloc(syms, maxsyms * sizeof *syms)) == NULL)
+			return;
+		syms = n;
+	}
+
+	if ((syms[nsyms].name = malloc(len + 1)) == NULL)
+		return;
+	memcpy(syms[nsyms].name, name, len);
+	syms[nsyms].name[len] = '\0';
+	syms[nsyms].addr = addr;
+	syms[nsyms].seq = nextseq++;
+	nsyms++;
+	sorted = FALSE;
+}
+
+/* a listing line - see the top */
+static int
+listline(const char *line)
+{
+	const char *p = line, *tok, *prev = NULL;
+	size_t len, prevlen = 0, n;
+	unsigned long addr;
+
+	while (isspace((unsigned char)*p))
+		p++;
+	for (len = 0; p[len] && !isspace((unsigned char)p[len]); len++)
+		;
+	if (!ishexword(p, len))
+		return 0;
+	addr = strtoul(p, NULL, 16);
+
+	/* the label is the first thing after the line number */
+	for (p += len; *p; p = tok + len)
+	{
+		while (isspace((unsigned char)*p))
+			p++;
+		if (*p == '\0')
+			break;
+		tok = p;
+		for (len = 0; tok[len] && !isspace((unsigned char)tok[len]); len++)
+			;
+
+		if (prev && isdecimal(prev, prevlen))
+		{
+			n = labellen(tok);
+			if (n > 0 && tok[n] == ':')
+			{
+				add((word)addr, tok, n);
+				return 1;
+			}
+		}
+
+		/* past the code bytes and cycles, and it isn't a label */
+		if (*tok == ';' || (prev && isdecimal(prev, prevlen) &&
+				!isxdigit((unsigned char)*tok) && *tok != '['))
+			break;
+
+		prev = tok;
+		prevlen = len;
+	}
+	return 0;
+}
+
+/* a line under a map's "Value  Global" heading */
+static int
+mapline(const char *line)
+{
+	const char *p = line;
+	size_t len, n;
+	unsigned long addr;
+
+	while (isspace((unsigned char)*p))
+		p++;
+	for (len = 0; p[len] && !isspace((unsigned char)p[len]); len++)
+		;
+	if (!ishexword(p, len))
+		return 0;
+	addr = strtoul(p, NULL, 16);
+
+	for (p += len; isspace((unsigned char)*p); p++)
+		;
+	if ((n = labellen(p)) == 0 || (p[n] && !isspace((unsigned char)p[n])))
+		return 0;
+
+	add((word)addr, p, n);
+	return 1;
+}
+
+int
+symtab_load(const char *path)
+{
+	char line[512];
+	FILE *fp = fopen(path, "r");
+	int ismap = FALSE, inglobals = FALSE;
+	int found = 0;
+
+	if (fp == NULL)
+		return -1;
+
+	while (fgets(line, sizeof line, fp) != NULL)
+	{
+		if (strstr(line, "Value") && strstr(line, "Global"))
+		{
+			ismap = inglobals = TRUE;
+			continue;
+		}
+		if (strncmp(line, "Area", 4) == 0 || strchr(line, '\f'))
+			inglobals = FALSE;
+
+		if (inglobals)
+			found += mapline(line);
+		else if (!ismap)
+			found += listline(line);
+	}
+
+	fclose(fp);
+	return found;
+}
+
+int
+symtab_loadlist(const char *list)
+{
+	char path[1024];
+	const char *p = list;
+	size_t n;
+	int total = 0, got;
+
+	while (*p)
+	{
+		n = strcspn(p, ":,");
+		if (n > 0 && n < sizeof path)
+		{
+			memcpy(path, p, n);
+			path[n] = '\0';
+
+			if ((got = symtab_load(path)) < 0)
+				fprintf(stderr, "Cannot read symbols from %s!\r\n", path);
+			else
+				total += got;
+		}
+		p += n;
+		if (*p)
+			p++;
+	}
+	return total;
+}
+
+void
+symtab_clear(void)
+{
+	while (nsyms > 0)
+		free(syms[--nsyms].name);
+	free(syms);
+	syms = NULL;
+	maxsyms = 0;
+	sorted = TRUE;
+}
+
+int
+symtab_count(void)
+{
+	return nsyms;
+}
+
+static int
+byaddr(const void *a, const void *b)
+{
+	const symbol *x = a, *y = b;
+
+	if (x->addr != y->addr)
+		return x->addr < y->addr ? -1 : 1;
+	return x->seq - y->seq;		/* first loaded first */
+}
+
+const char *
+symtab_lookup(word addr, word *base)
+{
+	int lo = 0, hi = nsyms - 1, mid, best = -1;
+
+	if (!sorted)
+	{
+		qsort(syms, nsyms, sizeof *syms, byaddr);
+		sorted = TRUE;
+	}
+
+	while (lo <= hi)
+	{
+		mid = (lo + hi) / 2;
+		if (syms[mid].addr <= addr)
+			best = mid, lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	if (best < 0)
+		return NULL;
+
+	/* the first of several at the same place */
+	while (best > 0 && syms[best - 1].addr == syms[best].addr)
+		best--;
+
+	if (base)
+		*base = syms[best].addr;
+	return syms[best].name;
+}
+
+void
+symtab_print(FILE *fp, word addr)
+{
+	word base;
+	const char *name = symtab_lookup(addr, &base);
+
+	if (name == NULL)
+		fprintf(fp, "0x%.4X", addr);
+	else if (base == addr)
+		fprintf(fp, "%s", name);
+	else
+		fprintf(fp, "%s+%d", name, addr - base);
+}
+
+int
+symtab_find(const char *name, word *addr)
+{
+	int i;
+
+	for (i = 0; i < nsyms; i++)
+		if (strcmp(syms[i].name, name) == 0)
+		{
+			*addr = syms[i].addr;
+			return 0;
+		}
+	return 1;
+}
@@ -0,0 +1,42 @@
+/*-----------------------------------------------------------------------*\
+ |  symtab.h  --  names for z80 addresses                                |
+ |                                                                       |
+ |  Loaded from what the ASxxxx tools in Z80asm/ leave behind: the       |
+ |  assembler's listing (asz80 -l, foo.lst) gives every label, and the   |
+ |  linker's map (aslink -m, foo.map) gives the globals.                 |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+#ifndef __SYMTAB_H_
+#define __SYMTAB_H_
+
+#include <stdio.h>
+#include "defs.h"
+
+
+/* read the labels out of a listing or map file, which is told apart by
+   its contents.  returns how many were found, or -1 if it can't be
+   read */
+int symtab_load(const char *path);
+
+/* load each file in a list separated by ':' or ',' - returns the total */
+int symtab_loadlist(const char *list);
+
+/* forget them all */
+void symtab_clear(void);
+
+/* how many there are */
+int symtab_count(void);
+
+/* the name of the nearest label at or before 'addr', or NULL if there
+   isn't one.  '*base' (if not NULL) gets the label's address */
+const char *symtab_lookup(word addr, word *base);
+
+/* print 'addr' as a name, name+offset, or 0xXXXX if nothing's before it */
+void symtab_print(FILE *fp, word addr);
+
+/* the address of 'name' - returns 0 if it's there */
+int symtab_find(const char *name, word *addr);
+
+#endif
@@ -0,0 +1,104 @@
+/*-----------------------------------------------------------------------*\
+ |  tracedump.c  --  turn a binary trace ring back into text             |
+ |                                                                       |
+ |      tracedump [-c] [-n count] tracefile                              |
+ |                                                                       |
+ |  prints the records oldest first, one line each, just as the         |
+ |  emulator's trace mode would have.  -n shows only the last 'count'    |
+ |  of them, and -c puts the cycle count at the front of each line.      |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "defs.h"
+#include "disassem.h"
+#include "tracering.h"
+
+
+/* the disassembler reads the instruction from the record itself */
+static byte
+recbyte(void *ctx, word addr)
+{
+	tracerec *rec = ctx;
+
+	return rec->op[(word)(addr - rec->pc) & 3];
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: tracedump [-c] [-n count] tracefile\n");
+	exit(2);
+}
+
+int
+main(int argc, char *argv[])
+{
+	byte hdr[TRACE_HDRSIZE];
+	byte *recs;
+	unsigned long long count, first, n;
+	long size, want = -1;
+	int cycles = FALSE;
+	int i;
+	FILE *fp;
+	tracerec rec;
+	disinstr dis;
+	char text[40];
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++)
+	{
+		if (strcmp(argv[i], "-c") == 0)
+			cycles = TRUE;
+		else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+			want = atol(argv[++i]);
+		else
+			usage();
+	}
+	if (i != argc - 1)
+		usage();
+
+	if ((fp = fopen(argv[i], "rb")) == NULL)
+	{
+		perror(argv[i]);
+		return 1;
+	}
+
+	if (fread(hdr, 1, sizeof hdr, fp) != sizeof hdr ||
+			tracering_header(hdr, &size, &count) != 0)
+	{
+		fprintf(stderr, "%s: not a trace ring\n", argv[i]);
+		return 1;
+	}
+
+	if ((recs = malloc((size_t)size * TRACE_RECSIZE)) == NULL ||
+			fread(recs, TRACE_RECSIZE, size, fp) != (size_t)size)
+	{
+		fprintf(stderr, "%s: trace ring is cut short\n", argv[i]);
+		return 1;
+	}
+	fclose(fp);
+
+	n = count < (unsigned long long)size ? count : (unsigned long long)size;
+	if (want >= 0 && (unsigned long long)want < n)
+		n = want;
+	first = count - n;
+
+	for (; first < count; first++)
+	{
+		tracering_unpack(recs, (long)(first % size), &rec);
+		disassemble(recbyte, &rec, rec.pc, &dis);
+		disassem_text(&dis, text, sizeof text);
+
+		if (cycles)
+			printf("%12llu ", rec.cycles);
+		printf("a%.2X f%.2X bc%.4X de%.4X hl%.4X ",
+				rec.af >> 8, rec.af & 0xFF, rec.bc, rec.de, rec.hl);
+		printf("ix%.4X iy%.4X sp%.4X pc%.4X:%.2X  %s\r\n",
+				rec.ix, rec.iy, rec.sp, rec.pc, rec.op[0], text);
+	}
+
+	return 0;
+}
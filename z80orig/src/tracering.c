@@ -0,0 +1,222 @@
+/*-----------------------------------------------------------------------*\
+ |  tracering.c  --  binary execution trace, kept in a ring              |
+ |                                                                       |
+ |  The ring is the header followed by the records, the same in memory   |
+ |  as in the file, so a file ring is just the block mmap'd and a        |
+ |  memory ring is saved with one write.                                 |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+#define _DEFAULT_SOURCE		/* for ftruncate and mmap under -std=c99 */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tracering.h"
+
+#ifdef UNIX
+#	define TRACE_MMAP
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <sys/mman.h>
+#endif
+
+
+struct tracering
+{
+	byte *base;		/* header, then records */
+	size_t len;
+	long size;		/* records */
+	long slot;		/* where the next one goes */
+	unsigned long long count;
+	int mapped;		/* base is mmap'd from a file */
+};
+
+
+#define PUT16(p, v)	((p)[0] = (v) & 0xFF, (p)[1] = ((v) >> 8) & 0xFF)
+#define GET16(p)	((word)((p)[0] | ((p)[1] << 8)))
+
+static void
+put64(byte *p, unsigned long long v)
+{
+	int i;
+
+	for (i = 0; i < 8; i++, v >>= 8)
+		p[i] = v & 0xFF;
+}
+
+static unsigned long long
+get64(const byte *p)
+{
+	unsigned long long v = 0;
+	int i;
+
+	for (i = 7; i >= 0; i--)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+
+/* header: magic, version (2), record size (2), size (8), count (8) */
+static void
+puthdr(tracering *tr)
+{
+	memcpy(tr->base, TRACE_MAGIC, 8);
+	PUT16(tr->base + 8, TRACE_VERSION);
+	PUT16(tr->base + 10, TRACE_RECSIZE);
+	put64(tr->base + 12, tr->size);
+	put64(tr->base + 20, tr->count);
+}
+
+
+tracering *
+tracering_open(const char *path, long size)
+{
+	tracering *tr = calloc(1, sizeof *tr);
+
+	if (tr == NULL)
+		return NULL;
+
+	tr->size = size > 0 ? size : TRACE_DEFSIZE;
+	tr->len = TRACE_HDRSIZE + (size_t)tr->size * TRACE_RECSIZE;
+
+	if (path != NULL)
+	{
+#ifdef TRACE_MMAP
+		int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+		void *map = MAP_FAILED;
+
+		if (fd >= 0 && ftruncate(fd, tr->len) == 0)
+			map = mmap(NULL, tr->len, PROT_READ | PROT_WRITE,
+					MAP_SHARED, fd, 0);
+		if (fd >= 0)
+			close(fd);
+
+		if (map == MAP_FAILED)
+		{
+			fprintf(stderr, "Cannot map trace file '%s'!\r\n", path);
+			free(tr);
+			return NULL;
+		}
+		tr->base = map;
+		tr->mapped = TRUE;
+#else
+		fprintf(stderr, "No trace files here - use memory and save it\r\n");
+		free(tr);
+		return NULL;
+#endif
+	}
+	else if ((tr->base = calloc(1, tr->len)) == NULL)
+	{
+		fprintf(stderr, "Cannot allocate %ld trace records!\r\n", tr->size);
+		free(tr);
+		return NULL;
+	}
+
+	puthdr(tr);
+	return tr;
+}
+
+void
+tracering_close(tracering *tr)
+{
+	if (tr == NULL)
+		return;
+
+#ifdef TRACE_MMAP
+	if (tr->mapped)
+	{
+		puthdr(tr);
+		munmap(tr->base, tr->len);
+	}
+	else
+#endif
+		free(tr->base);
+	free(tr);
+}
+
+void
+tracering_record(tracering *tr, z80info *z80)
+{
+	byte *p = tr->base + TRACE_HDRSIZE + (size_t)tr->slot * TRACE_RECSIZE;
+
+	if (++tr->slot == tr->size)
+		tr->slot = 0;
+
+	put64(p, z80->cycles);
+	PUT16(p + 8, PC);
+	PUT16(p + 10, AF);
+	PUT16(p + 12, BC);
+	PUT16(p + 14, DE);
+	PUT16(p + 16, HL);
+	PUT16(p + 18, IX);
+	PUT16(p + 20, IY);
+	PUT16(p + 22, SP);
+
+	/* peeked, so the ROM is seen and nothing is counted */
+	p[24] = Z80MEMPEEK(PC);
+	p[25] = Z80MEMPEEK(PC + 1);
+	p[26] = Z80MEMPEEK(PC + 2);
+	p[27] = Z80MEMPEEK(PC + 3);
+
+	p[28] = I;
+	p[29] = R;
+	p[30] = (IFF ? 1 : 0) | (IFF2 ? 2 : 0) | ((IMODE & 3) << 2);
+	p[31] = 0;
+
+	/* the count in the header is what makes the record real */
+	put64(tr->base + 20, ++tr->count);
+}
+
+int
+tracering_save(tracering *tr, const char *path)
+{
+	FILE *fp = fopen(path, "wb");
+	int bad;
+
+	if (fp == NULL)
+		return 1;
+
+	puthdr(tr);
+	bad = fwrite(tr->base, 1, tr->len, fp) != tr->len;
+	return (fclose(fp) != 0) || bad;
+}
+
+int
+tracering_inmemory(tracering *tr)
+{
+	return !tr->mapped;
+}
+
+int
+tracering_header(const byte *hdr, long *size, unsigned long long *count)
+{
+	if (memcmp(hdr, TRACE_MAGIC, 8) != 0 || GET16(hdr + 8) != TRACE_VERSION ||
+			GET16(hdr + 10) != TRACE_RECSIZE)
+		return 1;
+
+	*size = (long)get64(hdr + 12);
+	*count = get64(hdr + 20);
+	return *size <= 0;
+}
+
+void
+tracering_unpack(const byte *recs, long n, tracerec *rec)
+{
+	const byte *p = recs + (size_t)n * TRACE_RECSIZE;
+
+	rec->cycles = get64(p);
+	rec->pc = GET16(p + 8);
+	rec->af = GET16(p + 10);
+	rec->bc = GET16(p + 12);
+	rec->de = GET16(p + 14);
+	rec->hl = GET16(p + 16);
+	rec->ix = GET16(p + 18);
+	rec->iy = GET16(p + 20);
+	rec->sp = GET16(p + 22);
+	memcpy(rec->op, p + 24, 4);
+	rec->i = p[28];
+	rec->r = p[29];
+	rec->iff = p[30];
+}
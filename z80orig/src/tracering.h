@@ -0,0 +1,67 @@
+/*-----------------------------------------------------------------------*\
+ |  tracering.h  --  binary execution trace, kept in a ring              |
+ |                                                                       |
+ |  One fixed size record per instruction (the registers, the bytes at   |
+ |  PC and the cycle count, taken just before it runs) instead of the   |
+ |  text dumptrace() prints.  The ring lives in memory or in an mmap'd   |
+ |  file; a file is still good after the emulator dies.  "tracedump"     |
+ |  turns a saved ring back into dumptrace()'s text.                     |
+ |                                                                       |
+ |  2026-10-19                                                           |
+\*-----------------------------------------------------------------------*/
+
+#ifndef __TRACERING_H_
+#define __TRACERING_H_
+
+#include "defs.h"
+
+
+/* the file layout: a header, then 'size' records, all little-endian.
+   'count' records have been written in all; the oldest still there is
+   number count - size (if count > size) at slot (count % size). */
+#define TRACE_MAGIC	"Z80TRING"
+#define TRACE_VERSION	1
+#define TRACE_HDRSIZE	32
+#define TRACE_RECSIZE	32
+
+#define TRACE_DEFSIZE	(1L << 20)	/* records, when not asked for */
+
+/* one record, unpacked */
+typedef struct tracerec
+{
+	unsigned long long cycles;
+	word pc, af, bc, de, hl, ix, iy, sp;
+	byte op[4];		/* the instruction's bytes */
+	byte i, r;
+	byte iff;		/* IFF in bit 0, IFF2 in 1, IM in 2-3 */
+} tracerec;
+
+typedef struct tracering tracering;
+
+
+/* start a ring of 'size' records (0 for the default) - in the file
+   'path', or in memory if that's NULL.  returns NULL on failure */
+tracering *tracering_open(const char *path, long size);
+
+/* stop - a file is left holding what was written */
+void tracering_close(tracering *tr);
+
+/* take down the state 'z80' is in now */
+void tracering_record(tracering *tr, z80info *z80);
+
+/* write the ring out to 'path', as a file ring would be.  return 0 if
+   ok */
+int tracering_save(tracering *tr, const char *path);
+
+/* TRUE if the ring is in memory and would be lost at exit */
+int tracering_inmemory(tracering *tr);
+
+/* check a header read back from a file, and get the ring's size and
+   count out of it.  return 0 if it's one of ours */
+int tracering_header(const byte *hdr, long *size, unsigned long long *count);
+
+/* get record 'n' (counting from 0, for a ring of 'size') out of the
+   raw data following the header */
+void tracering_unpack(const byte *recs, long n, tracerec *rec);
+
+#endif
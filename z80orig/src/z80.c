@@ -9,6 +9,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include "defs.h"
+#include "tracering.h"
+#include "profile.h"
+#include "callgraph.h"
+#include "stats.h"
+#include "ophist.h"
+#include "coverage.h"
 
 
 /* All the following macros assume access to a parameter named "z80" */
@@ -62,6 +68,37 @@ static boolean parity_inited = FALSE;
 */
 
 
+/* tell the call-graph profiler (if it's on) about calls and returns */
+
+#define called(len) \
+{\
+	if (z80->callgraph)\
+		callgraph_call(z80->callgraph, z80, len);\
+}
+
+#define returned() \
+{\
+	if (z80->callgraph)\
+		callgraph_ret(z80->callgraph, z80);\
+}
+
+/* mark an instruction's address as run, if coverage is on */
+
+#define fetched() \
+{\
+	if (z80->coverage)\
+		COVER_SET(z80->coverage->exec, PC);\
+}
+
+/* count the opcode, if this is the build that does (see ophist.h) */
+#ifdef OPCODE_HISTOGRAM
+#define histogram(space, op)	ophist_count(space, op)
+#else
+#define histogram(space, op)
+#endif
+
+
+
 /* macros for swapping various popular entities */
 
 #define swapw(reg1,reg2) (tt = reg1, reg1 = reg2, reg2 = tt)
@@ -176,12 +213,20 @@ z80_emulator(z80info *z80, int count)
 infloop:
 #ifdef SYSTEM_POLL
 	system_poll( z80 );
+	z80stats.polls++;
 #endif
 
 	/* only execute "count" instructions at one whack */
 	if (count-- <= 0)
 		return TRUE;
 
+	z80stats.instructions++;
+
+	if (z80->profile)
+		profile_sample(z80->profile, z80);
+	if (z80->callgraph)
+		callgraph_step(z80->callgraph, z80);
+
 	/* see if the z80 is to be interrupted for any reason */
 	if (EVENT)
 	{
@@ -223,6 +268,9 @@ infloop:
 			SETMEM(SP, PC & MASK8);
 			PC = 0x66;
 			IFF = 0;
+			z80->cycles += 11;
+			called(0);
+			z80stats.interrupts++;
 			NMI = FALSE;
 			if (INTR)		/* catch this the next time */
 				EVENT = TRUE;
@@ -250,6 +298,8 @@ infloop:
 					--SP;
 					SETMEM(SP, PC & MASK8);
 					PC = 0x38;
+					z80->cycles += 13;
+					called(0);
 					break;
 				case 2:	/* most powerful/flexible mode */
 //HACK printf( " INT IM2\n" );
@@ -261,10 +311,13 @@ infloop:
 					PC = MEM(tt);
 					tt++;
 					PC |= MEM(tt) << 8;
+					z80->cycles += 19;
+					called(0);
 					break;
 			}
 			IFF = IFF2 = 0;
 			INTR = 0;
+			z80stats.interrupts++;
 		}
 		else if (INTR) {
 			/* try again the next time around */
@@ -274,18 +327,28 @@ infloop:
 		/* get the next opcode to execute if we do not have it yet */
 		if (i)
 		{
-			t = MEM(PC);
+			/* after the interrupt, so it's the handler that's recorded */
+			if (z80->tracering)
+				tracering_record(z80->tracering, z80);
+			fetched();
+			t = FETCH(PC);
 			PC++;
 		}
 	}
 	else
 	{
 		/* just get the next opcode */
-		t = MEM(PC);
+		if (z80->tracering)
+			tracering_record(z80->tracering, z80);
+		fetched();
+		t = FETCH(PC);
 		PC++;
 	}
 
 
+	z80->cycles += z80_cycles_main[t];
+	histogram(OPS_BASE, t);
+
 	/* main "switch" for initial opcode */
 	switch (t)
 	{
@@ -896,14 +959,20 @@ contsw:
 	case 0x20:					/* jr nz,e */
 	case 0x30:					/* jr nc,e */
 		if (!(F & flagmask[(t >> 4) & MASK1]))
+		{
 			PC += ((signed char)MEM(PC)) + 1;
+			z80->cycles += 5;
+		}
 		else
 			PC += 1;
 		break;
 	case 0x28:					/* jr z,e */
 	case 0x38:					/* jr c,e */
 		if (F & flagmask[(t >> 4) & MASK1])
+		{
 			PC += ((signed char)MEM(PC)) + 1;
+			z80->cycles += 5;
+		}
 		else
 			PC += 1;
 		break;
@@ -913,7 +982,10 @@ contsw:
 		break;
 	case 0x10:					/* djnz e */
 		if (--B)
+		{
 			PC += ((signed char)MEM(PC)) + 1;
+			z80->cycles += 5;
+		}
 		else
 			PC += 1;
 		break;
@@ -931,6 +1003,7 @@ contsw:
 		--SP;
 		SETMEM(SP, PC & MASK8);
 		PC = tt;
+		called(3);
 		break;
 	case 0xC4:					/* call nz,nn */
 	case 0xD4:					/* call nc,nn */
@@ -949,6 +1022,8 @@ contsw:
 			--SP;
 			SETMEM(SP, PC & MASK8);
 			PC = tt;
+			z80->cycles += 7;
+			called(3);
 		}
 		break;
 	case 0xCC:					/* call z,nn */
@@ -966,6 +1041,8 @@ contsw:
 			--SP;
 			SETMEM(SP, PC & MASK8);
 			PC = tt;
+			z80->cycles += 7;
+			called(3);
 		}
 		else
 			PC += 2;
@@ -976,6 +1053,7 @@ contsw:
 		SP++;
 		PC |= MEM(SP) << 8;
 		SP++;
+		returned();
 		break;
 	case 0xC0:					/* ret nz */
 	case 0xD0:					/* ret nc */
@@ -987,6 +1065,8 @@ contsw:
 			SP++;
 			PC |= MEM(SP) << 8;
 			SP++;
+			z80->cycles += 6;
+			returned();
 		}
 		break;
 	case 0xC8:					/* ret z */
@@ -999,6 +1079,8 @@ contsw:
 			SP++;
 			PC |= MEM(SP) << 8;
 			SP++;
+			z80->cycles += 6;
+			returned();
 		}
 		break;
 
@@ -1015,6 +1097,7 @@ contsw:
 		--SP;
 		SETMEM(SP, PC & MASK8);
 		PC = t & 0x38;
+		called(1);
 		break;
 
 
@@ -1046,6 +1129,8 @@ contsw:
 bitinstr:
 	t = MEM(PC);
 	PC++;
+	z80->cycles += z80_cycles_cb[t];
+	histogram(OPS_CB, t);
 
 	switch (t)
 	{
@@ -1415,6 +1500,8 @@ ireginstr:
 	rr = REGIXY[(t >> 5) & MASK1];
 	t = MEM(PC);
 	PC++;
+	z80->cycles += z80_cycles_xy[t];
+	histogram(rr == &IX ? OPS_DD : OPS_FD, t);
 
 	/* note: in comments below, "ir" is either "ix" or "iy" */
 	switch (t)
@@ -1605,6 +1692,8 @@ ireginstr:
 extinstr: 
 	t = MEM(PC);
 	PC++;
+	z80->cycles += z80_cycles_ed[t];
+	histogram(OPS_ED, t);
 	switch (t)
 	{
 	/* 8-bit load group */
@@ -1680,7 +1769,10 @@ extinstr:
 		setflag(OVERFLOW, --BC);
 
 		if ((t & BIT4) && BC)
+		{
 			PC -= 2;
+			z80->cycles += 5;
+		}
 
 		flagoff(HALF);
 		flagoff(NEGATIVE);
@@ -1704,7 +1796,10 @@ extinstr:
 		setflag(OVERFLOW, --BC);
 		flagon(NEGATIVE);
 		if ((t & BIT4) && t2 && BC)
+		{
 			PC -= 2;
+			z80->cycles += 5;
+		}
 		break;
 
 
@@ -1788,12 +1883,14 @@ extinstr:
 		SP++;
 		PC |= MEM(SP) << 8;
 		SP++;
+		returned();
 		break;
 	case 0x4D:					/* reti */
 		PC = MEM(SP);
 		SP++;
 		PC |= MEM(SP) << 8;
 		SP++;
+		returned();
 		break;
 
 
@@ -1846,7 +1943,10 @@ extinstr:
 		flagon(NEGATIVE);
 
 		if ((t & BIT4) && B)
+		{
 			PC -= 2;
+			z80->cycles += 5;
+		}
 
 		break;
 
@@ -1865,7 +1965,10 @@ extinstr:
 		flagon(NEGATIVE);
 
 		if ((t & BIT4) && B)
+		{
 			PC -= 2;
+			z80->cycles += 5;
+		}
 
 		break;
 
@@ -1883,7 +1986,11 @@ iregbitinstr:
 
 	/* note: we have to look ahead 1 byte for the opcode  -- the PC is
 	   bumped later after the "switch" */
-	switch (t = MEM((PC + 1) & 0xFFFF))
+	t = MEM((PC + 1) & 0xFFFF);
+	z80->cycles += z80_cycles_xycb[t];
+	histogram(rr == &IX ? OPS_DDCB : OPS_FDCB, t);
+
+	switch (t)
 	{
 
 	/* rotate & shift group */
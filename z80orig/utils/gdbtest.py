@@ -0,0 +1,210 @@
+#!/usr/bin/env python3
+#
+# gdbtest.py  --  a scripted check of the emulator's gdb stub
+#
+#   Starts the emulator on a pty with Z80_GDB_PORT set, types "g" at
+#   its EMU: prompt so the z80 is running (the stub is looked after
+#   from the run loop), then talks GDB's remote serial protocol to it:
+#   qSupported, ?, g, M/m, P, Z0/z0 with c, s, ^C and D.
+#
+#   The little program it drops at 0100 is
+#	0100  3E 05	ld a,5
+#	0102  3E 06	ld a,6
+#	0104  C3 00 01	jp 0100
+#   and an exec breakpoint on the 05 operand byte must never stop it.
+#
+#	python3 utils/gdbtest.py [-p port] [emulator [args...]]
+#
+#   (the emulator defaults to bin/z80)  Exits 0 if it all checks out.
+#
+#   2026-10-19
+
+import os
+import pty
+import select
+import signal
+import socket
+import sys
+import time
+
+
+PROGRAM = bytes([0x3E, 0x05, 0x3E, 0x06, 0xC3, 0x00, 0x01])
+ORIGIN = 0x0100
+REG_PC = 5		# af bc de hl sp pc ix iy ...
+NREGS = 13
+
+failures = 0
+
+
+def check(what, ok, detail=""):
+    global failures
+    print("%-40s %s%s" % (what, "ok" if ok else "FAILED",
+                          "" if ok or not detail else "  (" + detail + ")"))
+    if not ok:
+        failures += 1
+
+
+class Remote:
+    """just enough of a gdb remote protocol client"""
+
+    def __init__(self, port):
+        self.sock = socket.create_connection(("127.0.0.1", port), timeout=5)
+        self.buf = b""
+
+    def byte(self):
+        if not self.buf:
+            self.buf = self.sock.recv(4096)
+            if not self.buf:
+                raise EOFError("the stub hung up")
+        c, self.buf = self.buf[:1], self.buf[1:]
+        return c
+
+    def send(self, data):
+        body = data.encode()
+        self.sock.sendall(b"$%s#%02x" % (body, sum(body) & 0xFF))
+        c = self.byte()
+        if c != b"+":
+            raise IOError("no ack for %r, got %r" % (data, c))
+
+    def reply(self):
+        while self.byte() != b"$":
+            pass
+        body = b""
+        while True:
+            c = self.byte()
+            if c == b"#":
+                break
+            body += c
+        want = int(self.byte() + self.byte(), 16)
+        if want != sum(body) & 0xFF:
+            raise IOError("bad checksum on %r" % body)
+        self.sock.sendall(b"+")
+        return body.decode()
+
+    def ask(self, data):
+        self.send(data)
+        return self.reply()
+
+    def pc(self):
+        regs = self.ask("g")
+        return int(regs[REG_PC * 4 + 2:REG_PC * 4 + 4] +
+                   regs[REG_PC * 4:REG_PC * 4 + 2], 16)
+
+
+def le16(v):
+    return "%02x%02x" % (v & 0xFF, v >> 8)
+
+
+def connect(port, tries=50):
+    for _ in range(tries):
+        try:
+            return Remote(port)
+        except OSError:
+            time.sleep(0.1)
+    raise OSError("nothing listening on %d" % port)
+
+
+def drain(fd, secs):
+    """keep the emulator's console from filling up"""
+    end = time.time() + secs
+    while time.time() < end:
+        r, _, _ = select.select([fd], [], [], 0.05)
+        if r:
+            try:
+                os.read(fd, 4096)
+            except OSError:
+                return
+
+
+def main(argv):
+    port = 12000 + os.getpid() % 1000
+    if len(argv) > 1 and argv[1] == "-p":
+        port = int(argv[2])
+        argv = argv[2:]
+    emulator = argv[1:] or ["bin/z80"]
+
+    # it wants a controlling terminal (/dev/tty), so fork onto a pty
+    pid, master = pty.fork()
+    if pid == 0:
+        os.environ["Z80_GDB_PORT"] = str(port)
+        try:
+            os.execvp(emulator[0], emulator)
+        finally:
+            os._exit(127)
+
+    try:
+        drain(master, 0.5)
+        os.write(master, b"g\r")
+        drain(master, 0.2)
+        gdb = connect(port)
+
+        # attaching stops it
+        r = gdb.ask("qSupported:swbreak+;hwbreak+")
+        check("qSupported", "PacketSize=" in r and "swbreak+" in r, r)
+        r = gdb.ask("?")
+        check("? (stopped on attach)", r[:1] in ("S", "T"), r)
+        r = gdb.ask("g")
+        check("g (%d registers)" % NREGS, len(r) == NREGS * 4, r)
+
+        # the program, and PC at it
+        hexprog = PROGRAM.hex()
+        r = gdb.ask("M%x,%x:%s" % (ORIGIN, len(PROGRAM), hexprog))
+        check("M (write the program)", r == "OK", r)
+        r = gdb.ask("m%x,%x" % (ORIGIN, len(PROGRAM)))
+        check("m (read it back)", r == hexprog, r)
+        r = gdb.ask("P%x=%s" % (REG_PC, le16(ORIGIN)))
+        check("P (PC = %04X)" % ORIGIN, r == "OK" and gdb.pc() == ORIGIN, r)
+
+        # one breakpoint on an operand byte, one on an opcode
+        r = gdb.ask("Z0,%x,1" % (ORIGIN + 1))
+        check("Z0 on the ld operand", r == "OK", r)
+        r = gdb.ask("Z0,%x,1" % (ORIGIN + 4))
+        check("Z0 on the jp", r == "OK", r)
+        for n in range(2):
+            r = gdb.ask("c")
+            check("c -> stops (%d)" % (n + 1), r.startswith("T05"), r)
+            pc = gdb.pc()
+            check("  at the jp, not the operand", pc == ORIGIN + 4,
+                  "pc %04X" % pc)
+        for a in (ORIGIN + 1, ORIGIN + 4):
+            r = gdb.ask("z0,%x,1" % a)
+            check("z0 %04X" % a, r == "OK", r)
+
+        # single steps
+        r = gdb.ask("s")
+        check("s (the jp)", r.startswith("S05") or r.startswith("T05"), r)
+        pc = gdb.pc()
+        check("  to %04X" % ORIGIN, pc == ORIGIN, "pc %04X" % pc)
+        gdb.ask("s")
+        pc = gdb.pc()
+        check("s (ld a,5) to %04X" % (ORIGIN + 2), pc == ORIGIN + 2,
+              "pc %04X" % pc)
+
+        # let it run, then interrupt it
+        gdb.send("c")
+        drain(master, 0.3)
+        gdb.sock.sendall(b"\x03")
+        r = gdb.reply()
+        check("^C", r.startswith("T02") or r.startswith("S02"), r)
+        pc = gdb.pc()
+        check("  in the loop", ORIGIN <= pc < ORIGIN + len(PROGRAM),
+              "pc %04X" % pc)
+
+        r = gdb.ask("D")
+        check("D", r == "OK", r)
+        gdb.sock.close()
+
+    except (OSError, EOFError) as e:
+        check("talking to the stub", False, str(e))
+
+    finally:
+        os.kill(pid, signal.SIGKILL)
+        os.waitpid(pid, 0)
+        os.close(master)
+
+    print("%d failed" % failures if failures else "all ok")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))